@@ -45,13 +45,24 @@ public:
 			SELECT_SGNODE, SELECT_MESH, SELECT_POLY,
 		};
 
+		enum TransparencyMode {
+			TRANSPARENCY_SORTED, TRANSPARENCY_WEIGHTED,
+		};
+
 		bool showMeshBBox;
 		bool showPolyFrame;
 		bool showSGObjectBBox;
+		bool sortBlendedTriangles;
+		bool frustumCull;
+		bool animationPaused;
+		bool bakedAnimation;
 		TransformState transformState;
 		CameraModel cameraModel;
 		SelectState selectState;
+		TransparencyMode transparencyMode;
 		int selectIndex;
+		int animationIndex;
+		int instanceCount;
 
 		Vars () {
 			resetDefault();
@@ -61,10 +72,17 @@ public:
 			showMeshBBox = false;
 			showPolyFrame = false;
 			showSGObjectBBox = false;
+			sortBlendedTriangles = false;
+			frustumCull = true;
+			animationPaused = false;
+			bakedAnimation = true;
 			transformState = ROTATE;
 			cameraModel = MANIPULATE_WORLD;
 			selectState = SELECT_SGNODE;
+			transparencyMode = TRANSPARENCY_SORTED;
 			selectIndex = -1;
+			animationIndex = -1;
+			instanceCount = 1;
 		}
 	};
 
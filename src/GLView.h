@@ -30,7 +30,8 @@
 #include <OpenGL/glu.h>
 #include "AppState.h"
 #include "PMModelGL.h"
-//#include "PMWorldGL.h"
+#include "PMModelLoader.h"
+#include "PMWorldGL.h"
 #include "system/Input.h"
 #include "vecmath/MatrixG4.h"
 #include "renderer/Scenegraph.h"
@@ -40,18 +41,28 @@ protected:
 
 	std::string modelFile;
 	PMModelGL pmm;
+	PMModelLoader loader;
+	bool loaded;
+
+	// Set to view a map rather than a model
+	std::string worldFile;
+	PMWorldGL pmw;
 
 	unsigned _width;
 	unsigned _height;
 
+	sf::Clock _clock;
+
 public:
 
-	GLView () {
+	GLView ()
+		: loaded(false) {
 		_width = 800;
 		_height = 600;
 	}
 
-	GLView (int width, int height) {
+	GLView (int width, int height)
+		: loaded(false) {
 		_width = width;
 		_height = height;
 	}
@@ -62,26 +73,48 @@ public:
 		modelFile = str;
 	}
 
-	void init () {
-		glClearDepth(1.f);
-		glClearColor(.2f, .2f, .2f, 0.f);
+	/*
+	 * View a map instead of a model, streaming it in by region if stream
+	 * is set.
+	 */
 
-		glEnable(GL_DEPTH_TEST);
-		glDepthMask(GL_TRUE);
+	void setWorldFile (const std::string& str, bool stream) {
+		worldFile = str;
+		pmw.streaming = stream;
+	}
 
-		glDisable(GL_CULL_FACE);
-		glDisable(GL_ALPHA_TEST);
-		glDisable(GL_BLEND);
+	void init () {
+		gfx::GLState& gl = gfx::GLState::getState();
 
-		if (!pmm.LoadFile(modelFile)) {
-			std::cout << "Error encountered: " << pmm.errorMessage << std::endl;
-			exit(1);
-		}
+		glClearDepth(1.f);
+		gl.clearColor(.2f, .2f, .2f, 0.f);
 
-		pmm.Init();
+		gl.enable(GL_DEPTH_TEST);
+		gl.depthMask(true);
+
+		gl.disable(GL_CULL_FACE);
+		gl.disable(GL_ALPHA_TEST);
+		gl.disable(GL_BLEND);
 
 		AppState::getState();
 		resize(_width, _height);
+
+		// Maps load up front; their meshes are decoded as they are read,
+		// or by the streamer as they come in range
+		if (!worldFile.empty()) {
+			if (!pmw.LoadFile(worldFile)) {
+				std::cout << "Error encountered: " << pmw.errorMessage << std::endl;
+				exit(1);
+			}
+
+			pmw.Init();
+			loaded = true;
+			return;
+		}
+
+		// The model is loaded in the background; display() shows progress
+		// until it is ready
+		loader.start(&pmm, modelFile);
 	}
 
 	void resize (int width, int height) {
@@ -96,6 +129,17 @@ public:
 	}
 
 	void display () {
+		if (!loaded) {
+			loaded = loader.update();
+			if (!loaded) {
+				displayLoading();
+				return;
+			}
+
+			// Animation starts from the first drawn frame, not from launch
+			_clock.restart();
+		}
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		glMatrixMode(GL_MODELVIEW);
@@ -106,26 +150,102 @@ public:
 		AppState& state = AppState::getState();
 		state.camera.viewTransform();
 
-		// Draw Model
+		// Animate and draw Model or map
 
-		pmm.Draw();
+		std::stringstream str("");
+		str << "Paper Mario Model Viewer | ";
+		str << "Camera: ";
+		str << cameraStateString();
+
+		if (!worldFile.empty()) {
+			pmw.Update(_clock.restart().asSeconds());
+			pmw.Draw();
+
+			str << " | Map: ";
+			str << pmw.GetInfoString();
+		}
+		else {
+			pmm.Update(_clock.restart().asSeconds());
+			pmm.Draw();
+
+			str << " | Model: ";
+			str << pmm.GetInfoString();
+		}
 
 		// Draw state informational text
 
 		WindowController& wc = WindowController::getController();
+		
+		wc.window.setTitle(str.str());
+	}
+
+	/*
+	 * Draw a progress bar for the model load, and close the window if it
+	 * failed or was canceled.
+	 */
+
+	void displayLoading () {
+		WindowController& wc = WindowController::getController();
+
+		PMModelLoader::Stage stage = loader.getStage();
+		if (stage == PMModelLoader::FAILED) {
+			std::cout << "Error encountered: " << loader.getError() << std::endl;
+			exit(1);
+		}
+		if (stage == PMModelLoader::CANCELED) {
+			std::cout << "Loading canceled" << std::endl;
+			wc.window.close();
+			return;
+		}
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		glMatrixMode(GL_PROJECTION);
+		glPushMatrix();
+		glLoadIdentity();
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+		gfx::GLState::getState().disable(GL_DEPTH_TEST);
+
+		float right = -.5f + loader.getProgress();
+
+		glColor3f(.8f, .8f, .8f);
+		glBegin(GL_QUADS);
+			glVertex2f(-.5f, -.03f);
+			glVertex2f(right, -.03f);
+			glVertex2f(right, .03f);
+			glVertex2f(-.5f, .03f);
+		glEnd();
+		glBegin(GL_LINE_LOOP);
+			glVertex2f(-.5f, -.03f);
+			glVertex2f(.5f, -.03f);
+			glVertex2f(.5f, .03f);
+			glVertex2f(-.5f, .03f);
+		glEnd();
+		glColor3f(1.f, 1.f, 1.f);
+
+		gfx::GLState::getState().enable(GL_DEPTH_TEST);
+		glMatrixMode(GL_PROJECTION);
+		glPopMatrix();
+		glMatrixMode(GL_MODELVIEW);
 
 		std::stringstream str("");
-		str << "Paper Mario Model Viewer | ";
-		str << "Camera: ";
-		str << cameraStateString();
-		str << " | Model: ";
-		str << pmm.GetInfoString();
-		
+		str << "Paper Mario Model Viewer | Loading: " << PMModelLoader::stageName(stage)
+				<< " (" << int(loader.getProgress() * 100.f) << "%) | Esc to cancel";
+
 		wc.window.setTitle(str.str());
 	}
 
 	void eventLoop () {
 		AppState& state = AppState::getState();
+
+		// The model belongs to the loader until it is ready
+		if (!loaded) {
+			if (state.ic.input.keyPressed(sf::Keyboard::Escape)) {
+				loader.cancel();
+			}
+			return;
+		}
 		// Switch modelview transformation
 		if (state.ic.input.keyPressed(sf::Keyboard::T)) {
 			state.vars.transformState = AppState::Vars::TRANSLATE;
@@ -192,6 +312,38 @@ public:
 		if (state.ic.input.keyPressed(sf::Keyboard::Num1)) {
 			state.vars.showSGObjectBBox = (state.vars.showSGObjectBBox) ? 0 : 1;
 		}
+		if (state.ic.input.keyPressed(sf::Keyboard::Num2)) {
+			state.vars.sortBlendedTriangles = (state.vars.sortBlendedTriangles) ? 0 : 1;
+		}
+		if (state.ic.input.keyPressed(sf::Keyboard::Num3)) {
+			if (state.vars.transparencyMode == AppState::Vars::TRANSPARENCY_SORTED) {
+				state.vars.transparencyMode = AppState::Vars::TRANSPARENCY_WEIGHTED;
+			}
+			else {
+				state.vars.transparencyMode = AppState::Vars::TRANSPARENCY_SORTED;
+			}
+		}
+		if (state.ic.input.keyPressed(sf::Keyboard::Num4)) {
+			state.vars.frustumCull = (state.vars.frustumCull) ? 0 : 1;
+		}
+
+		// Animation
+		if (state.ic.input.keyPressed(sf::Keyboard::A)) {
+			state.vars.animationIndex++;
+			if (state.vars.animationIndex >= (int)pmm.animations.size()) {
+				state.vars.animationIndex = -1;
+			}
+		}
+		if (state.ic.input.keyPressed(sf::Keyboard::Space)) {
+			state.vars.animationPaused = !state.vars.animationPaused;
+		}
+		if (state.ic.input.keyPressed(sf::Keyboard::B)) {
+			state.vars.bakedAnimation = !state.vars.bakedAnimation;
+		}
+		if (state.ic.input.keyPressed(sf::Keyboard::I)) {
+			// 1, 16, 256, 1024, then back to 1
+			state.vars.instanceCount = (state.vars.instanceCount >= 1024) ? 1 : std::min(state.vars.instanceCount * 16, 1024);
+		}
 
 		// Display Restrictions
 		if (state.ic.input.keyPressed(sf::Keyboard::D)) {
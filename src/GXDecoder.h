@@ -0,0 +1,354 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GXDECODER_H_
+#define GXDECODER_H_
+
+#include <vector>
+#include "system/ByteView.h"
+#include "common.h"
+
+/**
+ * Decodes GX display lists into indexed vertex streams.
+ *
+ * A display list is a run of primitives, each an opcode byte (primitive
+ * type in the high five bits, vertex format in the low three), a 16-bit
+ * vertex count and the vertices.  Each vertex holds one 16-bit index per
+ * attribute enabled in the mesh's element mask, in attribute order.  The
+ * attribute table below gives the mask bit of each attribute; decoding is
+ * driven entirely by it, so a corrected layout is a one-line change.
+ *
+ * Decoding appends one index per attribute per vertex to the streams,
+ * and converts quads, strips and fans to a triangle list over those
+ * vertices.  Nothing here depends on GL, so exporters can use it too.
+ */
+
+class GXDecoder {
+public:
+
+	enum Attribute {
+		POSITION, NORMAL, COLOR0, COLOR1,
+		TEXCOORD0, TEXCOORD1, TEXCOORD2, TEXCOORD3,
+		TEXCOORD4, TEXCOORD5, TEXCOORD6, TEXCOORD7,
+		NUM_ATTRIBUTES,
+	};
+
+	enum Primitive {
+		QUADS = 0x80,
+		TRIANGLES = 0x90,
+		TRIANGLE_STRIP = 0x98,
+		TRIANGLE_FAN = 0xA0,
+		LINES = 0xA8,
+		LINE_STRIP = 0xB0,
+		POINTS = 0xB8,
+	};
+
+	struct AttributeFormat {
+		u32 maskBit;
+		u32 indexSize;
+	};
+
+	/**
+	 * The decoded vertices of a mesh.  indices[a][v] is the index of
+	 * vertex v into the array of attribute a; streams of attributes the
+	 * mask leaves out stay empty.
+	 */
+
+	struct Streams {
+		u32 attributes;
+		u32 vertexCount;
+		std::vector<u16> indices[NUM_ATTRIBUTES];
+		std::vector<u32> triangles;
+
+		Streams ()
+			: attributes(0), vertexCount(0) {
+		}
+
+		bool has (Attribute a) const {
+			return (attributes & (1 << a)) != 0;
+		}
+	};
+
+public:
+
+	static const AttributeFormat& format (Attribute a) {
+		static const AttributeFormat table[NUM_ATTRIBUTES] = {
+			{ 1 << 0, 2 },		// POSITION
+			{ 1 << 1, 2 },		// NORMAL
+			{ 1 << 2, 2 },		// COLOR0
+			{ 1 << 3, 2 },		// COLOR1
+			{ 1 << 4, 2 },		// TEXCOORD0
+			{ 1 << 5, 2 },		// TEXCOORD1
+			{ 1 << 6, 2 },		// TEXCOORD2
+			{ 1 << 7, 2 },		// TEXCOORD3
+			{ 1 << 8, 2 },		// TEXCOORD4
+			{ 1 << 9, 2 },		// TEXCOORD5
+			{ 1 << 10, 2 },		// TEXCOORD6
+			{ 1 << 11, 2 },		// TEXCOORD7
+		};
+		return table[a];
+	}
+
+	/**
+	 * Decode one display list, appending to out.  limits[a] is the size of
+	 * the array attribute a indexes; triangles touching an index past it
+	 * are dropped.  Only vertices a kept triangle uses are kept, so every
+	 * index in out is within its limit.  Returns false if the list is
+	 * malformed, keeping the primitives decoded before the fault.
+	 */
+
+	static bool decode (const ByteView& list, u32 elementMask, const u32* limits, Streams& out) {
+		u32 active[NUM_ATTRIBUTES];
+		u32 activeCount = 0;
+		u32 stride = 0;
+		out.attributes = activeAttributes(elementMask, active, activeCount, stride);
+
+		std::vector<u8> bad;
+		std::vector<u32> tris;
+		std::vector<u32> remap;
+
+		u32 pos = 0;
+		while (pos < list.size()) {
+			u8 op = list[pos];
+
+			// Display lists are padded to 32 bytes with NOPs
+			if (op == 0) {
+				pos++;
+				continue;
+			}
+
+			if (pos + 3 > list.size()) {
+				return false;
+			}
+
+			u32 primitive = op & 0xF8;
+			u32 count = getU16(list, pos + 1);
+			pos += 3;
+
+			if (primitive < QUADS || primitive > POINTS || pos + count * stride > list.size()) {
+				return false;
+			}
+
+			u32 first = out.vertexCount;
+			bad.assign(count, 0);
+
+			for (u32 v = 0; v < count; v++) {
+				for (u32 i = 0; i < activeCount; i++) {
+					u32 a = active[i];
+					u16 index = (format((Attribute)a).indexSize == 1) ? list[pos] : getU16(list, pos);
+					pos += format((Attribute)a).indexSize;
+
+					out.indices[a].push_back(index);
+					if (index >= limits[a]) {
+						bad[v] = 1;
+					}
+				}
+			}
+
+			tris.clear();
+			addTriangles(primitive, 0, count, bad, tris);
+
+			// Compact the primitive's vertices to those its triangles use
+			const u32 unused = ~0u;
+			remap.assign(count, unused);
+			for (u32 i = 0; i < tris.size(); i++) {
+				remap[tris[i]] = 0;
+			}
+
+			u32 kept = 0;
+			for (u32 v = 0; v < count; v++) {
+				if (remap[v] == unused) {
+					continue;
+				}
+				for (u32 i = 0; i < activeCount; i++) {
+					out.indices[active[i]][first + kept] = out.indices[active[i]][first + v];
+				}
+				remap[v] = kept++;
+			}
+			for (u32 i = 0; i < activeCount; i++) {
+				out.indices[active[i]].resize(first + kept);
+			}
+
+			for (u32 i = 0; i < tris.size(); i++) {
+				out.triangles.push_back(first + remap[tris[i]]);
+			}
+			out.vertexCount += kept;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Walk a display list without decoding it, for a quick measure.  Counts
+	 * the vertices and triangles of its surface primitives, and passes the
+	 * position index of each vertex whose indices are all in range to
+	 * visit.  Triangles decode would drop are still counted, so both counts
+	 * are upper bounds.  Returns false if the list is malformed.
+	 */
+
+	template <class Visitor>
+	static bool scan (const ByteView& list, u32 elementMask, const u32* limits, Visitor& visit,
+			u32& vertexCount, u32& triangleCount) {
+		u32 active[NUM_ATTRIBUTES];
+		u32 activeCount = 0;
+		u32 stride = 0;
+		u32 attributes = activeAttributes(elementMask, active, activeCount, stride);
+		bool hasPosition = (attributes & (1 << POSITION)) != 0;
+
+		u32 pos = 0;
+		while (pos < list.size()) {
+			if (list[pos] == 0) {
+				pos++;
+				continue;
+			}
+
+			if (pos + 3 > list.size()) {
+				return false;
+			}
+
+			u32 primitive = list[pos] & 0xF8;
+			u32 count = getU16(list, pos + 1);
+			pos += 3;
+
+			if (primitive < QUADS || primitive > POINTS || pos + count * stride > list.size()) {
+				return false;
+			}
+
+			u32 triangles = surfaceTriangles(primitive, count);
+			if (triangles == 0) {
+				pos += count * stride;
+				continue;
+			}
+			vertexCount += count;
+			triangleCount += triangles;
+
+			for (u32 v = 0; v < count; v++) {
+				u32 position = 0;
+				bool inRange = true;
+				for (u32 i = 0; i < activeCount; i++) {
+					u32 a = active[i];
+					u16 index = (format((Attribute)a).indexSize == 1) ? list[pos] : getU16(list, pos);
+					pos += format((Attribute)a).indexSize;
+
+					inRange = inRange && index < limits[a];
+					if (a == POSITION) {
+						position = index;
+					}
+				}
+
+				if (hasPosition && inRange) {
+					visit(position);
+				}
+			}
+		}
+
+		return true;
+	}
+
+protected:
+
+	/**
+	 * The attributes the mask enables, in order, and the bytes each vertex
+	 * takes.  Returns them as a bit set, as Streams::attributes holds.
+	 */
+
+	static u32 activeAttributes (u32 elementMask, u32* active, u32& activeCount, u32& stride) {
+		u32 attributes = 0;
+		for (u32 a = 0; a < NUM_ATTRIBUTES; a++) {
+			const AttributeFormat& f = format((Attribute)a);
+			if (elementMask & f.maskBit) {
+				active[activeCount++] = a;
+				stride += f.indexSize;
+				attributes |= 1 << a;
+			}
+		}
+		return attributes;
+	}
+
+	/**
+	 * The triangles addTriangles makes of a primitive, before any are
+	 * dropped.
+	 */
+
+	static u32 surfaceTriangles (u32 primitive, u32 count) {
+		switch (primitive) {
+		case QUADS:
+			return (count / 4) * 2;
+		case TRIANGLES:
+			return count / 3;
+		case TRIANGLE_STRIP:
+		case TRIANGLE_FAN:
+			return (count > 2) ? count - 2 : 0;
+		default:
+			return 0;
+		}
+	}
+
+	static void addTriangle (u32 base, u32 a, u32 b, u32 c, const std::vector<u8>& bad, std::vector<u32>& tris) {
+		if (bad[a] || bad[b] || bad[c]) {
+			return;
+		}
+		tris.push_back(base + a);
+		tris.push_back(base + b);
+		tris.push_back(base + c);
+	}
+
+	static void addTriangles (u32 primitive, u32 base, u32 count, const std::vector<u8>& bad, std::vector<u32>& tris) {
+		switch (primitive) {
+		case QUADS:
+			for (u32 i = 0; i + 3 < count; i += 4) {
+				addTriangle(base, i, i + 1, i + 2, bad, tris);
+				addTriangle(base, i, i + 2, i + 3, bad, tris);
+			}
+			break;
+		case TRIANGLES:
+			for (u32 i = 0; i + 2 < count; i += 3) {
+				addTriangle(base, i, i + 1, i + 2, bad, tris);
+			}
+			break;
+		case TRIANGLE_STRIP:
+			// Every other triangle is flipped to keep the winding
+			for (u32 i = 0; i + 2 < count; i++) {
+				if (i & 1) {
+					addTriangle(base, i + 1, i, i + 2, bad, tris);
+				}
+				else {
+					addTriangle(base, i, i + 1, i + 2, bad, tris);
+				}
+			}
+			break;
+		case TRIANGLE_FAN:
+			for (u32 i = 1; i + 1 < count; i++) {
+				addTriangle(base, 0, i, i + 1, bad, tris);
+			}
+			break;
+		default:
+			// Lines and points carry no surface
+			break;
+		}
+	}
+};
+
+#endif /* GXDECODER_H_ */
@@ -0,0 +1,276 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PMANIMATION_H_
+#define PMANIMATION_H_
+
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include "PMModel.h"
+#include "common.h"
+
+/**
+ * A Block 26/27 animation sequence compiled into compact tracks.
+ *
+ * Each track drives one value, either the texture index of a texture map
+ * (27.6) or the visibility of a scenegraph record (27.7), and holds the
+ * absolute value it takes at each frame that changes it, in time order.
+ * Texture changes are deltas in the file, so they are accumulated from the
+ * texture map's initial index while building.  Each frame also lists the
+ * track keys it sets, so stepping forward touches only those tracks.
+ */
+
+class PMAnimation {
+public:
+
+	enum TrackType {
+		TRACK_TEXMAP, TRACK_VISIBILITY,
+	};
+
+	struct Key {
+		f32 time;
+		s32 value;
+	};
+
+	struct Track {
+		TrackType type;
+		u32 target;
+		s32 base;
+		u32 keyIndex;
+		u32 keyCount;
+	};
+
+	struct Touch {
+		u32 track;
+		u32 key;
+	};
+
+protected:
+
+	// Track index by (type, target), while building
+	typedef std::map<std::pair<u32, u32>, u32> TrackIndex;
+
+public:
+
+	std::string name;
+	f32 length;
+	bool loop;
+
+	std::vector<f32> frameTimes;
+	std::vector<u32> frameTouches;
+	std::vector<Touch> touches;
+	std::vector<Track> tracks;
+	std::vector<Key> keys;
+
+public:
+
+	PMAnimation ()
+		: length(0), loop(false) {
+	}
+
+	bool build (const PMModel& model, unsigned animIndex) {
+		const PMModel::AnimationSeq& seq = model.animationSeqs[animIndex];
+
+		name = model.animation[animIndex].name;
+		loop = seq.loop != 0;
+
+		frameTimes.clear();
+		frameTouches.clear();
+		touches.clear();
+		tracks.clear();
+		keys.clear();
+
+		// Evaluate frames in time order; ties keep file order
+		std::vector<std::pair<f32, u32> > order(seq.frames.size());
+		for (u32 i = 0; i < order.size(); i++) {
+			order[i] = std::make_pair(seq.frames[i].time, i);
+		}
+		std::stable_sort(order.begin(), order.end(), frameLess);
+
+		// Keys are gathered per frame, then regrouped per track
+		std::vector<std::vector<std::pair<u32, s32> > > trackKeys;
+		std::vector<s32> current;
+		TrackIndex trackIndex;
+
+		for (u32 f = 0; f < order.size(); f++) {
+			const PMModel::AnimationSeq::Frame& frame = seq.frames[order[f].second];
+			frameTimes.push_back(frame.time);
+
+			// 27.6: the texture map index is cumulative within the frame
+			u32 texMap = 0;
+			for (u32 i = 0; i < frame.count[2]; i++) {
+				u32 entry = frame.index[2] + i;
+				if (entry >= seq.texChanges.size()) {
+					break;
+				}
+
+				const PMModel::AnimationSeq::TexChange& tc = seq.texChanges[entry];
+				texMap += tc.texMapIndex;
+				if (texMap >= model.texMaps.size()) {
+					continue;
+				}
+
+				u32 t = findTrack(TRACK_TEXMAP, texMap, model.texMaps[texMap].textureIndex, trackIndex, trackKeys, current);
+				current[t] += tc.delta;
+				setKey(trackKeys[t], f, current[t]);
+			}
+
+			// 27.7: n entries hold n (record, reveal/hide) byte pairs, with
+			// the record index cumulative within the frame
+			u32 record = 0;
+			u32 pairs = frame.count[3];
+			u32 start = frame.index[3] * 4;
+			for (u32 i = 0; i < pairs; i++) {
+				if (start + i * 2 + 1 >= seq.planeControl.size()) {
+					break;
+				}
+
+				record += seq.planeControl[start + i * 2];
+				s8 reveal = (s8)seq.planeControl[start + i * 2 + 1];
+				if (record >= model.sgRecords.size()) {
+					continue;
+				}
+
+				u32 t = findTrack(TRACK_VISIBILITY, record, initialVisibility(model, record), trackIndex, trackKeys, current);
+				current[t] = (reveal > 0) ? 1 : 0;
+				setKey(trackKeys[t], f, current[t]);
+			}
+		}
+
+		// Flatten per-track keys and index them by frame
+
+		std::vector<u32> touchCount(frameTimes.size() + 1, 0);
+		for (u32 t = 0; t < tracks.size(); t++) {
+			tracks[t].keyIndex = keys.size();
+			tracks[t].keyCount = trackKeys[t].size();
+
+			for (u32 k = 0; k < trackKeys[t].size(); k++) {
+				Key key;
+				key.time = frameTimes[trackKeys[t][k].first];
+				key.value = trackKeys[t][k].second;
+				keys.push_back(key);
+				touchCount[trackKeys[t][k].first + 1]++;
+			}
+		}
+
+		frameTouches.resize(frameTimes.size() + 1);
+		frameTouches[0] = 0;
+		for (u32 f = 1; f < frameTouches.size(); f++) {
+			frameTouches[f] = frameTouches[f - 1] + touchCount[f];
+		}
+
+		touches.resize(keys.size());
+		std::vector<u32> fill(frameTouches.begin(), frameTouches.end() - 1);
+		for (u32 t = 0; t < tracks.size(); t++) {
+			for (u32 k = 0; k < trackKeys[t].size(); k++) {
+				Touch& touch = touches[fill[trackKeys[t][k].first]++];
+				touch.track = t;
+				touch.key = tracks[t].keyIndex + k;
+			}
+		}
+
+		length = seq.length;
+		if (length <= 0 && !frameTimes.empty()) {
+			length = frameTimes.back();
+		}
+
+		return !tracks.empty();
+	}
+
+	/**
+	 * Index of the last frame at or before time, or -1 if time is before
+	 * the first frame.
+	 */
+
+	int findFrame (f32 time) const {
+		return int(std::upper_bound(frameTimes.begin(), frameTimes.end(), time) - frameTimes.begin()) - 1;
+	}
+
+	/**
+	 * Value of a track at time.
+	 */
+
+	s32 evaluate (u32 track, f32 time) const {
+		const Track& tr = tracks[track];
+		const Key* first = &keys[0] + tr.keyIndex;
+		const Key* last = first + tr.keyCount;
+
+		const Key* k = std::upper_bound(first, last, time, keyLess);
+		return (k == first) ? tr.base : (k - 1)->value;
+	}
+
+protected:
+
+	u32 findTrack (TrackType type, u32 target, s32 base, TrackIndex& trackIndex,
+			std::vector<std::vector<std::pair<u32, s32> > >& trackKeys, std::vector<s32>& current) {
+		std::pair<TrackIndex::iterator, bool> found =
+				trackIndex.insert(std::make_pair(std::make_pair(u32(type), target), u32(tracks.size())));
+		if (!found.second) {
+			return found.first->second;
+		}
+
+		Track tr;
+		tr.type = type;
+		tr.target = target;
+		tr.base = base;
+		tr.keyIndex = 0;
+		tr.keyCount = 0;
+
+		tracks.push_back(tr);
+		trackKeys.resize(tracks.size());
+		current.push_back(base);
+
+		return tracks.size() - 1;
+	}
+
+	static s32 initialVisibility (const PMModel& model, u32 record) {
+		s32 visIndex = model.sgRecords[record].sgObjectVisIndex;
+		if (visIndex < 0 || visIndex >= (s32)model.sgObjectVisibility.size()) {
+			return 1;
+		}
+		return model.sgObjectVisibility[visIndex].visibility != 0;
+	}
+
+	static void setKey (std::vector<std::pair<u32, s32> >& trackKeys, u32 frame, s32 value) {
+		if (!trackKeys.empty() && trackKeys.back().first == frame) {
+			trackKeys.back().second = value;
+		}
+		else {
+			trackKeys.push_back(std::make_pair(frame, value));
+		}
+	}
+
+	static bool frameLess (const std::pair<f32, u32>& a, const std::pair<f32, u32>& b) {
+		return a.first < b.first;
+	}
+
+	static bool keyLess (f32 time, const Key& k) {
+		return time < k.time;
+	}
+};
+
+#endif /* PMANIMATION_H_ */
@@ -0,0 +1,563 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PMANIMATIONBAKE_H_
+#define PMANIMATIONBAKE_H_
+
+#include <stdint.h>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include "system/MappedFile.h"
+#include "vecmath/TRS.h"
+#include "PMAnimation.h"
+#include "common.h"
+
+/**
+ * Animation sequences sampled at a fixed rate and stored in a file that is
+ * memory mapped for playback, so evaluating a frame is a table lookup.
+ *
+ * For each sequence and sample, the file holds the texture index of each
+ * animated texture map, a visibility bitset over the animated records, and
+ * the local transform of each scenegraph node:
+ *
+ *  - The discrete state of a sample is stored once per distinct state, as
+ *    a row, and each sample refers to its row.  Between key frames samples
+ *    share a row, so this costs two bytes per sample.
+ *  - Node transforms are stored as 16-bit deltas from the node's first
+ *    sample.  Nodes that never move store no samples at all.
+ *
+ * All data is host byte order and 4-byte aligned.  The header records a
+ * fingerprint of the sequences the file was baked from, so a stale bake
+ * is rejected and can be rebuilt.
+ */
+
+class PMAnimationBake {
+public:
+
+	enum { MAGIC = 0x42414D50, VERSION = 1, BYTE_ORDER_MARK = 0x01020304 };
+
+	// Rows are indexed by 16-bit sample entries, so no sequence has more
+	// samples than this; longer sequences hold their last sample
+	enum { MAX_SAMPLES = 65536 };
+
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t byteOrder;
+		uint32_t fingerprint;
+		uint32_t sequenceCount;
+		uint32_t nodeCount;
+		float sampleRate;
+		uint32_t sequenceOffset;
+	};
+
+	struct FileSequence {
+		char name[64];
+		float length;
+		uint32_t loop;
+		uint32_t sampleCount;
+		uint32_t rowCount;
+		uint32_t texTrackCount;
+		uint32_t visTrackCount;
+		uint32_t visWordCount;
+		uint32_t texTargetOffset;	// u16[texTrackCount]
+		uint32_t visTargetOffset;	// u16[visTrackCount]
+		uint32_t sampleRowOffset;	// u16[sampleCount]
+		uint32_t texRowOffset;		// u16[rowCount][texTrackCount]
+		uint32_t visRowOffset;		// u32[rowCount][visWordCount]
+		uint32_t nodeOffset;		// FileNode[nodeCount]
+	};
+
+	struct FileNode {
+		float base[10];				// translation, rotation xyzw, scale
+		float quant[6];				// translation and scale step per unit
+		uint32_t sampleOffset;		// FileNodeSample[sampleCount], or 0 if static
+	};
+
+	struct FileNodeSample {
+		int16_t translation[3];
+		int16_t rotation[4];
+		int16_t scale[3];
+	};
+
+	/**
+	 * Supplies the local transform of every scenegraph node at a time in
+	 * a sequence.
+	 */
+
+	class PoseSampler {
+	public:
+
+		virtual ~PoseSampler () { }
+
+		virtual void samplePose (const PMAnimation& anim, f32 time, std::vector<vmath::TRSf>& pose) = 0;
+	};
+
+protected:
+
+	MappedFile _file;
+	const FileHeader* _header;
+	const FileSequence* _sequences;
+
+public:
+
+	PMAnimationBake ()
+		: _header(NULL), _sequences(NULL) {
+	}
+
+	void close () {
+		_file.close();
+		_header = NULL;
+		_sequences = NULL;
+	}
+
+	/**
+	 * Map a baked file.  Fails if it is missing, malformed, was baked from
+	 * different sequences than fingerprint describes, or does not hold
+	 * sequenceCount sequences over nodeCount nodes.  Every table and index
+	 * in the file is checked against the mapping before it is used.
+	 */
+
+	bool open (const std::string& path, uint32_t fingerprint, unsigned sequenceCount, unsigned nodeCount) {
+		close();
+
+		if (!_file.open(path) || _file.size() < sizeof(FileHeader)) {
+			close();
+			return false;
+		}
+
+		const FileHeader* h = (const FileHeader*)_file.data();
+		if (h->magic != MAGIC || h->version != VERSION || h->byteOrder != BYTE_ORDER_MARK
+				|| h->fingerprint != fingerprint || h->sequenceCount != sequenceCount
+				|| h->nodeCount != nodeCount || !(h->sampleRate > 0 && h->sampleRate <= FLT_MAX)
+				|| !fits(h->sequenceOffset, h->sequenceCount, sizeof(FileSequence))) {
+			close();
+			return false;
+		}
+
+		const FileSequence* seqs = (const FileSequence*)(_file.data() + h->sequenceOffset);
+		for (unsigned i = 0; i < h->sequenceCount; i++) {
+			if (!validSequence(seqs[i], h->nodeCount)) {
+				close();
+				return false;
+			}
+		}
+
+		_header = h;
+		_sequences = seqs;
+
+		return true;
+	}
+
+	bool isOpen () const {
+		return _header != NULL;
+	}
+
+	unsigned getSequenceCount () const {
+		return _header ? _header->sequenceCount : 0;
+	}
+
+	const FileSequence& getSequence (unsigned seq) const {
+		return _sequences[seq];
+	}
+
+	/**
+	 * Sample index for a time, looping or clamping as the sequence does.
+	 */
+
+	unsigned sampleAt (unsigned seq, f32 time) const {
+		const FileSequence& s = _sequences[seq];
+
+		// Wrapped and clamped before converting, so no time overflows
+		f32 sample = std::floor(time * _header->sampleRate + .5f);
+		if (!(sample > 0)) {
+			return 0;
+		}
+		if (s.loop && s.sampleCount > 1) {
+			sample = std::fmod(sample, (f32)(s.sampleCount - 1));
+		}
+
+		return (unsigned)std::min(sample, (f32)(s.sampleCount - 1));
+	}
+
+	/**
+	 * Index of the discrete state row a sample uses.  Consecutive samples
+	 * with the same row have the same textures and visibility.
+	 */
+
+	unsigned getRow (unsigned seq, unsigned sample) const {
+		return array<uint16_t>(_sequences[seq].sampleRowOffset)[sample];
+	}
+
+	const uint16_t* getTextureRow (unsigned seq, unsigned row) const {
+		const FileSequence& s = _sequences[seq];
+		return array<uint16_t>(s.texRowOffset) + row * s.texTrackCount;
+	}
+
+	const uint16_t* getTextureTargets (unsigned seq) const {
+		return array<uint16_t>(_sequences[seq].texTargetOffset);
+	}
+
+	const uint16_t* getVisibilityTargets (unsigned seq) const {
+		return array<uint16_t>(_sequences[seq].visTargetOffset);
+	}
+
+	bool isVisible (unsigned seq, unsigned row, unsigned visTrack) const {
+		const FileSequence& s = _sequences[seq];
+		const uint32_t* bits = array<uint32_t>(s.visRowOffset) + row * s.visWordCount;
+		return (bits[visTrack >> 5] >> (visTrack & 31)) & 1;
+	}
+
+	bool isNodeAnimated (unsigned seq, unsigned node) const {
+		return array<FileNode>(_sequences[seq].nodeOffset)[node].sampleOffset != 0;
+	}
+
+	void getNodeTransform (unsigned seq, unsigned node, unsigned sample, vmath::TRSf& trs) const {
+		const FileNode& n = array<FileNode>(_sequences[seq].nodeOffset)[node];
+
+		trs.translation.set(n.base[0], n.base[1], n.base[2]);
+		trs.rotation.set(n.base[3], n.base[4], n.base[5], n.base[6]);
+		trs.scale.set(n.base[7], n.base[8], n.base[9]);
+
+		if (n.sampleOffset == 0) {
+			return;
+		}
+
+		const FileNodeSample& ns = array<FileNodeSample>(n.sampleOffset)[sample];
+
+		trs.translation.x += ns.translation[0] * n.quant[0];
+		trs.translation.y += ns.translation[1] * n.quant[1];
+		trs.translation.z += ns.translation[2] * n.quant[2];
+		trs.rotation.set(ns.rotation[0] / 32767.f, ns.rotation[1] / 32767.f,
+				ns.rotation[2] / 32767.f, ns.rotation[3] / 32767.f);
+		trs.rotation.normalize();
+		trs.scale.x += ns.scale[0] * n.quant[3];
+		trs.scale.y += ns.scale[1] * n.quant[4];
+		trs.scale.z += ns.scale[2] * n.quant[5];
+	}
+
+	/**
+	 * Hash of everything a bake depends on, to detect stale files.
+	 */
+
+	static uint32_t fingerprint (const std::vector<PMAnimation>& anims, unsigned nodeCount, f32 sampleRate) {
+		uint32_t h = 2166136261u;
+		hash(h, &nodeCount, sizeof(nodeCount));
+		hash(h, &sampleRate, sizeof(sampleRate));
+
+		for (unsigned i = 0; i < anims.size(); i++) {
+			const PMAnimation& a = anims[i];
+			hash(h, a.name.data(), a.name.size());
+			hash(h, &a.length, sizeof(a.length));
+			hash(h, &a.loop, sizeof(a.loop));
+			for (unsigned t = 0; t < a.tracks.size(); t++) {
+				hash(h, &a.tracks[t].type, sizeof(a.tracks[t].type));
+				hash(h, &a.tracks[t].target, sizeof(a.tracks[t].target));
+				hash(h, &a.tracks[t].base, sizeof(a.tracks[t].base));
+			}
+			for (unsigned k = 0; k < a.keys.size(); k++) {
+				hash(h, &a.keys[k].time, sizeof(a.keys[k].time));
+				hash(h, &a.keys[k].value, sizeof(a.keys[k].value));
+			}
+		}
+
+		return h;
+	}
+
+	/**
+	 * Sample every sequence at sampleRate samples per time unit and write
+	 * the result to path.
+	 */
+
+	static bool write (const std::string& path, const std::vector<PMAnimation>& anims,
+			unsigned nodeCount, f32 sampleRate, PoseSampler& sampler) {
+		std::vector<unsigned char> out(sizeof(FileHeader) + anims.size() * sizeof(FileSequence), 0);
+
+		FileHeader header;
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.byteOrder = BYTE_ORDER_MARK;
+		header.fingerprint = fingerprint(anims, nodeCount, sampleRate);
+		header.sequenceCount = anims.size();
+		header.nodeCount = nodeCount;
+		header.sampleRate = sampleRate;
+		header.sequenceOffset = sizeof(FileHeader);
+		std::memcpy(&out[0], &header, sizeof(header));
+
+		for (unsigned i = 0; i < anims.size(); i++) {
+			FileSequence seq;
+			bakeSequence(anims[i], nodeCount, sampleRate, sampler, seq, out);
+			std::memcpy(&out[sizeof(FileHeader) + i * sizeof(FileSequence)], &seq, sizeof(seq));
+		}
+
+		std::ofstream filestr(path.c_str(), std::fstream::out | std::fstream::binary | std::fstream::trunc);
+		if (filestr.fail() || !filestr.is_open()) {
+			return false;
+		}
+
+		filestr.write((const char*)&out[0], out.size());
+		return !filestr.fail();
+	}
+
+protected:
+
+	template <typename T>
+	const T* array (uint32_t offset) const {
+		return (const T*)(_file.data() + offset);
+	}
+
+	/**
+	 * Whether count items of size bytes at offset lie within the mapping,
+	 * at the alignment the writer gives them.
+	 */
+
+	bool fits (uint32_t offset, uint64_t count, size_t size) const {
+		return offset % 4 == 0 && offset <= _file.size() && count <= (_file.size() - offset) / size;
+	}
+
+	bool validSequence (const FileSequence& s, unsigned nodeCount) const {
+		if (s.sampleCount == 0 || s.sampleCount > MAX_SAMPLES || s.rowCount == 0
+				|| s.visWordCount != (s.visTrackCount + 31) / 32
+				|| !fits(s.texTargetOffset, s.texTrackCount, sizeof(uint16_t))
+				|| !fits(s.visTargetOffset, s.visTrackCount, sizeof(uint16_t))
+				|| !fits(s.sampleRowOffset, s.sampleCount, sizeof(uint16_t))
+				|| !fits(s.texRowOffset, (uint64_t)s.rowCount * s.texTrackCount, sizeof(uint16_t))
+				|| !fits(s.visRowOffset, (uint64_t)s.rowCount * s.visWordCount, sizeof(uint32_t))
+				|| !fits(s.nodeOffset, nodeCount, sizeof(FileNode))) {
+			return false;
+		}
+
+		const uint16_t* rows = array<uint16_t>(s.sampleRowOffset);
+		for (unsigned i = 0; i < s.sampleCount; i++) {
+			if (rows[i] >= s.rowCount) {
+				return false;
+			}
+		}
+
+		const FileNode* nodes = array<FileNode>(s.nodeOffset);
+		for (unsigned n = 0; n < nodeCount; n++) {
+			if (nodes[n].sampleOffset != 0 && !fits(nodes[n].sampleOffset, s.sampleCount, sizeof(FileNodeSample))) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	template <typename T>
+	static uint32_t append (std::vector<unsigned char>& out, const T* data, size_t count) {
+		uint32_t offset = out.size();
+		size_t bytes = count * sizeof(T);
+
+		out.resize(offset + ((bytes + 3) & ~size_t(3)), 0);
+		if (bytes > 0) {
+			std::memcpy(&out[offset], data, bytes);
+		}
+
+		return offset;
+	}
+
+	static void hash (uint32_t& h, const void* data, size_t size) {
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) {
+			h = (h ^ p[i]) * 16777619u;
+		}
+	}
+
+	static void bakeSequence (const PMAnimation& anim, unsigned nodeCount, f32 sampleRate,
+			PoseSampler& sampler, FileSequence& seq, std::vector<unsigned char>& out) {
+		std::memset(&seq, 0, sizeof(seq));
+		std::strncpy(seq.name, anim.name.c_str(), sizeof(seq.name) - 1);
+
+		seq.length = anim.length;
+		seq.loop = anim.loop;
+		// Written so a NaN length also takes one sample
+		f32 span = anim.length * sampleRate;
+		seq.sampleCount = (span > 0) ? (unsigned)std::ceil(std::min(span, (f32)(MAX_SAMPLES - 1))) + 1 : 1;
+
+		// Split tracks by kind
+
+		std::vector<uint16_t> texTargets, visTargets;
+		std::vector<unsigned> texTracks, visTracks;
+		for (unsigned t = 0; t < anim.tracks.size(); t++) {
+			if (anim.tracks[t].type == PMAnimation::TRACK_TEXMAP) {
+				texTracks.push_back(t);
+				texTargets.push_back(anim.tracks[t].target);
+			}
+			else {
+				visTracks.push_back(t);
+				visTargets.push_back(anim.tracks[t].target);
+			}
+		}
+
+		seq.texTrackCount = texTracks.size();
+		seq.visTrackCount = visTracks.size();
+		seq.visWordCount = (visTracks.size() + 31) / 32;
+
+		// Sample the discrete state, keeping one row per distinct state
+
+		std::vector<uint16_t> sampleRows(seq.sampleCount);
+		std::vector<uint16_t> texRows;
+		std::vector<uint32_t> visRows;
+		std::vector<uint16_t> texRow(texTracks.size());
+		std::vector<uint32_t> visRow(seq.visWordCount);
+
+		for (unsigned s = 0; s < seq.sampleCount; s++) {
+			f32 time = std::min(s / sampleRate, anim.length);
+
+			for (unsigned i = 0; i < texTracks.size(); i++) {
+				texRow[i] = (uint16_t)anim.evaluate(texTracks[i], time);
+			}
+
+			std::fill(visRow.begin(), visRow.end(), 0);
+			for (unsigned i = 0; i < visTracks.size(); i++) {
+				if (anim.evaluate(visTracks[i], time) != 0) {
+					visRow[i >> 5] |= 1u << (i & 31);
+				}
+			}
+
+			unsigned row = 0;
+			for (; row < seq.rowCount; row++) {
+				if (std::equal(texRow.begin(), texRow.end(), texRows.begin() + row * texRow.size())
+						&& std::equal(visRow.begin(), visRow.end(), visRows.begin() + row * visRow.size())) {
+					break;
+				}
+			}
+
+			if (row == seq.rowCount) {
+				texRows.insert(texRows.end(), texRow.begin(), texRow.end());
+				visRows.insert(visRows.end(), visRow.begin(), visRow.end());
+				seq.rowCount++;
+			}
+
+			sampleRows[s] = row;
+		}
+
+		seq.texTargetOffset = append(out, texTargets.empty() ? NULL : &texTargets[0], texTargets.size());
+		seq.visTargetOffset = append(out, visTargets.empty() ? NULL : &visTargets[0], visTargets.size());
+		seq.sampleRowOffset = append(out, &sampleRows[0], sampleRows.size());
+		seq.texRowOffset = append(out, texRows.empty() ? NULL : &texRows[0], texRows.size());
+		seq.visRowOffset = append(out, visRows.empty() ? NULL : &visRows[0], visRows.size());
+
+		// Sample node poses, then quantize the nodes that move
+
+		std::vector<vmath::TRSf> poses(nodeCount * seq.sampleCount);
+		std::vector<vmath::TRSf> pose(nodeCount);
+
+		for (unsigned s = 0; s < seq.sampleCount; s++) {
+			sampler.samplePose(anim, std::min(s / sampleRate, anim.length), pose);
+			for (unsigned n = 0; n < nodeCount; n++) {
+				poses[n * seq.sampleCount + s] = pose[n];
+			}
+		}
+
+		std::vector<FileNode> nodes(nodeCount);
+		std::vector<std::pair<unsigned, std::vector<FileNodeSample> > > nodeSamples;
+
+		for (unsigned n = 0; n < nodeCount; n++) {
+			const vmath::TRSf* p = &poses[n * seq.sampleCount];
+			FileNode& fn = nodes[n];
+
+			const float base[10] = { p[0].translation.x, p[0].translation.y, p[0].translation.z,
+					p[0].rotation.x, p[0].rotation.y, p[0].rotation.z, p[0].rotation.w,
+					p[0].scale.x, p[0].scale.y, p[0].scale.z };
+			std::memcpy(fn.base, base, sizeof(base));
+			std::memset(fn.quant, 0, sizeof(fn.quant));
+			fn.sampleOffset = 0;
+
+			float range[6] = { 0, 0, 0, 0, 0, 0 };
+			bool moves = false;
+
+			for (unsigned s = 1; s < seq.sampleCount; s++) {
+				const float d[6] = { p[s].translation.x - base[0], p[s].translation.y - base[1],
+						p[s].translation.z - base[2], p[s].scale.x - base[7],
+						p[s].scale.y - base[8], p[s].scale.z - base[9] };
+				for (int c = 0; c < 6; c++) {
+					range[c] = std::max(range[c], std::fabs(d[c]));
+				}
+				moves = moves || std::memcmp(&p[s].rotation, &p[0].rotation, sizeof(p[0].rotation)) != 0;
+			}
+
+			for (int c = 0; c < 6; c++) {
+				moves = moves || range[c] > 0;
+				fn.quant[c] = range[c] / 32767.f;
+			}
+
+			if (!moves) {
+				continue;
+			}
+
+			nodeSamples.push_back(std::make_pair(n, std::vector<FileNodeSample>(seq.sampleCount)));
+			std::vector<FileNodeSample>& samples = nodeSamples.back().second;
+
+			vmath::Quaternionf prev = p[0].rotation;
+			for (unsigned s = 0; s < seq.sampleCount; s++) {
+				FileNodeSample& ns = samples[s];
+
+				ns.translation[0] = quantize(p[s].translation.x - base[0], fn.quant[0]);
+				ns.translation[1] = quantize(p[s].translation.y - base[1], fn.quant[1]);
+				ns.translation[2] = quantize(p[s].translation.z - base[2], fn.quant[2]);
+				ns.scale[0] = quantize(p[s].scale.x - base[7], fn.quant[3]);
+				ns.scale[1] = quantize(p[s].scale.y - base[8], fn.quant[4]);
+				ns.scale[2] = quantize(p[s].scale.z - base[9], fn.quant[5]);
+
+				// q and -q are the same rotation; keep neighbours on one side
+				vmath::Quaternionf q = p[s].rotation;
+				if (q.dot(prev) < 0) {
+					q.set(-q.x, -q.y, -q.z, -q.w);
+				}
+				prev = q;
+
+				ns.rotation[0] = quantize(q.x, 1 / 32767.f);
+				ns.rotation[1] = quantize(q.y, 1 / 32767.f);
+				ns.rotation[2] = quantize(q.z, 1 / 32767.f);
+				ns.rotation[3] = quantize(q.w, 1 / 32767.f);
+			}
+		}
+
+		for (unsigned i = 0; i < nodeSamples.size(); i++) {
+			const std::vector<FileNodeSample>& samples = nodeSamples[i].second;
+			nodes[nodeSamples[i].first].sampleOffset = append(out, &samples[0], samples.size());
+		}
+
+		seq.nodeOffset = append(out, nodes.empty() ? NULL : &nodes[0], nodes.size());
+	}
+
+	static int16_t quantize (float v, float step) {
+		if (step == 0) {
+			return 0;
+		}
+
+		float q = std::floor(v / step + .5f);
+		return (int16_t)std::min(std::max(q, -32767.f), 32767.f);
+	}
+};
+
+#endif /* PMANIMATIONBAKE_H_ */
@@ -0,0 +1,370 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PMANIMATIONBATCH_H_
+#define PMANIMATIONBATCH_H_
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "renderer/Scenegraph.h"
+#include "renderer/InstanceBuffer.h"
+#include "system/TaskPool.h"
+#include "vecmath/Vecmath.h"
+#include "vecmath/SIMD.h"
+#include "PMAnimation.h"
+#include "common.h"
+
+/**
+ * Plays animations on many instances of one model at once, writing their
+ * node world matrices and visibility straight into an InstanceBuffer.
+ *
+ * Instances are grouped by animation.  Each group keeps its instances'
+ * times and track values in structure-of-arrays form, padded to four
+ * lanes, so a track is evaluated for four instances per SIMD step.  Groups
+ * are cut into chunks of CHUNK_LANES lanes and the chunks are run on a
+ * TaskPool; each chunk writes a disjoint range of the buffer.
+ */
+
+class PMAnimationBatch {
+public:
+
+	enum {
+		CHUNK_LANES = 64,
+	};
+
+protected:
+
+	struct Group {
+		const PMAnimation* anim;
+
+		// Keys flattened per track, in the animation's key order; values
+		// are 32-bit for the SIMD lanes, which s32 is not on every target
+		std::vector<float> keyTimes;
+		std::vector<int> keyValues;
+
+		// Scenegraph node driven by each visibility track, or -1
+		std::vector<int> trackNodes;
+
+		// Texture channel driven by each texture map track, or -1
+		std::vector<int> trackChannels;
+
+		std::vector<u32> instances;
+		u32 lanes;
+
+		std::vector<float> times;
+		std::vector<int> values;	// [track][lane]
+	};
+
+	class ChunkTask : public TaskPool::Task {
+	public:
+
+		PMAnimationBatch* batch;
+		u32 group;
+		u32 first;
+		u32 count;
+		f32 dt;
+
+		void run () {
+			batch->runChunk(group, first, count, dt);
+		}
+	};
+
+	const gfx::Scenegraph* _scenegraph;
+	std::vector<int> _recordNodes;
+	std::vector<u8> _baseVisible;
+	std::vector<std::vector<gfx::InstanceBuffer::TextureRef> > _channelTextures;
+
+	std::vector<Group> _groups;
+	std::vector<std::pair<u32, u32> > _instanceLanes;	// (group, lane)
+	std::vector<ChunkTask> _tasks;
+
+	gfx::InstanceBuffer _buffer;
+	bool _playing;
+
+public:
+
+	PMAnimationBatch ()
+		: _scenegraph(NULL), _playing(true) {
+	}
+
+	/**
+	 * Set the model the instances share.  recordNodes maps scenegraph
+	 * records to nodes (-1 for none), and baseVisible gives each node's
+	 * visibility before any animation touches it.  Clears all instances.
+	 */
+
+	void setModel (const gfx::Scenegraph* sg, const std::vector<int>& recordNodes, const std::vector<u8>& baseVisible) {
+		_scenegraph = sg;
+		_recordNodes = recordNodes;
+		_baseVisible = baseVisible;
+		clear();
+	}
+
+	/**
+	 * Set what each texture map track value selects: channels[c][v] is the
+	 * texture for value v of the tracks targeting texture map c, written
+	 * to channel c of the buffer.  Clears all instances.
+	 */
+
+	void setTextureChannels (const std::vector<std::vector<gfx::InstanceBuffer::TextureRef> >& channels) {
+		_channelTextures = channels;
+		clear();
+	}
+
+	/**
+	 * Add an instance playing anim (or nothing, if NULL), started phase
+	 * time units in.  placement is a GL-order matrix applied above the
+	 * model's root.  Returns the instance's index in the buffer.
+	 */
+
+	u32 addInstance (const PMAnimation* anim, f32 phase, const f32* placement) {
+		u32 g = 0;
+		while (g < _groups.size() && _groups[g].anim != anim) {
+			g++;
+		}
+		if (g == _groups.size()) {
+			newGroup(anim);
+		}
+
+		Group& group = _groups[g];
+		u32 lane = group.instances.size();
+		u32 instance = _instanceLanes.size();
+
+		group.instances.push_back(instance);
+		if (lane == group.lanes) {
+			growLanes(group, group.lanes + 4);
+		}
+		group.times[lane] = (anim != NULL && anim->length > 0) ? std::fmod(phase, anim->length) : 0;
+
+		_instanceLanes.push_back(std::make_pair(g, lane));
+
+		_buffer.resize(_instanceLanes.size(), (_scenegraph != NULL) ? _scenegraph->size() : 0, _channelTextures.size());
+		std::memcpy(_buffer.getPlacement(instance), placement, 16 * sizeof(f32));
+
+		return instance;
+	}
+
+	void clear () {
+		_groups.clear();
+		_instanceLanes.clear();
+		_buffer.resize(0, (_scenegraph != NULL) ? _scenegraph->size() : 0, _channelTextures.size());
+	}
+
+	const gfx::InstanceBuffer& getBuffer () const {
+		return _buffer;
+	}
+
+	u32 getInstanceCount () const {
+		return _instanceLanes.size();
+	}
+
+	/**
+	 * Value of an animation track for one instance, as of the last update.
+	 */
+
+	s32 getValue (u32 instance, u32 track) const {
+		const Group& group = _groups[_instanceLanes[instance].first];
+		return group.values[track * group.lanes + _instanceLanes[instance].second];
+	}
+
+	bool isPlaying () const {
+		return _playing;
+	}
+
+	void setPlaying (bool playing) {
+		_playing = playing;
+	}
+
+	/**
+	 * Advance every instance by dt, in the sequences' time units, and
+	 * rebuild the buffer.  The model's scenegraph must be up to date; it
+	 * is only read while the chunks run.
+	 */
+
+	void update (f32 dt, TaskPool& pool) {
+		if (_scenegraph == NULL) {
+			return;
+		}
+
+		_tasks.clear();
+		for (u32 g = 0; g < _groups.size(); g++) {
+			for (u32 first = 0; first < _groups[g].lanes; first += CHUNK_LANES) {
+				ChunkTask task;
+				task.batch = this;
+				task.group = g;
+				task.first = first;
+				task.count = std::min<u32>(CHUNK_LANES, _groups[g].lanes - first);
+				task.dt = _playing ? dt : 0;
+				_tasks.push_back(task);
+			}
+		}
+
+		// Submit only once the vector has stopped growing
+		for (u32 i = 0; i < _tasks.size(); i++) {
+			pool.submit(&_tasks[i]);
+		}
+		pool.wait();
+	}
+
+protected:
+
+	void newGroup (const PMAnimation* anim) {
+		_groups.push_back(Group());
+		Group& group = _groups.back();
+
+		group.anim = anim;
+		group.lanes = 0;
+
+		if (anim == NULL) {
+			return;
+		}
+
+		group.keyTimes.resize(anim->keys.size());
+		group.keyValues.resize(anim->keys.size());
+		for (u32 k = 0; k < anim->keys.size(); k++) {
+			group.keyTimes[k] = anim->keys[k].time;
+			group.keyValues[k] = anim->keys[k].value;
+		}
+
+		group.trackNodes.resize(anim->tracks.size(), -1);
+		group.trackChannels.resize(anim->tracks.size(), -1);
+		for (u32 t = 0; t < anim->tracks.size(); t++) {
+			const PMAnimation::Track& track = anim->tracks[t];
+			if (track.type == PMAnimation::TRACK_VISIBILITY && track.target < _recordNodes.size()) {
+				group.trackNodes[t] = _recordNodes[track.target];
+			}
+			else if (track.type == PMAnimation::TRACK_TEXMAP && track.target < _channelTextures.size()) {
+				group.trackChannels[t] = track.target;
+			}
+		}
+	}
+
+	/**
+	 * Widen a group to lanes, keeping each track's values.  New lanes
+	 * start at the track's base value.
+	 */
+
+	static void growLanes (Group& group, u32 lanes) {
+		u32 trackCount = (group.anim != NULL) ? group.anim->tracks.size() : 0;
+
+		std::vector<int> values(trackCount * lanes);
+		for (u32 t = 0; t < trackCount; t++) {
+			for (u32 l = 0; l < lanes; l++) {
+				values[t * lanes + l] = (l < group.lanes) ? group.values[t * group.lanes + l] : (int)group.anim->tracks[t].base;
+			}
+		}
+
+		group.values.swap(values);
+		group.times.resize(lanes, 0);
+		group.lanes = lanes;
+	}
+
+	void runChunk (u32 g, u32 first, u32 count, f32 dt) {
+		Group& group = _groups[g];
+		const PMAnimation* anim = group.anim;
+
+		if (anim != NULL) {
+			advanceTimes(*anim, &group.times[first], count, dt);
+
+			for (u32 t = 0; t < anim->tracks.size(); t++) {
+				const PMAnimation::Track& track = anim->tracks[t];
+				evaluateTrack(&group.times[first], count, &group.keyTimes[0] + track.keyIndex,
+						&group.keyValues[0] + track.keyIndex, track.keyCount, track.base,
+						&group.values[t * group.lanes + first]);
+			}
+		}
+
+		u32 nodeCount = _scenegraph->size();
+		u32 end = std::min<u32>(first + count, group.instances.size());
+
+		for (u32 lane = first; lane < end; lane++) {
+			u32 instance = group.instances[lane];
+
+			u8* visible = _buffer.getVisibility(instance);
+			std::memcpy(visible, &_baseVisible[0], nodeCount);
+
+			for (u32 t = 0; t < group.trackNodes.size(); t++) {
+				if (group.trackNodes[t] >= 0) {
+					visible[group.trackNodes[t]] = (group.values[t * group.lanes + lane] != 0);
+				}
+			}
+
+			if (!_channelTextures.empty()) {
+				gfx::InstanceBuffer::TextureRef* textures = _buffer.getTextures(instance);
+				std::fill(textures, textures + _channelTextures.size(), gfx::InstanceBuffer::TextureRef());
+
+				for (u32 t = 0; t < group.trackChannels.size(); t++) {
+					int c = group.trackChannels[t];
+					int value = group.values[t * group.lanes + lane];
+					if (c >= 0 && value >= 0 && value < (int)_channelTextures[c].size()) {
+						textures[c] = _channelTextures[c][value];
+					}
+				}
+			}
+
+			const f32* placement = _buffer.getPlacement(instance);
+			for (u32 n = 0; n < nodeCount; n++) {
+				const f32* world = _scenegraph->getNode(n).getWorldMatrix().asArray();
+				f32* out = _buffer.getMatrix(instance, n);
+#ifdef VMATH_SSE
+				vmath::simd::mul4x4(world, placement, out);
+#else
+				vmath::Matrix4f m(world);
+				m.mul(vmath::Matrix4f(placement));
+				std::memcpy(out, m.asArray(), 16 * sizeof(f32));
+#endif
+			}
+		}
+	}
+
+	static void advanceTimes (const PMAnimation& anim, float* times, u32 count, f32 dt) {
+		for (u32 i = 0; i < count; i++) {
+			f32 t = times[i] + dt;
+			if (t >= anim.length) {
+				t = (anim.loop && anim.length > 0) ? std::fmod(t, anim.length) : anim.length;
+			}
+			times[i] = t;
+		}
+	}
+
+	static void evaluateTrack (const float* times, u32 count, const float* keyTimes, const int* keyValues,
+			u32 keyCount, int base, int* out) {
+#ifdef VMATH_SSE
+		vmath::simd::stepTrack(times, count, keyTimes, keyValues, keyCount, base, out);
+#else
+		for (u32 i = 0; i < count; i++) {
+			int v = base;
+			for (u32 k = 0; k < keyCount && keyTimes[k] <= times[i]; k++) {
+				v = keyValues[k];
+			}
+			out[i] = v;
+		}
+#endif
+	}
+};
+
+#endif /* PMANIMATIONBATCH_H_ */
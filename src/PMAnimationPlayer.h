@@ -0,0 +1,198 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PMANIMATIONPLAYER_H_
+#define PMANIMATIONPLAYER_H_
+
+#include <vector>
+#include <cmath>
+#include "PMAnimation.h"
+#include "common.h"
+
+/**
+ * Plays back a PMAnimation.  The player tracks the current value of every
+ * track and reports which ones changed, leaving it to the owner to push
+ * them into the scene.
+ *
+ * Moving forward applies just the frames passed over, found by binary
+ * search on the frame times.  Seeking backward or wrapping a loop
+ * re-evaluates every track at the new time.
+ */
+
+class PMAnimationPlayer {
+protected:
+
+	const PMAnimation* _anim;
+	f32 _time;
+	int _frame;
+	bool _playing;
+
+	std::vector<s32> _values;
+	std::vector<u8> _changedMark;
+	std::vector<u32> _changed;
+
+public:
+
+	PMAnimationPlayer ()
+		: _anim(NULL), _time(0), _frame(-1), _playing(false) {
+	}
+
+	/**
+	 * Advance by dt, in the sequence's time units.  Sequences that don't
+	 * loop stop at their end.
+	 */
+
+	void advance (f32 dt) {
+		if (_anim == NULL || !_playing) {
+			return;
+		}
+
+		f32 t = _time + dt;
+
+		if (t < _anim->length) {
+			setTime(t, true);
+		}
+		else if (_anim->loop && _anim->length > 0) {
+			setTime(std::fmod(t, _anim->length), false);
+		}
+		else {
+			setTime(_anim->length, true);
+			_playing = false;
+		}
+	}
+
+	void clearChanged () {
+		for (u32 i = 0; i < _changed.size(); i++) {
+			_changedMark[_changed[i]] = 0;
+		}
+		_changed.clear();
+	}
+
+	const PMAnimation* getAnimation () const {
+		return _anim;
+	}
+
+	/**
+	 * Tracks whose value changed since the last clearChanged.
+	 */
+
+	const std::vector<u32>& getChanged () const {
+		return _changed;
+	}
+
+	f32 getTime () const {
+		return _time;
+	}
+
+	s32 getValue (u32 track) const {
+		return _values[track];
+	}
+
+	bool isPlaying () const {
+		return _playing;
+	}
+
+	/**
+	 * Start an animation from the beginning.  Every track is reported as
+	 * changed, so the owner can bring the scene in line with it.
+	 */
+
+	void play (const PMAnimation* anim) {
+		_anim = anim;
+		_time = 0;
+		_frame = -1;
+		_playing = (anim != NULL);
+
+		_changed.clear();
+		_values.clear();
+		_changedMark.clear();
+
+		if (anim == NULL) {
+			return;
+		}
+
+		_values.resize(anim->tracks.size());
+		_changedMark.resize(anim->tracks.size(), 0);
+
+		for (u32 t = 0; t < anim->tracks.size(); t++) {
+			_values[t] = anim->tracks[t].base;
+			markChanged(t);
+		}
+
+		setTime(0, true);
+	}
+
+	void seek (f32 time) {
+		if (_anim != NULL) {
+			setTime(time, time >= _time);
+		}
+	}
+
+	void setPlaying (bool state) {
+		_playing = state && (_anim != NULL);
+	}
+
+protected:
+
+	void markChanged (u32 track) {
+		if (!_changedMark[track]) {
+			_changedMark[track] = 1;
+			_changed.push_back(track);
+		}
+	}
+
+	void setTime (f32 time, bool forward) {
+		int frame = _anim->findFrame(time);
+
+		if (forward && frame >= _frame) {
+			for (int f = _frame + 1; f <= frame; f++) {
+				for (u32 i = _anim->frameTouches[f]; i < _anim->frameTouches[f + 1]; i++) {
+					const PMAnimation::Touch& touch = _anim->touches[i];
+					s32 v = _anim->keys[touch.key].value;
+
+					if (_values[touch.track] != v) {
+						_values[touch.track] = v;
+						markChanged(touch.track);
+					}
+				}
+			}
+		}
+		else {
+			for (u32 t = 0; t < _values.size(); t++) {
+				s32 v = _anim->evaluate(t, time);
+
+				if (_values[t] != v) {
+					_values[t] = v;
+					markChanged(t);
+				}
+			}
+		}
+
+		_frame = frame;
+		_time = time;
+	}
+};
+
+#endif /* PMANIMATIONPLAYER_H_ */
@@ -33,6 +33,7 @@
 #include <iostream>
 #include <iomanip>
 #include "vecmath/Vector3.h"
+#include "vecmath/TRS.h"
 #include "TPL.h"
 #include "common.h"
 
@@ -819,6 +820,45 @@ public:
 			transform = getF32(buffer, offset + 0);
 		}
 
+		/**
+		 * Convert count 24-float records, starting at id, to TRS form.
+		 *
+		 * The records are applied in the order 1, 7, 2, 8, 4, 5, 3, 6:
+		 * T(trans) T(sPost) S(scale) T(-sPre) R(rot2) T(r1Post) R(2 * rot1) T(-r1Pre),
+		 * with rotations in ZYX order.  Moving each translation to the left
+		 * folds this to T * S * R with R = R(rot2) * R(2 * rot1).
+		 */
+
+		static void toTRS (const std::vector<SGObjectTrans>& v, int id, unsigned count, vmath::TRSf* out) {
+			for (unsigned i = 0; i < count; i++, id += 24) {
+				const vmath::Vector3f trans(v[id+0].transform, v[id+1].transform, v[id+2].transform);
+				const vmath::Vector3f scale(v[id+3].transform, v[id+4].transform, v[id+5].transform);
+				const vmath::Vector3f rot1(v[id+6].transform, v[id+7].transform, v[id+8].transform);
+				const vmath::Vector3f rot2(v[id+9].transform, v[id+10].transform, v[id+11].transform);
+				const vmath::Vector3f r1Post(v[id+12].transform, v[id+13].transform, v[id+14].transform);
+				const vmath::Vector3f r1Pre(v[id+15].transform, v[id+16].transform, v[id+17].transform);
+				const vmath::Vector3f sPost(v[id+18].transform, v[id+19].transform, v[id+20].transform);
+				const vmath::Vector3f sPre(v[id+21].transform, v[id+22].transform, v[id+23].transform);
+
+				vmath::Quaternionf q1, q2;
+				q1.setEulerZYX(2.f * rot1);
+				q2.setEulerZYX(rot2);
+
+				// Offset applied inside the scale: -sPre + R2 * (r1Post - R1 * r1Pre)
+				vmath::Vector3f p(r1Pre);
+				q1.transform(p);
+				p = r1Post - p;
+				q2.transform(p);
+				p -= sPre;
+
+				out[i].translation.set(trans.x + sPost.x + scale.x * p.x,
+						trans.y + sPost.y + scale.y * p.y,
+						trans.z + sPost.z + scale.z * p.z);
+				out[i].rotation = q2 * q1;
+				out[i].scale = scale;
+			}
+		}
+
 		static std::string headerString () {
 			std::stringstream str;
 
@@ -947,6 +987,184 @@ public:
 		}
 	};
 
+	/**
+	 * Animation Sequence [Block 27]
+	 *
+	 * A format within the format: a header (27.1) of sub-block counts and
+	 * offsets relative to the start of the block, followed by the sub-blocks.
+	 * Sub-blocks whose representation is unknown are kept raw.
+	 */
+
+	struct AnimationSeq {
+		enum { HEADER_SIZE = 92 };
+
+		enum SubBlock {
+			B27_2, B27_3, B27_4, B27_5, B27_6, B27_7, B27_8, B27_9, NUM_SUBBLOCKS,
+		};
+
+		/**
+		 * Frame List [Block 27.3].  Each frame names a run of entries in
+		 * Blocks 27.4 to 27.8 to evaluate at its time.
+		 */
+
+		struct Frame {
+			enum { SIZE = 44 };
+
+			f32 time;
+			u32 index[5];
+			u32 count[5];
+
+			void read (const std::vector<u8>& buffer, int offset) {
+				time = getF32(buffer, offset + 0);
+				for (int i = 0; i < 5; i++) {
+					index[i] = getU32(buffer, offset + 4 + i * 8);
+					count[i] = getU32(buffer, offset + 8 + i * 8);
+				}
+			}
+		};
+
+		/**
+		 * Texture Map Change [Block 27.6]
+		 */
+
+		struct TexChange {
+			enum { SIZE = 12 };
+
+			u8 texMapIndex;
+			s8 delta;
+			s8 s0x02;
+			s8 s0x03;
+			u32 u0x04;
+			u32 u0x08;
+
+			void read (const std::vector<u8>& buffer, int offset) {
+				texMapIndex = buffer[offset + 0];
+				delta = (s8)buffer[offset + 1];
+				s0x02 = (s8)buffer[offset + 2];
+				s0x03 = (s8)buffer[offset + 3];
+				u0x04 = getU32(buffer, offset + 4);
+				u0x08 = getU32(buffer, offset + 8);
+			}
+		};
+
+		u32 size;
+		u32 count[NUM_SUBBLOCKS];
+		u32 offset[NUM_SUBBLOCKS];
+
+		u32 loop;
+		u32 u0x04;
+		f32 length;
+
+		std::vector<Frame> frames;
+		std::vector<u32> block4;
+		std::vector<u32> block5;
+		std::vector<TexChange> texChanges;
+		std::vector<u8> planeControl;
+		std::vector<u32> block8;
+		std::vector<u32> block9;
+
+		AnimationSeq ()
+			: size(0), loop(0), u0x04(0), length(0) {
+			for (int i = 0; i < NUM_SUBBLOCKS; i++) {
+				count[i] = 0;
+				offset[i] = 0;
+			}
+		}
+
+		/**
+		 * Read the sequence at offset.  Returns false if any part of it
+		 * falls outside the buffer.
+		 */
+
+		bool read (const std::vector<u8>& buffer, u32 base) {
+			static const u32 entrySize[NUM_SUBBLOCKS] = { 12, Frame::SIZE, 4, 4, TexChange::SIZE, 4, 4, 8 };
+
+			// Checked against the space left after base, so no sum can wrap
+			if (base > buffer.size() || buffer.size() - base < HEADER_SIZE) {
+				return false;
+			}
+			const u32 avail = buffer.size() - base;
+
+			size = getU32(buffer, base + 0);
+			for (int i = 0; i < NUM_SUBBLOCKS; i++) {
+				count[i] = getU32(buffer, base + 4 + i * 4);
+				offset[i] = getU32(buffer, base + 36 + i * 4);
+
+				if (count[i] != 0 && (offset[i] > avail || count[i] > (avail - offset[i]) / entrySize[i])) {
+					return false;
+				}
+			}
+
+			loop = 0;
+			u0x04 = 0;
+			length = 0;
+			if (count[B27_2] > 0) {
+				loop = getU32(buffer, base + offset[B27_2] + 0);
+				u0x04 = getU32(buffer, base + offset[B27_2] + 4);
+				length = getF32(buffer, base + offset[B27_2] + 8);
+			}
+
+			frames.resize(count[B27_3]);
+			for (u32 i = 0; i < frames.size(); i++) {
+				frames[i].read(buffer, base + offset[B27_3] + i * Frame::SIZE);
+			}
+
+			readWords(buffer, base + offset[B27_4], count[B27_4], block4);
+			readWords(buffer, base + offset[B27_5], count[B27_5], block5);
+
+			texChanges.resize(count[B27_6]);
+			for (u32 i = 0; i < texChanges.size(); i++) {
+				texChanges[i].read(buffer, base + offset[B27_6] + i * TexChange::SIZE);
+			}
+
+			planeControl.resize(count[B27_7] * 4);
+			for (u32 i = 0; i < planeControl.size(); i++) {
+				planeControl[i] = buffer[base + offset[B27_7] + i];
+			}
+
+			readWords(buffer, base + offset[B27_8], count[B27_8], block8);
+			readWords(buffer, base + offset[B27_9], count[B27_9] * 2, block9);
+
+			return true;
+		}
+
+		static std::string headerString () {
+			std::stringstream str;
+
+			str << "      ID|    Loop|  Length|  Frames|  TexChg|  Planes|   27.4|   27.5|   27.8|   27.9|";
+
+			return str.str();
+		}
+
+		std::string toString (int id) {
+			std::stringstream str;
+			str.precision(1);
+
+			str << std::fixed;
+			str << std::setw(8) << id << ": ";
+			str << std::setw(8) << loop << ",";
+			str << std::setw(8) << length << ",";
+			str << std::setw(8) << count[B27_3] << ",";
+			str << std::setw(8) << count[B27_6] << ",";
+			str << std::setw(8) << count[B27_7] << ",";
+			str << std::setw(7) << count[B27_4] << ",";
+			str << std::setw(7) << count[B27_5] << ",";
+			str << std::setw(7) << count[B27_8] << ",";
+			str << std::setw(7) << count[B27_9];
+
+			return str.str();
+		}
+
+	protected:
+
+		static void readWords (const std::vector<u8>& buffer, u32 offset, u32 count, std::vector<u32>& out) {
+			out.resize(count);
+			for (u32 i = 0; i < count; i++) {
+				out[i] = getU32(buffer, offset + i * 4);
+			}
+		}
+	};
+
 public:
 
 	std::string filename;
@@ -969,10 +1187,26 @@ public:
 	std::vector<SGObjectTrans> sgObjectTransforms;
 	std::vector<Scenegraph> sgRecords;
 	std::vector<Animation> animation;
+	std::vector<AnimationSeq> animationSeqs;
 
 public:
 
 	bool LoadFile (const std::string& file) {
+		std::vector<u8> buffer;
+		if (!ReadFile(file, buffer)) {
+			return false;
+		}
+
+		Parse(buffer);
+		return true;
+	}
+
+	/*
+	 * Read the whole model file into buffer, for Parse.  The two are kept
+	 * apart so a background loader can report them as separate stages.
+	 */
+
+	bool ReadFile (const std::string& file, std::vector<u8>& buffer) {
 		filename = file;
 
 		// Attempt to open file
@@ -988,12 +1222,16 @@ public:
 		filestr.seekg(0, std::fstream::beg);
 
 		// Read file into buffer
-		std::vector<u8> buffer(filesize);
+		buffer.resize(filesize);
 		filestr.read((char*)&buffer[0], filesize);
 		filestr.close();
 
 		std::cout << "File Size: " << filesize << " bytes" << std::endl;
 
+		return true;
+	}
+
+	void Parse (const std::vector<u8>& buffer) {
 		// Parse file into data structures
 		header.read(buffer, 0);
 
@@ -1087,7 +1325,13 @@ public:
 			animation[i].read(buffer, header.blockOffset[ABlock] + i * Animation::SIZE);
 		}
 
-		return true;
+		animationSeqs.resize(animation.size());
+		for (u32 i = 0; i < animation.size(); i++) {
+			if (!animationSeqs[i].read(buffer, animation[i].dataOffset)) {
+				std::cout << "(!!) Malformed animation sequence: " << animation[i].name << std::endl;
+				animationSeqs[i] = AnimationSeq();
+			}
+		}
 	}
 
 	bool WriteInfoFile (const std::string& outfile, const TPL& tpl) {
@@ -1189,6 +1433,12 @@ public:
 		}
 		filestr << std::endl << std::endl;
 
+		filestr << blockHeader("Block 27: Animation Sequences", AnimationSeq::headerString());
+		for (unsigned int i = 0; i < animationSeqs.size(); i++) {
+			filestr << animationSeqs[i].toString(i) << std::endl;
+		}
+		filestr << std::endl << std::endl;
+
 		filestr.flush();
 		filestr.close();
 
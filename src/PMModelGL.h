@@ -26,18 +26,52 @@
 #ifndef PMMODELGL_H_
 #define PMMODELGL_H_
 
+#include <SFML/System.hpp>
 #include <iostream>
+#include <cmath>
 #include <algorithm>
 #include <vector>
+#include <stdexcept>
 #include "renderer/Scenegraph.h"
 #include "renderer/RenderGL.h"
 #include "system/WindowController.h"
 #include "vecmath/Vecmath.h"
 #include "PMModel.h"
+#include "PMAnimation.h"
+#include "PMAnimationPlayer.h"
+#include "PMAnimationBake.h"
+#include "PMAnimationBatch.h"
+#include "system/TaskPool.h"
 #include "TPL.h"
 #include "common.h"
 
-class PMModelGL : public PMModel {
+class PMModelGL : public PMModel, public PMAnimationBake::PoseSampler {
+protected:
+
+	/*
+	 * Builds a run of the meshes in builtMeshes.  Each task writes only its
+	 * own slots and keeps its own scratch, so tasks share nothing.
+	 */
+
+	class MeshTask : public TaskPool::Task {
+	public:
+
+		const PMModelGL* model;
+		std::vector<gfx::TriMesh>* out;
+		u32 first;
+		u32 count;
+		std::string error;
+
+		void run () {
+			try {
+				model->buildMeshes(first, count, *out);
+			}
+			catch (const std::exception& e) {
+				error = e.what();
+			}
+		}
+	};
+
 public:
 
 	TPL tpl;
@@ -45,73 +79,107 @@ public:
 	gfx::Scenegraph scenegraph;
 	gfx::RenderGL renderer;
 
+	std::vector<PMAnimation> animations;
+	PMAnimationPlayer animPlayer;
+	int animIndex;
+
+	PMAnimationBake animBake;
+	bool animBaked;
+	bool bakeRequested;
+	float bakeTime;
+	int bakeRow;
+
+	std::vector<vmath::TRSf> restPose;
+
+	PMAnimationBatch animBatch;
+	TaskPool* taskPool;
+	int instanceCount;
+	int instanceAnim;
+
+	// Node created for each scenegraph record, or -1
+	std::vector<int> recordNodes;
+
+	// Texture array holding every texture an animation gives each texture
+	// map, or NULL, and the layer of each texture index in it, or -1
+	std::vector<gfx::TextureArray*> texMapArrays;
+	std::vector<std::vector<int> > texMapLayers;
+
+	// Geometry created for each scenegraph record and each texture map
+	std::vector<std::vector<gfx::Geometry*> > recordGeometry;
+	std::vector<std::vector<gfx::Geometry*> > texMapGeometry;
+
+	// Meshes built ahead of the scenegraph walk, one per mesh of each
+	// object, starting at the object's base slot.  Freed once registered.
+	std::vector<u32> objectMeshBase;
+	std::vector<u32> meshSlotObject;
+	std::vector<gfx::TriMesh> builtMeshes;
+
 	std::string errorMessage;
 
 public:
 
+	PMModelGL ()
+		: animIndex(-1), animBaked(false), bakeRequested(false), bakeTime(0), bakeRow(-1),
+		  taskPool(NULL), instanceCount(1), instanceAnim(-1) {
+	}
+
+	virtual ~PMModelGL () {
+		delete taskPool;
+	}
+
 	/*
 	 * Parses the PMModel Scene Graph and transformation data into a renderable
-	 * Scenegraph object.
+	 * Scenegraph object.  The record tree is walked depth-first with an explicit
+	 * stack, so long sibling chains don't recurse, and nodes are created in the
+	 * depth-first order the Scenegraph pool requires.
 	 */
 
-	void parseSceneNode (gfx::Scenegraph::Node* node, unsigned sgRecordIndex) {
-		const Scenegraph& sgr = sgRecords[sgRecordIndex];
+	void parseSceneGraph (unsigned rootRecordIndex) {
+		// Pending (record, parent node) pairs; parent -1 denotes the root
+		std::vector<std::pair<int, int> > pending;
+		pending.push_back(std::make_pair((int)rootRecordIndex, -1));
 
-		vmath::Vector3f v1(sgObjectTransforms[sgr.sgObjectTransIndex + 0].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 1].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 2].transform);
+		scenegraph.reserve(sgRecords.size());
 
-		vmath::Vector3f v2(sgObjectTransforms[sgr.sgObjectTransIndex + 3].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 4].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 5].transform);
+		while (!pending.empty()) {
+			int sgRecordIndex = pending.back().first;
+			int parent = pending.back().second;
+			pending.pop_back();
 
-		vmath::Vector3f v3(sgObjectTransforms[sgr.sgObjectTransIndex + 6].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 7].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 8].transform);
-
-		vmath::Vector3f v4(sgObjectTransforms[sgr.sgObjectTransIndex + 9].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 10].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 11].transform);
-
-		vmath::Vector3f v5(sgObjectTransforms[sgr.sgObjectTransIndex + 12].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 13].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 14].transform);
-
-		vmath::Vector3f v6(sgObjectTransforms[sgr.sgObjectTransIndex + 15].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 16].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 17].transform);
+			if (sgRecordIndex < 0 || sgRecordIndex >= (int)sgRecords.size()
+					|| scenegraph.size() > sgRecords.size()) {
+				std::cout << "(!!) Malformed scenegraph record: " << sgRecordIndex << std::endl;
+				return;
+			}
 
-		vmath::Vector3f v7(sgObjectTransforms[sgr.sgObjectTransIndex + 18].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 19].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 20].transform);
+			const Scenegraph& sgr = sgRecords[sgRecordIndex];
+			int node = (parent == -1) ? scenegraph.root() : scenegraph.newChild(parent);
 
-		vmath::Vector3f v8(sgObjectTransforms[sgr.sgObjectTransIndex + 21].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 22].transform,
-				sgObjectTransforms[sgr.sgObjectTransIndex + 23].transform);
+			parseSceneNode(node, sgRecordIndex);
 
-		node->addTransform(gfx::Scenegraph::Node::TRANSFORM_TRANSLATE, v1);
-		node->addTransform(gfx::Scenegraph::Node::TRANSFORM_TRANSLATE, v7);
-		node->addTransform(gfx::Scenegraph::Node::TRANSFORM_SCALE, v2);
-		node->addTransform(gfx::Scenegraph::Node::TRANSFORM_TRANSLATE, 0.f - v8);
-		node->addTransform(gfx::Scenegraph::Node::TRANSFORM_ROTATE_ZYX, v4);
-		node->addTransform(gfx::Scenegraph::Node::TRANSFORM_TRANSLATE, v5);
-		node->addTransform(gfx::Scenegraph::Node::TRANSFORM_ROTATE_ZYX, 2.f * v3);
-		node->addTransform(gfx::Scenegraph::Node::TRANSFORM_TRANSLATE, 0.f - v6);
+			// Push the sibling first so the child's subtree is built before it
+			if (sgr.nextRecord != -1 && parent != -1) {
+				pending.push_back(std::make_pair(sgr.nextRecord, parent));
+			}
+			if (sgr.childRecord != -1) {
+				pending.push_back(std::make_pair(sgr.childRecord, node));
+			}
+		}
+	}
 
-		parseGeometry(node, sgRecordIndex);
+	void parseSceneNode (int nodeIndex, unsigned sgRecordIndex) {
+		const Scenegraph& sgr = sgRecords[sgRecordIndex];
+		gfx::Scenegraph::Node* node = &scenegraph.getNode(nodeIndex);
 
-		if (sgr.childRecord != -1) {
-			gfx::Scenegraph::Node* child = scenegraph.newChild(node);
-			parseSceneNode(child, sgr.childRecord);
-		}
+		vmath::TRSf trs;
+		SGObjectTrans::toTRS(sgObjectTransforms, sgr.sgObjectTransIndex, 1, &trs);
+		node->setTransform(trs);
 
-		if (sgr.nextRecord != -1 && node->hasParent()) {
-			gfx::Scenegraph::Node* sibling = scenegraph.newChild(node->getParent());
-			parseSceneNode(sibling, sgr.nextRecord);
-		}
+		recordNodes[sgRecordIndex] = nodeIndex;
+		parseGeometry(nodeIndex, sgRecordIndex);
 	}
 
-	void parseGeometry (gfx::Scenegraph::Node* node, unsigned sgRecordIndex) {
+	void parseGeometry (int node, unsigned sgRecordIndex) {
 		const Scenegraph& sgr = sgRecords[sgRecordIndex];
 
 		// Skip node if it has no geometry attached
@@ -126,12 +194,14 @@ public:
 			const Mesh& mesh = meshes[object.meshIndex + meshId];
 			gfx::Geometry geo;
 
-			geo.mesh(parseMesh(object, meshId));
+			geo.mesh(renderer.addMesh(builtMeshes[objectMeshBase[sgr.sgObjectIndex] + meshId]));
 			geo.spacialNode = node;
 
+			// Texture arrays need GL, so are swapped in by Upload
 			if (mesh.texMapIndex != -1) {
 				unsigned textureId = textures[texMaps[mesh.texMapIndex].textureIndex].tplIndex;
 				geo.texture = renderer.getTexture(textureId);
+				geo.textureChannel = mesh.texMapIndex;
 			}
 
 			if (visibility.visibility == 0) {
@@ -141,10 +211,361 @@ public:
 			parseGeometryBlending(object, geo);
 			parseGeometryCulling(object, geo);
 
-			node->addGeometry(renderer.addGeometry(geo));
+			gfx::Geometry* geoPtr = renderer.addGeometry(geo);
+			scenegraph.addGeometry(node, geoPtr);
+
+			recordGeometry[sgRecordIndex].push_back(geoPtr);
+			if (mesh.texMapIndex != -1) {
+				texMapGeometry[mesh.texMapIndex].push_back(geoPtr);
+			}
+		}
+	}
+
+	/*
+	 * Compile the Block 26/27 animation sequences into tracks.  Sequences
+	 * that drive nothing this viewer understands are dropped.
+	 */
+
+	void parseAnimations () {
+		animations.clear();
+
+		for (unsigned i = 0; i < animationSeqs.size(); i++) {
+			PMAnimation anim;
+			if (anim.build(*this, i)) {
+				animations.push_back(anim);
+			}
+		}
+	}
+
+	/*
+	 * Upload the textures each animated texture map can show into one
+	 * texture array, so animating it only changes a layer index.  Maps
+	 * whose textures differ in size or format keep swapping textures.
+	 */
+
+	void parseTextureArrays () {
+		texMapArrays.assign(texMaps.size(), NULL);
+		texMapLayers.assign(texMaps.size(), std::vector<int>());
+
+		for (unsigned tm = 0; tm < texMaps.size(); tm++) {
+			std::vector<int> layerOf(textures.size(), -1);
+			std::vector<gfx::Texture*> layers;
+
+			addTextureLayer(texMaps[tm].textureIndex, layerOf, layers);
+
+			for (unsigned a = 0; a < animations.size(); a++) {
+				const PMAnimation& anim = animations[a];
+				for (unsigned t = 0; t < anim.tracks.size(); t++) {
+					const PMAnimation::Track& track = anim.tracks[t];
+					if (track.type != PMAnimation::TRACK_TEXMAP || track.target != tm) {
+						continue;
+					}
+					for (unsigned k = track.keyIndex; k < track.keyIndex + track.keyCount; k++) {
+						addTextureLayer(anim.keys[k].value, layerOf, layers);
+					}
+				}
+			}
+
+			if (layers.size() < 2 || layerOf[texMaps[tm].textureIndex] == -1) {
+				continue;
+			}
+
+			texMapArrays[tm] = renderer.addTextureArray(layers);
+			if (texMapArrays[tm] != NULL) {
+				texMapLayers[tm].swap(layerOf);
+			}
+		}
+	}
+
+	/*
+	 * Point each texture map's geometry at its texture array, if it got
+	 * one, in place of the single texture it was built with.
+	 */
+
+	void applyTextureArrays () {
+		for (unsigned tm = 0; tm < texMaps.size(); tm++) {
+			if (texMapArrays[tm] == NULL) {
+				continue;
+			}
+
+			int layer = texMapLayers[tm][texMaps[tm].textureIndex];
+			const std::vector<gfx::Geometry*>& geos = texMapGeometry[tm];
+			for (unsigned i = 0; i < geos.size(); i++) {
+				geos[i]->texture = NULL;
+				geos[i]->textureArray = texMapArrays[tm];
+				geos[i]->textureLayer = layer;
+			}
+		}
+
+		renderer.invalidateQueue();
+	}
+
+	void addTextureLayer (s32 textureIndex, std::vector<int>& layerOf, std::vector<gfx::Texture*>& layers) {
+		if (textureIndex < 0 || textureIndex >= (s32)textures.size() || layerOf[textureIndex] != -1) {
+			return;
+		}
+
+		gfx::Texture* tex = renderer.getTexture(textures[textureIndex].tplIndex);
+		if (tex == NULL) {
+			return;
+		}
+
+		layerOf[textureIndex] = layers.size();
+		layers.push_back(tex);
+	}
+
+	/*
+	 * Push a track value into the scene.  Only the geometry attached to the
+	 * track's texture map or record is touched.  Returns true if the render
+	 * queue must be rebuilt; texture array layer changes don't need it.
+	 * Baked tracks come from a file, so targets are range checked too.
+	 */
+
+	bool applyTrack (const PMAnimation::Track& track, s32 value) {
+		if (track.type == PMAnimation::TRACK_TEXMAP) {
+			if (value < 0 || value >= (s32)textures.size() || track.target >= texMapGeometry.size()) {
+				return false;
+			}
+
+			const std::vector<gfx::Geometry*>& geos = texMapGeometry[track.target];
+
+			if (texMapArrays[track.target] != NULL) {
+				int layer = texMapLayers[track.target][value];
+				for (unsigned i = 0; i < geos.size() && layer != -1; i++) {
+					geos[i]->textureLayer = layer;
+				}
+				return false;
+			}
+
+			gfx::Texture* tex = renderer.getTexture(textures[value].tplIndex);
+			for (unsigned i = 0; i < geos.size(); i++) {
+				geos[i]->texture = tex;
+			}
+			return true;
+		}
+		else {
+			if (track.target >= recordGeometry.size()) {
+				return false;
+			}
+
+			const std::vector<gfx::Geometry*>& geos = recordGeometry[track.target];
+			for (unsigned i = 0; i < geos.size(); i++) {
+				geos[i]->visible = (value != 0);
+			}
+			return true;
+		}
+	}
+
+	/*
+	 * Switch to animation index, or to none if index is -1.  Anything the
+	 * previous animation changed is put back first.
+	 */
+
+	void playAnimation (int index, bool baked) {
+		if (animIndex != -1) {
+			const PMAnimation& prev = animations[animIndex];
+			for (unsigned t = 0; t < prev.tracks.size(); t++) {
+				if (applyTrack(prev.tracks[t], prev.tracks[t].base)) {
+					renderer.invalidateQueue();
+				}
+			}
+
+			if (animBaked) {
+				for (unsigned n = 0; n < scenegraph.size(); n++) {
+					if (animBake.isNodeAnimated(animIndex, n)) {
+						scenegraph.getNode(n).setTransform(restPose[n]);
+					}
+				}
+			}
+		}
+
+		animIndex = (index >= 0 && index < (int)animations.size()) ? index : -1;
+		bakeRequested = baked;
+		animBaked = baked && animBake.isOpen();
+		bakeTime = 0;
+		bakeRow = -1;
+
+		animPlayer.play((animIndex == -1 || animBaked) ? NULL : &animations[animIndex]);
+	}
+
+	/*
+	 * Load the baked samples for this model's animations, baking them
+	 * first if there is no bake or it is out of date.
+	 */
+
+	void loadAnimationBake () {
+		if (animations.empty()) {
+			return;
+		}
+
+		std::string bakePath = filename + ".bake";
+		const float rate = 60.f / 1000.f;	// Samples per millisecond
+
+		uint32_t fp = PMAnimationBake::fingerprint(animations, scenegraph.size(), rate);
+
+		if (animBake.open(bakePath, fp, animations.size(), scenegraph.size())) {
+			return;
+		}
+
+		if (!PMAnimationBake::write(bakePath, animations, scenegraph.size(), rate, *this)
+				|| !animBake.open(bakePath, fp, animations.size(), scenegraph.size())) {
+			std::cout << "(!!) Could not write animation bake '" << bakePath << "'" << std::endl;
+		}
+	}
+
+	/*
+	 * Node poses for baking.  No decoded track moves nodes yet, so every
+	 * sample is the rest pose.
+	 */
+
+	void samplePose (const PMAnimation&, f32, std::vector<vmath::TRSf>& pose) {
+		pose = restPose;
+	}
+
+	/*
+	 * Apply the baked sample for the current time.  Textures and visibility
+	 * are only touched when the sample's state row changes.
+	 */
+
+	void updateBaked (float dt) {
+		AppState& state = AppState::getState();
+		if (!state.vars.animationPaused) {
+			bakeTime += dt;
+		}
+
+		unsigned sample = animBake.sampleAt(animIndex, bakeTime);
+		int row = animBake.getRow(animIndex, sample);
+
+		if (row != bakeRow) {
+			const PMAnimationBake::FileSequence& seq = animBake.getSequence(animIndex);
+			const uint16_t* texTargets = animBake.getTextureTargets(animIndex);
+			const uint16_t* visTargets = animBake.getVisibilityTargets(animIndex);
+			const uint16_t* texRow = animBake.getTextureRow(animIndex, row);
+			const uint16_t* prevTexRow = (bakeRow == -1) ? NULL : animBake.getTextureRow(animIndex, bakeRow);
+
+			PMAnimation::Track track;
+			track.type = PMAnimation::TRACK_TEXMAP;
+			for (unsigned i = 0; i < seq.texTrackCount; i++) {
+				if (prevTexRow == NULL || prevTexRow[i] != texRow[i]) {
+					track.target = texTargets[i];
+					if (applyTrack(track, texRow[i])) {
+						renderer.invalidateQueue();
+					}
+				}
+			}
+
+			track.type = PMAnimation::TRACK_VISIBILITY;
+			for (unsigned i = 0; i < seq.visTrackCount; i++) {
+				bool vis = animBake.isVisible(animIndex, row, i);
+				if (bakeRow == -1 || animBake.isVisible(animIndex, bakeRow, i) != vis) {
+					track.target = visTargets[i];
+					if (applyTrack(track, vis)) {
+						renderer.invalidateQueue();
+					}
+				}
+			}
+
+			bakeRow = row;
+		}
+
+		for (unsigned n = 0; n < scenegraph.size(); n++) {
+			if (animBake.isNodeAnimated(animIndex, n)) {
+				vmath::TRSf trs;
+				animBake.getNodeTransform(animIndex, n, sample, trs);
+				scenegraph.getNode(n).setTransform(trs);
+			}
 		}
 	}
 
+	/*
+	 * Lay count instances out on a square grid, spaced by the model's
+	 * bound.  Each plays the selected animation, or a random one if none
+	 * is selected, from a random phase.
+	 */
+
+	void placeInstances (int count, int anim) {
+		std::vector<u8> baseVisible(scenegraph.size(), 1);
+		for (unsigned r = 0; r < sgRecords.size(); r++) {
+			s32 visIndex = sgRecords[r].sgObjectVisIndex;
+			if (recordNodes[r] >= 0 && visIndex >= 0 && visIndex < (s32)sgObjectVisibility.size()) {
+				baseVisible[recordNodes[r]] = (sgObjectVisibility[visIndex].visibility != 0);
+			}
+		}
+
+		animBatch.setModel(&scenegraph, recordNodes, baseVisible);
+
+		// Texture map tracks pick a layer where the map got an array
+		std::vector<std::vector<gfx::InstanceBuffer::TextureRef> > channels(texMaps.size());
+		for (unsigned tm = 0; tm < texMaps.size(); tm++) {
+			for (unsigned v = 0; v < textures.size(); v++) {
+				if (texMapArrays[tm] != NULL) {
+					channels[tm].push_back(gfx::InstanceBuffer::TextureRef(NULL, texMapLayers[tm][v]));
+				}
+				else {
+					channels[tm].push_back(gfx::InstanceBuffer::TextureRef(renderer.getTexture(textures[v].tplIndex), -1));
+				}
+			}
+		}
+		animBatch.setTextureChannels(channels);
+
+		const vmath::Vector3f& e = scenegraph.getNode(scenegraph.root()).getBound().extants();
+		f32 spacing = 2.5f * std::max(std::max(e.x, e.z), 1.f);
+		int side = (int)std::ceil(std::sqrt((f32)count));
+
+		// A fixed hash rather than rand(), so layouts repeat between runs
+		u32 seed = 0x9E3779B9u;
+
+		for (int i = 0; i < count; i++) {
+			f32 m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+			m[12] = ((i % side) - (side - 1) * .5f) * spacing;
+			m[14] = ((i / side) - (side - 1) * .5f) * spacing;
+
+			seed = seed * 1664525u + 1013904223u;
+			const PMAnimation* pa = NULL;
+			if (anim >= 0 && anim < (int)animations.size()) {
+				pa = &animations[anim];
+			}
+			else if (!animations.empty()) {
+				pa = &animations[(seed >> 16) % animations.size()];
+			}
+
+			seed = seed * 1664525u + 1013904223u;
+			f32 phase = (pa != NULL) ? pa->length * ((seed >> 16) & 0xFFFF) / 65536.f : 0;
+
+			animBatch.addInstance(pa, phase, m);
+		}
+
+		instanceCount = count;
+		instanceAnim = anim;
+		renderer.instances(&animBatch.getBuffer());
+	}
+
+	/*
+	 * Animate and place every instance.  The model's own animation is
+	 * stopped while instanced, as instances carry their own.
+	 */
+
+	void updateInstances (float dt) {
+		AppState& state = AppState::getState();
+
+		if (animIndex != -1) {
+			playAnimation(-1, bakeRequested);
+		}
+
+		if (taskPool == NULL) {
+			taskPool = new TaskPool(TaskPool::defaultWorkerCount());
+		}
+
+		if (state.vars.instanceCount != instanceCount || state.vars.animationIndex != instanceAnim) {
+			placeInstances(state.vars.instanceCount, state.vars.animationIndex);
+		}
+
+		scenegraph.update();
+
+		animBatch.setPlaying(!state.vars.animationPaused);
+		animBatch.update(dt * 1000.f, *taskPool);
+	}
+
 	void parseGeometryBlending (const SGObject& object, gfx::Geometry& geo) {
 		switch (object.blending) {
 		case 0x00:
@@ -181,17 +602,110 @@ public:
 		}
 	}
 
-	gfx::Mesh* parseMesh (const SGObject& object, int meshId) {
+	/*
+	 * Build every mesh of every object the scenegraph uses, split into
+	 * runs of roughly equal polygon counts on the task pool.  Each mesh
+	 * lands in its own slot and is registered with the renderer later, in
+	 * scenegraph order, so the result does not depend on scheduling.
+	 */
+
+	void parseMeshes () {
+		if (taskPool == NULL) {
+			taskPool = new TaskPool(TaskPool::defaultWorkerCount());
+		}
+
+		sf::Clock clock;
+
+		std::vector<u8> used(sgObjects.size(), 0);
+		for (u32 i = 0; i < sgRecords.size(); i++) {
+			s32 o = sgRecords[i].sgObjectIndex;
+			if (o >= 0 && o < (s32)sgObjects.size()) {
+				used[o] = 1;
+			}
+		}
+
+		objectMeshBase.assign(sgObjects.size(), 0);
+		meshSlotObject.clear();
+		u32 polyTotal = 0;
+
+		for (u32 o = 0; o < sgObjects.size(); o++) {
+			objectMeshBase[o] = meshSlotObject.size();
+			if (!used[o]) {
+				continue;
+			}
+			for (int m = 0; m < sgObjects[o].meshCount; m++) {
+				meshSlotObject.push_back(o);
+				polyTotal += meshes[sgObjects[o].meshIndex + m].polygonCount;
+			}
+		}
+
+		builtMeshes.assign(meshSlotObject.size(), gfx::TriMesh());
+
+		// Several runs per thread, so stealing can even out uneven meshes
+		u32 threads = taskPool->getWorkerCount() + 1;
+		u32 runPolys = std::max<u32>(polyTotal / (threads * 4), 256);
+
+		std::vector<MeshTask> tasks;
+		for (u32 slot = 0; slot < meshSlotObject.size(); ) {
+			MeshTask task;
+			task.model = this;
+			task.out = &builtMeshes;
+			task.first = slot;
+
+			u32 polys = 0;
+			while (slot < meshSlotObject.size() && (polys < runPolys || slot == task.first)) {
+				polys += meshes[meshIndex(slot)].polygonCount;
+				slot++;
+			}
+
+			task.count = slot - task.first;
+			tasks.push_back(task);
+		}
+
+		for (u32 i = 0; i < tasks.size(); i++) {
+			taskPool->submit(&tasks[i]);
+		}
+		taskPool->wait();
+
+		for (u32 i = 0; i < tasks.size(); i++) {
+			if (!tasks[i].error.empty()) {
+				throw std::runtime_error(tasks[i].error);
+			}
+		}
+
+		std::cout << "Model meshes: " << builtMeshes.size() << " built from " << polyTotal << " polygons in "
+				<< clock.getElapsedTime().asSeconds() * 1000.f << " ms, " << tasks.size() << " tasks on "
+				<< threads << " threads" << std::endl;
+	}
+
+	/*
+	 * Index into meshes of the mesh built in a slot.
+	 */
+
+	u32 meshIndex (u32 slot) const {
+		u32 o = meshSlotObject[slot];
+		return sgObjects[o].meshIndex + (slot - objectMeshBase[o]);
+	}
+
+	void buildMeshes (u32 first, u32 count, std::vector<gfx::TriMesh>& out) const {
+		std::vector<unsigned> polyIndex;
+
+		for (u32 slot = first; slot < first + count; slot++) {
+			u32 o = meshSlotObject[slot];
+			parseMesh(sgObjects[o], slot - objectMeshBase[o], out[slot], polyIndex);
+		}
+	}
+
+	void parseMesh (const SGObject& object, int meshId, gfx::TriMesh& renderMesh, std::vector<unsigned>& polyIndex) const {
 		const Mesh& mesh = meshes[object.meshIndex + meshId];
 
-		gfx::TriMesh renderMesh;
 		if (mesh.texMapIndex == -1) {
 			renderMesh.useTexCoords(false);
 		}
 
 		for (int polyId = 0; polyId < mesh.polygonCount; polyId++) {
 			const Polygon& poly = polygons[mesh.polygonIndex + polyId];
-			std::vector<unsigned> polyIndex;
+			polyIndex.clear();
 
 			// Draw each vertex suite in polygon
 			for (unsigned int v = 0; v < poly.vertexCount; v++) {
@@ -214,16 +728,18 @@ public:
 
 			renderMesh.addIndexPolygon(polyIndex);
 		}
-
-		return renderer.addMesh(renderMesh);
 	}
 
+	/*
+	 * Create a texture for each TPL entry.  They are uploaded by Upload.
+	 */
+
 	void parseTextures () {
 		for (unsigned i = 0; i < textures.size(); i++) {
 			gfx::TextureData texData(GL_RGBA, tpl._textures[i].texHeader.width,
 					tpl._textures[i].texHeader.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
 					0, tpl._textures[i].tex);
-			gfx::Texture tex(GL_TEXTURE_2D, texData);
+			gfx::Texture tex(GL_TEXTURE_2D, texData, false);
 
 			renderer.addTexture(tex);
 		}
@@ -249,12 +765,104 @@ public:
 	}
 
 	void Init () {
+		Build();
+		Upload();
+	}
+
+	/*
+	 * Build the scenegraph, meshes and animations from the loaded model.
+	 * Makes no GL calls, so it can run on a loading thread.
+	 */
+
+	void Build () {
 		AppState& state = AppState::getState();
 		renderer.camera(&state.camera);
+		renderer.scenegraph(&scenegraph);
 
 		parseTextures();
+		parseAnimations();
+
+		texMapArrays.assign(texMaps.size(), NULL);
+		texMapLayers.assign(texMaps.size(), std::vector<int>());
+
+		recordNodes.assign(sgRecords.size(), -1);
+		recordGeometry.resize(sgRecords.size());
+		texMapGeometry.resize(texMaps.size());
+
+		parseMeshes();
+		parseSceneGraph(sgRecords.size() - 1);
+		std::vector<gfx::TriMesh>().swap(builtMeshes);
+		scenegraph.update();
+
+		restPose.resize(scenegraph.size());
+		for (unsigned n = 0; n < scenegraph.size(); n++) {
+			restPose[n] = scenegraph.getNode(n).getTransform();
+		}
+
+		loadAnimationBake();
+	}
+
+	/*
+	 * Upload what Build left to the GL.  Must be called on the thread
+	 * owning the context.
+	 */
+
+	void Upload () {
+		for (unsigned i = 0; i < renderer.getTextureSlotCount(); i++) {
+			gfx::Texture* tex = renderer.getTexture(i);
+			if (tex != NULL) {
+				tex->upload();
+			}
+		}
+
+		parseTextureArrays();
+		applyTextureArrays();
+	}
+
+	/*
+	 * Step the selected animation by dt seconds and bring the scene up to
+	 * date.  Sequence times appear to be in milliseconds.
+	 */
+
+	void Update (float dt) {
+		AppState& state = AppState::getState();
+
+		if (state.vars.instanceCount > 1) {
+			updateInstances(dt);
+			return;
+		}
+
+		if (instanceCount > 1) {
+			animBatch.clear();
+			renderer.instances(NULL);
+			instanceCount = 1;
+		}
+
+		if (state.vars.animationIndex != animIndex || state.vars.bakedAnimation != bakeRequested) {
+			playAnimation(state.vars.animationIndex, state.vars.bakedAnimation);
+			state.vars.animationIndex = animIndex;
+		}
+
+		if (animBaked && animIndex != -1) {
+			updateBaked(dt * 1000.f);
+			scenegraph.update();
+			return;
+		}
+
+		animPlayer.setPlaying(!state.vars.animationPaused);
+		animPlayer.advance(dt * 1000.f);
+
+		const PMAnimation* anim = animPlayer.getAnimation();
+		const std::vector<u32>& changed = animPlayer.getChanged();
+		if (anim != NULL) {
+			for (unsigned i = 0; i < changed.size(); i++) {
+				if (applyTrack(anim->tracks[changed[i]], animPlayer.getValue(changed[i]))) {
+					renderer.invalidateQueue();
+				}
+			}
+		}
+		animPlayer.clearChanged();
 
-		parseSceneNode (scenegraph.root(), sgRecords.size() - 1);
 		scenegraph.update();
 	}
 
@@ -286,6 +894,20 @@ public:
 			str << " = " << state.vars.selectIndex;
 		}
 
+		if (instanceCount > 1) {
+			str << " | Instances: " << instanceCount;
+		}
+
+		if (animIndex != -1) {
+			str << " | Anim: " << animations[animIndex].name;
+			if (animBaked) {
+				str << " (baked)";
+			}
+			if (state.vars.animationPaused) {
+				str << " (paused)";
+			}
+		}
+
 		return str.str();
 	}
 
@@ -295,7 +917,16 @@ public:
 			return false;
 		}
 
-		std::string tplPath = pathname(file) + "/" + header.textureFile + "-";
+		return LoadTextures();
+	}
+
+	/*
+	 * Decode the model's TPL and write the info file.  Expects the model
+	 * to be loaded already.
+	 */
+
+	bool LoadTextures () {
+		std::string tplPath = pathname(filename) + "/" + header.textureFile + "-";
 
 		if (!tpl.LoadFile(tplPath)) {
 			errorMessage.append("could not open texture file '" + tplPath + "';");
@@ -0,0 +1,271 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PMMODELLOADER_H_
+#define PMMODELLOADER_H_
+
+#include <SFML/System.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "PMModelGL.h"
+#include "common.h"
+
+/**
+ * Loads a model on a background thread, so the window keeps drawing while
+ * it happens.  Loading runs in stages: the file is read, parsed, its
+ * textures decoded, and its scene built, all on the loading thread.  The
+ * last stage, upload, needs the GL context, so update() runs it on the
+ * calling thread once the others are done.
+ *
+ * A cancel takes effect at the next stage boundary.
+ */
+
+class PMModelLoader {
+public:
+
+	enum Stage {
+		IDLE, READ, PARSE, DECODE, BUILD, UPLOAD, DONE, FAILED, CANCELED,
+	};
+
+protected:
+
+	PMModelGL* _model;
+	std::string _file;
+	sf::Thread* _thread;
+
+	mutable sf::Mutex _mutex;
+	Stage _stage;
+	bool _cancel;
+	std::string _error;
+
+	sf::Clock _clock;
+	sf::Clock _stageClock;
+
+public:
+
+	PMModelLoader ()
+		: _model(NULL), _thread(NULL), _stage(IDLE), _cancel(false) {
+	}
+
+	virtual ~PMModelLoader () {
+		cancel();
+		wait();
+	}
+
+	/**
+	 * Start loading file into model, which must not be touched by the
+	 * caller until update() returns true.
+	 */
+
+	void start (PMModelGL* model, const std::string& file) {
+		wait();
+
+		_model = model;
+		_file = file;
+		_stage = IDLE;
+		_cancel = false;
+		_error.clear();
+		_clock.restart();
+
+		_thread = new sf::Thread(&PMModelLoader::threadMain, this);
+		_thread->launch();
+	}
+
+	/**
+	 * Stop loading at the next stage boundary.  An upload not yet started
+	 * is skipped.
+	 */
+
+	void cancel () {
+		sf::Lock lock(_mutex);
+		_cancel = true;
+
+		if (_stage == UPLOAD) {
+			_stage = CANCELED;
+		}
+	}
+
+	/**
+	 * Run the upload once the loading thread is done with the model.  Call
+	 * once a frame on the thread owning the GL context.  Returns true once
+	 * the model is ready to draw.
+	 */
+
+	bool update () {
+		Stage stage = getStage();
+
+		if (stage == UPLOAD) {
+			wait();
+
+			_stageClock.restart();
+			_model->Upload();
+			report(UPLOAD);
+
+			std::cout << "Load: ready in " << _clock.getElapsedTime().asSeconds() * 1000.f << " ms" << std::endl;
+
+			sf::Lock lock(_mutex);
+			_stage = DONE;
+			return true;
+		}
+
+		return stage == DONE;
+	}
+
+	const std::string& getError () const {
+		return _error;
+	}
+
+	/**
+	 * Fraction of the stages finished, for a progress bar.
+	 */
+
+	float getProgress () const {
+		Stage stage = getStage();
+		if (stage <= IDLE) {
+			return 0.f;
+		}
+		if (stage >= DONE) {
+			return 1.f;
+		}
+		return float(stage - READ) / float(DONE - READ);
+	}
+
+	Stage getStage () const {
+		sf::Lock lock(_mutex);
+		return _stage;
+	}
+
+	bool isFinished () const {
+		return getStage() >= DONE;
+	}
+
+	static const char* stageName (Stage stage) {
+		switch (stage) {
+		case IDLE: return "Waiting";
+		case READ: return "Reading";
+		case PARSE: return "Parsing";
+		case DECODE: return "Decoding textures";
+		case BUILD: return "Building scene";
+		case UPLOAD: return "Uploading";
+		case DONE: return "Done";
+		case FAILED: return "Failed";
+		case CANCELED: return "Canceled";
+		}
+		return "";
+	}
+
+protected:
+
+	static void threadMain (PMModelLoader* loader) {
+		loader->run();
+	}
+
+	void run () {
+		try {
+			std::vector<u8> buffer;
+
+			if (!enter(READ)) {
+				return;
+			}
+			if (!_model->ReadFile(_file, buffer)) {
+				fail("could not open model file '" + _file + "';");
+				return;
+			}
+
+			if (!enter(PARSE)) {
+				return;
+			}
+			_model->Parse(buffer);
+			std::vector<u8>().swap(buffer);
+
+			if (!enter(DECODE)) {
+				return;
+			}
+			if (!_model->LoadTextures()) {
+				fail(_model->errorMessage);
+				return;
+			}
+
+			if (!enter(BUILD)) {
+				return;
+			}
+			_model->Build();
+
+			enter(UPLOAD);
+		}
+		catch (const std::exception& e) {
+			fail(e.what());
+		}
+	}
+
+	/**
+	 * Move on to stage, reporting how long the last one took.  Returns
+	 * false if loading was canceled.
+	 */
+
+	bool enter (Stage stage) {
+		Stage last;
+		{
+			sf::Lock lock(_mutex);
+			if (_cancel) {
+				_stage = CANCELED;
+				return false;
+			}
+			last = _stage;
+			_stage = stage;
+		}
+
+		if (last != IDLE) {
+			report(last);
+		}
+		_stageClock.restart();
+
+		return true;
+	}
+
+	void fail (const std::string& message) {
+		sf::Lock lock(_mutex);
+		_error = message;
+		_stage = FAILED;
+	}
+
+	void report (Stage stage) {
+		std::cout << "Load: " << stageName(stage) << " took "
+				<< _stageClock.getElapsedTime().asSeconds() * 1000.f << " ms" << std::endl;
+	}
+
+	void wait () {
+		if (_thread != NULL) {
+			_thread->wait();
+			delete _thread;
+			_thread = NULL;
+		}
+	}
+
+};
+
+#endif /* PMMODELLOADER_H_ */
@@ -34,6 +34,9 @@
 #include <stack>
 #include <vector>
 #include <map>
+#include "system/ByteView.h"
+#include "system/MappedFile.h"
+#include "GXDecoder.h"
 #include "common.h"
 
 class PMWorld {
@@ -46,7 +49,7 @@ public:
 		u32 indexCount;
 		u32 tableIndexCount;
 
-		void read (const std::vector<u8>& buffer, u32 offset) {
+		void read (const ByteView& buffer, u32 offset) {
 			addrMasterIndex = getU32(buffer, offset + 4);
 			indexCount = getU32(buffer, offset + 8);
 			tableIndexCount = getU32(buffer, offset + 12);
@@ -78,9 +81,13 @@ public:
 		std::string str2;
 		std::string dateString;
 
-		void read (const std::vector<u8>& buffer, u32 offset) {
+		bool read (const ByteView& buffer, u32 offset) {
 			addr = offset;
 
+			if (!buffer.contains(offset, 20)) {
+				return false;
+			}
+
 			u32 addrVerString = getU32(buffer, offset + 0);
 			sgRootNode = getU32(buffer, offset + 4);
 			u32 addrStr1 = getU32(buffer, offset + 8);
@@ -91,6 +98,8 @@ public:
 			str1 = getString(buffer, addrStr1, 64);
 			str2 = getString(buffer, addrStr2, 64);
 			dateString = getString(buffer, addrDateString, 64);
+
+			return true;
 		}
 
 		std::string toString () const {
@@ -121,11 +130,21 @@ public:
 		u32 materialCount;
 		std::vector<MatNamePair> materials;
 
-		void read (const std::vector<u8>& buffer, u32 offset) {
+		bool read (const ByteView& buffer, u32 offset) {
 			addr = offset;
 
-			materialCount = getU32(buffer, offset + 0);
+			materialCount = 0;
+			materials.clear();
+			if (!buffer.contains(offset, 4)) {
+				return false;
+			}
+
+			u32 count = getU32(buffer, offset + 0);
+			if (count > (buffer.size() - offset - 4) / 8) {
+				return false;
+			}
 
+			materialCount = count;
 			materials.resize(materialCount);
 			for (u32 i = 0; i < materialCount; i++) {
 				u32 nameAddr = getU32(buffer, offset + 4 + (i * 8));
@@ -133,6 +152,8 @@ public:
 				materials[i].name = getString(buffer, nameAddr, 64);
 				materials[i].addr = getU32(buffer, offset + 8 + (i * 8));
 			}
+
+			return true;
 		}
 
 		std::string toString () const {
@@ -157,16 +178,28 @@ public:
 		u32 textureCount;
 		std::vector<std::string> textureNames;
 
-		void read(const std::vector<u8>& buffer, u32 offset) {
+		bool read(const ByteView& buffer, u32 offset) {
 			addr = offset;
 
-			textureCount = getU32(buffer, offset + 0);
+			textureCount = 0;
+			textureNames.clear();
+			if (!buffer.contains(offset, 4)) {
+				return false;
+			}
+
+			u32 count = getU32(buffer, offset + 0);
+			if (count > (buffer.size() - offset - 4) / 4) {
+				return false;
+			}
 
+			textureCount = count;
 			textureNames.resize(textureCount);
 			for (u32 i = 0; i < textureCount; i++) {
 				u32 nameAddr = getU32(buffer, offset + 4 + (i * 4));
 				textureNames[i] = getString(buffer, nameAddr, 64);
 			}
+
+			return true;
 		}
 
 		std::string toString () const {
@@ -181,23 +214,48 @@ public:
 		}
 	};
 
+	/*
+	 * Addresses of the vertex attribute arrays.  Fields past addrColor are
+	 * assumed to follow the GX attribute order, as the first four do.
+	 * Each array is a count followed by its entries; 0 means absent.
+	 */
+
 	struct VCDTable {
 
 		std::string name;
 		u32 addr;
 
 		u32 addrVertex;
-		u32 u0x04;
-		u32 u0x08;
+		u32 addrNormal;
+		u32 colorCount;
 		u32 addrColor;
+		u32 addrColor1;
+		u32 texCoordCount;
+		u32 addrTexCoord[8];
 
-		void read (const std::vector<u8>& buffer, u32 offset) {
+		bool read (const ByteView& buffer, u32 offset) {
 			addr = offset;
 
+			addrVertex = addrNormal = addrColor = addrColor1 = 0;
+			colorCount = texCoordCount = 0;
+			for (u32 i = 0; i < 8; i++) {
+				addrTexCoord[i] = 0;
+			}
+			if (!buffer.contains(offset, 24) || !buffer.contains(offset + 24, std::min(getU32(buffer, offset + 20), (u32)8) * 4)) {
+				return false;
+			}
+
 			addrVertex = getU32(buffer, offset + 0);
-			u0x04 = getU32(buffer, offset + 4);
-			u0x08 = getU32(buffer, offset + 8);
+			addrNormal = getU32(buffer, offset + 4);
+			colorCount = getU32(buffer, offset + 8);
 			addrColor = getU32(buffer, offset + 12);
+			addrColor1 = getU32(buffer, offset + 16);
+			texCoordCount = getU32(buffer, offset + 20);
+			for (u32 i = 0; i < 8; i++) {
+				addrTexCoord[i] = (i < texCoordCount) ? getU32(buffer, offset + 24 + (i * 4)) : 0;
+			}
+
+			return true;
 		}
 
 		std::string toString() const {
@@ -206,12 +264,20 @@ public:
 			str << std::showbase;
 			str << std::setw(16) << std::left << "Vertex Addr:";
 			str << std::setw(8) << std::right << std::hex << addrVertex << std::endl;
-			str << std::setw(16) << std::left << "u0x04:";
-			str << std::setw(8) << std::right << std::hex << u0x04 << std::endl;
-			str << std::setw(16) << std::left << "u0x08:";
-			str << std::setw(8) << std::right << std::hex << u0x08 << std::endl;
+			str << std::setw(16) << std::left << "Normal Addr:";
+			str << std::setw(8) << std::right << std::hex << addrNormal << std::endl;
+			str << std::setw(16) << std::left << "Color Count:";
+			str << std::setw(8) << std::right << std::dec << colorCount << std::endl;
 			str << std::setw(16) << std::left << "Color Addr:";
 			str << std::setw(8) << std::right << std::hex << addrColor << std::endl;
+			str << std::setw(16) << std::left << "Color 1 Addr:";
+			str << std::setw(8) << std::right << std::hex << addrColor1 << std::endl;
+			str << std::setw(16) << std::left << "TexCoord Count:";
+			str << std::setw(8) << std::right << std::dec << texCoordCount << std::endl;
+			for (u32 i = 0; i < 8 && i < texCoordCount; i++) {
+				str << "TexCoord " << i << " Addr:" << std::setw(6) << " ";
+				str << std::setw(8) << std::right << std::hex << addrTexCoord[i] << std::endl;
+			}
 
 			return str.str();
 		}
@@ -234,9 +300,14 @@ public:
 
 		s32 textureID;
 
-		void read (const std::vector<u8>& buffer, u32 offset) {
+		bool read (const ByteView& buffer, u32 offset) {
 			addr = offset;
 
+			textureID = -1;
+			if (!buffer.contains(offset, 16)) {
+				return false;
+			}
+
 			u32 nameAddr = getU32(buffer, offset + 0);
 			r = buffer[offset + 4];
 			g = buffer[offset + 5];
@@ -250,8 +321,15 @@ public:
 
 			name = getString(buffer, nameAddr, 64);
 
-			s32 subTexAddr = getU32(buffer, addrTexture);
-			textureID = (addrTexture > 0) ? (subTexAddr - 0x14) / 16 : -1;
+			if (addrTexture > 0) {
+				if (!buffer.contains(addrTexture, 4)) {
+					return false;
+				}
+				s32 subTexAddr = getU32(buffer, addrTexture);
+				textureID = (subTexAddr - 0x14) / 16;
+			}
+
+			return true;
 		}
 
 		static std::string headerString () {
@@ -283,54 +361,64 @@ public:
 
 	struct Vertex {
 
-		f32 x;
-		f32 y;
-		f32 z;
+		s16 x;
+		s16 y;
+		s16 z;
 
-		void read (const std::vector<u8>& buffer, u32 offset) {
-			float scale = 0.01f; // Arbitrary scale value
-			x = getS16(buffer, offset + 0) * scale;
-			y = getS16(buffer, offset + 2) * scale;
-			z = getS16(buffer, offset + 4) * scale;
+		void read (const ByteView& buffer, u32 offset) {
+			x = getS16(buffer, offset + 0);
+			y = getS16(buffer, offset + 2);
+			z = getS16(buffer, offset + 4);
 		}
-	};
 
-	struct PolyVertex {
-		u16 vertexID;
-		u16 colorID;
-		u16 texCoordID;
+		/*
+		 * Positions are kept as stored.  This arbitrary scale takes them to
+		 * viewer units, and is left to the transform.
+		 */
 
-		void read (const std::vector<u8>& buffer, u32 offset, u32 mask) {
-			vertexID = getU16(buffer, offset);
-			texCoordID = getU16(buffer, offset + 2);
+		static f32 scale () {
+			return 0.01f;
 		}
 	};
 
-	struct Polygon {
+	struct Normal {
 
-		u32 addr;
+		f32 nx;
+		f32 ny;
+		f32 nz;
 
-		u16 u0x00;
-		u8 vertexCount;
-		std::vector<PolyVertex> vertices;
+		void read (const ByteView& buffer, u32 offset) {
+			float scale = 1.f / 16384.f; // 1.14 fixed point, assumed
+			nx = getS16(buffer, offset + 0) * scale;
+			ny = getS16(buffer, offset + 2) * scale;
+			nz = getS16(buffer, offset + 4) * scale;
+		}
+	};
 
-		void read (const std::vector<u8>& buffer, u32 offset, u32 mask) {
-			addr = offset;
+	struct VertexColor {
+
+		u8 r;
+		u8 g;
+		u8 b;
+		u8 a;
+
+		void read (const ByteView& buffer, u32 offset) {
+			r = buffer[offset + 0];
+			g = buffer[offset + 1];
+			b = buffer[offset + 2];
+			a = buffer[offset + 3];
+		}
+	};
 
-			u0x00 = getU16(buffer, offset + 0);
-			vertexCount = buffer[offset + 2];
+	struct TexCoord {
 
-			u16 bitcount = 0;
-			for (int i = 0; i < 8; i++) {
-				if (mask & (1 << i)) {
-					bitcount++;
-				}
-			}
+		f32 s;
+		f32 t;
 
-			vertices.resize(vertexCount);
-			for (int i = 0; i < vertexCount; i++) {
-				vertices[i].read(buffer, offset + 3 + (i * 2 * bitcount), mask);
-			}
+		void read (const ByteView& buffer, u32 offset) {
+			float scale = 1.f / 256.f; // 8.8 fixed point, assumed
+			s = getS16(buffer, offset + 0) * scale;
+			t = getS16(buffer, offset + 2) * scale;
 		}
 	};
 
@@ -339,19 +427,18 @@ public:
 
 		u32 addrData;
 		u32 length;
-		std::vector<u8> data;
 
-		void read(const std::vector<u8>& buffer, u32 offset) {
+		// Raw data .. for now.  A view into the world's file mapping;
+		// empty if the data runs past the end of the file.
+		ByteView data;
+
+		void read(const ByteView& buffer, u32 offset) {
 			addr = offset;
 
 			addrData = getU32(buffer, offset + 0);
 			length = getU32(buffer, offset + 4);
 
-			// Raw data .. for now
-			data.resize(length);
-			for (unsigned int i = 0; i < length; i++) {
-				data[i] = buffer[addrData + i];
-			}
+			data = buffer.sub(addrData, length);
 		}
 
 		std::string toString () const {
@@ -363,14 +450,22 @@ public:
 				if (i > 0) {
 					str << std::setw(19) << std::setfill(' ') << " ";
 				}
-				str << std::setfill('0');
+				// Format the row by hand; stream formatting per byte is
+				// most of the time it takes to write the info file
+				static const char digits[] = "0123456789ABCDEF";
+				char row[32 * 3 + 4 * 2];
+				unsigned int len = 0;
 				for (unsigned int j = 0; j < 32; j++) {
 					if (i + j >= data.size()) break;
-					str << std::setw(2) << std::hex << (int)data[i + j] << " ";
+					row[len++] = digits[data[i + j] >> 4];
+					row[len++] = digits[data[i + j] & 0xF];
+					row[len++] = ' ';
 					if (j % 8 == 7) {
-						str << "  ";
+						row[len++] = ' ';
+						row[len++] = ' ';
 					}
 				}
+				str.write(row, len);
 				str << std::endl;
 			}
 
@@ -389,28 +484,42 @@ public:
 		u32 u0x0C;
 
 		std::vector<MeshData> data;
-		std::vector<Polygon> polygons;
 
-		void read (const std::vector<u8>& buffer, u32 offset) {
+		// Every display list in data, decoded; see PMWorld::DecodeMesh
+		GXDecoder::Streams streams;
+
+		/*
+		 * Read the header and display list table at offset.  Returns false,
+		 * leaving the mesh empty, if either runs past the end of the buffer.
+		 */
+
+		bool read (const ByteView& buffer, u32 offset) {
 			id = 0;
 			addr = offset;
 
+			u0x00 = polyCount = elementMask = u0x0C = 0;
+			data.clear();
+			if (!buffer.contains(offset, 16)) {
+				return false;
+			}
+
+			u32 count = getU32(buffer, offset + 4);
+			if (count > (buffer.size() - offset - 16) / 8) {
+				return false;
+			}
+
 			u0x00 = getU32(buffer, offset + 0);
-			polyCount = getU32(buffer, offset + 4);
+			polyCount = count;
 			elementMask = getU32(buffer, offset + 8);
 			u0x0C = getU32(buffer, offset + 12);
 
+			// Each entry is the address and length of a display list
 			data.resize(polyCount);
-			polygons.resize(polyCount);
-
-			u32 polyOffset = offset + 16;
 			for (u32 i = 0; i < polyCount; i++) {
-				u32 polyAddr = getU32(buffer, polyOffset);
-				//u32 polyDataLen = getU32(buffer, polyOffset + 4);
-
-				polygons[i].read(buffer, polyAddr, elementMask);
-				polyOffset += 8;
+				data[i].read(buffer, offset + 16 + (i * 8));
 			}
+
+			return true;
 		}
 
 		static std::string headerString () {
@@ -473,14 +582,20 @@ public:
 		u32 u0x60;
 		u32 u0x64;
 
-		std::vector<Mesh> meshes;
-		u32 parentID;
-		u32 childID;
-		u32 nextID;
-		u32 prevID;
+		// Index into PMWorld::meshes and PMWorld::materials, and of the
+		// linked records, or -1
+		s32 meshID;
+		s32 materialID;
+		s32 parentID;
+		s32 childID;
+		s32 nextID;
+		s32 prevID;
+
+		Scenegraph ()
+			: id(0), addr(0), meshID(-1), materialID(-1), parentID(-1), childID(-1), nextID(-1), prevID(-1) {
+		}
 
-		void read (const std::vector<u8>& buffer, int offset) {
-			id = 0;
+		void read (const ByteView& buffer, int offset) {
 			addr = offset;
 
 			u32 addrStr1 = getU32(buffer, offset + 0);
@@ -512,43 +627,6 @@ public:
 
 			str1 = getString(buffer, addrStr1, 64);
 			str2 = getString(buffer, addrStr2, 64);
-
-			// Read mesh(es)
-			meshes.resize(u0x5C);
-			if (u0x5C != 0) {
-				meshes[0].read(buffer, u0x64);
-
-				// Mesh data
-				for (unsigned int j = 0; j < meshes[0].polyCount; j++) {
-					meshes[0].data[j].read(buffer, meshes[0].addr + 16 + (j * 8));
-				}
-			}
-		}
-
-		static void read (const std::vector<u8>& buffer, int offset, std::vector<Scenegraph>& sgrv, s32 parentID, s32 prevID) {
-			Scenegraph sgNode;
-			sgNode.read(buffer, offset);
-			sgNode.id = sgrv.size();
-
-			if (parentID != -1) {
-				sgNode.parentID = parentID;
-				sgrv[parentID].childID = sgNode.id;
-			}
-
-			if (prevID != -1) {
-				sgNode.prevID = prevID;
-				sgrv[prevID].nextID = sgNode.id;
-			}
-
-			sgrv.push_back(sgNode);
-
-			if (sgNode.addrChild != 0) {
-				Scenegraph::read(buffer, sgNode.addrChild, sgrv, sgNode.id, -1);
-			}
-
-			if (sgNode.addrNext != 0) {
-				Scenegraph::read(buffer, sgNode.addrNext, sgrv, -1, sgNode.id);
-			}
 		}
 
 		static std::string headerString () {
@@ -602,9 +680,30 @@ public:
 		}
 	};
 
+protected:
+
+	/*
+	 * A scenegraph record waiting to be read, with the records it links to.
+	 */
+
+	struct PendingRecord {
+		u32 addr;
+		s32 parentID;
+		s32 prevID;
+
+		PendingRecord (u32 a, s32 parent, s32 prev)
+			: addr(a), parentID(parent), prevID(prev) {
+		}
+	};
+
 public:
 
 	std::string filename;
+
+	// The whole file, mapped read-only.  Mesh data views point into it, so
+	// it lives as long as the world.
+	MappedFile mappedFile;
+
 	Header header;
 	InfoTable infoTable;
 	MaterialTable matTable;
@@ -614,91 +713,305 @@ public:
 	std::vector<Scenegraph> sgRecords;
 	std::vector<Mesh> meshes;
 	std::vector<Vertex> vertices;
-	std::map<u32, Material> materials;
+	std::vector<Normal> normals;
+	std::vector<VertexColor> colors[2];
+	std::vector<TexCoord> texCoords[8];
+	std::vector<Material> materials;
+
+	// When false, ReadSceneGraph leaves each mesh's streams empty and
+	// DecodeMesh is left to the caller, such as when streaming
+	bool decodeMeshes;
+
+	PMWorld ()
+		: decodeMeshes(true) {
+	}
 
 	bool LoadFile (const std::string& file) {
 		filename = file;
 
-		// Attempt to open file
-		std::ifstream filestr;
-		filestr.open(filename.c_str(), std::fstream::in | std::fstream::binary);
-		if (filestr.fail() || !filestr.is_open()) {
+		// Map file; addresses in the body are relative to the end of the
+		// 32 byte descriptor
+		if (!mappedFile.open(filename) || mappedFile.size() < Header::SIZE) {
 			return false;
 		}
 
-		// Get size of file
-		filestr.seekg(0, std::fstream::end);
-		int filesize = (int)filestr.tellg() - 32;
-		filestr.seekg(0, std::fstream::beg);
-
-		// Read first 32 bytes
-		std::vector<u8> descriptor(32);
-		filestr.read((char*)&descriptor[0], 32);
-
-		// Read file into buffer
-		std::vector<u8> buffer(filesize);
-		filestr.read((char*)&buffer[0], filesize);
-		filestr.close();
+		ByteView descriptor(mappedFile.data(), Header::SIZE);
+		ByteView buffer(mappedFile.data() + Header::SIZE, mappedFile.size() - Header::SIZE);
+		int filesize = buffer.size();
 
 		std::cout << "File Size: " << filesize << " bytes" << std::endl;
 
 		// Read Header
 		header.read(descriptor, 0);
 
-		// Read Tables
+		// Read Tables.  Every offset comes from the file, so each read is
+		// checked against the mapping before it is made
+		if (header.indexCount > buffer.size() / 4 || !buffer.contains(header.addrMasterIndex, 4 * header.indexCount)) {
+			std::cout << "(!!) Malformed master index" << std::endl;
+			return false;
+		}
+
 		u32 tableBase = header.addrMasterIndex + (4 * header.indexCount);
+		if (!buffer.contains(tableBase, 64)) {
+			std::cout << "(!!) Malformed table index" << std::endl;
+			return false;
+		}
+
 		u32 tableStringBase = tableBase + (header.tableIndexCount * 8);
 
 		u32 infoAddr = getU32(buffer, tableBase + 24);
 		u32 infoStringOffset = getU32(buffer, tableBase + 28);
-		infoTable.read(buffer, infoAddr);
+		if (!infoTable.read(buffer, infoAddr)) {
+			std::cout << "(!!) Malformed information table" << std::endl;
+			return false;
+		}
 		infoTable.name = getString(buffer, tableStringBase + infoStringOffset, 64);
 
 		u32 matAddr = getU32(buffer, tableBase + 40);
 		u32 matStringOffset = getU32(buffer, tableBase + 44);
-		matTable.read(buffer, matAddr);
+		if (!matTable.read(buffer, matAddr)) {
+			std::cout << "(!!) Malformed material table" << std::endl;
+		}
 		matTable.name = getString(buffer, tableStringBase + matStringOffset, 64);
 
 		u32 texAddr = getU32(buffer, tableBase + 48);
 		u32 texStringOffset = getU32(buffer, tableBase + 52);
-		texTable.read(buffer, texAddr);
+		if (!texTable.read(buffer, texAddr)) {
+			std::cout << "(!!) Malformed texture table" << std::endl;
+		}
 		texTable.name = getString(buffer, tableStringBase + texStringOffset, 64);
 
 		u32 vcdAddr = getU32(buffer, tableBase + 56);
 		u32 vcdStringOffset = getU32(buffer, tableBase + 60);
-		vcdTable.read(buffer, vcdAddr);
+		if (!vcdTable.read(buffer, vcdAddr)) {
+			std::cout << "(!!) Malformed VCD table" << std::endl;
+		}
 		vcdTable.name = getString(buffer, tableStringBase + vcdStringOffset, 64);
 
 		// Read Material Data
+		materials.resize(matTable.materialCount);
 		for (u32 i = 0; i < matTable.materialCount; i++) {
-			Material mat;
-			mat.read(buffer, matTable.materials[i].addr);
-			materials[matTable.materials[i].addr] = mat;
+			if (!materials[i].read(buffer, matTable.materials[i].addr)) {
+				std::cout << "(!!) Malformed material " << i << std::endl;
+			}
 		}
 
 		// Read VCD Data
-		u32 vertexCount = getU32(buffer, vcdTable.addrVertex);
-		vertices.resize(vertexCount);
-		for (unsigned int i = 0; i < vertexCount; i++) {
-			vertices[i].read(buffer, vcdTable.addrVertex + 4 + (i * 6));
+		ReadArray(buffer, vcdTable.addrVertex, 6, vertices);
+		ReadArray(buffer, vcdTable.addrNormal, 6, normals);
+		ReadArray(buffer, vcdTable.addrColor, 4, colors[0]);
+		ReadArray(buffer, vcdTable.addrColor1, 4, colors[1]);
+		for (u32 i = 0; i < 8; i++) {
+			ReadArray(buffer, vcdTable.addrTexCoord[i], 4, texCoords[i]);
 		}
 
-		// Read scenegraph
-		Scenegraph::read(buffer, infoTable.sgRootNode, sgRecords, -1, -1);
+		// Read scenegraph and meshes
+		if (!ReadSceneGraph(buffer, infoTable.sgRootNode)) {
+			std::cout << "(!!) Malformed scenegraph" << std::endl;
+		}
 
-		// Read meshes
-		for (unsigned int i = 0; i < sgRecords.size(); i++) {
-			if (sgRecords[i].u0x64 != 0) {
-				Mesh mesh;
-				mesh.read(buffer, sgRecords[i].u0x64);
-				mesh.id = meshes.size();
-
-				// Mesh data
-				for (unsigned int j = 0; j < mesh.polyCount; j++) {
-					mesh.data[j].read(buffer, mesh.addr + 16 + (j * 8));
+		ResolveMaterials();
+
+		u32 meshDataCount = 0;
+		u32 meshDataBytes = 0;
+		for (u32 i = 0; i < meshes.size(); i++) {
+			for (u32 j = 0; j < meshes[i].data.size(); j++) {
+				meshDataCount++;
+				meshDataBytes += meshes[i].data[j].data.size();
+			}
+		}
+
+		std::cout << "Mesh Data: " << meshDataBytes << " bytes in " << meshDataCount
+				<< " blocks, viewed in place" << std::endl;
+
+		return true;
+	}
+
+	/*
+	 * Read the scenegraph rooted at rootAddr into sgRecords, and each
+	 * record's mesh into meshes, in one walk with an explicit stack.
+	 * Records are stored depth-first, children before siblings, which is
+	 * the order a recursive walk would give.  A quick walk over the link
+	 * fields alone counts the records and meshes first, so both tables
+	 * are sized once and filled in place.  Returns false, keeping what was
+	 * read, if a link leaves the buffer or the records loop.
+	 */
+
+	bool ReadSceneGraph (const ByteView& buffer, u32 rootAddr) {
+		sgRecords.clear();
+		meshes.clear();
+
+		u32 recordCount = 0;
+		u32 meshCount = 0;
+		bool valid = CountSceneGraph(buffer, rootAddr, recordCount, meshCount);
+
+		sgRecords.resize(recordCount);
+		meshes.resize(meshCount);
+
+		std::vector<PendingRecord> pending;
+		if (recordCount > 0) {
+			pending.push_back(PendingRecord(rootAddr, -1, -1));
+		}
+
+		u32 nextRecord = 0;
+		u32 nextMesh = 0;
+
+		while (!pending.empty() && nextRecord < recordCount) {
+			PendingRecord p = pending.back();
+			pending.pop_back();
+
+			Scenegraph& sgr = sgRecords[nextRecord];
+			sgr.read(buffer, p.addr);
+			sgr.id = nextRecord++;
+
+			// Siblings share the parent; only the first is its child link
+			if (p.parentID != -1) {
+				sgr.parentID = p.parentID;
+				if (p.prevID == -1) {
+					sgRecords[p.parentID].childID = sgr.id;
+				}
+			}
+			if (p.prevID != -1) {
+				sgr.prevID = p.prevID;
+				sgRecords[p.prevID].nextID = sgr.id;
+			}
+
+			if (sgr.u0x64 != 0 && nextMesh < meshCount) {
+				if (!meshes[nextMesh].read(buffer, sgr.u0x64)) {
+					std::cout << "(!!) Malformed mesh at " << std::hex << sgr.u0x64 << std::dec << std::endl;
 				}
+				meshes[nextMesh].id = nextMesh;
+				if (decodeMeshes) {
+					DecodeMesh(meshes[nextMesh]);
+				}
+				sgr.meshID = nextMesh++;
+			}
+
+			// Push the sibling first so the child's subtree is read before it
+			if (sgr.addrNext != 0) {
+				pending.push_back(PendingRecord(sgr.addrNext, p.parentID, sgr.id));
+			}
+			if (sgr.addrChild != 0) {
+				pending.push_back(PendingRecord(sgr.addrChild, sgr.id, -1));
+			}
+		}
+
+		return valid;
+	}
+
+	/*
+	 * Resolve each record's material address (u0x60) to an index into
+	 * materials, so nothing past loading has to look materials up by
+	 * address.  Records naming no known material get -1.
+	 */
+
+	void ResolveMaterials () {
+		std::map<u32, s32> materialIDs;
+		for (u32 i = 0; i < materials.size(); i++) {
+			materialIDs[materials[i].addr] = i;
+		}
+
+		for (u32 i = 0; i < sgRecords.size(); i++) {
+			std::map<u32, s32>::const_iterator iter = materialIDs.find(sgRecords[i].u0x60);
+			sgRecords[i].materialID = (iter != materialIDs.end()) ? iter->second : -1;
+		}
+	}
 
-				meshes.push_back(mesh);
+	/*
+	 * Decode a mesh's display lists into its vertex streams, checking
+	 * every index against the attribute arrays.  Decoding into separate
+	 * streams only reads the world, so different meshes can be decoded on
+	 * different threads.
+	 */
+
+	void DecodeMesh (Mesh& mesh) const {
+		DecodeMesh(mesh, mesh.streams);
+	}
+
+	void DecodeMesh (const Mesh& mesh, GXDecoder::Streams& streams) const {
+		u32 limits[GXDecoder::NUM_ATTRIBUTES];
+		AttributeLimits(limits);
+
+		for (u32 i = 0; i < mesh.data.size(); i++) {
+			if (!GXDecoder::decode(mesh.data[i].data, mesh.elementMask, limits, streams)) {
+				std::cout << "(!!) Malformed display list in mesh " << mesh.id << ": " << i << std::endl;
+			}
+		}
+	}
+
+	/*
+	 * The size of the array each GX attribute indexes, for the decoder.
+	 */
+
+	void AttributeLimits (u32* limits) const {
+		limits[GXDecoder::POSITION] = vertices.size();
+		limits[GXDecoder::NORMAL] = normals.size();
+		limits[GXDecoder::COLOR0] = colors[0].size();
+		limits[GXDecoder::COLOR1] = colors[1].size();
+		for (u32 i = 0; i < 8; i++) {
+			limits[GXDecoder::TEXCOORD0 + i] = texCoords[i].size();
+		}
+	}
+
+	/*
+	 * Read a count-prefixed attribute array of stride-byte entries.  An
+	 * array that would run past the end of the buffer is left empty.
+	 */
+
+	template <class T>
+	static void ReadArray (const ByteView& buffer, u32 addr, u32 stride, std::vector<T>& out) {
+		out.clear();
+		if (addr == 0 || !buffer.contains(addr, 4)) {
+			return;
+		}
+
+		u32 count = getU32(buffer, addr);
+		if (count > (buffer.size() - addr - 4) / stride) {
+			std::cout << "(!!) Malformed vertex array at " << std::hex << addr << std::dec << std::endl;
+			return;
+		}
+
+		out.resize(count);
+		for (u32 i = 0; i < count; i++) {
+			out[i].read(buffer, addr + 4 + (i * stride));
+		}
+	}
+
+	/*
+	 * Count the records and meshes reachable from rootAddr, following only
+	 * the link fields.  Stops at the first record outside the buffer, or
+	 * once there are more records than the buffer could hold.
+	 */
+
+	static bool CountSceneGraph (const ByteView& buffer, u32 rootAddr, u32& recordCount, u32& meshCount) {
+		recordCount = 0;
+		meshCount = 0;
+
+		const u32 maxRecords = buffer.size() / Scenegraph::SIZE;
+
+		std::vector<u32> pending;
+		pending.push_back(rootAddr);
+
+		while (!pending.empty()) {
+			u32 addr = pending.back();
+			pending.pop_back();
+
+			if (!buffer.contains(addr, Scenegraph::SIZE) || recordCount >= maxRecords) {
+				return false;
+			}
+
+			recordCount++;
+			if (getU32(buffer, addr + 100) != 0) {
+				meshCount++;
+			}
+
+			u32 addrNext = getU32(buffer, addr + 16);
+			u32 addrChild = getU32(buffer, addr + 12);
+			if (addrNext != 0) {
+				pending.push_back(addrNext);
+			}
+			if (addrChild != 0) {
+				pending.push_back(addrChild);
 			}
 		}
 
@@ -741,9 +1054,8 @@ public:
 		filestr << vcdTable.toString() << std::endl << std::endl;
 
 		filestr << blockHeader("Materials", Material::headerString());
-		std::map<u32, Material>::iterator matIter;
-		for (matIter = materials.begin(); matIter != materials.end(); matIter++) {
-			filestr << matIter->second.toString() << std::endl;
+		for (unsigned int i = 0; i < materials.size(); i++) {
+			filestr << materials[i].toString() << std::endl;
 		}
 
 		filestr << blockHeader("Scene Graph", Scenegraph::headerString());
@@ -29,116 +29,609 @@
 #include <SFML/System.hpp>
 #include <SFML/Window.hpp>
 #include <iostream>
+#include <sstream>
 #include <vector>
+#include <map>
+#include <algorithm>
 #include "vecmath/Vecmath.h"
 #include "renderer/RenderGL.h"
+#include "renderer/Scenegraph.h"
+#include "renderer/BVH.h"
+#include "renderer/TextureUploader.h"
+#include "system/TaskPool.h"
+#include "AppState.h"
 #include "PMWorld.h"
+#include "PMWorldStreamer.h"
 #include "TPL.h"
 #include "common.h"
 
-class PMWorldGL : public PMWorld {
+class PMWorldGL : public PMWorld, public PMWorldStreamer::Source {
 public:
 
 	TPL tpl;
-	std::vector<GLuint> glTextures;
+
+	gfx::Scenegraph scenegraph;
+	gfx::RenderGL renderer;
+	gfx::BVH bvh;
+	TaskPool* taskPool;
+
+	// Textures are uploaded a budgeted number of bytes per frame
+	gfx::TextureUploader textureUploader;
+	u32 textureBytesPerFrame;
+
+	// Set before LoadFile to stream meshes and textures in by region
+	// rather than decoding and uploading the whole map up front
+	bool streaming;
+	PMWorldStreamer::Settings streamSettings;
+	PMWorldStreamer streamer;
+
+	// Started by LoadFile, reported on the first Draw and once every
+	// queued texture is uploaded
+	sf::Clock loadClock;
+	bool firstFrame;
+	bool texturesPending;
+
+	// Set before Init to draw each record's mesh as geometry of its own
+	// rather than merged per texture, such as for records that move after
+	// loading.  Batches are cut on a grid of batchCellSize world units;
+	// zero makes it a quarter of the map's width.  Streamed maps are never
+	// batched
+	bool batching;
+	f32 batchCellSize;
+
+	// Node created for each scenegraph record
+	std::vector<int> recordNodes;
 
 	std::string errorMessage;
 
+protected:
+
+	/*
+	 * A record's mesh waiting to be merged into a batch, with the node
+	 * that places it.
+	 */
+
+	struct BatchItem {
+		int node;
+		s32 meshID;
+		s32 textureID;
+		gfx::BoundAABB bound;
+	};
+
+	std::vector<BatchItem> batchItems;
+
+	/*
+	 * Grows a box over the positions GXDecoder::scan visits.
+	 */
+
+	struct PositionBound {
+		const std::vector<Vertex>& vertices;
+		vmath::Vector3f vmin;
+		vmath::Vector3f vmax;
+		bool empty;
+
+		PositionBound (const std::vector<Vertex>& v)
+			: vertices(v), empty(true) {
+		}
+
+		void operator() (u32 index) {
+			const Vertex& vertex = vertices[index];
+			if (empty) {
+				vmin.set(vertex.x, vertex.y, vertex.z);
+				vmax = vmin;
+				empty = false;
+				return;
+			}
+			vmin.set(std::min<f32>(vmin.x, vertex.x), std::min<f32>(vmin.y, vertex.y), std::min<f32>(vmin.z, vertex.z));
+			vmax.set(std::max<f32>(vmax.x, vertex.x), std::max<f32>(vmax.y, vertex.y), std::max<f32>(vmax.z, vertex.z));
+		}
+	};
+
 public:
 
-	void Init() {
+	PMWorldGL ()
+		: taskPool(NULL), textureBytesPerFrame(1024 * 1024), streaming(false), firstFrame(true),
+		  texturesPending(false), batching(true), batchCellSize(0.f) {
+	}
+
+	virtual ~PMWorldGL () {
+		streamer.shutdown();
+		textureUploader.shutdown();
+		delete taskPool;
+	}
+
+	void Init () {
+		AppState& state = AppState::getState();
+		renderer.camera(&state.camera);
+		renderer.scenegraph(&scenegraph);
+
+		if (taskPool == NULL) {
+			taskPool = new TaskPool(TaskPool::defaultWorkerCount());
+		}
+		textureUploader.init(taskPool, textureBytesPerFrame);
+
+		parseTextures();
+		parseSceneGraph();
+
+		scenegraph.update();
+		batchGeometry();
+
+		renderer.uploadMeshes();
+		scenegraph.update();
+
+		std::cout << "World Scenegraph: " << scenegraph.size() << " nodes, "
+				<< scenegraph.getGeometryCount() << " geometry" << std::endl;
+
+		if (streaming) {
+			setupStreaming();
+			return;
+		}
+
+		u32 shortCount = 0;
+		u32 floatCount = 0;
+		for (u32 i = 0; i < scenegraph.getGeometryCount(); i++) {
+			shortCount += scenegraph.getGeometry(i)->mesh()->getShortVertexList().size();
+			floatCount += scenegraph.getGeometry(i)->mesh()->getVertexList().size();
+		}
 
+		std::cout << "World Positions: " << shortCount << " vertices as GL_SHORT, " << floatCount
+				<< " as float, " << (shortCount * sizeof(gfx::vertex3s) + floatCount * sizeof(gfx::vertex3f)) / 1024
+				<< " KB" << std::endl;
+
+		buildBVH();
+	}
+
+	/*
+	 * Build the BVH the renderer culls with, splitting the work across a
+	 * task pool.  The map is static, so this is done once.
+	 */
+
+	void buildBVH () {
+		sf::Clock clock;
+		bvh.build(scenegraph, taskPool);
+		float ms = clock.getElapsedTime().asSeconds() * 1000.f;
+
+		renderer.bvh(&bvh);
+
+		std::cout << "World BVH: " << bvh.getNodes().size() << " nodes over " << bvh.getItemCount()
+				<< " geometry, depth " << bvh.getDepth() << ", built in " << ms << " ms on "
+				<< taskPool->getWorkerCount() + 1 << " threads" << std::endl;
+	}
+
+	/*
+	 * Measure the map and cut it into chunks for streaming.  Geometry
+	 * bounds change as chunks come and go, so the renderer culls by walking
+	 * the scenegraph rather than with a BVH.
+	 */
+
+	void setupStreaming () {
+		sf::Clock clock;
+		streamer.setup(&scenegraph, this, &renderer, &textureUploader, taskPool, streamSettings);
+		float ms = clock.getElapsedTime().asSeconds() * 1000.f;
+
+		renderer.bvh(NULL);
+
+		const PMWorldStreamer::Settings& settings = streamer.getSettings();
+		std::cout << "World Streaming: " << streamer.getChunkCount() << " chunks of " << settings.chunkSize
+				<< " units, load within " << settings.loadDistance << ", unload past " << settings.unloadDistance
+				<< ", budget " << settings.budgetBytes / 1024 << " KB, measured in " << ms << " ms" << std::endl;
+	}
+
+	/*
+	 * Bring world matrices and bounds up to date.  Only nodes whose
+	 * transforms changed since the last update are recomputed, so a static
+	 * map costs one pass over the node flags.  When streaming, chunks are
+	 * loaded and evicted around the eye first.  Queued textures are
+	 * uploaded last, within their per-frame budget.
+	 */
+
+	void Update (float) {
+		if (streaming) {
+			vmath::Vector3f eye;
+			if (eyePosition(eye)) {
+				streamer.update(eye);
+			}
+		}
+
+		scenegraph.update();
+		textureUploader.update();
+
+		if (texturesPending && textureUploader.isIdle()) {
+			texturesPending = false;
+			std::cout << "World textures: uploaded " << loadClock.getElapsedTime().asSeconds() * 1000.f
+					<< " ms after load started" << std::endl;
+		}
 	}
 
 	void Draw () {
-		//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		drawSceneGraph(sgRecords[0]);
+		renderer.drawGeometry();
 
-		/*glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		for (u32 i = 0; i < meshes.size(); i++) {
-			const Mesh& mesh = meshes[i];
+		if (firstFrame) {
+			firstFrame = false;
+			std::cout << "World first frame: " << loadClock.getElapsedTime().asSeconds() * 1000.f
+					<< " ms after load started" << std::endl;
+		}
+	}
 
-			for (u32 j = 0; j < mesh.polyCount; j++) {
-				const Polygon& polygon = mesh.polygons[j];
-				glBegin(GL_TRIANGLE_STRIP);
+	/*
+	 * The eye in world space, from the inverse of the camera's view
+	 * transform.  Returns false until the camera has a valid transform.
+	 */
 
-				for (u32 k = 0; k < polygon.vertexCount; k++) {
-					const PolyVertex& pvertex = polygon.vertices[k];
-					const Vertex& vertex = vertices[pvertex.vertexID];
+	static bool eyePosition (vmath::Vector3f& eye) {
+		vmath::Matrix4f view = AppState::getState().camera.getCameraTransform();
 
-					glVertex3f(vertex.x, vertex.y, vertex.z);
-				}
-				glEnd();
+		try {
+			view.invertAffine();
+		}
+		catch (const vmath::Matrix4f::SingularException&) {
+			return false;
+		}
+
+		eye.set(view(0, 3), view(1, 3), view(2, 3));
+		return true;
+	}
+
+	/*
+	 * Report how much of the map the last frame culled.
+	 */
+
+	std::string GetInfoString () {
+		const gfx::RenderGL::RenderStats& stats = renderer.getStats();
+		unsigned total = scenegraph.getGeometryCount();
+
+		std::stringstream str;
+		str << "Drawn: " << stats.drawCalls << "/" << total;
+		if (total > 0) {
+			str << " | Culled: " << (100 * stats.culledGeometry / total) << "%";
+		}
+		if (!textureUploader.isIdle()) {
+			str << " | Textures pending: " << textureUploader.getPendingCount();
+		}
+		if (streaming) {
+			str << " | Chunks: " << streamer.getResidentCount() << "/" << streamer.getChunkCount()
+					<< " (" << streamer.getResidentBytes() / 1024 << " KB)";
+		}
+		else {
+			str << " | BVH nodes rejected: " << stats.culledNodes;
+		}
+
+		return str.str();
+	}
+
+	/*
+	 * Build a renderable Scenegraph node for each record.  Records are
+	 * stored depth-first with parents first, which is the order the
+	 * Scenegraph pool requires, so each record's node is created as a
+	 * child of its parent record's node.  Top level records hang off the
+	 * Scenegraph root.
+	 */
+
+	void parseSceneGraph () {
+		recordNodes.assign(sgRecords.size(), -1);
+		scenegraph.reserve(sgRecords.size() * 2 + 1);
+
+		for (u32 i = 0; i < sgRecords.size(); i++) {
+			const Scenegraph& sgr = sgRecords[i];
+
+			int parent = (sgr.parentID == -1) ? scenegraph.root() : recordNodes[sgr.parentID];
+			int node = scenegraph.newChild(parent);
+
+			scenegraph.getNode(node).setTransform(recordTransform(sgr));
+			recordNodes[i] = node;
+
+			parseGeometry(node, sgr);
+		}
+	}
+
+	/*
+	 * The record's local transform.  Records translate by u30, scale by
+	 * u18, translate by u48, rotate by the ZYX Euler angles at u24 and
+	 * translate by u3C, in that order.  Moving both inner translations out
+	 * past the scale and rotation leaves a single T * S * R.
+	 */
+
+	static vmath::TRSf recordTransform (const Scenegraph& sgr) {
+		vmath::TRSf trs;
+		trs.rotation.setEulerZYX(vmath::Vector3f(sgr.u0x24, sgr.u0x28, sgr.u0x2C));
+		trs.scale.set(sgr.u0x18, sgr.u0x1C, sgr.u0x20);
+
+		vmath::Vector3f pivot(sgr.u0x3C, sgr.u0x40, sgr.u0x44);
+		trs.rotation.transform(pivot);
+		pivot += vmath::Vector3f(sgr.u0x48, sgr.u0x4C, sgr.u0x50);
+
+		trs.translation.set(sgr.u0x30 + sgr.u0x18 * pivot.x, sgr.u0x34 + sgr.u0x1C * pivot.y,
+				sgr.u0x38 + sgr.u0x20 * pivot.z);
+
+		return trs;
+	}
+
+	/*
+	 * Attach the record's mesh, if it draws one.  Positions stay 16-bit,
+	 * so the geometry hangs off a child node that carries the vertex scale,
+	 * which the record's own children must not inherit.  When streaming,
+	 * the geometry starts hidden with an empty mesh for the streamer to
+	 * fill.  When batching, the mesh is left for batchGeometry to merge.
+	 */
+
+	void parseGeometry (int node, const Scenegraph& sgr) {
+		if (sgr.u0x5C == 0 || sgr.meshID == -1) {
+			return;
+		}
+
+		const Mesh& mesh = meshes[sgr.meshID];
+		if (!streaming && (!mesh.streams.has(GXDecoder::POSITION) || mesh.streams.triangles.empty())) {
+			return;
+		}
+
+		int meshNode = scenegraph.newChild(node);
+		scenegraph.getNode(meshNode).setScale(vmath::Vector3f(Vertex::scale()));
+
+		s32 textureID = -1;
+		if (sgr.materialID != -1) {
+			s32 id = materials[sgr.materialID].textureID;
+			if (id >= 0 && u32(id) < renderer.getTextureSlotCount() && renderer.getTexture(id) != NULL) {
+				textureID = id;
 			}
-		}*/
-		/*glBegin(GL_POINTS);
-		for (unsigned int i = 0; i < vertices.size(); i++) {
-			glVertex3f(vertices[i].x, vertices[i].y, vertices[i].z);
 		}
-		glEnd();*/
+
+		if (batching && !streaming) {
+			BatchItem item;
+			item.node = meshNode;
+			item.meshID = sgr.meshID;
+			item.textureID = textureID;
+			batchItems.push_back(item);
+			return;
+		}
+
+		gfx::Geometry geo;
+		geo.spacialNode = meshNode;
+		if (textureID != -1) {
+			geo.texture = renderer.getTexture(textureID);
+		}
+
+		gfx::TriMesh renderMesh;
+		if (streaming) {
+			geo.visible = false;
+		}
+		else {
+			parseMesh(mesh.streams, geo.hasTexture(), renderMesh);
+		}
+		geo.mesh(renderer.addMesh(renderMesh));
+
+		gfx::Geometry* geoPtr = renderer.addGeometry(geo);
+		scenegraph.addGeometry(meshNode, geoPtr);
+
+		if (streaming) {
+			streamer.addItem(geoPtr, sgr.meshID);
+		}
 	}
 
-	void drawSceneGraph (const Scenegraph& sgr) {
-		glPushMatrix();
+	/*
+	 * Merge the meshes parseGeometry set aside into one mesh per texture
+	 * in each cell of a grid over the XZ plane, with positions baked into
+	 * world space.  A frame then draws at most one batch per texture per
+	 * cell in view instead of one geometry per record, and culling still
+	 * works cell by cell.  Each cell's batches hang off a node of their
+	 * own under the root.  World matrices must be current.
+	 */
+
+	void batchGeometry () {
+		if (batchItems.empty()) {
+			return;
+		}
 
+		// Place each item by the center of its world bound
+		gfx::BoundAABB mapBound;
+		for (u32 i = 0; i < batchItems.size(); i++) {
+			BatchItem& item = batchItems[i];
+			const GXDecoder::Streams& streams = meshes[item.meshID].streams;
 
+			PositionBound positions(vertices);
+			for (u32 v = 0; v < streams.vertexCount; v++) {
+				positions(streams.indices[GXDecoder::POSITION][v]);
+			}
+			item.bound.set(positions.vmin, positions.vmax);
+			item.bound.transform(vmath::Matrix4f(scenegraph.getNode(item.node).getWorldMatrix()));
+			mapBound.addBound(item.bound);
+		}
 
-		glTranslatef(sgr.u0x30, sgr.u0x34, sgr.u0x38);
+		const vmath::Vector3f& extants = mapBound.extants();
+		f32 cellSize = batchCellSize;
+		if (cellSize <= 0.f) {
+			cellSize = std::max(std::max(extants.x, extants.z) * 2.f / 4.f, 1.f);
+		}
+		vmath::Vector3f origin = mapBound.center() - extants;
+
+		// Keyed by cell row, column and texture, so batches come out in
+		// cell order as the scenegraph pool needs
+		typedef std::pair<std::pair<s32, s32>, s32> BatchKey;
+		std::map<BatchKey, std::vector<u32> > batches;
+		for (u32 i = 0; i < batchItems.size(); i++) {
+			const vmath::Vector3f& c = batchItems[i].bound.center();
+			std::pair<s32, s32> cell((s32)((c.z - origin.z) / cellSize), (s32)((c.x - origin.x) / cellSize));
+			batches[BatchKey(cell, batchItems[i].textureID)].push_back(i);
+		}
 
-		glScalef(sgr.u0x18, sgr.u0x1C, sgr.u0x20);
+		int cellNode = -1;
+		std::pair<s32, s32> lastCell(-1, -1);
+		std::vector<f32> points;
 
+		for (std::map<BatchKey, std::vector<u32> >::const_iterator iter = batches.begin(); iter != batches.end(); ++iter) {
+			if (cellNode == -1 || iter->first.first != lastCell) {
+				cellNode = scenegraph.newChild(scenegraph.root());
+				lastCell = iter->first.first;
+			}
 
-		glTranslatef(sgr.u0x48, sgr.u0x4C, sgr.u0x50);
-		//glRotatef(sgr.u0x2C, 0.f, 0.f, 1.f);
-		//glRotatef(sgr.u0x28, 0.f, 1.f, 0.f);
-		//glRotatef(sgr.u0x24, 1.f, 0.f, 0.f);
-		glTranslatef(sgr.u0x3C, sgr.u0x40, sgr.u0x44);
+			gfx::Geometry geo;
+			geo.spacialNode = cellNode;
+			if (iter->first.second != -1) {
+				geo.texture = renderer.getTexture(iter->first.second);
+			}
 
+			gfx::TriMesh batch;
+			batch.useVertices(true);
+			batch.useShortVertices(false);
+			batch.useNormals(false);
+			batch.useTexCoords(geo.hasTexture());
+
+			for (u32 i = 0; i < iter->second.size(); i++) {
+				const BatchItem& item = batchItems[iter->second[i]];
+				const GXDecoder::Streams& streams = meshes[item.meshID].streams;
+
+				points.resize(streams.vertexCount * 3);
+				for (u32 v = 0; v < streams.vertexCount; v++) {
+					const Vertex& vertex = vertices[streams.indices[GXDecoder::POSITION][v]];
+					points[v * 3 + 0] = vertex.x;
+					points[v * 3 + 1] = vertex.y;
+					points[v * 3 + 2] = vertex.z;
+				}
+				// World matrices are in GL order; transformPoints takes rows
+				if (!points.empty()) {
+					vmath::MatrixG4f world(scenegraph.getNode(item.node).getWorldMatrix());
+					world.transpose();
+					world.transformPoints(&points[0], streams.vertexCount, &points[0]);
+				}
 
-		if (sgr.u0x5C != 0) {
-			const Material& material = materials[sgr.u0x60];
+				parseMesh(streams, geo.hasTexture(), batch, &points);
+			}
 
-			drawMesh(sgr.meshes[0], material);
+			geo.mesh(renderer.addMesh(batch));
+			scenegraph.addGeometry(cellNode, renderer.addGeometry(geo));
 		}
 
-		glPopMatrix();
+		std::cout << "World Batches: " << batchItems.size() << " meshes merged into " << batches.size()
+				<< " batches over cells of " << cellSize << " units" << std::endl;
+
+		batchItems.clear();
+	}
+
+	/*
+	 * Bound a mesh's in-range positions for the streamer, and size its
+	 * buffers from the vertex and triangle counts, scanning the display
+	 * lists rather than decoding them.  Both may overestimate a mesh with
+	 * bad indices.  Called on worker threads; only reads the world.
+	 */
 
-		if (sgr.addrChild != 0) {
-			drawSceneGraph(sgRecords[sgr.childID]);
+	bool measureMesh (u32 key, gfx::BoundAABB& bound, u32& bytes) const {
+		const Mesh& mesh = meshes[key];
+
+		u32 limits[GXDecoder::NUM_ATTRIBUTES];
+		AttributeLimits(limits);
+
+		PositionBound positions(vertices);
+		u32 vertexCount = 0;
+		u32 triangleCount = 0;
+		for (u32 i = 0; i < mesh.data.size(); i++) {
+			GXDecoder::scan(mesh.data[i].data, mesh.elementMask, limits, positions, vertexCount, triangleCount);
 		}
 
-		//glPopMatrix();
+		if (positions.empty || triangleCount == 0) {
+			return false;
+		}
+		bound.set(positions.vmin, positions.vmax);
 
-		if (sgr.addrNext != 0) {
-			drawSceneGraph(sgRecords[sgr.nextID]);
+		u32 vertexBytes = sizeof(gfx::vertex3s) + sizeof(gfx::color4ub);
+		if (mesh.elementMask & GXDecoder::format(GXDecoder::TEXCOORD0).maskBit) {
+			vertexBytes += sizeof(gfx::texCoord2f);
 		}
+		bytes = vertexCount * vertexBytes + triangleCount * 3 * sizeof(GLuint);
+
+		return true;
 	}
 
-	void drawMesh (const Mesh& mesh, const Material& material) {
+	void buildMesh (u32 key, bool textured, gfx::TriMesh& out) const {
+		GXDecoder::Streams streams;
+		DecodeMesh(meshes[key], streams);
+		parseMesh(streams, textured, out);
+	}
 
-		if (material.textureID >= 0) {
-			glEnable(GL_TEXTURE_2D);
-			glBindTexture(GL_TEXTURE_2D, glTextures[material.textureID]);
+	/*
+	 * Add a mesh's vertices and triangles to renderMesh.  Positions are
+	 * kept 16-bit, unless worldPoints gives them already transformed, as
+	 * packed floats, to append to a batch.
+	 */
+
+	void parseMesh (const GXDecoder::Streams& streams, bool textured, gfx::TriMesh& renderMesh,
+			const std::vector<f32>* worldPoints = NULL) const {
+		bool hasColor = streams.has(GXDecoder::COLOR0);
+		bool hasTexCoord = streams.has(GXDecoder::TEXCOORD0);
+		u32 base = renderMesh.getVertexCount();
+
+		if (worldPoints == NULL) {
+			renderMesh.useVertices(false);
+			renderMesh.useShortVertices(true);
+			renderMesh.useNormals(false);
+			renderMesh.useTexCoords(textured);
 		}
 
-		for (u32 j = 0; j < mesh.polyCount; j++) {
-			const Polygon& polygon = mesh.polygons[j];
-			glBegin(GL_TRIANGLE_STRIP);
+		// The decoder keeps only vertices whose indices are all in range
+		for (u32 v = 0; v < streams.vertexCount; v++) {
+			gfx::vertexDef vdef;
+
+			if (worldPoints != NULL) {
+				vdef.vertex = gfx::vertex3f((*worldPoints)[v * 3], (*worldPoints)[v * 3 + 1], (*worldPoints)[v * 3 + 2]);
+			}
+			else {
+				const Vertex& vertex = vertices[streams.indices[GXDecoder::POSITION][v]];
+				vdef.shortVertex = gfx::vertex3s(vertex.x, vertex.y, vertex.z);
+			}
 
-			for (u32 k = 0; k < polygon.vertexCount; k++) {
-				const PolyVertex& pvertex = polygon.vertices[k];
-				const Vertex& vertex = vertices[pvertex.vertexID];
+			if (hasColor) {
+				const VertexColor& c = colors[0][streams.indices[GXDecoder::COLOR0][v]];
+				vdef.color = gfx::color4ub(c.r, c.g, c.b, c.a);
+			}
 
-				glVertex3f(vertex.x, vertex.y, vertex.z);
-				glTexCoord2f(vertex.x, vertex.y);
+			if (hasTexCoord) {
+				const TexCoord& tc = texCoords[0][streams.indices[GXDecoder::TEXCOORD0][v]];
+				vdef.texCoord = gfx::texCoord2f(tc.s, tc.t);
 			}
-			glEnd();
+
+			renderMesh.addVertex(vdef);
 		}
 
-		glDisable(GL_TEXTURE_2D);
+		for (u32 i = 0; i + 2 < streams.triangles.size(); i += 3) {
+			renderMesh.addIndexTriangle(base + streams.triangles[i], base + streams.triangles[i + 1],
+					base + streams.triangles[i + 2]);
+		}
+	}
+
+	/*
+	 * Create a texture for each TPL entry.  Outside streaming mode every
+	 * texture is queued for upload at once; geometry draws with the
+	 * placeholder until its texture arrives.
+	 */
+
+	void parseTextures () {
+		u32 count = std::min<u32>(texTable.textureCount, tpl._textures.size());
+
+		for (u32 i = 0; i < count; i++) {
+			gfx::TextureData texData(GL_RGBA, tpl._textures[i].texHeader.width,
+					tpl._textures[i].texHeader.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+					0, tpl._textures[i].tex);
+			gfx::Texture tex(GL_TEXTURE_2D, texData, false);
+
+			renderer.addTexture(tex);
+		}
+
+		// The streamer queues textures as chunks come in
+		if (!streaming) {
+			for (u32 i = 0; i < renderer.getTextureSlotCount(); i++) {
+				gfx::Texture* tex = renderer.getTexture(i);
+				if (tex != NULL) {
+					textureUploader.queue(tex);
+					texturesPending = true;
+				}
+			}
+		}
 	}
 
 	bool LoadFile (const std::string& file) {
+		loadClock.restart();
+
+		// The streamer decodes meshes as their chunks come in range
+		decodeMeshes = !streaming;
+
 		if (!PMWorld::LoadFile(file)) {
 			errorMessage.append("could not open world file '" + filename + "';");
 			return false;
@@ -159,40 +652,9 @@ public:
 			return false;
 		}
 
-		LoadTextures();
 		return true;
 	}
 
-	void LoadTextures () {
-		glTextures.resize(tpl._header.nTextures);
-		glGenTextures(tpl._header.nTextures, &glTextures[0]);
-
-		//for (unsigned int i = 0; i < tpl._header.nTextures; i++) {
-		for (unsigned int i = 0; i < texTable.textureCount; i++) {
-			int ti = i;
-			glBindTexture(GL_TEXTURE_2D, glTextures[ti]);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-			//switch (texMaps[i].u0x04) {
-			//	case 0x00:
-			//		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-			//		break;
-			//	case 0x03:
-					glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-			//		break;
-			//	default:
-			//		std::cout << "(!!) Unknown tex env mode: " << texMaps[i].u0x04 << std::endl;
-			//}
-
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-					tpl._textures[ti].texHeader.width, tpl._textures[ti].texHeader.height,
-					0, GL_RGBA, GL_UNSIGNED_BYTE, &tpl._textures[ti].tex._data[0]);
-		}
-	}
-
 	void drawWireBox (const vmath::Vector3f& vmin, const vmath::Vector3f& vmax) const {
 		glBegin(GL_LINE_LOOP);
 			glVertex3f(vmin.x, vmin.y, vmin.z);
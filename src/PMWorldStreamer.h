@@ -0,0 +1,602 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PMWORLDSTREAMER_H_
+#define PMWORLDSTREAMER_H_
+
+#include <SFML/System.hpp>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include "renderer/RenderGL.h"
+#include "renderer/Scenegraph.h"
+#include "renderer/Geometry.h"
+#include "renderer/BoundAABB.h"
+#include "renderer/TextureUploader.h"
+#include "system/TaskPool.h"
+#include "vecmath/Vecmath.h"
+#include "common.h"
+
+/**
+ * Streams the meshes and textures of a large map in and out by region.
+ *
+ * Geometry is grouped into chunks on a grid over the XZ plane, by the
+ * center of each geometry's world bound.  Each frame, chunks nearer the
+ * eye than the load distance are decoded on a TaskPool and uploaded on the
+ * calling thread, a few per frame; chunks beyond the unload distance, or
+ * the farthest ones when over the memory budget, are evicted.  Textures
+ * are reference counted across the chunks that use them, and queued on a
+ * TextureUploader when one is given.  Distances are measured across the
+ * XZ plane, ignoring height, so an eye high over the map still loads the
+ * ground below it.
+ *
+ * Geometry being streamed must start with an empty mesh of its own and be
+ * hidden; the streamer shows it once its chunk is resident.
+ */
+
+class PMWorldStreamer {
+public:
+
+	/**
+	 * Decodes the meshes the streamer asks for.  Both calls are made from
+	 * worker threads, several at once, so must only read shared data.
+	 */
+
+	class Source {
+	public:
+
+		virtual ~Source () { }
+
+		/**
+		 * The bound of an item's mesh, in the space of its geometry's node,
+		 * and roughly the bytes its vertex and index buffers will take.
+		 * Returns false if the item draws nothing.
+		 */
+
+		virtual bool measureMesh (u32 key, gfx::BoundAABB& bound, u32& bytes) const = 0;
+
+		virtual void buildMesh (u32 key, bool textured, gfx::TriMesh& out) const = 0;
+	};
+
+	/**
+	 * Distances are in world units, across the XZ plane.  Zero picks a
+	 * size from the map's extent: chunks an eighth of its width, loaded
+	 * within two chunks of the eye and unloaded past two and a half.  The
+	 * unload distance should exceed the load distance, so a camera sitting
+	 * on a boundary doesn't load and evict the same chunk every frame.
+	 */
+
+	struct Settings {
+		f32 chunkSize;
+		f32 loadDistance;
+		f32 unloadDistance;
+		u32 budgetBytes;
+		u32 uploadsPerFrame;
+
+		Settings ()
+			: chunkSize(0.f), loadDistance(0.f), unloadDistance(0.f),
+			  budgetBytes(64 * 1024 * 1024), uploadsPerFrame(2) {
+		}
+	};
+
+	enum ChunkState {
+		UNLOADED, LOADING, RESIDENT,
+	};
+
+protected:
+
+	struct Item {
+		gfx::Geometry* geo;
+		u32 key;
+		gfx::BoundAABB bound;
+		u32 bytes;
+	};
+
+	class LoadTask : public TaskPool::Task {
+	public:
+
+		PMWorldStreamer* streamer;
+		u32 chunk;
+
+		void run () {
+			streamer->loadChunk(chunk);
+		}
+	};
+
+	class MeasureTask : public TaskPool::Task {
+	public:
+
+		PMWorldStreamer* streamer;
+		u32 first;
+		u32 count;
+
+		void run () {
+			streamer->measureItems(first, count);
+		}
+	};
+
+	struct Chunk {
+		std::vector<u32> items;
+		gfx::BoundAABB bound;
+		u32 bytes;
+
+		// Only touched by the calling thread
+		ChunkState state;
+		bool wanted;
+
+		// Set by the load task, under the streamer's mutex
+		bool done;
+
+		// Filled by the load task, emptied once uploaded
+		std::vector<gfx::TriMesh> staged;
+		LoadTask task;
+
+		f32 distance;
+	};
+
+	const Source* _source;
+	gfx::Scenegraph* _scenegraph;
+	gfx::RenderGL* _renderer;
+	gfx::TextureUploader* _uploader;
+	TaskPool* _pool;
+	Settings _settings;
+
+	std::vector<Item> _items;
+	std::vector<Chunk> _chunks;
+	std::map<gfx::Texture*, u32> _textureRefs;
+
+	sf::Mutex _mutex;
+	u32 _inFlight;
+	u32 _residentBytes;
+	u32 _residentChunks;
+
+public:
+
+	PMWorldStreamer ()
+		: _source(NULL), _scenegraph(NULL), _renderer(NULL), _uploader(NULL), _pool(NULL), _inFlight(0), _residentBytes(0), _residentChunks(0) {
+	}
+
+	virtual ~PMWorldStreamer () {
+		shutdown();
+	}
+
+	/**
+	 * Queue geometry for streaming; key is passed back to the source.
+	 */
+
+	void addItem (gfx::Geometry* geo, u32 key) {
+		Item item;
+		item.geo = geo;
+		item.key = key;
+		item.bytes = 0;
+		_items.push_back(item);
+	}
+
+	/**
+	 * Measure every item and cut the map into chunks.  World matrices must
+	 * be current, so call this after updating the scenegraph.  Items that
+	 * draw nothing are dropped.  Without an uploader, textures are uploaded
+	 * as soon as their first chunk is.
+	 */
+
+	void setup (gfx::Scenegraph* sg, const Source* source, gfx::RenderGL* renderer,
+			gfx::TextureUploader* uploader, TaskPool* pool, const Settings& settings) {
+		_scenegraph = sg;
+		_uploader = uploader;
+		_source = source;
+		_renderer = renderer;
+		_pool = pool;
+		_settings = settings;
+
+		std::vector<MeasureTask> tasks((_items.size() + 255) / 256);
+		for (u32 i = 0; i < tasks.size(); i++) {
+			tasks[i].streamer = this;
+			tasks[i].first = i * 256;
+			tasks[i].count = std::min<u32>(256, _items.size() - i * 256);
+			_pool->submit(&tasks[i]);
+		}
+		_pool->wait();
+
+		gfx::BoundAABB mapBound;
+		u32 kept = 0;
+
+		for (u32 i = 0; i < _items.size(); i++) {
+			Item& item = _items[i];
+			if (item.bound.isSingular()) {
+				continue;
+			}
+
+			item.bound.transform(vmath::Matrix4f(sg->getNode(item.geo->spacialNode).getWorldMatrix()));
+			mapBound.addBound(item.bound);
+			_items[kept++] = item;
+		}
+		_items.resize(kept);
+
+		if (mapBound.isSingular()) {
+			return;
+		}
+
+		const vmath::Vector3f& extants = mapBound.extants();
+		if (_settings.chunkSize <= 0.f) {
+			_settings.chunkSize = std::max(std::max(extants.x, extants.z) * 2.f / 8.f, 1.f);
+		}
+		if (_settings.loadDistance <= 0.f) {
+			_settings.loadDistance = _settings.chunkSize * 2.f;
+		}
+		if (_settings.unloadDistance < _settings.loadDistance) {
+			_settings.unloadDistance = _settings.loadDistance * 1.25f;
+		}
+
+		vmath::Vector3f origin = mapBound.center() - extants;
+		std::map<std::pair<s32, s32>, u32> cells;
+
+		for (u32 i = 0; i < _items.size(); i++) {
+			const vmath::Vector3f& c = _items[i].bound.center();
+			std::pair<s32, s32> cell((s32)((c.x - origin.x) / _settings.chunkSize),
+					(s32)((c.z - origin.z) / _settings.chunkSize));
+
+			std::map<std::pair<s32, s32>, u32>::iterator iter = cells.find(cell);
+			if (iter == cells.end()) {
+				iter = cells.insert(std::make_pair(cell, cells.size())).first;
+			}
+		}
+
+		// Chunks are only resized here, so tasks can hold on to them
+		_chunks.resize(cells.size());
+		for (u32 i = 0; i < _chunks.size(); i++) {
+			Chunk& chunk = _chunks[i];
+			chunk.bytes = 0;
+			chunk.state = UNLOADED;
+			chunk.wanted = false;
+			chunk.done = false;
+			chunk.distance = 0.f;
+			chunk.task.streamer = this;
+			chunk.task.chunk = i;
+		}
+
+		for (u32 i = 0; i < _items.size(); i++) {
+			const vmath::Vector3f& c = _items[i].bound.center();
+			std::pair<s32, s32> cell((s32)((c.x - origin.x) / _settings.chunkSize),
+					(s32)((c.z - origin.z) / _settings.chunkSize));
+
+			Chunk& chunk = _chunks[cells[cell]];
+			chunk.items.push_back(i);
+			chunk.bound.addBound(_items[i].bound);
+			chunk.bytes += _items[i].bytes;
+		}
+	}
+
+	/**
+	 * Finish, drop and start chunk loads for an eye at the given world
+	 * position.  Must be called on the thread owning the GL context.
+	 * Returns the number of chunks uploaded, after which the scenegraph
+	 * needs updating to refit its bounds.
+	 */
+
+	u32 update (const vmath::Vector3f& eye) {
+		if (_chunks.empty()) {
+			return 0;
+		}
+
+		for (u32 i = 0; i < _chunks.size(); i++) {
+			_chunks[i].distance = distance(_chunks[i].bound, eye);
+		}
+
+		// With no workers the pool only runs tasks in wait(), so load one
+		// chunk a frame on this thread instead
+		if (_pool->getWorkerCount() == 0) {
+			for (u32 i = 0; i < _chunks.size(); i++) {
+				Chunk& chunk = _chunks[i];
+				if (chunk.state != LOADING || chunk.done) {
+					continue;
+				}
+
+				if (chunk.wanted) {
+					loadChunk(i);
+					break;
+				}
+
+				chunk.state = UNLOADED;
+				_inFlight--;
+			}
+		}
+
+		u32 uploads = integrate();
+		evict();
+		request();
+
+		return uploads;
+	}
+
+	/**
+	 * Wait out any loads in flight.  Call before the pool or the source
+	 * goes away.
+	 */
+
+	void shutdown () {
+		if (_pool != NULL && _pool->getWorkerCount() > 0 && _inFlight > 0) {
+			_pool->wait();
+		}
+		_inFlight = 0;
+		_pool = NULL;
+	}
+
+	u32 getChunkCount () const {
+		return _chunks.size();
+	}
+
+	u32 getInFlightCount () const {
+		return _inFlight;
+	}
+
+	u32 getResidentBytes () const {
+		return _residentBytes;
+	}
+
+	u32 getResidentCount () const {
+		return _residentChunks;
+	}
+
+	const Settings& getSettings () const {
+		return _settings;
+	}
+
+protected:
+
+	void measureItems (u32 first, u32 count) {
+		for (u32 i = first; i < first + count; i++) {
+			Item& item = _items[i];
+			item.bound.reset();
+			if (!_source->measureMesh(item.key, item.bound, item.bytes)) {
+				item.bound.reset();
+			}
+		}
+	}
+
+	void loadChunk (u32 index) {
+		Chunk& chunk = _chunks[index];
+
+		chunk.staged.resize(chunk.items.size());
+		for (u32 i = 0; i < chunk.items.size(); i++) {
+			const Item& item = _items[chunk.items[i]];
+			chunk.staged[i] = gfx::TriMesh();
+			_source->buildMesh(item.key, item.geo->hasTexture(), chunk.staged[i]);
+		}
+
+		sf::Lock lock(_mutex);
+		chunk.done = true;
+	}
+
+	/**
+	 * Upload finished chunks, nearest first, up to the per-frame limit.
+	 * Loads that finished after their chunk fell out of range are dropped.
+	 */
+
+	u32 integrate () {
+		std::vector<std::pair<f32, u32> > ready;
+		{
+			sf::Lock lock(_mutex);
+			for (u32 i = 0; i < _chunks.size(); i++) {
+				if (_chunks[i].state == LOADING && _chunks[i].done) {
+					ready.push_back(std::make_pair(_chunks[i].distance, i));
+				}
+			}
+		}
+		std::sort(ready.begin(), ready.end());
+
+		u32 uploads = 0;
+		for (u32 r = 0; r < ready.size(); r++) {
+			Chunk& chunk = _chunks[ready[r].second];
+
+			if (chunk.wanted && uploads == _settings.uploadsPerFrame) {
+				continue;
+			}
+
+			chunk.done = false;
+			_inFlight--;
+
+			if (!chunk.wanted) {
+				chunk.staged.clear();
+				chunk.state = UNLOADED;
+				continue;
+			}
+
+			for (u32 i = 0; i < chunk.items.size(); i++) {
+				gfx::Geometry* geo = _items[chunk.items[i]].geo;
+
+				*geo->mesh() = chunk.staged[i];
+				geo->mesh(geo->mesh());
+				_renderer->uploadMesh(geo->mesh());
+				_scenegraph->getNode(geo->spacialNode).invalidateBound();
+				geo->visible = true;
+
+				if (geo->texture != NULL && _textureRefs[geo->texture]++ == 0) {
+					if (_uploader != NULL) {
+						_uploader->queue(geo->texture);
+					}
+					else {
+						geo->texture->upload();
+					}
+					_residentBytes += geo->texture->getByteSize();
+				}
+			}
+
+			chunk.staged.clear();
+			chunk.state = RESIDENT;
+			_residentBytes += chunk.bytes;
+			_residentChunks++;
+			uploads++;
+		}
+
+		if (uploads > 0) {
+			_renderer->invalidateQueue();
+		}
+
+		return uploads;
+	}
+
+	/**
+	 * Evict resident chunks past the unload distance, then the farthest
+	 * until back under budget.  In-flight loads past the unload distance
+	 * are marked unwanted and dropped when they finish.
+	 */
+
+	void evict () {
+		std::vector<std::pair<f32, u32> > resident;
+
+		for (u32 i = 0; i < _chunks.size(); i++) {
+			Chunk& chunk = _chunks[i];
+
+			if (chunk.distance <= _settings.unloadDistance) {
+				if (chunk.state == RESIDENT) {
+					resident.push_back(std::make_pair(chunk.distance, i));
+				}
+				continue;
+			}
+
+			if (chunk.state == RESIDENT) {
+				unloadChunk(i);
+			}
+			else {
+				chunk.wanted = false;
+			}
+		}
+
+		std::sort(resident.begin(), resident.end());
+		while (_residentBytes > _settings.budgetBytes && resident.size() > 1) {
+			unloadChunk(resident.back().second);
+			resident.pop_back();
+		}
+	}
+
+	void unloadChunk (u32 index) {
+		Chunk& chunk = _chunks[index];
+
+		for (u32 i = 0; i < chunk.items.size(); i++) {
+			gfx::Geometry* geo = _items[chunk.items[i]].geo;
+
+			// The mesh keeps its bound, which culling still reads
+			_renderer->releaseMesh(geo->mesh());
+			geo->mesh()->clear();
+			geo->visible = false;
+
+			if (geo->texture != NULL && --_textureRefs[geo->texture] == 0) {
+				_residentBytes -= geo->texture->getByteSize();
+				if (_uploader != NULL) {
+					_uploader->cancel(geo->texture);
+				}
+				geo->texture->release();
+			}
+		}
+
+		chunk.state = UNLOADED;
+		chunk.wanted = false;
+		_residentBytes -= chunk.bytes;
+		_residentChunks--;
+		_renderer->invalidateQueue();
+	}
+
+	/**
+	 * Start loads for the nearest unloaded chunks in range, while they fit
+	 * the budget alongside what is resident and in flight.  Resident chunks
+	 * farther out than a wanted one are evicted to make room for it.  At
+	 * most one load per worker, or one in all, is in flight at a time.
+	 */
+
+	void request () {
+		std::vector<std::pair<f32, u32> > wanted;
+		std::vector<std::pair<f32, u32> > resident;
+		u32 pendingBytes = 0;
+
+		for (u32 i = 0; i < _chunks.size(); i++) {
+			Chunk& chunk = _chunks[i];
+
+			if (chunk.state == LOADING) {
+				// A load marked unwanted is taken back if it comes in range
+				// again before finishing
+				if (chunk.distance <= _settings.loadDistance) {
+					chunk.wanted = true;
+				}
+				if (chunk.wanted) {
+					pendingBytes += chunk.bytes;
+				}
+			}
+			else if (chunk.state == UNLOADED && chunk.distance <= _settings.loadDistance) {
+				wanted.push_back(std::make_pair(chunk.distance, i));
+			}
+			else if (chunk.state == RESIDENT) {
+				resident.push_back(std::make_pair(chunk.distance, i));
+			}
+		}
+		std::sort(wanted.begin(), wanted.end());
+		std::sort(resident.begin(), resident.end());
+
+		u32 maxInFlight = std::max<u32>(_pool->getWorkerCount(), 1);
+
+		for (u32 w = 0; w < wanted.size() && _inFlight < maxInFlight; w++) {
+			Chunk& chunk = _chunks[wanted[w].second];
+
+			while (!resident.empty() && resident.back().first > wanted[w].first
+					&& _residentBytes + pendingBytes + chunk.bytes > _settings.budgetBytes) {
+				unloadChunk(resident.back().second);
+				resident.pop_back();
+			}
+
+			// Always let the nearest chunk in, so a small budget still shows
+			// something
+			if ((_residentChunks > 0 || pendingBytes > 0) && _residentBytes + pendingBytes + chunk.bytes > _settings.budgetBytes) {
+				break;
+			}
+
+			chunk.state = LOADING;
+			chunk.wanted = true;
+			pendingBytes += chunk.bytes;
+			_inFlight++;
+
+			if (_pool->getWorkerCount() > 0) {
+				_pool->submit(&chunk.task);
+			}
+		}
+	}
+
+	/**
+	 * Distance across the XZ plane from a point to the nearest point of a
+	 * box, or zero over it.
+	 */
+
+	static f32 distance (const gfx::BoundAABB& bound, const vmath::Vector3f& p) {
+		vmath::Vector3f d = p - bound.center();
+		const vmath::Vector3f& e = bound.extants();
+
+		f32 dx = std::max(std::fabs(d.x) - e.x, 0.f);
+		f32 dz = std::max(std::fabs(d.z) - e.z, 0.f);
+
+		return std::sqrt(dx * dx + dz * dz);
+	}
+
+};
+
+#endif /* PMWORLDSTREAMER_H_ */
@@ -101,33 +101,45 @@ inline s8 getSComponent (u32 src, int idx) {
 	return (s8) getComponent(src, idx);
 }
 
-inline u16 getU16 (const std::vector<u8>& v, int index) {
+/*
+ * Big-endian reads from any indexable byte buffer: a std::vector<u8>, or a
+ * ByteView into a mapped file.
+ */
+
+template <class Buffer>
+inline u16 getU16 (const Buffer& v, int index) {
 	return v[index] << 8 | v[index+1];
 }
 
-inline u32 getU32 (const std::vector<u8>& v, int index) {
+template <class Buffer>
+inline u32 getU32 (const Buffer& v, int index) {
 	return v[index] << 24 | v[index+1] << 16 | v[index+2] << 8 | v[index+3];
 }
 
-inline s16 getS16 (const std::vector<u8>& v, int index) {
+template <class Buffer>
+inline s16 getS16 (const Buffer& v, int index) {
 	return (s16) getU16(v, index);
 }
 
-inline s32 getS32 (const std::vector<u8>& v, int index) {
+template <class Buffer>
+inline s32 getS32 (const Buffer& v, int index) {
 	return (s32) getU32(v, index);
 }
 
-inline f32 getF16 (const std::vector<u8>& v, int index) {
+template <class Buffer>
+inline f32 getF16 (const Buffer& v, int index) {
 	u16 raw = getU16(v, index);
 	return halfFloat(raw);
 }
 
-inline f32 getF32 (const std::vector<u8>& v, int index) {
+template <class Buffer>
+inline f32 getF32 (const Buffer& v, int index) {
 	u32 raw = getU32(v, index);
 	return (*(f32*) &raw);
 }
 
-inline std::string getString (const std::vector<u8>& v, int index, int maxLen) {
+template <class Buffer>
+inline std::string getString (const Buffer& v, int index, int maxLen) {
 	std::string str = "";
 	for (int i = 0; i < maxLen; i++) {
 		if (v[index + i] == 0) break;
@@ -34,8 +34,29 @@
 
 int main (int argc, char** argv)
 {
-	if (argc <= 1) {
+	// -w views a map rather than a model, and -s streams it in by region
+	bool world = false;
+	bool stream = false;
+
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; arg++) {
+		std::string option(argv[arg]);
+		if (option == "-w") {
+			world = true;
+		}
+		else if (option == "-s") {
+			world = true;
+			stream = true;
+		}
+		else {
+			std::cout << "Unknown option: " << option << std::endl;
+			return 1;
+		}
+	}
+
+	if (arg >= argc) {
 		std::cout << "No model file specified" << std::endl;
+		std::cout << "Usage: " << argv[0] << " [-w [-s]] file" << std::endl;
 		return 1;
 	}
 	
@@ -64,12 +85,17 @@ int main (int argc, char** argv)
 	
 	//wc.window.preserveOpenGLStates(true);
 
-	GLView view = GLView(appInitWidth, appInitHeight);
+	GLView view(appInitWidth, appInitHeight);
 
-	std::cout << "File: " << argv[1] << std::endl;
+	std::cout << "File: " << argv[arg] << std::endl;
 
 	try {
-		view.setModelFile(std::string(argv[1]));
+		if (world) {
+			view.setWorldFile(std::string(argv[arg]), stream);
+		}
+		else {
+			view.setModelFile(std::string(argv[arg]));
+		}
 		view.init();
 
 		std::string programDir = pathname(std::string(argv[0]));
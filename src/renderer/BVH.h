@@ -0,0 +1,596 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_BVH_H_
+#define GFX_BVH_H_
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "../vecmath/Vecmath.h"
+#include "../vecmath/MatrixG4.h"
+#include "../system/TaskPool.h"
+#include "BoundAABB.h"
+#include "Frustum.h"
+#include "Geometry.h"
+#include "Scenegraph.h"
+
+namespace gfx {
+
+	/**
+	 * A bounding volume hierarchy over the world-space bounds of the geometry
+	 * in a scenegraph, for culling and ray queries over large static scenes
+	 * such as world maps.
+	 *
+	 * The tree is built top-down with a binned surface area heuristic.  The
+	 * top levels are split on the calling thread until there is one subtree
+	 * per task; the subtrees are then built on a task pool and appended in a
+	 * fixed order.  Every range is split the same way either way, so the
+	 * tree's shape does not depend on the number of workers.
+	 *
+	 * Nodes are kept in one array, with the two children of an inner node
+	 * adjacent.  Each node covers a contiguous range of the item list.  The
+	 * tree reflects the world bounds at build time, and must be rebuilt after
+	 * nodes move.
+	 */
+
+	class BVH {
+	public:
+
+		struct Node {
+			BoundAABB bound;
+
+			// Inner nodes: index of the first child, and a count of 0.
+			// Leaves: first item and item count.
+			unsigned first;
+			unsigned count;
+
+			bool isLeaf () const {
+				return count != 0;
+			}
+		};
+
+		static const unsigned BIN_COUNT = 12;
+		static const unsigned MAX_LEAF_SIZE = 8;
+
+	protected:
+
+		struct Prim {
+			float min[3];
+			float max[3];
+			float center[3];
+		};
+
+		struct Range {
+			unsigned node;
+			unsigned begin;
+			unsigned end;
+			unsigned depth;
+
+			Range (unsigned n, unsigned b, unsigned e, unsigned d)
+				: node(n), begin(b), end(e), depth(d) {
+			}
+		};
+
+		class SubtreeTask : public TaskPool::Task {
+		public:
+
+			BVH* bvh;
+			Range range;
+			std::vector<Node> nodes;
+			unsigned depth;
+
+			SubtreeTask (BVH* tree, const Range& r)
+				: bvh(tree), range(r), depth(0) {
+			}
+
+			void run () {
+				nodes.push_back(Node());
+				Range local(0, range.begin, range.end, range.depth);
+				depth = bvh->buildNodes(nodes, local, 0, NULL);
+			}
+		};
+
+		std::vector<Node> _nodes;
+		std::vector<unsigned> _items;
+		std::vector<Prim> _prims;
+		unsigned _depth;
+
+	public:
+
+		BVH ()
+			: _depth(0) {
+		}
+
+		/**
+		 * Build over every geometry in sg that has a world bound.  Items are
+		 * scenegraph geometry indices.  The scenegraph must be up to date.
+		 * With a pool, subtrees are built as parallel tasks.
+		 */
+
+		void build (const Scenegraph& sg, TaskPool* pool) {
+			_nodes.clear();
+			_items.clear();
+			_prims.assign(sg.getGeometryCount(), Prim());
+			_depth = 0;
+
+			for (unsigned g = 0; g < sg.getGeometryCount(); g++) {
+				const BoundAABB& b = sg.getGeometry(g)->getWorldAABB();
+				if (b.isSingular()) {
+					continue;
+				}
+
+				Prim& p = _prims[g];
+				for (int i = 0; i < 3; i++) {
+					p.min[i] = b.center()(i) - b.extants()(i);
+					p.max[i] = b.center()(i) + b.extants()(i);
+					p.center[i] = b.center()(i);
+				}
+				_items.push_back(g);
+			}
+
+			if (_items.empty()) {
+				return;
+			}
+
+			// Stop the serial phase at about four subtrees per thread
+			unsigned threads = (pool != NULL) ? pool->getWorkerCount() + 1 : 1;
+			unsigned taskSize = std::max(_items.size() / (threads * 4), (size_t)1024);
+
+			std::vector<Range> deferred;
+			_nodes.push_back(Node());
+			_depth = buildNodes(_nodes, Range(0, 0, _items.size(), 0),
+					(pool != NULL) ? taskSize : 0, &deferred);
+
+			std::vector<SubtreeTask> tasks;
+			tasks.reserve(deferred.size());
+			for (unsigned i = 0; i < deferred.size(); i++) {
+				tasks.push_back(SubtreeTask(this, deferred[i]));
+			}
+			for (unsigned i = 0; i < tasks.size(); i++) {
+				pool->submit(&tasks[i]);
+			}
+			if (!tasks.empty()) {
+				pool->wait();
+			}
+
+			for (unsigned i = 0; i < tasks.size(); i++) {
+				appendSubtree(tasks[i].range.node, tasks[i].nodes);
+				_depth = std::max(_depth, tasks[i].depth);
+			}
+		}
+
+		/**
+		 * Collect the items whose bounds are not outside the frustum.  Items
+		 * in leaves that straddle a plane are tested one by one.  Returns the
+		 * number of tree nodes rejected.
+		 */
+
+		unsigned cull (const Frustum& frustum, std::vector<unsigned>& visible) const {
+			visible.clear();
+			if (_nodes.empty()) {
+				return 0;
+			}
+
+			unsigned rejected = 0;
+
+			std::vector<std::pair<unsigned, unsigned> > stack;
+			stack.push_back(std::make_pair(0u, (unsigned)Frustum::ALL_PLANES));
+
+			while (!stack.empty()) {
+				const Node& node = _nodes[stack.back().first];
+				unsigned mask = stack.back().second;
+				stack.pop_back();
+
+				if (mask != 0 && frustum.test(node.bound, mask) == Frustum::OUTSIDE) {
+					rejected++;
+					continue;
+				}
+
+				if (node.isLeaf()) {
+					for (unsigned i = node.first; i < node.first + node.count; i++) {
+						unsigned itemMask = mask;
+						if (itemMask == 0 || frustum.test(itemBound(_items[i]), itemMask) != Frustum::OUTSIDE) {
+							visible.push_back(_items[i]);
+						}
+					}
+				}
+				else {
+					stack.push_back(std::make_pair(node.first + 1, mask));
+					stack.push_back(std::make_pair(node.first, mask));
+				}
+			}
+
+			return rejected;
+		}
+
+		/**
+		 * Find the nearest triangle hit by the ray from origin along dir.
+		 * On a hit, returns true with the distance in units of dir and the
+		 * scenegraph geometry index.
+		 */
+
+		bool raycast (const Scenegraph& sg, const vmath::Vector3f& origin, const vmath::Vector3f& dir,
+				float& t, unsigned& geometry) const {
+			if (_nodes.empty()) {
+				return false;
+			}
+
+			float inv[3];
+			for (int i = 0; i < 3; i++) {
+				inv[i] = (dir(i) != 0.f) ? 1.f / dir(i) : FLT_MAX;
+			}
+
+			bool hit = false;
+			t = FLT_MAX;
+
+			std::vector<unsigned> stack;
+			stack.push_back(0);
+
+			while (!stack.empty()) {
+				const Node& node = _nodes[stack.back()];
+				stack.pop_back();
+
+				if (!intersectBound(node.bound, origin, inv, t)) {
+					continue;
+				}
+
+				if (!node.isLeaf()) {
+					stack.push_back(node.first + 1);
+					stack.push_back(node.first);
+					continue;
+				}
+
+				for (unsigned i = node.first; i < node.first + node.count; i++) {
+					if (intersectGeometry(sg, _items[i], origin, dir, t)) {
+						geometry = _items[i];
+						hit = true;
+					}
+				}
+			}
+
+			return hit;
+		}
+
+		unsigned getDepth () const {
+			return _depth;
+		}
+
+		unsigned getItemCount () const {
+			return _items.size();
+		}
+
+		const std::vector<Node>& getNodes () const {
+			return _nodes;
+		}
+
+	protected:
+
+		/**
+		 * Split ranges until they are leaves, starting with the root range
+		 * at nodes[range.node].  With deferred set, ranges of at most
+		 * taskSize items are left as placeholders and queued there instead.
+		 * Returns the depth reached.
+		 */
+
+		unsigned buildNodes (std::vector<Node>& nodes, const Range& root, unsigned taskSize,
+				std::vector<Range>* deferred) {
+			unsigned depth = root.depth;
+
+			std::vector<Range> stack;
+			stack.push_back(root);
+
+			while (!stack.empty()) {
+				Range r = stack.back();
+				stack.pop_back();
+
+				depth = std::max(depth, r.depth);
+
+				float bmin[3], bmax[3], cmin[3], cmax[3];
+				rangeBounds(r.begin, r.end, bmin, bmax, cmin, cmax);
+				nodes[r.node].bound.set(vmath::Vector3f(bmin[0], bmin[1], bmin[2]),
+						vmath::Vector3f(bmax[0], bmax[1], bmax[2]));
+
+				unsigned count = r.end - r.begin;
+				if (deferred != NULL && count <= taskSize && r.node != 0) {
+					deferred->push_back(r);
+					continue;
+				}
+
+				unsigned mid = split(r.begin, r.end, bmin, bmax, cmin, cmax);
+				if (mid == r.begin) {
+					nodes[r.node].first = r.begin;
+					nodes[r.node].count = count;
+					continue;
+				}
+
+				unsigned left = nodes.size();
+				nodes.push_back(Node());
+				nodes.push_back(Node());
+
+				nodes[r.node].first = left;
+				nodes[r.node].count = 0;
+
+				stack.push_back(Range(left + 1, mid, r.end, r.depth + 1));
+				stack.push_back(Range(left, r.begin, mid, r.depth + 1));
+			}
+
+			return depth;
+		}
+
+		/**
+		 * Pick the cheapest of the binned splits along the longest centroid
+		 * axis and partition the items around it.  Returns the first item of
+		 * the right half, or begin if the range should stay a leaf.
+		 */
+
+		unsigned split (unsigned begin, unsigned end, const float* bmin, const float* bmax,
+				const float* cmin, const float* cmax) {
+			unsigned count = end - begin;
+			if (count <= 2) {
+				return begin;
+			}
+
+			int axis = 0;
+			for (int i = 1; i < 3; i++) {
+				if (cmax[i] - cmin[i] > cmax[axis] - cmin[axis]) {
+					axis = i;
+				}
+			}
+
+			float extent = cmax[axis] - cmin[axis];
+			if (extent <= 0.f) {
+				return begin;
+			}
+
+			float scale = BIN_COUNT / extent;
+
+			unsigned binCount[BIN_COUNT];
+			float binMin[BIN_COUNT][3];
+			float binMax[BIN_COUNT][3];
+
+			for (unsigned b = 0; b < BIN_COUNT; b++) {
+				binCount[b] = 0;
+				resetBox(binMin[b], binMax[b]);
+			}
+
+			for (unsigned i = begin; i < end; i++) {
+				const Prim& p = _prims[_items[i]];
+				unsigned b = binOf(p, axis, cmin[axis], scale);
+				binCount[b]++;
+				growBox(binMin[b], binMax[b], p.min, p.max);
+			}
+
+			// Sweep from the right for the right-hand costs, then from the
+			// left to find the cheapest plane
+			float rightCost[BIN_COUNT];
+			float rmin[3], rmax[3];
+			unsigned rcount = 0;
+			resetBox(rmin, rmax);
+
+			for (unsigned b = BIN_COUNT - 1; b > 0; b--) {
+				rcount += binCount[b];
+				growBox(rmin, rmax, binMin[b], binMax[b]);
+				rightCost[b] = rcount * halfArea(rmin, rmax);
+			}
+
+			float bestCost = FLT_MAX;
+			unsigned bestBin = 0;
+			float lmin[3], lmax[3];
+			unsigned lcount = 0;
+			resetBox(lmin, lmax);
+
+			for (unsigned b = 1; b < BIN_COUNT; b++) {
+				lcount += binCount[b - 1];
+				growBox(lmin, lmax, binMin[b - 1], binMax[b - 1]);
+				if (lcount == 0 || lcount == count) {
+					continue;
+				}
+
+				float cost = lcount * halfArea(lmin, lmax) + rightCost[b];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestBin = b;
+				}
+			}
+
+			// Keep small ranges whole unless splitting pays for the extra
+			// traversal step
+			float leafCost = count * halfArea(bmin, bmax);
+			if (bestBin == 0 || (count <= MAX_LEAF_SIZE && halfArea(bmin, bmax) + bestCost >= leafCost)) {
+				return begin;
+			}
+
+			unsigned mid = begin;
+			for (unsigned i = begin; i < end; i++) {
+				if (binOf(_prims[_items[i]], axis, cmin[axis], scale) < bestBin) {
+					std::swap(_items[i], _items[mid++]);
+				}
+			}
+
+			return mid;
+		}
+
+		/**
+		 * Move a subtree built on its own into place: its root replaces the
+		 * placeholder at node, and the rest are appended.
+		 */
+
+		void appendSubtree (unsigned node, const std::vector<Node>& subtree) {
+			unsigned base = _nodes.size() - 1;
+
+			for (unsigned i = 0; i < subtree.size(); i++) {
+				Node n = subtree[i];
+				if (!n.isLeaf()) {
+					n.first += base;
+				}
+
+				if (i == 0) {
+					_nodes[node] = n;
+				}
+				else {
+					_nodes.push_back(n);
+				}
+			}
+		}
+
+		BoundAABB itemBound (unsigned item) const {
+			const Prim& p = _prims[item];
+
+			BoundAABB bound;
+			bound.set(vmath::Vector3f(p.min[0], p.min[1], p.min[2]), vmath::Vector3f(p.max[0], p.max[1], p.max[2]));
+			return bound;
+		}
+
+		void rangeBounds (unsigned begin, unsigned end, float* bmin, float* bmax, float* cmin, float* cmax) const {
+			resetBox(bmin, bmax);
+			resetBox(cmin, cmax);
+
+			for (unsigned i = begin; i < end; i++) {
+				const Prim& p = _prims[_items[i]];
+				growBox(bmin, bmax, p.min, p.max);
+				growBox(cmin, cmax, p.center, p.center);
+			}
+		}
+
+		bool intersectGeometry (const Scenegraph& sg, unsigned g, const vmath::Vector3f& origin,
+				const vmath::Vector3f& dir, float& t) const {
+			const Geometry* geo = sg.getGeometry(g);
+			const std::vector<unsigned int>& indexList = geo->mesh()->getIndexList();
+
+			std::vector<vertex3f> positions;
+			geo->mesh()->getPositions(positions);
+			if (positions.empty()) {
+				return false;
+			}
+
+			// Each vertex goes to world space once, not once per triangle
+			// using it.  World matrices are in GL order, so transpose first.
+			vmath::MatrixG4f world = sg.getNode(geo->spacialNode).getWorldMatrix();
+			world.transpose();
+			world.transformPoints(&positions[0].x, positions.size(), &positions[0].x);
+
+			bool hit = false;
+
+			for (unsigned i = 0; i + 2 < indexList.size(); i += 3) {
+				vmath::Vector3f v0 = asVector(positions[indexList[i + 0]]);
+				vmath::Vector3f v1 = asVector(positions[indexList[i + 1]]);
+				vmath::Vector3f v2 = asVector(positions[indexList[i + 2]]);
+
+				// Moller-Trumbore, accepting either winding
+				vmath::Vector3f e1 = v1 - v0;
+				vmath::Vector3f e2 = v2 - v0;
+				vmath::Vector3f p = dir.cross(e2);
+
+				float det = e1.dot(p);
+				if (std::fabs(det) < 1e-12f) {
+					continue;
+				}
+
+				float invDet = 1.f / det;
+				vmath::Vector3f s = origin - v0;
+
+				float u = s.dot(p) * invDet;
+				if (u < 0.f || u > 1.f) {
+					continue;
+				}
+
+				vmath::Vector3f q = s.cross(e1);
+				float v = dir.dot(q) * invDet;
+				if (v < 0.f || u + v > 1.f) {
+					continue;
+				}
+
+				float d = e2.dot(q) * invDet;
+				if (d >= 0.f && d < t) {
+					t = d;
+					hit = true;
+				}
+			}
+
+			return hit;
+		}
+
+		static bool intersectBound (const BoundAABB& bound, const vmath::Vector3f& origin, const float* inv,
+				float tmax) {
+			float tmin = 0.f;
+
+			for (int i = 0; i < 3; i++) {
+				float lo = bound.center()(i) - bound.extants()(i);
+				float hi = bound.center()(i) + bound.extants()(i);
+
+				float t0 = (lo - origin(i)) * inv[i];
+				float t1 = (hi - origin(i)) * inv[i];
+				if (t0 > t1) {
+					std::swap(t0, t1);
+				}
+
+				tmin = std::max(tmin, t0);
+				tmax = std::min(tmax, t1);
+				if (tmin > tmax) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		static vmath::Vector3f asVector (const vertex3f& v) {
+			return vmath::Vector3f(v.x, v.y, v.z);
+		}
+
+		static unsigned binOf (const Prim& p, int axis, float origin, float scale) {
+			unsigned b = (unsigned)((p.center[axis] - origin) * scale);
+			return std::min(b, BIN_COUNT - 1);
+		}
+
+		static float halfArea (const float* min, const float* max) {
+			float dx = max[0] - min[0];
+			float dy = max[1] - min[1];
+			float dz = max[2] - min[2];
+			return dx * dy + dy * dz + dz * dx;
+		}
+
+		static void growBox (float* min, float* max, const float* bmin, const float* bmax) {
+			for (int i = 0; i < 3; i++) {
+				min[i] = std::min(min[i], bmin[i]);
+				max[i] = std::max(max[i], bmax[i]);
+			}
+		}
+
+		static void resetBox (float* min, float* max) {
+			for (int i = 0; i < 3; i++) {
+				min[i] = FLT_MAX;
+				max[i] = -FLT_MAX;
+			}
+		}
+
+	};
+
+}
+
+#endif /* GFX_BVH_H_ */
@@ -49,13 +49,39 @@ namespace gfx {
 
 		virtual ~Bound () { }
 
+		/**
+		 * Grow the bound to enclose another.  Singular bounds enclose nothing
+		 * and are ignored.
+		 */
+
+		void addBound (const Bound& bound) {
+			if (bound._singular) {
+				return;
+			}
+
+			vmath::Vector3f min = bound._center - bound._extants;
+			vmath::Vector3f max = bound._center + bound._extants;
+
+			if (!_singular) {
+				vmath::Vector3f curMin = _center - _extants;
+				vmath::Vector3f curMax = _center + _extants;
+
+				for (int i = 0; i < 3; i++) {
+					if (curMin(i) < min(i)) min(i) = curMin(i);
+					if (curMax(i) > max(i)) max(i) = curMax(i);
+				}
+			}
+
+			recalcBound(min, max);
+		}
+
 		void addPoints (const std::vector<vmath::Vector3f>& verts) {
 			if (verts.size() == 0) {
 				return;
 			}
 
 			vmath::Vector3f min(FLT_MAX);
-			vmath::Vector3f max(FLT_MIN);
+			vmath::Vector3f max(-FLT_MAX);
 
 			if (!_singular) {
 				min = _center - _extants;
@@ -64,13 +90,13 @@ namespace gfx {
 
 			for (unsigned i = 0; i < verts.size(); i++) {
 				if (verts[i].x < min.x) min.x = verts[i].x;
-				else if (verts[i].x > max.x) max.x = verts[i].x;
+				if (verts[i].x > max.x) max.x = verts[i].x;
 
 				if (verts[i].y < min.y) min.y = verts[i].y;
-				else if (verts[i].y > max.y) max.y = verts[i].y;
+				if (verts[i].y > max.y) max.y = verts[i].y;
 
 				if (verts[i].z < min.z) min.z = verts[i].z;
-				else if (verts[i].z > max.z) max.z = verts[i].z;
+				if (verts[i].z > max.z) max.z = verts[i].z;
 			}
 
 			recalcBound(min, max);
@@ -82,7 +108,7 @@ namespace gfx {
 			}
 
 			vmath::Vector3f min(FLT_MAX);
-			vmath::Vector3f max(FLT_MIN);
+			vmath::Vector3f max(-FLT_MAX);
 
 			if (!_singular) {
 				min = _center - _extants;
@@ -91,18 +117,58 @@ namespace gfx {
 
 			for (unsigned i = 0; i < verts.size(); i++) {
 				if (verts[i].x < min.x) min.x = verts[i].x;
-				else if (verts[i].x > max.x) max.x = verts[i].x;
+				if (verts[i].x > max.x) max.x = verts[i].x;
 
 				if (verts[i].y < min.y) min.y = verts[i].y;
-				else if (verts[i].y > max.y) max.y = verts[i].y;
+				if (verts[i].y > max.y) max.y = verts[i].y;
 
 				if (verts[i].z < min.z) min.z = verts[i].z;
-				else if (verts[i].z > max.z) max.z = verts[i].z;
+				if (verts[i].z > max.z) max.z = verts[i].z;
 			}
 
 			recalcBound(min, max);
 		}
 
+		/**
+		 * 16-bit positions are compared as integers and only the extremes
+		 * converted, so no float copy of the mesh is needed.
+		 */
+
+		void addPoints (const std::vector<vertex3s>& verts) {
+			if (verts.size() == 0) {
+				return;
+			}
+
+			short min[3] = { verts[0].x, verts[0].y, verts[0].z };
+			short max[3] = { verts[0].x, verts[0].y, verts[0].z };
+
+			for (unsigned i = 1; i < verts.size(); i++) {
+				if (verts[i].x < min[0]) min[0] = verts[i].x;
+				if (verts[i].x > max[0]) max[0] = verts[i].x;
+
+				if (verts[i].y < min[1]) min[1] = verts[i].y;
+				if (verts[i].y > max[1]) max[1] = verts[i].y;
+
+				if (verts[i].z < min[2]) min[2] = verts[i].z;
+				if (verts[i].z > max[2]) max[2] = verts[i].z;
+			}
+
+			vmath::Vector3f vmin(min[0], min[1], min[2]);
+			vmath::Vector3f vmax(max[0], max[1], max[2]);
+
+			if (!_singular) {
+				vmath::Vector3f curMin = _center - _extants;
+				vmath::Vector3f curMax = _center + _extants;
+
+				for (int i = 0; i < 3; i++) {
+					if (curMin(i) < vmin(i)) vmin(i) = curMin(i);
+					if (curMax(i) > vmax(i)) vmax(i) = curMax(i);
+				}
+			}
+
+			recalcBound(vmin, vmax);
+		}
+
 		const vmath::Vector3f& center () const {
 			return _center;
 		}
@@ -119,12 +185,24 @@ namespace gfx {
 			_extants = vec;
 		}
 
+		bool isSingular () const {
+			return _singular;
+		}
+
 		void reset () {
 			_center.set(0.f);
 			_extants.set(0.f);
 			_singular = true;
 		}
 
+		/**
+		 * Make the bound exactly enclose the box from min to max.
+		 */
+
+		void set (const vmath::Vector3f& min, const vmath::Vector3f& max) {
+			recalcBound(min, max);
+		}
+
 		virtual void transform (const vmath::Matrix4f& mat) = 0;
 
 	protected:
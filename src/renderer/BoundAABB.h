@@ -26,6 +26,8 @@
 #ifndef GFX_BOUNDAABB_H_
 #define GFX_BOUNDAABB_H_
 
+#include <cmath>
+
 #include "Bound.h"
 
 namespace gfx {
@@ -39,30 +41,34 @@ namespace gfx {
 
 		virtual ~BoundAABB () { }
 
+		/**
+		 * Transform the box and refit it to the axes.  The matrix is expected
+		 * in GL (column-major) order, as stored for scenegraph world matrices.
+		 */
+
 		void transform (const vmath::Matrix4f& mat) {
-			vmath::Vector3f min = _center - _extants;
-			vmath::Vector3f max = _center + _extants;
+			if (_singular) {
+				return;
+			}
 
-			vmath::Vector3f newMin(mat.getElement(12), mat.getElement(13), mat.getElement(14));
-			vmath::Vector3f newMax(newMin);
+#ifdef VMATH_SSE
+			vmath::simd::transformBoundGL(mat.asArray(), &_center.x, &_extants.x, &_center.x, &_extants.x);
+#else
+			vmath::Vector3f newCenter(mat.getElement(12), mat.getElement(13), mat.getElement(14));
+			vmath::Vector3f newExtants(0.f);
 
 			for (int i = 0; i < 3; i++) {
 				for (int j = 0; j < 3; j++) {
-					float av = mat(i, j) * min(j);
-					float bv = mat(i, j) * max(j);
-
-					if (av < bv) {
-						newMin(i) += av;
-						newMax(i) += bv;
-					}
-					else {
-						newMin(i) += bv;
-						newMax(i) += av;
-					}
+					float m = mat(j, i);
+
+					newCenter(i) += m * _center(j);
+					newExtants(i) += std::fabs(m) * _extants(j);
 				}
 			}
 
-			recalcBound(newMin, newMax);
+			_center = newCenter;
+			_extants = newExtants;
+#endif
 		}
 
 	protected:
@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_DEPTHSORT_H_
+#define GFX_DEPTHSORT_H_
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+namespace gfx {
+
+	/**
+	 * A view-space depth paired with the index of whatever it was computed
+	 * for (a geometry, a triangle).
+	 */
+
+	struct DepthKey {
+		float depth;
+		unsigned index;
+
+		DepthKey () { }
+
+		DepthKey (float d, unsigned i)
+			: depth(d), index(i) {
+		}
+
+		bool operator< (const DepthKey& k) const {
+			return depth < k.depth;
+		}
+	};
+
+	/**
+	 * Map a float onto an unsigned integer with the same ordering, so depths
+	 * can be radix sorted.
+	 */
+
+	inline unsigned depthRadixKey (float f) {
+		unsigned u;
+		std::memcpy(&u, &f, sizeof(u));
+		return u ^ ((u & 0x80000000) ? 0xFFFFFFFF : 0x80000000);
+	}
+
+	/**
+	 * Sort keys by ascending depth.  Small sets use std::sort; larger sets
+	 * use a stable four-pass LSD radix sort, with scratch as the ping-pong
+	 * buffer so repeated per-frame sorts don't allocate.
+	 */
+
+	inline void depthSort (std::vector<DepthKey>& keys, std::vector<DepthKey>& scratch) {
+		const unsigned count = keys.size();
+
+		if (count < 64) {
+			std::sort(keys.begin(), keys.end());
+			return;
+		}
+
+		scratch.resize(count);
+
+		DepthKey* src = &keys[0];
+		DepthKey* dst = &scratch[0];
+
+		for (unsigned shift = 0; shift < 32; shift += 8) {
+			unsigned hist[256];
+			std::memset(hist, 0, sizeof(hist));
+
+			for (unsigned i = 0; i < count; i++) {
+				hist[(depthRadixKey(src[i].depth) >> shift) & 0xFF]++;
+			}
+
+			unsigned sum = 0;
+			for (unsigned b = 0; b < 256; b++) {
+				unsigned c = hist[b];
+				hist[b] = sum;
+				sum += c;
+			}
+
+			for (unsigned i = 0; i < count; i++) {
+				dst[hist[(depthRadixKey(src[i].depth) >> shift) & 0xFF]++] = src[i];
+			}
+
+			std::swap(src, dst);
+		}
+
+		// Four passes leave the result back in keys
+	}
+
+}
+
+#endif /* GFX_DEPTHSORT_H_ */
@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_FRUSTUM_H_
+#define GFX_FRUSTUM_H_
+
+#include <cmath>
+
+#include "Bound.h"
+
+namespace gfx {
+
+	/**
+	 * The six clip planes of a view volume, extracted from a combined
+	 * projection * modelview matrix.  Plane normals point into the volume.
+	 *
+	 * Bounds are tested against a mask of planes; planes that a bound lies
+	 * entirely inside of are cleared from the mask, so the children of a
+	 * bound need not test against them again.
+	 */
+
+	class Frustum {
+	public:
+
+		enum Plane {
+			PLANE_LEFT,
+			PLANE_RIGHT,
+			PLANE_BOTTOM,
+			PLANE_TOP,
+			PLANE_NEAR,
+			PLANE_FAR,
+			PLANE_COUNT,
+		};
+
+		enum Result {
+			OUTSIDE,
+			INTERSECT,
+			INSIDE,
+		};
+
+		static const unsigned ALL_PLANES = (1 << PLANE_COUNT) - 1;
+
+	protected:
+
+		float _planes[PLANE_COUNT][4];
+
+	public:
+
+		Frustum () {
+			for (int i = 0; i < PLANE_COUNT; i++) {
+				_planes[i][0] = _planes[i][1] = _planes[i][2] = 0.f;
+				_planes[i][3] = 1.f;
+			}
+		}
+
+		/**
+		 * Extract the planes from projection and modelview matrices in GL
+		 * (column-major) order, as returned by glGetFloatv.  Bounds tested
+		 * afterward are taken to be in the modelview's object space.
+		 */
+
+		void extract (const float* projection, const float* modelview) {
+			float clip[16];
+
+			for (int c = 0; c < 4; c++) {
+				for (int r = 0; r < 4; r++) {
+					clip[c * 4 + r] = projection[0 * 4 + r] * modelview[c * 4 + 0]
+							+ projection[1 * 4 + r] * modelview[c * 4 + 1]
+							+ projection[2 * 4 + r] * modelview[c * 4 + 2]
+							+ projection[3 * 4 + r] * modelview[c * 4 + 3];
+				}
+			}
+
+			extract(clip);
+		}
+
+		/**
+		 * Extract the planes from a combined clip matrix in GL order.
+		 */
+
+		void extract (const float* clip) {
+			for (int i = 0; i < PLANE_COUNT; i++) {
+				int row = i / 2;
+				float sign = (i % 2 == 0) ? 1.f : -1.f;
+
+				for (int c = 0; c < 4; c++) {
+					_planes[i][c] = clip[c * 4 + 3] + sign * clip[c * 4 + row];
+				}
+
+				float len = std::sqrt(_planes[i][0] * _planes[i][0] + _planes[i][1] * _planes[i][1]
+						+ _planes[i][2] * _planes[i][2]);
+
+				if (len > 0.f) {
+					for (int c = 0; c < 4; c++) {
+						_planes[i][c] /= len;
+					}
+				}
+			}
+		}
+
+		const float* getPlane (Plane plane) const {
+			return _planes[plane];
+		}
+
+		/**
+		 * Classify a bound against the planes in mask.  Planes the bound is
+		 * fully inside of are removed from mask.  Singular bounds are always
+		 * outside.
+		 */
+
+		Result test (const Bound& bound, unsigned& mask) const {
+			if (bound.isSingular()) {
+				return OUTSIDE;
+			}
+
+			const vmath::Vector3f& c = bound.center();
+			const vmath::Vector3f& e = bound.extants();
+
+			for (int i = 0; i < PLANE_COUNT; i++) {
+				unsigned bit = 1 << i;
+				if ((mask & bit) == 0) {
+					continue;
+				}
+
+				const float* p = _planes[i];
+
+				float dist = p[0] * c.x + p[1] * c.y + p[2] * c.z + p[3];
+				float radius = std::fabs(p[0]) * e.x + std::fabs(p[1]) * e.y + std::fabs(p[2]) * e.z;
+
+				if (dist + radius < 0.f) {
+					return OUTSIDE;
+				}
+				if (dist - radius >= 0.f) {
+					mask &= ~bit;
+				}
+			}
+
+			return (mask == 0) ? INSIDE : INTERSECT;
+		}
+
+	};
+
+}
+
+#endif /* GFX_FRUSTUM_H_ */
@@ -0,0 +1,403 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_GLSTATE_H_
+#define GFX_GLSTATE_H_
+
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+
+namespace gfx {
+
+	/**
+	 * Shadow of the GL state the renderer changes between draws: enables,
+	 * texture bindings and environment, alpha testing, blending, culling,
+	 * depth writes, the clear color and the current program.  Each setter
+	 * issues its GL call only if the value differs from the shadow, and
+	 * counts the call as issued or elided.
+	 *
+	 * Values start unknown, so the first call for each is always issued;
+	 * the active texture unit starts at unit 0, the GL default.  All code
+	 * touching this state should go through the tracker, or call
+	 * invalidate() after changing it directly.
+	 */
+
+	class GLState {
+	public:
+
+		enum {
+			TEXTURE_UNITS = 4,
+		};
+
+		struct Counters {
+			unsigned issued;
+			unsigned elided;
+
+			Counters ()
+				: issued(0), elided(0) {
+			}
+		};
+
+	protected:
+
+		enum {
+			CAP_ALPHA_TEST,
+			CAP_BLEND,
+			CAP_CULL_FACE,
+			CAP_DEPTH_TEST,
+			CAP_COUNT,
+		};
+
+		enum {
+			BIND_2D,
+			BIND_2D_ARRAY,
+			BIND_COUNT,
+		};
+
+		template <typename T>
+		struct Cached {
+			T value;
+			bool known;
+
+			Cached ()
+				: value(), known(false) {
+			}
+
+			/**
+			 * Store v, returning false if it was already the known value.
+			 */
+
+			bool update (const T& v) {
+				if (known && value == v) {
+					return false;
+				}
+				value = v;
+				known = true;
+				return true;
+			}
+		};
+
+		struct BlendFunc {
+			GLenum srcRGB, dstRGB, srcAlpha, dstAlpha;
+
+			bool operator== (const BlendFunc& b) const {
+				return srcRGB == b.srcRGB && dstRGB == b.dstRGB && srcAlpha == b.srcAlpha && dstAlpha == b.dstAlpha;
+			}
+		};
+
+		struct AlphaFunc {
+			GLenum func;
+			GLfloat ref;
+
+			bool operator== (const AlphaFunc& a) const {
+				return func == a.func && ref == a.ref;
+			}
+		};
+
+		struct Color {
+			GLfloat rgba[4];
+
+			bool operator== (const Color& c) const {
+				return rgba[0] == c.rgba[0] && rgba[1] == c.rgba[1] && rgba[2] == c.rgba[2] && rgba[3] == c.rgba[3];
+			}
+		};
+
+		unsigned _unit;
+
+		Cached<bool> _caps[CAP_COUNT];
+		Cached<bool> _textureEnabled[TEXTURE_UNITS];
+		Cached<GLuint> _bindings[TEXTURE_UNITS][BIND_COUNT];
+		Cached<GLint> _envMode[TEXTURE_UNITS];
+
+		Cached<AlphaFunc> _alphaFunc;
+		Cached<BlendFunc> _blendFunc;
+		Cached<GLenum> _cullFace;
+		Cached<bool> _depthMask;
+		Cached<Color> _clearColor;
+		Cached<GLuint> _program;
+
+		Counters _counters;
+
+	public:
+
+		GLState ()
+			: _unit(0) {
+		}
+
+		/**
+		 * The tracker for the one GL context the viewer draws with.
+		 */
+
+		static GLState& getState () {
+			static GLState gs;
+			return gs;
+		}
+
+		void enable (GLenum cap) {
+			setEnabled(cap, true);
+		}
+
+		void disable (GLenum cap) {
+			setEnabled(cap, false);
+		}
+
+		/**
+		 * Enable or disable a capability.  Texture targets apply to the
+		 * active unit.  Capabilities the tracker doesn't shadow are always
+		 * passed through.
+		 */
+
+		void setEnabled (GLenum cap, bool state) {
+			Cached<bool>* cached = enableSlot(cap);
+			if (cached == NULL || cached->update(state)) {
+				(state) ? glEnable(cap) : glDisable(cap);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		/**
+		 * Whether a capability is enabled, asking GL only if the value is
+		 * not yet known.
+		 */
+
+		bool isEnabled (GLenum cap) {
+			Cached<bool>* cached = enableSlot(cap);
+			if (cached == NULL) {
+				return glIsEnabled(cap) == GL_TRUE;
+			}
+			if (!cached->known) {
+				cached->update(glIsEnabled(cap) == GL_TRUE);
+			}
+			return cached->value;
+		}
+
+		void activeTexture (GLenum unit) {
+			unsigned index = unit - GL_TEXTURE0;
+			if (index != _unit || index >= TEXTURE_UNITS) {
+				glActiveTexture(unit);
+				_unit = index;
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		void bindTexture (GLenum target, GLuint name) {
+			Cached<GLuint>* cached = bindingSlot(target);
+			if (cached == NULL || cached->update(name)) {
+				glBindTexture(target, name);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		/**
+		 * Delete a texture.  GL unbinds a deleted texture from every unit,
+		 * so the shadow does too, or a later texture given the same name
+		 * would never be bound.
+		 */
+
+		void deleteTexture (GLuint name) {
+			if (name == 0) {
+				return;
+			}
+
+			glDeleteTextures(1, &name);
+
+			for (unsigned u = 0; u < TEXTURE_UNITS; u++) {
+				for (unsigned b = 0; b < BIND_COUNT; b++) {
+					if (_bindings[u][b].known && _bindings[u][b].value == name) {
+						_bindings[u][b].value = 0;
+					}
+				}
+			}
+		}
+
+		void texEnvMode (GLint mode) {
+			if (_unit >= TEXTURE_UNITS || _envMode[_unit].update(mode)) {
+				glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		void alphaFunc (GLenum func, GLfloat ref) {
+			AlphaFunc af = { func, ref };
+			if (_alphaFunc.update(af)) {
+				glAlphaFunc(func, ref);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		void blendFunc (GLenum src, GLenum dst) {
+			BlendFunc bf = { src, dst, src, dst };
+			if (_blendFunc.update(bf)) {
+				glBlendFunc(src, dst);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		void blendFuncSeparate (GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha) {
+			BlendFunc bf = { srcRGB, dstRGB, srcAlpha, dstAlpha };
+			if (_blendFunc.update(bf)) {
+				glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		void cullFace (GLenum mode) {
+			if (_cullFace.update(mode)) {
+				glCullFace(mode);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		void depthMask (bool state) {
+			if (_depthMask.update(state)) {
+				glDepthMask(state ? GL_TRUE : GL_FALSE);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		/**
+		 * Whether depth writes are on, asking GL only if not yet known.
+		 */
+
+		bool getDepthMask () {
+			if (!_depthMask.known) {
+				GLboolean mask = GL_TRUE;
+				glGetBooleanv(GL_DEPTH_WRITEMASK, &mask);
+				_depthMask.update(mask == GL_TRUE);
+			}
+			return _depthMask.value;
+		}
+
+		void clearColor (GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+			Color c = { { r, g, b, a } };
+			if (_clearColor.update(c)) {
+				glClearColor(r, g, b, a);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		/**
+		 * The clear color, asking GL only if not yet known.
+		 */
+
+		void getClearColor (GLfloat rgba[4]) {
+			if (!_clearColor.known) {
+				Color c;
+				glGetFloatv(GL_COLOR_CLEAR_VALUE, c.rgba);
+				_clearColor.update(c);
+			}
+			for (int i = 0; i < 4; i++) {
+				rgba[i] = _clearColor.value.rgba[i];
+			}
+		}
+
+		void useProgram (GLuint program) {
+			if (_program.update(program)) {
+				glUseProgram(program);
+				_counters.issued++;
+			}
+			else {
+				_counters.elided++;
+			}
+		}
+
+		/**
+		 * Forget every shadowed value after GL state was changed without the
+		 * tracker.  The active unit is assumed to be back at unit 0.
+		 */
+
+		void invalidate () {
+			Counters counters = _counters;
+			*this = GLState();
+			_counters = counters;
+		}
+
+		const Counters& getCounters () const {
+			return _counters;
+		}
+
+		void resetCounters () {
+			_counters = Counters();
+		}
+
+	protected:
+
+		Cached<bool>* enableSlot (GLenum cap) {
+			switch (cap) {
+				case GL_ALPHA_TEST: return &_caps[CAP_ALPHA_TEST];
+				case GL_BLEND: return &_caps[CAP_BLEND];
+				case GL_CULL_FACE: return &_caps[CAP_CULL_FACE];
+				case GL_DEPTH_TEST: return &_caps[CAP_DEPTH_TEST];
+				case GL_TEXTURE_2D: return (_unit < TEXTURE_UNITS) ? &_textureEnabled[_unit] : NULL;
+			}
+			return NULL;
+		}
+
+		Cached<GLuint>* bindingSlot (GLenum target) {
+			if (_unit >= TEXTURE_UNITS) {
+				return NULL;
+			}
+			switch (target) {
+				case GL_TEXTURE_2D: return &_bindings[_unit][BIND_2D];
+				case GL_TEXTURE_2D_ARRAY_EXT: return &_bindings[_unit][BIND_2D_ARRAY];
+			}
+			return NULL;
+		}
+
+	};
+
+}
+
+#endif /* GFX_GLSTATE_H_ */
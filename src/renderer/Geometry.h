@@ -29,13 +29,14 @@
 #include "Scenegraph.h"
 #include "Mesh.h"
 #include "Texture.h"
+#include "TextureArray.h"
 
 namespace gfx {
 
 	/**
 	 * Geometry reflects an instance of geometric data; more than one Geometry node
 	 * may point to the same data set, but each object reflects a separate spacial
-	 * instance.
+	 * instance.
 	 */
 
 	class Geometry {
@@ -43,7 +44,27 @@ namespace gfx {
 
 		Texture* texture;
 
-		Scenegraph::Node* spacialNode;
+		/**
+		 * When set, the geometry samples layer textureLayer of this array
+		 * instead of texture.  Changing the layer needs no new bind and no
+		 * render queue rebuild.
+		 */
+
+		TextureArray* textureArray;
+		int textureLayer;
+
+		/**
+		 * Texture channel of an InstanceBuffer that picks this geometry's
+		 * texture or layer per instance, or -1.
+		 */
+
+		int textureChannel;
+
+		/**
+		 * Index of the scenegraph node that positions this geometry, or -1.
+		 */
+
+		int spacialNode;
 
 		bool visible;
 		bool alphaTest;
@@ -55,42 +76,62 @@ namespace gfx {
 		unsigned blendDst;
 		unsigned cullFunc;
 
+		/**
+		 * The last frame the renderer found this geometry inside the view
+		 * frustum.  Maintained by RenderGL.
+		 */
+
+		unsigned visibleFrame;
+
 	protected:
 
 		Mesh* _mesh;
 		BoundAABB _aabb;
+		BoundAABB _worldAabb;
 
 	public:
 
 		Geometry ()
-			: texture(NULL), spacialNode(NULL), visible(true), alphaTest(false),
-			  blend(false), cull(false), _mesh(NULL) {
+			: texture(NULL), textureArray(NULL), textureLayer(0), textureChannel(-1), spacialNode(-1), visible(true),
+			  alphaTest(false), blend(false), cull(false), alphaThresh(0.f), blendSrc(GL_ONE), blendDst(GL_ZERO),
+			  cullFunc(GL_BACK), visibleFrame(0), _mesh(NULL) {
 		}
 
 		Geometry (Mesh* meshPtr)
-			: texture(NULL), spacialNode(NULL), visible(true), alphaTest(false),
-			  blend(false), cull(false), _mesh(meshPtr) {
+			: texture(NULL), textureArray(NULL), textureLayer(0), textureChannel(-1), spacialNode(-1), visible(true),
+			  alphaTest(false), blend(false), cull(false), alphaThresh(0.f), blendSrc(GL_ONE), blendDst(GL_ZERO),
+			  cullFunc(GL_BACK), visibleFrame(0), _mesh(meshPtr) {
 		}
 
 		Geometry (Mesh* meshPtr, Texture* texPtr)
-			: texture(texPtr), spacialNode(NULL), visible(true), alphaTest(false),
-			  blend(false), cull(false), _mesh(meshPtr) {
+			: texture(texPtr), textureArray(NULL), textureLayer(0), textureChannel(-1), spacialNode(-1), visible(true),
+			  alphaTest(false), blend(false), cull(false), alphaThresh(0.f), blendSrc(GL_ONE), blendDst(GL_ZERO),
+			  cullFunc(GL_BACK), visibleFrame(0), _mesh(meshPtr) {
 		}
 
 		const BoundAABB& getAABB () const {
 			return _aabb;
 		}
 
+		/**
+		 * The local bound transformed by the world matrix of the spacial
+		 * node, as of the last scenegraph update.
+		 */
+
+		const BoundAABB& getWorldAABB () const {
+			return _worldAabb;
+		}
+
 		bool hasMesh () const {
 			return _mesh != NULL;
 		}
 
 		bool hasSpacialNode () const {
-			return spacialNode != NULL;
+			return spacialNode != -1;
 		}
 
 		bool hasTexture () const {
-			return texture != NULL;
+			return texture != NULL || textureArray != NULL;
 		}
 
 		Mesh* mesh () {
@@ -105,11 +146,53 @@ namespace gfx {
 			_mesh = meshPtr;
 
 			_aabb.reset();
-			_aabb.addPoints(_mesh->getVertexList());
+			if (_mesh->useShortVertices()) {
+				_aabb.addPoints(_mesh->getShortVertexList());
+			}
+			else {
+				_aabb.addPoints(_mesh->getVertexList());
+			}
+		}
+
+		void updateWorldBound (const vmath::Matrix4f& world) {
+			_worldAabb = _aabb;
+			_worldAabb.transform(world);
 		}
 
 	};
 
+	/*
+	 * Defined here rather than in Scenegraph.h, since it needs the complete
+	 * Geometry type.  Children follow their parents in the pool, so a reverse
+	 * pass refits every child before its parent.
+	 */
+
+	inline void Scenegraph::updateBounds () {
+		for (int i = nodeSet.size() - 1; i >= 0; i--) {
+			Node& node = nodeSet[i];
+			if (!node.dirtyBound) {
+				continue;
+			}
+
+			node.bound.reset();
+
+			for (unsigned g = node.geoIndex; g < node.geoIndex + node.geoCount; g++) {
+				geoSet[g]->updateWorldBound(node.worldMatrix);
+				node.bound.addBound(geoSet[g]->getWorldAABB());
+			}
+
+			for (int c = node.firstChild; c != -1; c = nodeSet[c].nextSibling) {
+				node.bound.addBound(nodeSet[c].bound);
+			}
+
+			node.dirtyBound = false;
+
+			if (node.parent != -1) {
+				nodeSet[node.parent].dirtyBound = true;
+			}
+		}
+	}
+
 }
 
 #endif /* GFX_GEOMETRY_H_ */
@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_INSTANCEBUFFER_H_
+#define GFX_INSTANCEBUFFER_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace gfx {
+
+	class Texture;
+
+	/**
+	 * Per-frame world transforms for many instances of one scenegraph.
+	 * Each instance has a placement, which stands in for the root's parent,
+	 * and a GL-order world matrix and visibility flag for every node.  It
+	 * also has a texture for every texture channel, which overrides the
+	 * texture of geometry drawing from that channel.  Data is laid out
+	 * instance by instance so writers can fill disjoint ranges in parallel.
+	 */
+
+	class InstanceBuffer {
+	public:
+
+		/**
+		 * A channel's texture for one instance.  Geometry sampling an array
+		 * uses layer; other geometry uses texture.  NULL or -1 leaves the
+		 * geometry's own.
+		 */
+
+		struct TextureRef {
+			Texture* texture;
+			int layer;
+
+			TextureRef ()
+				: texture(NULL), layer(-1) {
+			}
+
+			TextureRef (Texture* t, int l)
+				: texture(t), layer(l) {
+			}
+		};
+
+	protected:
+
+		unsigned _nodeCount;
+		unsigned _instanceCount;
+		unsigned _channelCount;
+
+		std::vector<float> _placements;
+		std::vector<float> _matrices;
+		std::vector<unsigned char> _visible;
+		std::vector<TextureRef> _textures;
+
+	public:
+
+		InstanceBuffer ()
+			: _nodeCount(0), _instanceCount(0), _channelCount(0) {
+		}
+
+		unsigned getInstanceCount () const {
+			return _instanceCount;
+		}
+
+		unsigned getChannelCount () const {
+			return _channelCount;
+		}
+
+		unsigned getNodeCount () const {
+			return _nodeCount;
+		}
+
+		const float* getMatrix (unsigned instance, unsigned node) const {
+			return &_matrices[(instance * _nodeCount + node) * 16];
+		}
+
+		float* getMatrix (unsigned instance, unsigned node) {
+			return &_matrices[(instance * _nodeCount + node) * 16];
+		}
+
+		const float* getPlacement (unsigned instance) const {
+			return &_placements[instance * 16];
+		}
+
+		float* getPlacement (unsigned instance) {
+			return &_placements[instance * 16];
+		}
+
+		bool isVisible (unsigned instance, unsigned node) const {
+			return _visible[instance * _nodeCount + node] != 0;
+		}
+
+		unsigned char* getVisibility (unsigned instance) {
+			return &_visible[instance * _nodeCount];
+		}
+
+		const TextureRef& getTexture (unsigned instance, unsigned channel) const {
+			return _textures[instance * _channelCount + channel];
+		}
+
+		TextureRef* getTextures (unsigned instance) {
+			return &_textures[instance * _channelCount];
+		}
+
+		void resize (unsigned instanceCount, unsigned nodeCount, unsigned channelCount = 0) {
+			_instanceCount = instanceCount;
+			_nodeCount = nodeCount;
+			_channelCount = channelCount;
+			_placements.resize(instanceCount * 16);
+			_matrices.resize(instanceCount * nodeCount * 16);
+			_visible.resize(instanceCount * nodeCount, 1);
+			_textures.resize(instanceCount * channelCount);
+		}
+	};
+
+}
+
+#endif /* GFX_INSTANCEBUFFER_H_ */
@@ -38,6 +38,7 @@ namespace gfx {
 	protected:
 
 		std::vector<vertex3f> vertexList;
+		std::vector<vertex3s> shortVertexList;
 		std::vector<normal3f> normalList;
 		std::vector<color4ub> colorList;
 		std::vector<texCoord2f> texCoordList;
@@ -48,6 +49,8 @@ namespace gfx {
 
 		unsigned int vtxBitmask;
 
+		int bufferId;
+
 	public:
 
 		enum {
@@ -55,16 +58,20 @@ namespace gfx {
 			VTX_NORMAL = 2,
 			VTX_COLOR = 4,
 			VTX_TEXCOORD = 8,
+
+			// Outside the default mask, so only meshes that ask for 16-bit
+			// positions keep them
+			VTX_SHORT_VERTEX = 0x10000,
 		};
 
 		Mesh ()
-			: vertexList(0), normalList(0), colorList(0), texCoordList(0), vertexCount(0),
-			  indexList(0), indexCount(0), vtxBitmask(0xFFFF) {
+			: vertexList(0), shortVertexList(0), normalList(0), colorList(0), texCoordList(0), vertexCount(0),
+			  indexList(0), indexCount(0), vtxBitmask(0xFFFF), bufferId(-1) {
 		}
 
 		Mesh (unsigned int bitmask)
-			: vertexList(0), normalList(0), colorList(0), texCoordList(0), vertexCount(0),
-			  indexList(0), indexCount(0), vtxBitmask(bitmask) {
+			: vertexList(0), shortVertexList(0), normalList(0), colorList(0), texCoordList(0), vertexCount(0),
+			  indexList(0), indexCount(0), vtxBitmask(bitmask), bufferId(-1) {
 		}
 
 		void addIndex (unsigned int idx) {
@@ -80,6 +87,9 @@ namespace gfx {
 			if (vtxBitmask & VTX_VERTEX) {
 				vertexList.push_back(vdef.vertex);
 			}
+			if (vtxBitmask & VTX_SHORT_VERTEX) {
+				shortVertexList.push_back(vdef.shortVertex);
+			}
 			if (vtxBitmask & VTX_NORMAL) {
 				normalList.push_back(vdef.normal);
 			}
@@ -95,10 +105,26 @@ namespace gfx {
 
 		void clear () {
 			vertexList.clear();
+			shortVertexList.clear();
 			normalList.clear();
 			colorList.clear();
 			texCoordList.clear();
 			indexList.clear();
+			vertexCount = 0;
+			indexCount = 0;
+		}
+
+		/**
+		 * The renderer's buffer holding a copy of this mesh, or -1 if the
+		 * mesh is drawn from its lists.
+		 */
+
+		int getBufferId () const {
+			return bufferId;
+		}
+
+		void setBufferId (int id) {
+			bufferId = id;
 		}
 
 		const std::vector<color4ub>& getColorList () const {
@@ -113,6 +139,50 @@ namespace gfx {
 			return indexList;
 		}
 
+		/**
+		 * Position idx as floats, from whichever position list the mesh
+		 * keeps.  16-bit positions are not scaled.
+		 */
+
+		vertex3f getPosition (unsigned idx) const {
+			if (vtxBitmask & VTX_SHORT_VERTEX) {
+				const vertex3s& v = shortVertexList[idx];
+				return vertex3f(v.x, v.y, v.z);
+			}
+			return vertexList[idx];
+		}
+
+		/**
+		 * All positions as floats, for meshes that keep 16-bit positions
+		 * and only need floats now and then (picking).
+		 */
+
+		void getPositions (std::vector<vertex3f>& out) const {
+			if (!(vtxBitmask & VTX_SHORT_VERTEX)) {
+				out = vertexList;
+				return;
+			}
+
+			out.resize(shortVertexList.size());
+			if (out.empty()) {
+				return;
+			}
+
+			// Padding is widened along with the rest and skipped
+			std::vector<float> widened(shortVertexList.size() * 4);
+#ifdef VMATH_SSE
+			vmath::simd::shortsToFloats(&shortVertexList[0].x, widened.size(), &widened[0]);
+#else
+			const short* in = &shortVertexList[0].x;
+			for (unsigned i = 0; i < widened.size(); i++) {
+				widened[i] = in[i];
+			}
+#endif
+			for (unsigned i = 0; i < out.size(); i++) {
+				out[i] = vertex3f(widened[i * 4 + 0], widened[i * 4 + 1], widened[i * 4 + 2]);
+			}
+		}
+
 		const std::vector<normal3f>& getNormalList () const {
 			return normalList;
 		}
@@ -125,6 +195,10 @@ namespace gfx {
 			return vertexCount;
 		}
 
+		const std::vector<vertex3s>& getShortVertexList () const {
+			return shortVertexList;
+		}
+
 		const std::vector<vertex3f>& getVertexList () const {
 			return vertexList;
 		}
@@ -162,6 +236,17 @@ namespace gfx {
 			setState(VTX_TEXCOORD, state);
 		}
 
+		bool useShortVertices () const {
+			return (vtxBitmask & VTX_SHORT_VERTEX);
+		}
+
+		void useShortVertices (bool state) {
+			if (state != (bool)(vtxBitmask & VTX_SHORT_VERTEX)) {
+				clear();
+			}
+			setState(VTX_SHORT_VERTEX, state);
+		}
+
 		bool useVertices () const {
 			return (vtxBitmask & VTX_VERTEX);
 		}
@@ -0,0 +1,322 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_OITBUFFER_H_
+#define GFX_OITBUFFER_H_
+
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+#include <iostream>
+#include <string>
+
+#include "GLState.h"
+#include "Shader.h"
+
+namespace gfx {
+
+	/**
+	 * Off-screen targets for weighted blended order-independent transparency
+	 * (McGuire & Bavoil 2013).  Transparent fragments are accumulated in any
+	 * order into two floating point targets, then resolved over the opaque
+	 * scene in a single full-screen pass.
+	 *
+	 * Target 0 holds the weighted, premultiplied color sum in RGB and the
+	 * revealage product in A.  Target 1 holds the weight sum in R.  Both are
+	 * written with one separate blend function: RGB adds, A multiplies by
+	 * (1 - alpha), which keeps the technique within GL 2.1.
+	 */
+
+	class OITBuffer {
+	protected:
+
+		GLuint _fbo;
+		GLuint _accumTex;
+		GLuint _weightTex;
+		GLuint _depthRb;
+
+		int _width;
+		int _height;
+		bool _failed;
+
+		Shader _accumShader;
+		Shader _resolveShader;
+
+		GLint _useTextureLoc;
+
+		bool _savedBlend;
+		bool _savedDepthTest;
+		bool _savedDepthMask;
+
+	public:
+
+		OITBuffer ()
+			: _fbo(0), _accumTex(0), _weightTex(0), _depthRb(0), _width(0), _height(0),
+			  _failed(false), _useTextureLoc(-1), _savedBlend(false), _savedDepthTest(true),
+			  _savedDepthMask(true) {
+		}
+
+		/**
+		 * Start the accumulation pass.  The opaque depth buffer is copied in
+		 * so transparent fragments are still occluded by solid geometry.
+		 * Returns false if OIT is unavailable on this context.
+		 */
+
+		bool begin () {
+			if (!prepare()) {
+				return false;
+			}
+
+			GLState& gl = GLState::getState();
+
+			// Saved through the tracker rather than pushed, so it stays in
+			// step with what end() restores
+			_savedBlend = gl.isEnabled(GL_BLEND);
+			_savedDepthTest = gl.isEnabled(GL_DEPTH_TEST);
+			_savedDepthMask = gl.getDepthMask();
+
+			glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, 0);
+			glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, _fbo);
+			glBlitFramebufferEXT(0, 0, _width, _height, 0, 0, _width, _height,
+					GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _fbo);
+
+			GLenum buffers[2] = { GL_COLOR_ATTACHMENT0_EXT, GL_COLOR_ATTACHMENT1_EXT };
+			glDrawBuffers(2, buffers);
+
+			GLfloat clearColor[4];
+			gl.getClearColor(clearColor);
+			gl.clearColor(0.f, 0.f, 0.f, 1.f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			gl.clearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+			gl.depthMask(false);
+			gl.enable(GL_BLEND);
+			gl.blendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+			_accumShader.bind();
+			glUniform1i(_accumShader.uniform("tex"), 0);
+
+			return true;
+		}
+
+		/**
+		 * Finish accumulation and composite the result over the default
+		 * framebuffer.  Restores the blend enable and depth state saved by
+		 * begin(), and leaves texture units 0 and 1 unbound.
+		 */
+
+		void end () {
+			GLState& gl = GLState::getState();
+
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+			_resolveShader.bind();
+			glUniform1i(_resolveShader.uniform("accumTex"), 0);
+			glUniform1i(_resolveShader.uniform("weightTex"), 1);
+
+			gl.activeTexture(GL_TEXTURE1);
+			gl.bindTexture(GL_TEXTURE_2D, _weightTex);
+			gl.activeTexture(GL_TEXTURE0);
+			gl.bindTexture(GL_TEXTURE_2D, _accumTex);
+
+			// The caller may have reset blending since begin()
+			gl.enable(GL_BLEND);
+			gl.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			gl.disable(GL_DEPTH_TEST);
+
+			glMatrixMode(GL_PROJECTION);
+			glPushMatrix();
+			glLoadIdentity();
+			glMatrixMode(GL_MODELVIEW);
+			glPushMatrix();
+			glLoadIdentity();
+
+			glBegin(GL_QUADS);
+				glTexCoord2f(0.f, 0.f); glVertex2f(-1.f, -1.f);
+				glTexCoord2f(1.f, 0.f); glVertex2f(1.f, -1.f);
+				glTexCoord2f(1.f, 1.f); glVertex2f(1.f, 1.f);
+				glTexCoord2f(0.f, 1.f); glVertex2f(-1.f, 1.f);
+			glEnd();
+
+			glPopMatrix();
+			glMatrixMode(GL_PROJECTION);
+			glPopMatrix();
+			glMatrixMode(GL_MODELVIEW);
+
+			gl.setEnabled(GL_BLEND, _savedBlend);
+			gl.setEnabled(GL_DEPTH_TEST, _savedDepthTest);
+			gl.depthMask(_savedDepthMask);
+
+			gl.activeTexture(GL_TEXTURE1);
+			gl.bindTexture(GL_TEXTURE_2D, 0);
+			gl.activeTexture(GL_TEXTURE0);
+			gl.bindTexture(GL_TEXTURE_2D, 0);
+
+			Shader::unbind();
+		}
+
+		bool isAvailable () const {
+			return !_failed;
+		}
+
+		/**
+		 * Tell the accumulation shader whether the current geometry is
+		 * textured.  Only valid between begin() and end().
+		 */
+
+		void useTexture (bool state) {
+			glUniform1f(_useTextureLoc, state ? 1.f : 0.f);
+		}
+
+	protected:
+
+		bool prepare () {
+			if (_failed) {
+				return false;
+			}
+
+			if (!_accumShader.isValid()) {
+				if (!_accumShader.build(accumVertexSrc(), accumFragmentSrc())
+						|| !_resolveShader.build(resolveVertexSrc(), resolveFragmentSrc())) {
+					std::cout << "(!!) OIT shaders unavailable: " << _accumShader.getLog()
+							<< _resolveShader.getLog() << std::endl;
+					_failed = true;
+					return false;
+				}
+				_useTextureLoc = _accumShader.uniform("useTexture");
+			}
+
+			GLint viewport[4];
+			glGetIntegerv(GL_VIEWPORT, viewport);
+
+			if (_fbo == 0 || viewport[2] != _width || viewport[3] != _height) {
+				if (!resize(viewport[2], viewport[3])) {
+					std::cout << "(!!) OIT framebuffer incomplete" << std::endl;
+					_failed = true;
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool resize (int width, int height) {
+			_width = width;
+			_height = height;
+
+			if (_fbo == 0) {
+				glGenFramebuffersEXT(1, &_fbo);
+				glGenTextures(1, &_accumTex);
+				glGenTextures(1, &_weightTex);
+				glGenRenderbuffersEXT(1, &_depthRb);
+			}
+
+			setupTarget(_accumTex);
+			setupTarget(_weightTex);
+
+			glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, _depthRb);
+			glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH24_STENCIL8_EXT, _width, _height);
+			glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _fbo);
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, _accumTex, 0);
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT1_EXT, GL_TEXTURE_2D, _weightTex, 0);
+			glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, _depthRb);
+			glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_STENCIL_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, _depthRb);
+
+			GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+			return status == GL_FRAMEBUFFER_COMPLETE_EXT;
+		}
+
+		void setupTarget (GLuint tex) {
+			GLState& gl = GLState::getState();
+
+			gl.bindTexture(GL_TEXTURE_2D, tex);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F_ARB, _width, _height, 0, GL_RGBA, GL_FLOAT, NULL);
+			gl.bindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		static std::string accumVertexSrc () {
+			return
+				"#version 120\n"
+				"varying float viewDepth;\n"
+				"void main () {\n"
+				"	gl_Position = ftransform();\n"
+				"	gl_FrontColor = gl_Color;\n"
+				"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+				"	viewDepth = -(gl_ModelViewMatrix * gl_Vertex).z;\n"
+				"}\n";
+		}
+
+		static std::string accumFragmentSrc () {
+			return
+				"#version 120\n"
+				"uniform sampler2D tex;\n"
+				"uniform float useTexture;\n"
+				"varying float viewDepth;\n"
+				"void main () {\n"
+				"	vec4 c = gl_Color;\n"
+				"	if (useTexture > 0.5) c *= texture2D(tex, gl_TexCoord[0].st);\n"
+				"	float d = viewDepth / 200.0;\n"
+				"	float w = c.a * clamp(0.03 / (1e-5 + d * d * d * d), 1e-2, 3e3);\n"
+				"	gl_FragData[0] = vec4(c.rgb * c.a * w, c.a);\n"
+				"	gl_FragData[1] = vec4(c.a * w, 0.0, 0.0, c.a);\n"
+				"}\n";
+		}
+
+		static std::string resolveVertexSrc () {
+			return
+				"#version 120\n"
+				"void main () {\n"
+				"	gl_Position = gl_Vertex;\n"
+				"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+				"}\n";
+		}
+
+		static std::string resolveFragmentSrc () {
+			return
+				"#version 120\n"
+				"uniform sampler2D accumTex;\n"
+				"uniform sampler2D weightTex;\n"
+				"void main () {\n"
+				"	vec4 accum = texture2D(accumTex, gl_TexCoord[0].st);\n"
+				"	float weight = texture2D(weightTex, gl_TexCoord[0].st).r;\n"
+				"	if (accum.a >= 1.0) discard;\n"
+				"	gl_FragColor = vec4(accum.rgb / max(weight, 1e-5), 1.0 - accum.a);\n"
+				"}\n";
+		}
+
+	};
+
+}
+
+#endif /* GFX_OITBUFFER_H_ */
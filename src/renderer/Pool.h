@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_POOL_H_
+#define GFX_POOL_H_
+
+#include <new>
+#include <vector>
+
+namespace gfx {
+
+	/**
+	 * A pool of objects addressed by generational handles.
+	 *
+	 * Objects are stored in fixed size blocks of BLOCK_SIZE, so they sit
+	 * contiguously for iteration and never move once added; pointers to
+	 * them stay valid until they are removed.  Removing an object bumps its
+	 * slot's generation and frees the slot for reuse, so handles to it from
+	 * before then no longer resolve.
+	 */
+
+	template <typename T>
+	class Pool {
+	public:
+
+		enum {
+			BLOCK_SIZE = 256,
+		};
+
+		struct Handle {
+			unsigned index;
+			unsigned generation;
+
+			Handle ()
+				: index(~0u), generation(0) {
+			}
+
+			Handle (unsigned i, unsigned g)
+				: index(i), generation(g) {
+			}
+
+			bool operator== (const Handle& h) const {
+				return index == h.index && generation == h.generation;
+			}
+
+			bool operator!= (const Handle& h) const {
+				return !(*this == h);
+			}
+		};
+
+	protected:
+
+		std::vector<T*> _blocks;
+		std::vector<unsigned> _generations;
+		std::vector<unsigned char> _alive;
+		std::vector<unsigned> _free;
+		unsigned _count;
+
+	public:
+
+		Pool ()
+			: _count(0) {
+		}
+
+		virtual ~Pool () {
+			clear();
+		}
+
+		/**
+		 * Copy obj into a slot, reusing the most recently freed one first.
+		 */
+
+		Handle add (const T& obj) {
+			unsigned index;
+			if (!_free.empty()) {
+				index = _free.back();
+				_free.pop_back();
+			}
+			else {
+				index = _generations.size();
+				if (index % BLOCK_SIZE == 0) {
+					_blocks.push_back(static_cast<T*>(::operator new(sizeof(T) * BLOCK_SIZE)));
+				}
+				_generations.push_back(0);
+				_alive.push_back(0);
+			}
+
+			new (slot(index)) T(obj);
+			_alive[index] = 1;
+			_count++;
+
+			return Handle(index, _generations[index]);
+		}
+
+		/**
+		 * The object a handle refers to, or NULL if it has been removed.
+		 */
+
+		T* get (const Handle& h) {
+			return isValid(h) ? slot(h.index) : NULL;
+		}
+
+		const T* get (const Handle& h) const {
+			return isValid(h) ? slot(h.index) : NULL;
+		}
+
+		/**
+		 * The live object in slot index, or NULL.  Slots run from 0 to
+		 * capacity(); freed slots are skipped by returning NULL.
+		 */
+
+		T* at (unsigned index) {
+			return (index < _alive.size() && _alive[index]) ? slot(index) : NULL;
+		}
+
+		const T* at (unsigned index) const {
+			return (index < _alive.size() && _alive[index]) ? slot(index) : NULL;
+		}
+
+		/**
+		 * The current handle to the live object in slot index.
+		 */
+
+		Handle handle (unsigned index) const {
+			return Handle(index, _generations[index]);
+		}
+
+		/**
+		 * Slot index of an object in the pool, found by its address, or -1.
+		 */
+
+		int indexOf (const T* obj) const {
+			for (unsigned b = 0; b < _blocks.size(); b++) {
+				if (obj >= _blocks[b] && obj < _blocks[b] + BLOCK_SIZE) {
+					return b * BLOCK_SIZE + (obj - _blocks[b]);
+				}
+			}
+			return -1;
+		}
+
+		bool isValid (const Handle& h) const {
+			return h.index < _alive.size() && _alive[h.index] && _generations[h.index] == h.generation;
+		}
+
+		void remove (const Handle& h) {
+			if (!isValid(h)) {
+				return;
+			}
+
+			slot(h.index)->~T();
+			_alive[h.index] = 0;
+			_generations[h.index]++;
+			_free.push_back(h.index);
+			_count--;
+		}
+
+		void clear () {
+			for (unsigned i = 0; i < _alive.size(); i++) {
+				if (_alive[i]) {
+					slot(i)->~T();
+				}
+			}
+			for (unsigned b = 0; b < _blocks.size(); b++) {
+				::operator delete(_blocks[b]);
+			}
+
+			_blocks.clear();
+			_generations.clear();
+			_alive.clear();
+			_free.clear();
+			_count = 0;
+		}
+
+		/**
+		 * Number of slots, live or free.
+		 */
+
+		unsigned capacity () const {
+			return _alive.size();
+		}
+
+		/**
+		 * Number of live objects.
+		 */
+
+		unsigned size () const {
+			return _count;
+		}
+
+	protected:
+
+		T* slot (unsigned index) const {
+			return _blocks[index / BLOCK_SIZE] + (index % BLOCK_SIZE);
+		}
+
+	private:
+
+		// Copying would hand out a second set of addresses for the same
+		// handles, so pools are not copyable
+		Pool (const Pool&);
+		Pool& operator= (const Pool&);
+
+	};
+
+}
+
+#endif /* GFX_POOL_H_ */
@@ -27,71 +27,381 @@
 #define GFX_RENDERGL_H_
 
 #include <OpenGL/gl.h>
+#include <cmath>
+#include <iostream>
+#include <string>
 #include <vector>
+#include <list>
+#include <map>
 #include <algorithm>
+#include <stdexcept>
 
 #include "../vecmath/Vecmath.h"
 #include "../vecmath/MatrixG4.h"
 #include "Mesh.h"
+#include "Pool.h"
+#include "GLState.h"
 #include "Texture.h"
-#include "CameraController.h"
+#include "TextureArray.h"
+#include "Shader.h"
+#include "Scenegraph.h"
+#include "Frustum.h"
+#include "BVH.h"
+#include "RenderQueue.h"
+#include "OITBuffer.h"
+#include "DepthSort.h"
+#include "Camera.h"
+#include "InstanceBuffer.h"
 #include "../AppState.h"
 
 namespace gfx {
 
 	/**
-	 * Sorting function for rendering transparent meshes back-to-font.
-	 * Right now this is a hack and very inefficient.  Sorting by mesh
-	 * is also not sufficient sometimes.
+	 * Main rendering class.  This class owns most of its resources, so
+	 * the client need not worry about cleaning up returned pointers.
+	 *
+	 * Meshes, textures and geometry live in pools: each can be created and
+	 * destroyed by handle, and a destroyed resource's handle stops
+	 * resolving rather than dangling.  Pointers returned by the add
+	 * functions stay valid until that resource is destroyed.  Destroying
+	 * geometry detaches it from the scenegraph, and a mesh or texture
+	 * still in use refuses to be destroyed, so no pointer the renderer
+	 * draws through is left dangling.
 	 */
 
-	bool blendSort (const Geometry* a, const Geometry* b) {
-		CameraController& cc = CameraController::getController();
+	class RenderGL {
+	public:
 
-		vmath::Vector3f transEye = cc.camera->getEye();
-		//cc.camera->getCameraTransform().transform(transEye);
+		/**
+		 * Per-frame counters, reset at the start of each drawGeometry call.
+		 * stateChanges and elidedChanges count the GL state calls the
+		 * GLState tracker issued and skipped during the call.
+		 */
 
-		vmath::Vector3f transA = a->getAABB().center();
-		vmath::Vector3f transB = b->getAABB().center();
-		cc.camera->getCameraTransform().transform(transA);
-		cc.camera->getCameraTransform().transform(transB);
+		struct RenderStats {
+			unsigned drawCalls;
+			unsigned stateChanges;
+			unsigned elidedChanges;
+			unsigned textureBinds;
+			unsigned queueRebuilds;
+			unsigned culledNodes;
+			unsigned culledGeometry;
+			unsigned culledInstances;
 
-		vmath::Vector3f dista = transA - transEye;
-		vmath::Vector3f distb = transB - transEye;
+			RenderStats ()
+				: drawCalls(0), stateChanges(0), elidedChanges(0), textureBinds(0), queueRebuilds(0),
+				  culledNodes(0), culledGeometry(0), culledInstances(0) {
+			}
 
-		return dista.length() > distb.length();
-	}
+			void reset () {
+				drawCalls = 0;
+				stateChanges = 0;
+				elidedChanges = 0;
+				textureBinds = 0;
+				queueRebuilds = 0;
+				culledNodes = 0;
+				culledGeometry = 0;
+				culledInstances = 0;
+			}
+		};
 
-	/**
-	 * Main rendering class.  This class owns most of its resources, so
-	 * the client need not worry about cleaning up returned pointers.
-	 */
+	protected:
+
+		/**
+		 * The textures last applied while drawing a queue.  The GL state
+		 * itself is shadowed by GLState; this tracks which objects it came
+		 * from, so texturing is only toggled when geometry gains or loses
+		 * a texture.
+		 */
+
+		struct DrawState {
+			Texture* texture;
+			TextureArray* textureArray;
+			int textureLayer;
+
+			DrawState ()
+				: texture(NULL), textureArray(NULL), textureLayer(-1) {
+			}
+		};
+
+		/**
+		 * Static buffers holding a copy of one mesh.  Vertex attributes are
+		 * stored one list after another in a single buffer; positions come
+		 * first, float positions then any 16-bit vertex3s positions.
+		 */
+
+		struct MeshBuffer {
+			GLuint vertexBuffer;
+			GLuint indexBuffer;
+			GLsizei indexCount;
+			GLsizeiptr shortVertexOffset;
+			GLsizeiptr normalOffset;
+			GLsizeiptr colorOffset;
+			GLsizeiptr texCoordOffset;
+
+			MeshBuffer ()
+				: vertexBuffer(0), indexBuffer(0), indexCount(0), shortVertexOffset(0), normalOffset(0),
+				  colorOffset(0), texCoordOffset(0) {
+			}
+		};
 
-	class RenderGL {
 	protected:
 
-		std::list<Mesh> meshList;
-		std::vector<Texture> textures;
+		Pool<Mesh> meshList;
+		std::vector<MeshBuffer> _meshBuffers;
+		std::vector<int> _freeMeshBuffers;
+		Pool<Texture> textures;
+		std::list<TextureArray> textureArrays;
 
-		std::vector<Geometry> geoList;
+		Pool<Geometry> geoList;
 
 		Camera* _camera;
+		Scenegraph* _scenegraph;
+		const BVH* _bvh;
+		std::vector<unsigned> _bvhVisible;
+		const InstanceBuffer* _instances;
+		std::vector<unsigned char> _instanceVisible;
+
+		Frustum _frustum;
+		std::vector<unsigned> _cullMasks;
+		unsigned _frame;
+		bool _culling;
+
+		RenderQueue _opaqueQueue;
+		std::vector<const Geometry*> _blendQueue;
+		std::vector<DepthKey> _blendKeys;
+		std::vector<float> _blendRadius;
+		std::vector<DepthKey> _triKeys;
+		std::vector<std::pair<const Geometry*, unsigned> > _triRefs;
+		std::vector<DepthKey> _sortScratch;
+		bool _queueDirty;
+		int _queueSelectState;
+		int _queueSelectIndex;
+
+		OITBuffer _oit;
+
+		Shader _arrayShader;
+		GLint _arrayLayerLoc;
+		int _arraySupport;
+		bool _arraysEnabled;
+
+		DrawState _drawState;
+		RenderStats _stats;
 
 	public:
 
+		typedef Pool<Mesh>::Handle MeshHandle;
+		typedef Pool<Texture>::Handle TextureHandle;
+		typedef Pool<Geometry>::Handle GeometryHandle;
+
+		RenderGL ()
+			: _camera(NULL), _scenegraph(NULL), _bvh(NULL), _instances(NULL), _frame(0), _culling(false), _queueDirty(true),
+			  _queueSelectState(-1), _queueSelectIndex(-1), _arrayLayerLoc(-1), _arraySupport(-1),
+			  _arraysEnabled(true) {
+		}
+
 		Geometry* addGeometry (const Geometry& geo) {
-			geoList.push_back(geo);
-			return &geoList.back();
+			return getGeometry(createGeometry(geo));
 		}
 
 		Mesh* addMesh (const Mesh& mesh) {
-			meshList.push_back(mesh);
-			return &meshList.back();
+			return getMesh(createMesh(mesh));
 		}
 
 		Texture* addTexture (const Texture& tex) {
-			textures.push_back(tex);
-			return &textures.back();
+			return getTexture(createTexture(tex));
+		}
+
+		GeometryHandle createGeometry (const Geometry& geo) {
+			_queueDirty = true;
+			return geoList.add(geo);
+		}
+
+		MeshHandle createMesh (const Mesh& mesh) {
+			return meshList.add(mesh);
+		}
+
+		TextureHandle createTexture (const Texture& tex) {
+			return textures.add(tex);
+		}
+
+		/**
+		 * Destroy a geometry, detaching it from the scenegraph first.  A BVH
+		 * holds scenegraph geometry indices, which detaching shifts, so
+		 * the BVH is dropped and culling walks the scenegraph until a
+		 * rebuilt one is set.
+		 */
+
+		void destroyGeometry (GeometryHandle handle) {
+			Geometry* geo = geoList.get(handle);
+			if (geo == NULL) {
+				return;
+			}
+
+			if (_scenegraph != NULL && _scenegraph->removeGeometry(geo)) {
+				_bvh = NULL;
+			}
+			geoList.remove(handle);
+			_queueDirty = true;
+		}
+
+		/**
+		 * Destroy a mesh and its buffers.  Throws, destroying nothing, if
+		 * live geometry still uses it.
+		 */
+
+		void destroyMesh (MeshHandle handle) {
+			Mesh* mesh = meshList.get(handle);
+			if (mesh == NULL) {
+				return;
+			}
+
+			for (unsigned i = 0; i < geoList.capacity(); i++) {
+				const Geometry* geo = geoList.at(i);
+				if (geo != NULL && geo->mesh() == mesh) {
+					throw std::logic_error("Mesh destroyed while geometry still uses it");
+				}
+			}
+
+			releaseMesh(mesh);
+			meshList.remove(handle);
+		}
+
+		/**
+		 * Destroy a texture and its GL object.  Throws, destroying nothing,
+		 * if live geometry or a texture array still uses it.
+		 */
+
+		void destroyTexture (TextureHandle handle) {
+			Texture* tex = textures.get(handle);
+			if (tex == NULL) {
+				return;
+			}
+
+			for (unsigned i = 0; i < geoList.capacity(); i++) {
+				const Geometry* geo = geoList.at(i);
+				if (geo != NULL && geo->texture == tex) {
+					throw std::logic_error("Texture destroyed while geometry still uses it");
+				}
+			}
+			for (std::list<TextureArray>::const_iterator iter = textureArrays.begin(); iter != textureArrays.end(); ++iter) {
+				for (unsigned l = 0; l < iter->getLayerCount(); l++) {
+					if (iter->getLayerTexture(l) == tex) {
+						throw std::logic_error("Texture destroyed while a texture array still uses it");
+					}
+				}
+			}
+
+			tex->release();
+			textures.remove(handle);
+		}
+
+		Geometry* getGeometry (GeometryHandle handle) {
+			return geoList.get(handle);
+		}
+
+		Mesh* getMesh (MeshHandle handle) {
+			return meshList.get(handle);
+		}
+
+		Texture* getTexture (TextureHandle handle) {
+			return textures.get(handle);
+		}
+
+		/**
+		 * Upload layers as one texture array.  Returns NULL if the layers
+		 * differ in size or format, or the context can't sample arrays; the
+		 * caller should keep using the separate textures then.
+		 */
+
+		TextureArray* addTextureArray (const std::vector<Texture*>& layers) {
+			if (!TextureArray::isCompatible(layers) || !prepareArrays()) {
+				return NULL;
+			}
+
+			textureArrays.push_back(TextureArray(layers));
+			return &textureArrays.back();
+		}
+
+		/**
+		 * Copy every mesh not yet uploaded into static vertex and index
+		 * buffers, and draw them from there from now on.  Meshes keep their
+		 * lists, which bounds and transparency sorting still read, so a mesh
+		 * must not change once uploaded.
+		 */
+
+		void uploadMeshes () {
+			for (unsigned i = 0; i < meshList.capacity(); i++) {
+				Mesh* mesh = meshList.at(i);
+				if (mesh != NULL) {
+					uploadMesh(mesh);
+				}
+			}
+		}
+
+		void uploadMesh (Mesh* mesh) {
+			if (mesh->getBufferId() != -1 || mesh->getIndexCount() == 0) {
+				return;
+			}
+
+			MeshBuffer mb;
+			GLsizeiptr floatVertexBytes = mesh->getVertexList().size() * sizeof(vertex3f);
+			GLsizeiptr shortVertexBytes = mesh->getShortVertexList().size() * sizeof(vertex3s);
+			GLsizeiptr normalBytes = mesh->getNormalList().size() * sizeof(normal3f);
+			GLsizeiptr colorBytes = mesh->getColorList().size() * sizeof(color4ub);
+			GLsizeiptr texCoordBytes = mesh->getTexCoordList().size() * sizeof(texCoord2f);
+
+			mb.shortVertexOffset = floatVertexBytes;
+			mb.normalOffset = mb.shortVertexOffset + shortVertexBytes;
+			mb.colorOffset = mb.normalOffset + normalBytes;
+			mb.texCoordOffset = mb.colorOffset + colorBytes;
+			mb.indexCount = mesh->getIndexCount();
+
+			glGenBuffers(1, &mb.vertexBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, mb.vertexBuffer);
+			glBufferData(GL_ARRAY_BUFFER, mb.texCoordOffset + texCoordBytes, NULL, GL_STATIC_DRAW);
+			bufferList(0, mesh->getVertexList());
+			bufferList(mb.shortVertexOffset, mesh->getShortVertexList());
+			bufferList(mb.normalOffset, mesh->getNormalList());
+			bufferList(mb.colorOffset, mesh->getColorList());
+			bufferList(mb.texCoordOffset, mesh->getTexCoordList());
+
+			glGenBuffers(1, &mb.indexBuffer);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mb.indexBuffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, mb.indexCount * sizeof(GLuint),
+					&mesh->getIndexList()[0], GL_STATIC_DRAW);
+
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+			if (!_freeMeshBuffers.empty()) {
+				mesh->setBufferId(_freeMeshBuffers.back());
+				_freeMeshBuffers.pop_back();
+				_meshBuffers[mesh->getBufferId()] = mb;
+			}
+			else {
+				mesh->setBufferId(_meshBuffers.size());
+				_meshBuffers.push_back(mb);
+			}
+		}
+
+		/**
+		 * Delete a mesh's buffers; it is drawn from its lists again until
+		 * uploaded anew.
+		 */
+
+		void releaseMesh (Mesh* mesh) {
+			int id = mesh->getBufferId();
+			if (id == -1) {
+				return;
+			}
+
+			glDeleteBuffers(1, &_meshBuffers[id].vertexBuffer);
+			glDeleteBuffers(1, &_meshBuffers[id].indexBuffer);
+			_meshBuffers[id] = MeshBuffer();
+			_freeMeshBuffers.push_back(id);
+
+			mesh->setBufferId(-1);
 		}
 
 		void camera (Camera* cam) {
@@ -99,87 +409,404 @@ namespace gfx {
 		}
 
 		/**
-		 * Draw all geometry added to the renderer.  First solid objects are
-		 * drawn, then any transparent meshes are sorted and drawn.
+		 * Set the scenegraph that positions the geometry.  It must be set
+		 * before drawing; only geometry attached to visible nodes inside the
+		 * view frustum is drawn.
+		 */
+
+		void scenegraph (Scenegraph* sg) {
+			_scenegraph = sg;
+		}
+
+		/**
+		 * Cull with a BVH built over the scenegraph's geometry instead of
+		 * walking the scenegraph.  Suits large static scenes.  Pass NULL to
+		 * walk the scenegraph again.
+		 */
+
+		void bvh (const BVH* tree) {
+			_bvh = tree;
+		}
+
+		/**
+		 * Draw many instances of the scenegraph, placed by the world matrices
+		 * and node visibility in buffer, instead of the scenegraph's own.
+		 * Pass NULL to go back to drawing the scenegraph once.  The buffer
+		 * must stay valid, and is read at draw time.
+		 */
+
+		void instances (const InstanceBuffer* buffer) {
+			_instances = buffer;
+			_queueDirty = true;
+		}
+
+		/**
+		 * Mark the render queues out of date.  Call after changing the
+		 * visibility or render state of any geometry.
+		 */
+
+		void invalidateQueue () {
+			_queueDirty = true;
+		}
+
+		/**
+		 * Draw all geometry added to the renderer.  Geometry outside the view
+		 * frustum is culled first, then solid objects are drawn in state-sorted
+		 * order, then any transparent meshes are sorted and drawn.
 		 */
 
 		void drawGeometry () {
+			if (_scenegraph == NULL) {
+				return;
+			}
+
+			_stats.reset();
+			checkQueue();
+
+			GLState::Counters counters = GLState::getState().getCounters();
+
+			if (_instances != NULL) {
+				drawInstances();
+				resetState();
+				countState(counters);
+				return;
+			}
+
+			cullScene();
+
+			const std::vector<RenderQueue::Entry>& entries = _opaqueQueue.getEntries();
+			for (unsigned i = 0; i < entries.size(); i++) {
+				if (!isDrawable(entries[i].geo)) {
+					_stats.culledGeometry++;
+					continue;
+				}
+				drawGeometry(entries[i].geo);
+			}
+
 			AppState& state = AppState::getState();
-			std::vector<const Geometry*> blended;
+			if (state.vars.transparencyMode != AppState::Vars::TRANSPARENCY_WEIGHTED || !drawBlendedWeighted()) {
+				drawBlended();
+			}
 
-			for (unsigned i = 0; i < geoList.size(); i++) {
-				const Geometry* citer = &geoList[i];
-				if (state.vars.selectState == AppState::Vars::SELECT_SGNODE && state.vars.selectIndex != -1) {
-					if (state.vars.selectIndex != (int)i) {
-						continue;
+			resetState();
+			countState(counters);
+		}
+
+		void drawGeometry (const Geometry* geo) {
+			applyState(geo);
+
+			glPushMatrix();
+			glMultMatrixf(worldMatrix(geo).asArray());
+
+			drawMesh(geo->mesh(), GL_TRIANGLES);
+			_stats.drawCalls++;
+
+			glPopMatrix();
+		}
+
+		/**
+		 * Draw every instance in the instance buffer.  Instances whose root
+		 * bound is outside the view frustum are skipped whole.  Geometry is
+		 * drawn queue entry by queue entry, so state changes once per entry
+		 * rather than once per instance, except for geometry whose texture
+		 * comes from an instance texture channel.  Transparent geometry is
+		 * drawn last but is not depth sorted.
+		 */
+
+		void drawInstances () {
+			const InstanceBuffer& ib = *_instances;
+			cullInstances();
+
+			for (int pass = 0; pass < 2; pass++) {
+				const std::vector<RenderQueue::Entry>& entries = _opaqueQueue.getEntries();
+				unsigned count = (pass == 0) ? entries.size() : _blendQueue.size();
+
+				for (unsigned i = 0; i < count; i++) {
+					const Geometry* geo = (pass == 0) ? entries[i].geo : _blendQueue[i];
+					bool applied = false;
+					bool channel = geo->textureChannel >= 0 && (unsigned)geo->textureChannel < ib.getChannelCount();
+
+					for (unsigned inst = 0; inst < ib.getInstanceCount(); inst++) {
+						if (!_instanceVisible[inst] || !ib.isVisible(inst, geo->spacialNode)) {
+							continue;
+						}
+
+						if (channel) {
+							const InstanceBuffer::TextureRef& ref = ib.getTexture(inst, geo->textureChannel);
+							applyState(geo, (ref.texture != NULL) ? ref.texture : geo->texture,
+									(ref.layer >= 0) ? ref.layer : geo->textureLayer);
+						}
+						else if (!applied) {
+							applyState(geo);
+							applied = true;
+						}
+
+						glPushMatrix();
+						glMultMatrixf(ib.getMatrix(inst, geo->spacialNode));
+
+						drawMesh(geo->mesh(), GL_TRIANGLES);
+						_stats.drawCalls++;
+
+						glPopMatrix();
 					}
 				}
+			}
+		}
 
-				if (!citer->visible) {
-					continue;
+		/**
+		 * Draw transparent geometry back-to-front.  View depth is computed
+		 * once per geometry from its world-space bound center and the keys
+		 * are radix sorted.  With per-triangle sorting enabled, geometry
+		 * whose depth ranges overlap is merged and drawn triangle by triangle
+		 * in depth order instead, which handles intersecting planes.
+		 */
+
+		void drawBlended () {
+			AppState& state = AppState::getState();
+
+			if (_blendQueue.empty()) {
+				return;
+			}
+
+			if (_camera == NULL) {
+				for (unsigned i = 0; i < _blendQueue.size(); i++) {
+					if (!isDrawable(_blendQueue[i])) {
+						_stats.culledGeometry++;
+						continue;
+					}
+					drawGeometry(_blendQueue[i]);
 				}
+				return;
+			}
+
+			const vmath::Matrix4f& view = _camera->getCameraTransform();
+
+			_blendKeys.clear();
+			_blendRadius.resize(_blendQueue.size());
 
-				if (citer->blend) {
-					blended.push_back(&*citer);
+			for (unsigned i = 0; i < _blendQueue.size(); i++) {
+				const Geometry* geo = _blendQueue[i];
+				if (!isDrawable(geo)) {
+					_stats.culledGeometry++;
 					continue;
 				}
 
-				drawGeometry(&*citer);
+				const vmath::Vector3f& c = geo->getAABB().center();
+				const vmath::Vector3f& e = geo->getAABB().extants();
+
+				float row[4];
+				depthRow(view, worldMatrix(geo), row);
+
+				_blendKeys.push_back(DepthKey(row[0] * c.x + row[1] * c.y + row[2] * c.z + row[3], i));
+				_blendRadius[i] = std::fabs(row[0]) * e.x + std::fabs(row[1]) * e.y + std::fabs(row[2]) * e.z;
 			}
 
-			CameraController& cc = CameraController::getController();
-			cc.camera = _camera;
+			if (_blendKeys.empty()) {
+				return;
+			}
 
-			sort(blended.begin(), blended.end(), blendSort);
+			depthSort(_blendKeys, _sortScratch);
 
-			std::vector<const Geometry*>::const_iterator cpiter;
-			for (cpiter = blended.begin(); cpiter != blended.end(); cpiter++) {
-				const Geometry* geoPtr = *cpiter;
-				drawGeometry(geoPtr);
+			if (!state.vars.sortBlendedTriangles) {
+				for (unsigned i = 0; i < _blendKeys.size(); i++) {
+					drawGeometry(_blendQueue[_blendKeys[i].index]);
+				}
+				return;
 			}
-		}
 
-		void drawGeometry (const Geometry* geo) {
-			const vmath::MatrixG4f& worldMat = geo->spacialNode->getWorldMatrix();
+			// Group runs of geometry whose depth ranges overlap
 
-			glPushMatrix();
-			glPushAttrib(GL_ENABLE_BIT);
+			unsigned first = 0;
+			float clusterFar = _blendKeys[0].depth + _blendRadius[_blendKeys[0].index];
 
-			glMultMatrixf(worldMat.asArray());
+			for (unsigned i = 1; i <= _blendKeys.size(); i++) {
+				if (i < _blendKeys.size()) {
+					const DepthKey& key = _blendKeys[i];
+					if (key.depth - _blendRadius[key.index] < clusterFar) {
+						clusterFar = std::max(clusterFar, key.depth + _blendRadius[key.index]);
+						continue;
+					}
+				}
+
+				drawBlendedTriangles(view, first, i);
 
-			if (geo->hasTexture()) {
-				geo->texture->enable();
-				geo->texture->bind();
+				if (i < _blendKeys.size()) {
+					first = i;
+					clusterFar = _blendKeys[i].depth + _blendRadius[_blendKeys[i].index];
+				}
 			}
+		}
 
-			if (geo->alphaTest) {
-				glEnable(GL_ALPHA_TEST);
-				glAlphaFunc(GL_GEQUAL, geo->alphaThresh);
+		/**
+		 * Draw transparent geometry with weighted blended order-independent
+		 * transparency.  No sorting is done; geometry is drawn in queue order
+		 * into the OIT targets and resolved in one pass.  Returns false if
+		 * the context can't support it, in which case nothing is drawn.
+		 */
+
+		bool drawBlendedWeighted () {
+			if (_blendQueue.empty()) {
+				return true;
 			}
-			if (geo->blend) {
-				glEnable(GL_BLEND);
-				glBlendFunc(geo->blendSrc, geo->blendDst);
+
+			resetState();
+
+			if (!_oit.begin()) {
+				return false;
 			}
-			if (geo->cull) {
-				glEnable(GL_CULL_FACE);
-				glCullFace(geo->cullFunc);
+
+			int textured = -1;
+
+			// The accumulation shader samples 2D textures only, so array
+			// geometry falls back to its layer's source texture here
+			_arraysEnabled = false;
+
+			for (unsigned i = 0; i < _blendQueue.size(); i++) {
+				const Geometry* geo = _blendQueue[i];
+				if (!isDrawable(geo)) {
+					_stats.culledGeometry++;
+					continue;
+				}
+
+				applyState(geo, false);
+
+				if ((int)geo->hasTexture() != textured) {
+					textured = geo->hasTexture();
+					_oit.useTexture(geo->hasTexture());
+				}
+
+				glPushMatrix();
+				glMultMatrixf(worldMatrix(geo).asArray());
+
+				drawMesh(geo->mesh(), GL_TRIANGLES);
+				_stats.drawCalls++;
+
+				glPopMatrix();
 			}
 
-			drawMesh(geo->mesh(), GL_TRIANGLES);
+			resetState();
+			_oit.end();
 
-			glPopAttrib();
-			glPopMatrix();
+			_arraysEnabled = true;
+
+			return true;
+		}
+
+		/**
+		 * Draw the triangles of the sorted blended geometry in [first, last)
+		 * back-to-front, switching state and transform only when consecutive
+		 * triangles belong to different geometry.
+		 */
+
+		void drawBlendedTriangles (const vmath::Matrix4f& view, unsigned first, unsigned last) {
+			_triKeys.clear();
+			_triRefs.clear();
+
+			for (unsigned i = first; i < last; i++) {
+				const Geometry* geo = _blendQueue[_blendKeys[i].index];
+				const Mesh* mesh = geo->mesh();
+				const std::vector<unsigned int>& indexList = mesh->getIndexList();
+
+				float row[4];
+				depthRow(view, worldMatrix(geo), row);
+
+				for (unsigned t = 0; t + 2 < indexList.size(); t += 3) {
+					vertex3f v0 = mesh->getPosition(indexList[t + 0]);
+					vertex3f v1 = mesh->getPosition(indexList[t + 1]);
+					vertex3f v2 = mesh->getPosition(indexList[t + 2]);
+
+					float depth = (row[0] * (v0.x + v1.x + v2.x) + row[1] * (v0.y + v1.y + v2.y)
+							+ row[2] * (v0.z + v1.z + v2.z)) / 3.f + row[3];
+
+					_triKeys.push_back(DepthKey(depth, _triRefs.size()));
+					_triRefs.push_back(std::make_pair(geo, t));
+				}
+			}
+
+			depthSort(_triKeys, _sortScratch);
+
+			const Geometry* current = NULL;
+
+			for (unsigned i = 0; i < _triKeys.size(); i++) {
+				const Geometry* geo = _triRefs[_triKeys[i].index].first;
+				unsigned t = _triRefs[_triKeys[i].index].second;
+
+				if (geo != current) {
+					if (current != NULL) {
+						glEnd();
+						glPopMatrix();
+					}
+
+					applyState(geo);
+
+					glPushMatrix();
+					glMultMatrixf(worldMatrix(geo).asArray());
+					glBegin(GL_TRIANGLES);
+
+					_stats.drawCalls++;
+					current = geo;
+				}
+
+				const std::vector<unsigned int>& indexList = geo->mesh()->getIndexList();
+				emitVertex(geo->mesh(), indexList[t + 0]);
+				emitVertex(geo->mesh(), indexList[t + 1]);
+				emitVertex(geo->mesh(), indexList[t + 2]);
+			}
+
+			if (current != NULL) {
+				glEnd();
+				glPopMatrix();
+			}
 		}
 
 		void drawMesh (const Mesh* mesh, GLuint renderType) {
-			drawMeshImmediate(mesh, renderType);
+			if (mesh->getBufferId() != -1) {
+				drawMeshBuffered(mesh, renderType);
+			}
+			else {
+				drawMeshImmediate(mesh, renderType);
+			}
+		}
+
+		void drawMeshBuffered (const Mesh* mesh, GLuint renderType) {
+			const MeshBuffer& mb = _meshBuffers[mesh->getBufferId()];
+
+			glBindBuffer(GL_ARRAY_BUFFER, mb.vertexBuffer);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mb.indexBuffer);
+
+			if (mesh->useColors()) {
+				glEnableClientState(GL_COLOR_ARRAY);
+				glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid*) mb.colorOffset);
+			}
+			if (mesh->useNormals()) {
+				glEnableClientState(GL_NORMAL_ARRAY);
+				glNormalPointer(GL_FLOAT, 0, (const GLvoid*) mb.normalOffset);
+			}
+			if (mesh->useTexCoords()) {
+				glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+				glTexCoordPointer(2, GL_FLOAT, 0, (const GLvoid*) mb.texCoordOffset);
+			}
+			if (mesh->useShortVertices()) {
+				glEnableClientState(GL_VERTEX_ARRAY);
+				glVertexPointer(3, GL_SHORT, sizeof(vertex3s), (const GLvoid*) mb.shortVertexOffset);
+			}
+			else if (mesh->useVertices()) {
+				glEnableClientState(GL_VERTEX_ARRAY);
+				glVertexPointer(3, GL_FLOAT, 0, NULL);
+			}
+
+			glDrawElements(renderType, mb.indexCount, GL_UNSIGNED_INT, NULL);
+
+			glDisableClientState(GL_COLOR_ARRAY);
+			glDisableClientState(GL_NORMAL_ARRAY);
+			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+			glDisableClientState(GL_VERTEX_ARRAY);
+
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 		}
 
 		void drawMeshImmediate (const Mesh* mesh, GLuint renderType) {
-			const std::vector<vertex3f>& vertexList = mesh->getVertexList();
-			const std::vector<normal3f>& normalList = mesh->getNormalList();
-			const std::vector<color4ub>& colorList = mesh->getColorList();
-			const std::vector<texCoord2f>& texCoordList = mesh->getTexCoordList();
 			const std::vector<unsigned int>& indexList = mesh->getIndexList();
 
 			typedef std::vector<unsigned int>::const_iterator uintCIter;
@@ -187,40 +814,436 @@ namespace gfx {
 			glBegin(renderType);
 
 			for (uintCIter iter = indexList.begin(); iter < indexList.end(); iter++) {
-				if (mesh->useColors()) {
-					const color4ub& color = colorList[*iter];
-					glColor4ub(color.r, color.g, color.b, color.a);
+				emitVertex(mesh, *iter);
+			}
+
+			glEnd();
+		}
+
+		void emitVertex (const Mesh* mesh, unsigned idx) {
+			if (mesh->useColors()) {
+				const color4ub& color = mesh->getColorList()[idx];
+				glColor4ub(color.r, color.g, color.b, color.a);
+			}
+
+			if (mesh->useNormals()) {
+				const normal3f& normal = mesh->getNormalList()[idx];
+				glNormal3f(normal.nx, normal.ny, normal.nz);
+			}
+
+			if (mesh->useTexCoords()) {
+				const texCoord2f& texCoord = mesh->getTexCoordList()[idx];
+				glTexCoord2f(texCoord.s, texCoord.t);
+			}
+
+			if (mesh->useShortVertices()) {
+				const vertex3s& vertex = mesh->getShortVertexList()[idx];
+				glVertex3s(vertex.x, vertex.y, vertex.z);
+			}
+			else if (mesh->useVertices()) {
+				const vertex3f& vertex = mesh->getVertexList()[idx];
+				glVertex3f(vertex.x, vertex.y, vertex.z);
+			}
+		}
+
+		/**
+		 * The texture in slot id, or NULL if the slot is free.  Slots run
+		 * up to getTextureSlotCount(); check each for NULL when iterating.
+		 */
+
+		Texture* getTexture (unsigned id) {
+			return textures.at(id);
+		}
+
+		unsigned getTextureSlotCount () const {
+			return textures.capacity();
+		}
+
+		const RenderStats& getStats () const {
+			return _stats;
+		}
+
+	protected:
+
+		template <class T>
+		static void bufferList (GLsizeiptr offset, const std::vector<T>& list) {
+			if (!list.empty()) {
+				glBufferSubData(GL_ARRAY_BUFFER, offset, list.size() * sizeof(T), &list[0]);
+			}
+		}
+
+		/**
+		 * Rebuild the render queues if geometry was added, invalidated, or
+		 * the selection filter has changed since the last build.
+		 */
+
+		void checkQueue () {
+			AppState& state = AppState::getState();
+
+			int selectState = state.vars.selectState;
+			int selectIndex = state.vars.selectIndex;
+
+			if (!_queueDirty && selectState == _queueSelectState && selectIndex == _queueSelectIndex) {
+				return;
+			}
+
+			_queueSelectState = selectState;
+			_queueSelectIndex = selectIndex;
+			_queueDirty = false;
+
+			buildQueue(selectState == AppState::Vars::SELECT_SGNODE ? selectIndex : -1);
+		}
+
+		/**
+		 * Mark the geometry that survives culling for this frame.  The frustum
+		 * is taken from the current GL projection and modelview matrices, so
+		 * this must run after the camera transform has been applied.
+		 *
+		 * Nodes are visited in pool order, which is depth-first, so a rejected
+		 * subtree is skipped by jumping to its end.  Each node's remaining plane
+		 * mask is kept for its children, which skip planes their parent was
+		 * found fully inside of.  With a BVH set, its nodes are tested instead
+		 * and culledNodes counts the BVH nodes rejected.
+		 */
+
+		void cullScene () {
+			AppState& state = AppState::getState();
+
+			_frame++;
+			_culling = state.vars.frustumCull;
+
+			if (!_culling) {
+				return;
+			}
+
+			float projection[16];
+			float modelview[16];
+			glGetFloatv(GL_PROJECTION_MATRIX, projection);
+			glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+
+			_frustum.extract(projection, modelview);
+
+			const Scenegraph& sg = *_scenegraph;
+
+			if (_bvh != NULL) {
+				_stats.culledNodes = _bvh->cull(_frustum, _bvhVisible);
+
+				for (unsigned i = 0; i < _bvhVisible.size(); i++) {
+					Geometry* geo = sg.getGeometry(_bvhVisible[i]);
+					if (sg.getNode(geo->spacialNode).isWorldVisible()) {
+						geo->visibleFrame = _frame;
+					}
 				}
+				return;
+			}
+
+			_cullMasks.resize(sg.size());
 
-				if (mesh->useNormals()) {
-					const normal3f& normal = normalList[*iter];
-					glNormal3f(normal.nx, normal.ny, normal.nz);
+			for (int i = 0; i < (int)sg.size(); ) {
+				const Scenegraph::Node& node = sg.getNode(i);
+				unsigned mask = node.hasParent() ? _cullMasks[node.getParent()] : Frustum::ALL_PLANES;
+
+				if (node.getBound().isSingular()) {
+					i = node.getSubtreeEnd();
+					continue;
 				}
 
-				if (mesh->useTexCoords()) {
-					const texCoord2f& texCoord = texCoordList[*iter];
-					glTexCoord2f(texCoord.s, texCoord.t);
+				if (!node.isVisible() || (mask != 0 && _frustum.test(node.getBound(), mask) == Frustum::OUTSIDE)) {
+					_stats.culledNodes++;
+					i = node.getSubtreeEnd();
+					continue;
 				}
 
-				if (mesh->useVertices()) {
-					const vertex3f& vertex = vertexList[*iter];
-					glVertex3f(vertex.x, vertex.y, vertex.z);
+				_cullMasks[i] = mask;
+
+				unsigned geoEnd = node.getGeometryIndex() + node.getGeometryCount();
+				for (unsigned g = node.getGeometryIndex(); g < geoEnd; g++) {
+					Geometry* geo = sg.getGeometry(g);
+
+					unsigned geoMask = mask;
+					if (geoMask != 0 && _frustum.test(geo->getWorldAABB(), geoMask) == Frustum::OUTSIDE) {
+						continue;
+					}
+					geo->visibleFrame = _frame;
 				}
+
+				i++;
 			}
+		}
 
-			glEnd();
+		/**
+		 * Test each instance's bound against the view frustum.  The root's
+		 * bound is in model space, so its placement takes it to the world.
+		 */
+
+		void cullInstances () {
+			AppState& state = AppState::getState();
+			const InstanceBuffer& ib = *_instances;
+
+			_instanceVisible.assign(ib.getInstanceCount(), 1);
+
+			if (!state.vars.frustumCull || ib.getNodeCount() == 0) {
+				return;
+			}
+
+			float projection[16];
+			float modelview[16];
+			glGetFloatv(GL_PROJECTION_MATRIX, projection);
+			glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+
+			_frustum.extract(projection, modelview);
+
+			const BoundAABB& rootBound = _scenegraph->getNode(_scenegraph->root()).getBound();
+
+			for (unsigned inst = 0; inst < ib.getInstanceCount(); inst++) {
+				BoundAABB bound = rootBound;
+				bound.transform(vmath::Matrix4f(ib.getPlacement(inst)));
+
+				unsigned mask = Frustum::ALL_PLANES;
+				if (_frustum.test(bound, mask) == Frustum::OUTSIDE) {
+					_instanceVisible[inst] = 0;
+					_stats.culledInstances++;
+				}
+			}
 		}
 
-		const std::vector<Geometry>& getGeometry () const {
-			return geoList;
+		/**
+		 * Geometry under a hidden node is never drawn, culling or not.
+		 */
+
+		bool isDrawable (const Geometry* geo) const {
+			if (!_culling) {
+				return _scenegraph->getNode(geo->spacialNode).isWorldVisible();
+			}
+			return geo->visibleFrame == _frame;
 		}
 
-		Texture* getTexture (unsigned id) {
-			return &textures.at(id);
+		const vmath::MatrixG4f& worldMatrix (const Geometry* geo) const {
+			return _scenegraph->getNode(geo->spacialNode).getWorldMatrix();
+		}
+
+		void buildQueue (int selectIndex) {
+			_opaqueQueue.clear();
+			_opaqueQueue.reserve(geoList.size());
+			_blendQueue.clear();
+
+			std::map<const Mesh*, unsigned> meshIds;
+			std::map<const TextureArray*, unsigned> arrayIds;
+
+			for (unsigned i = 0; i < geoList.capacity(); i++) {
+				const Geometry* geo = geoList.at(i);
+
+				if (geo == NULL) {
+					continue;
+				}
+
+				if (selectIndex != -1 && selectIndex != (int)i) {
+					continue;
+				}
+
+				// Instances carry their own visibility
+				if (!geo->visible && _instances == NULL) {
+					continue;
+				}
+
+				if (geo->blend) {
+					_blendQueue.push_back(geo);
+					continue;
+				}
+
+				// Arrays sort after the plain textures; the layer is not part
+				// of the key, so animating it leaves the queue valid
+				unsigned textureId = 0;
+				if (geo->textureArray != NULL) {
+					textureId = textures.capacity() + 1 + arrayIds.insert(std::make_pair(geo->textureArray, arrayIds.size())).first->second;
+				}
+				else if (geo->texture != NULL) {
+					textureId = textures.indexOf(geo->texture) + 1;
+				}
+
+				unsigned meshId = meshIds.insert(std::make_pair(geo->mesh(), meshIds.size())).first->second;
+
+				_opaqueQueue.push(RenderQueue::makeKey(geo, textureId, meshId), geo);
+			}
+
+			_opaqueQueue.sort();
+			_stats.queueRebuilds++;
+		}
+
+		/**
+		 * Build the shader that samples texture arrays, the first time it
+		 * is needed.  Returns false if arrays are unavailable.
+		 */
+
+		bool prepareArrays () {
+			if (_arraySupport == -1) {
+				if (_arrayShader.build(arrayVertexSrc(), arrayFragmentSrc())) {
+					_arrayShader.bind();
+					glUniform1i(_arrayShader.uniform("tex"), 0);
+					_arrayLayerLoc = _arrayShader.uniform("layer");
+					Shader::unbind();
+					_arraySupport = 1;
+				}
+				else {
+					std::cout << "(!!) Texture arrays unavailable: " << _arrayShader.getLog() << std::endl;
+					_arraySupport = 0;
+				}
+			}
+
+			return _arraySupport == 1;
+		}
+
+		/**
+		 * Stand-ins for the fixed function texturing the other paths use:
+		 * the vertex color modulated by the texel.
+		 */
+
+		static std::string arrayVertexSrc () {
+			return
+				"#version 120\n"
+				"void main () {\n"
+				"	gl_Position = ftransform();\n"
+				"	gl_FrontColor = gl_Color;\n"
+				"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+				"}\n";
 		}
 
-		unsigned getTextureCount () const {
-			return textures.size();
+		static std::string arrayFragmentSrc () {
+			return
+				"#version 120\n"
+				"#extension GL_EXT_texture_array : require\n"
+				"uniform sampler2DArray tex;\n"
+				"uniform float layer;\n"
+				"void main () {\n"
+				"	gl_FragColor = gl_Color * texture2DArray(tex, vec3(gl_TexCoord[0].st, layer));\n"
+				"}\n";
+		}
+
+		/**
+		 * Compute the row of view * world that yields view-space z, so the
+		 * depth of a model-space point is a single dot product.  The view
+		 * matrix is row-major; world matrices are stored in GL order.
+		 */
+
+		static void depthRow (const vmath::Matrix4f& view, const vmath::Matrix4f& world, float row[4]) {
+			const float* v = view.asArray() + 8;
+			const float* w = world.asArray();
+
+			for (int j = 0; j < 4; j++) {
+				row[j] = v[0] * w[j * 4 + 0] + v[1] * w[j * 4 + 1] + v[2] * w[j * 4 + 2] + v[3] * w[j * 4 + 3];
+			}
+		}
+
+		/**
+		 * Bring the GL state in line with what the geometry needs.  Calls
+		 * that wouldn't change anything are elided by GLState.  Pass
+		 * blendState false to leave blending to the caller.
+		 */
+
+		void applyState (const Geometry* geo, bool blendState = true) {
+			applyState(geo, geo->texture, geo->textureLayer, blendState);
+		}
+
+		/**
+		 * As above, but with texture and textureLayer standing in for the
+		 * geometry's own, such as an instance's.
+		 */
+
+		void applyState (const Geometry* geo, Texture* texture, int textureLayer, bool blendState = true) {
+			DrawState& ds = _drawState;
+			GLState& gl = GLState::getState();
+
+			TextureArray* textureArray = geo->textureArray;
+			if (textureArray != NULL && !_arraysEnabled) {
+				texture = textureArray->getLayerTexture(textureLayer);
+				textureArray = NULL;
+			}
+
+			if (texture != ds.texture) {
+				if (texture != NULL) {
+					if (ds.texture == NULL) {
+						texture->enable();
+					}
+					texture->bind();
+					_stats.textureBinds++;
+				}
+				else {
+					ds.texture->disable();
+				}
+				ds.texture = texture;
+			}
+
+			if (textureArray != ds.textureArray) {
+				if (textureArray != NULL) {
+					if (ds.textureArray == NULL) {
+						_arrayShader.bind();
+					}
+					textureArray->bind();
+					_stats.textureBinds++;
+				}
+				else {
+					TextureArray::unbind();
+					Shader::unbind();
+				}
+				ds.textureArray = textureArray;
+				ds.textureLayer = -1;
+			}
+			if (textureArray != NULL && textureLayer != ds.textureLayer) {
+				glUniform1f(_arrayLayerLoc, (float)textureLayer);
+				ds.textureLayer = textureLayer;
+			}
+
+			gl.setEnabled(GL_ALPHA_TEST, geo->alphaTest);
+			if (geo->alphaTest) {
+				gl.alphaFunc(GL_GEQUAL, geo->alphaThresh);
+			}
+
+			if (blendState) {
+				gl.setEnabled(GL_BLEND, geo->blend);
+				if (geo->blend) {
+					gl.blendFunc(geo->blendSrc, geo->blendDst);
+				}
+			}
+
+			gl.setEnabled(GL_CULL_FACE, geo->cull);
+			if (geo->cull) {
+				gl.cullFace(geo->cullFunc);
+			}
+		}
+
+		/**
+		 * Return to the default state expected by the rest of the viewer:
+		 * no texturing, alpha testing, blending or culling.
+		 */
+
+		void resetState () {
+			DrawState& ds = _drawState;
+			GLState& gl = GLState::getState();
+
+			if (ds.texture != NULL) {
+				ds.texture->disable();
+			}
+			if (ds.textureArray != NULL) {
+				TextureArray::unbind();
+				Shader::unbind();
+			}
+			gl.disable(GL_ALPHA_TEST);
+			gl.disable(GL_BLEND);
+			gl.disable(GL_CULL_FACE);
+
+			ds.texture = NULL;
+			ds.textureArray = NULL;
+			ds.textureLayer = -1;
+		}
+
+		/**
+		 * Record the state calls issued and elided since counters was read.
+		 */
+
+		void countState (const GLState::Counters& counters) {
+			const GLState::Counters& now = GLState::getState().getCounters();
+			_stats.stateChanges = now.issued - counters.issued;
+			_stats.elidedChanges = now.elided - counters.elided;
 		}
 	};
 
@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_RENDERQUEUE_H_
+#define GFX_RENDERQUEUE_H_
+
+#include <vector>
+#include <algorithm>
+
+#include "Geometry.h"
+
+namespace gfx {
+
+	/**
+	 * A list of geometry ordered by a 64-bit state key, so that consecutive
+	 * draws share as much render state as possible.  From most to least
+	 * significant, the key packs culling, alpha testing, texture and mesh.
+	 */
+
+	class RenderQueue {
+	public:
+
+		typedef unsigned long long SortKey;
+
+		struct Entry {
+			SortKey key;
+			const Geometry* geo;
+
+			bool operator< (const Entry& e) const {
+				return key < e.key;
+			}
+		};
+
+	protected:
+
+		std::vector<Entry> _entries;
+
+	public:
+
+		RenderQueue ()
+			: _entries(0) {
+		}
+
+		void clear () {
+			_entries.clear();
+		}
+
+		const std::vector<Entry>& getEntries () const {
+			return _entries;
+		}
+
+		void push (SortKey key, const Geometry* geo) {
+			Entry e;
+			e.key = key;
+			e.geo = geo;
+			_entries.push_back(e);
+		}
+
+		void reserve (unsigned count) {
+			_entries.reserve(count);
+		}
+
+		unsigned size () const {
+			return _entries.size();
+		}
+
+		/**
+		 * Order entries by key.  Entries with equal keys keep the order they
+		 * were pushed in, so draw order is deterministic.
+		 */
+
+		void sort () {
+			std::stable_sort(_entries.begin(), _entries.end());
+		}
+
+		/**
+		 * Build the sort key for a geometry.  textureId should be 0 for
+		 * untextured geometry; meshId orders draws within the same state.
+		 *
+		 * Bits:  63     cull enabled
+		 *        59-62  cull face (low nibble of the GL enum)
+		 *        58     alpha test enabled
+		 *        50-57  alpha threshold, quantized
+		 *        26-49  texture
+		 *        0-25   mesh
+		 */
+
+		static SortKey makeKey (const Geometry* geo, unsigned textureId, unsigned meshId) {
+			SortKey key = 0;
+
+			if (geo->cull) {
+				key |= SortKey(1) << 63;
+				key |= SortKey(geo->cullFunc & 0xF) << 59;
+			}
+
+			if (geo->alphaTest) {
+				float thresh = std::min(std::max(geo->alphaThresh, 0.f), 1.f);
+				key |= SortKey(1) << 58;
+				key |= SortKey(unsigned(thresh * 255.f + .5f) & 0xFF) << 50;
+			}
+
+			key |= SortKey(textureId & 0xFFFFFF) << 26;
+			key |= SortKey(meshId & 0x3FFFFFF);
+
+			return key;
+		}
+
+	};
+
+}
+
+#endif /* GFX_RENDERQUEUE_H_ */
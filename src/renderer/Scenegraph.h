@@ -26,11 +26,12 @@
 #ifndef GFX_SCENEGRAPH_H_
 #define GFX_SCENEGRAPH_H_
 
-#include <utility>
-#include <list>
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 
 #include "../vecmath/MatrixG4.h"
+#include "../vecmath/TRS.h"
 #include "BoundAABB.h"
 
 namespace gfx {
@@ -43,74 +44,107 @@ namespace gfx {
 	 *
 	 * Each node caries local transformation data relative to the world position of
 	 * its parent.  The world transformation is precomputed for each object to allow
-	 * for independent draw order.
+	 * for independent draw order.  The local transform is kept as translation,
+	 * rotation quaternion and scale; the matrix composed from it is cached, and
+	 * only rebuilt when the transform changes.
+	 *
+	 * Each node also keeps a world-space bound enclosing all geometry in its
+	 * subtree, so whole subtrees can be culled at once.
+	 *
+	 * Nodes live in one contiguous pool and refer to each other by index.  The
+	 * pool is kept in depth-first order: a node's descendants immediately follow
+	 * it, ending at its subtree end.  Updates and traversals are therefore linear
+	 * scans, and a subtree can be skipped by jumping to its end.  Geometry is
+	 * likewise kept in one list, with each node owning a contiguous range.
 	 */
 
 	class Scenegraph {
 	public:
 
 		class Node {
-		public:
-
-			enum TransformType {
-				TRANSFORM_TRANSLATE,
-				TRANSFORM_SCALE,
-				TRANSFORM_ROTATE_XYZ,
-				TRANSFORM_ROTATE_ZYX,
-			};
-
-			typedef std::pair<TransformType, vmath::Vector3f> Transform;
-
 		protected:
 
-			typedef std::list<Node*>::iterator NodeIter;
-
 			friend class Scenegraph;
 
 		protected:
 
-			Node* parent;
-			std::list<Node*> children;
+			int parent;
+			int firstChild;
+			int lastChild;
+			int nextSibling;
+			int subtreeEnd;
 
-			std::vector<Geometry*> geoNodes;
+			unsigned geoIndex;
+			unsigned geoCount;
 
+			vmath::MatrixG4f localMatrix;
 			vmath::MatrixG4f worldMatrix;
 			bool dirtyMatrix;
+			bool worldChanged;
 			bool visible;
+			bool worldVisible;
 
-			std::vector<Transform> transformSet;
+			BoundAABB bound;
+			bool dirtyBound;
+
+			vmath::TRSf transform;
 
 		public:
 
 			Node ()
-				: parent(NULL), children(0), geoNodes(0), worldMatrix(vmath::Matrix4f::IDENTITY),
-				  dirtyMatrix(true), visible(true), transformSet(0) {
+				: parent(-1), firstChild(-1), lastChild(-1), nextSibling(-1), subtreeEnd(0),
+				  geoIndex(0), geoCount(0), localMatrix(vmath::Matrix4f::IDENTITY),
+				  worldMatrix(vmath::Matrix4f::IDENTITY), dirtyMatrix(true),
+				  worldChanged(false), visible(true), worldVisible(true), dirtyBound(true), transform() {
 			}
 
-			void addGeometry (Geometry* geo) {
-				geoNodes.push_back(geo);
+			/**
+			 * World-space bound of all geometry in this node's subtree, as of
+			 * the last Scenegraph::update.
+			 */
+
+			const BoundAABB& getBound () const {
+				return bound;
 			}
 
-			unsigned addTransform (TransformType type, const vmath::Vector3f& v) {
-				transformSet.push_back(std::make_pair(type, v));
-				dirtyMatrix = true;
-				return transformSet.size() - 1;
+			/**
+			 * The composed local transform, in GL (column-major) order.
+			 */
+
+			const vmath::MatrixG4f& getLocalMatrix () const {
+				return localMatrix;
+			}
+
+			int getFirstChild () const {
+				return firstChild;
 			}
 
-			const std::list<Node*>& getChildren () const {
-				return children;
+			unsigned getGeometryCount () const {
+				return geoCount;
 			}
 
-			Node* getParent () const {
+			unsigned getGeometryIndex () const {
+				return geoIndex;
+			}
+
+			int getNextSibling () const {
+				return nextSibling;
+			}
+
+			int getParent () const {
 				return parent;
 			}
 
-			const vmath::Vector3f& getTransform (unsigned index) const {
-				return transformSet.at(index).second;
+			/**
+			 * Index one past the last node in this node's subtree.
+			 */
+
+			int getSubtreeEnd () const {
+				return subtreeEnd;
 			}
 
-			TransformType getTransformType (unsigned index) const {
-				return transformSet.at(index).first;
+			const vmath::TRSf& getTransform () const {
+				return transform;
 			}
 
 			const vmath::MatrixG4f& getWorldMatrix () const {
@@ -118,122 +152,246 @@ namespace gfx {
 			}
 
 			bool hasChildren () const {
-				return children.size() > 0;
+				return firstChild != -1;
 			}
 
 			bool hasParent () const {
-				return parent != NULL;
+				return parent != -1;
 			}
 
-			void setTransform (unsigned index, const vmath::Vector3f& v) {
-				transformSet.at(index).second = v;
-				dirtyMatrix = true;
+			/**
+			 * Mark the subtree bound stale, such as after the mesh of attached
+			 * geometry has changed.
+			 */
+
+			void invalidateBound () {
+				dirtyBound = true;
 			}
 
-			void setVisibility (bool vis) {
-				visible = vis;
+			bool isVisible () const {
+				return visible;
 			}
 
-			void updateTransform (unsigned index, const vmath::Vector3f& v) {
-				transformSet.at(index).second += v;
-				dirtyMatrix = true;
+			/**
+			 * Whether this node and all of its ancestors are visible, as of
+			 * the last Scenegraph::update.
+			 */
+
+			bool isWorldVisible () const {
+				return worldVisible;
 			}
 
-		protected:
+			void setRotation (const vmath::Quaternionf& q) {
+				transform.rotation = q;
+				dirtyMatrix = true;
+			}
 
-			void checkWorldMatrix () {
-				if (parent == NULL && dirtyMatrix) {
-					worldMatrix.setIdentity();
-					updateWorldMatrix();
-					return;
-				}
+			void setScale (const vmath::Vector3f& v) {
+				transform.scale = v;
+				dirtyMatrix = true;
+			}
 
-				for (NodeIter iter = children.begin(); iter != children.end(); iter++) {
-					Node* child = *iter;
-					if (child->dirtyMatrix) {
-						child->updateWorldMatrix(worldMatrix);
-					}
-					else {
-						child->checkWorldMatrix();
-					}
-				}
+			void setTransform (const vmath::TRSf& trs) {
+				transform = trs;
+				dirtyMatrix = true;
 			}
 
-			void updateWorldMatrix (const vmath::MatrixG4f& parentWorld) {
-				worldMatrix.set(parentWorld);
-				updateWorldMatrix();
-			}
-
-			void updateWorldMatrix () {
-
-				// Recalculate world matrix
-				for (unsigned i = 0; i < transformSet.size(); i++) {
-					const vmath::Vector3f& v = transformSet[i].second;
-
-					switch (transformSet[i].first) {
-					case TRANSFORM_TRANSLATE:
-						worldMatrix.translate(v.x, v.y, v.z);
-						break;
-					case TRANSFORM_SCALE:
-						worldMatrix.scale(v.x, v.y, v.z);
-						break;
-					case TRANSFORM_ROTATE_XYZ:
-						worldMatrix.rotateX(v.x);
-						worldMatrix.rotateY(v.y);
-						worldMatrix.rotateZ(v.z);
-						break;
-					case TRANSFORM_ROTATE_ZYX:
-						worldMatrix.rotateZ(v.z);
-						worldMatrix.rotateY(v.y);
-						worldMatrix.rotateX(v.x);
-						break;
-					}
-				}
+			void setTranslation (const vmath::Vector3f& v) {
+				transform.translation = v;
+				dirtyMatrix = true;
+			}
 
-				for (NodeIter iter = children.begin(); iter != children.end(); iter++) {
-					Node* child = *iter;
-					child->updateWorldMatrix(worldMatrix);
-				}
+			void setVisibility (bool vis) {
+				visible = vis;
+			}
 
-				worldMatrix.transpose();
+		protected:
 
+			void updateLocalMatrix () {
+				transform.composeGL(localMatrix);
 				dirtyMatrix = false;
 			}
 		};
 
 	protected:
 
-		Node* rootNode;
-
-		std::list<Node> nodeSet;
+		std::vector<Node> nodeSet;
+		std::vector<Geometry*> geoSet;
+		int lastGeoNode;
 
 	public:
 
-		Scenegraph () {
-			nodeSet.push_back(Node());
-			rootNode = &nodeSet.front();
+		Scenegraph ()
+			: nodeSet(1), geoSet(0), lastGeoNode(-1) {
+			nodeSet[0].subtreeEnd = 1;
 		}
 
 		virtual ~Scenegraph () { }
 
-		Node* newChild (Node* parent) {
+		/**
+		 * Attach geometry to a node.  Each node's geometry is kept contiguous,
+		 * so geometry can only be added to a node until geometry is added to
+		 * a node after it.
+		 */
+
+		void addGeometry (int node, Geometry* geo) {
+			Node& n = nodeSet.at(node);
+
+			if (node < lastGeoNode) {
+				throw std::logic_error("Geometry must be added to scenegraph nodes in order");
+			}
+
+			if (node != lastGeoNode) {
+				n.geoIndex = geoSet.size();
+				lastGeoNode = node;
+			}
+
+			geoSet.push_back(geo);
+			n.geoCount++;
+			n.dirtyBound = true;
+		}
+
+		/**
+		 * Detach geometry from its node.  Later geometry moves down one
+		 * index, so anything holding geometry indices, such as a BVH, must
+		 * be rebuilt.  Returns false if the geometry was not attached.
+		 */
+
+		bool removeGeometry (const Geometry* geo) {
+			std::vector<Geometry*>::iterator iter = std::find(geoSet.begin(), geoSet.end(), geo);
+			if (iter == geoSet.end()) {
+				return false;
+			}
+
+			unsigned index = iter - geoSet.begin();
+			geoSet.erase(iter);
+
+			for (unsigned i = 0; i < nodeSet.size(); i++) {
+				Node& node = nodeSet[i];
+				if (node.geoCount > 0 && node.geoIndex <= index && index < node.geoIndex + node.geoCount) {
+					node.geoCount--;
+					node.dirtyBound = true;
+				}
+				else if (node.geoIndex > index) {
+					node.geoIndex--;
+				}
+			}
+
+			return true;
+		}
+
+		Geometry* getGeometry (unsigned index) const {
+			return geoSet[index];
+		}
+
+		unsigned getGeometryCount () const {
+			return geoSet.size();
+		}
+
+		Node& getNode (int index) {
+			return nodeSet[index];
+		}
+
+		const Node& getNode (int index) const {
+			return nodeSet[index];
+		}
+
+		/**
+		 * Create a node as the last child of parent and return its index.
+		 * To keep the pool in depth-first order, parent's subtree must be the
+		 * last thing in the pool: children can only be added to the node most
+		 * recently created or one of its ancestors.
+		 */
+
+		int newChild (int parent) {
+			if (nodeSet.at(parent).subtreeEnd != (int)nodeSet.size()) {
+				throw std::logic_error("Scenegraph nodes must be created in depth-first order");
+			}
+
+			int index = nodeSet.size();
+
 			nodeSet.push_back(Node());
-			Node* node = &nodeSet.back();
+			Node& node = nodeSet.back();
+			Node& p = nodeSet[parent];
 
-			node->parent = parent;
-			parent->children.push_back(node);
+			node.parent = parent;
+			node.subtreeEnd = index + 1;
 
-			return node;
+			if (p.lastChild != -1) {
+				nodeSet[p.lastChild].nextSibling = index;
+			}
+			else {
+				p.firstChild = index;
+			}
+			p.lastChild = index;
+
+			for (int i = parent; i != -1; i = nodeSet[i].parent) {
+				nodeSet[i].subtreeEnd = index + 1;
+			}
+
+			return index;
+		}
+
+		void reserve (unsigned nodeCount) {
+			nodeSet.reserve(nodeCount);
+		}
+
+		int root () const {
+			return 0;
 		}
 
-		Node* root () const {
-			return rootNode;
+		unsigned size () const {
+			return nodeSet.size();
 		}
 
+		/**
+		 * Bring world matrices and bounds up to date for any nodes whose
+		 * transforms have changed, and inherited visibility for every node.
+		 */
+
 		void update () {
-			rootNode->checkWorldMatrix();
+			updateWorldMatrices();
+			updateBounds();
+		}
+
+	protected:
+
+		/**
+		 * Parents precede their children in the pool, so one forward pass sees
+		 * each parent's new world matrix before its children need it.  Only
+		 * nodes whose transforms changed, and their descendants, are updated.
+		 * Matrices are in GL order, so world = local * parent world.
+		 * Visibility is inherited in the same pass.
+		 */
+
+		void updateWorldMatrices () {
+			for (unsigned i = 0; i < nodeSet.size(); i++) {
+				Node& node = nodeSet[i];
+
+				node.worldVisible = node.visible && (node.parent == -1 || nodeSet[node.parent].worldVisible);
+
+				bool parentChanged = node.parent != -1 && nodeSet[node.parent].worldChanged;
+
+				node.worldChanged = node.dirtyMatrix || parentChanged;
+				if (!node.worldChanged) {
+					continue;
+				}
+
+				if (node.dirtyMatrix) {
+					node.updateLocalMatrix();
+				}
+
+				node.worldMatrix.set(node.localMatrix);
+				if (node.parent != -1) {
+					node.worldMatrix.mul(nodeSet[node.parent].worldMatrix);
+				}
+
+				node.dirtyBound = true;
+			}
 		}
 
+		void updateBounds ();
+
 	};
 
 }
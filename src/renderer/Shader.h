@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_SHADER_H_
+#define GFX_SHADER_H_
+
+#include <OpenGL/gl.h>
+#include <string>
+#include <vector>
+
+#include "GLState.h"
+
+namespace gfx {
+
+	/**
+	 * A linked GLSL program built from one vertex and one fragment shader.
+	 * Compile errors are kept in the log rather than thrown, so callers can
+	 * fall back to the fixed function path.
+	 */
+
+	class Shader {
+	protected:
+
+		GLuint _program;
+		std::string _log;
+
+	public:
+
+		Shader ()
+			: _program(0) {
+		}
+
+		void bind () const {
+			GLState::getState().useProgram(_program);
+		}
+
+		bool build (const std::string& vertexSrc, const std::string& fragmentSrc) {
+			release();
+
+			GLuint vs = compileStage(GL_VERTEX_SHADER, vertexSrc);
+			GLuint fs = compileStage(GL_FRAGMENT_SHADER, fragmentSrc);
+
+			if (vs == 0 || fs == 0) {
+				if (vs != 0) glDeleteShader(vs);
+				if (fs != 0) glDeleteShader(fs);
+				return false;
+			}
+
+			_program = glCreateProgram();
+			glAttachShader(_program, vs);
+			glAttachShader(_program, fs);
+			glLinkProgram(_program);
+
+			glDeleteShader(vs);
+			glDeleteShader(fs);
+
+			GLint status = GL_FALSE;
+			glGetProgramiv(_program, GL_LINK_STATUS, &status);
+			if (status != GL_TRUE) {
+				_log.append(programLog(_program));
+				release();
+				return false;
+			}
+
+			return true;
+		}
+
+		const std::string& getLog () const {
+			return _log;
+		}
+
+		GLuint getProgram () const {
+			return _program;
+		}
+
+		bool isValid () const {
+			return _program != 0;
+		}
+
+		void release () {
+			if (_program != 0) {
+				glDeleteProgram(_program);
+				_program = 0;
+			}
+		}
+
+		GLint uniform (const char* name) const {
+			return glGetUniformLocation(_program, name);
+		}
+
+		static void unbind () {
+			GLState::getState().useProgram(0);
+		}
+
+	protected:
+
+		GLuint compileStage (GLenum type, const std::string& src) {
+			GLuint shader = glCreateShader(type);
+
+			const GLchar* srcPtr = src.c_str();
+			glShaderSource(shader, 1, &srcPtr, NULL);
+			glCompileShader(shader);
+
+			GLint status = GL_FALSE;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+			if (status != GL_TRUE) {
+				GLint len = 0;
+				glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+
+				std::vector<GLchar> log(len + 1, 0);
+				glGetShaderInfoLog(shader, len, NULL, &log[0]);
+				_log.append(&log[0]);
+
+				glDeleteShader(shader);
+				return 0;
+			}
+
+			return shader;
+		}
+
+		static std::string programLog (GLuint program) {
+			GLint len = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+
+			std::vector<GLchar> log(len + 1, 0);
+			glGetProgramInfoLog(program, len, NULL, &log[0]);
+			return std::string(&log[0]);
+		}
+
+	};
+
+}
+
+#endif /* GFX_SHADER_H_ */
@@ -40,6 +40,27 @@ namespace gfx {
 		}
 	};
 
+	/**
+	 * A position quantized to 16 bits, padded to 8 bytes so each vertex
+	 * starts on a 4-byte boundary in vertex buffers.  The scale back to
+	 * model units is left to the transform.
+	 */
+
+	struct vertex3s {
+		short x;
+		short y;
+		short z;
+		short pad;
+
+		vertex3s ()
+			: pad(0) {
+		}
+
+		vertex3s (short a, short b, short c)
+			: x(a), y(b), z(c), pad(0) {
+		}
+	};
+
 	struct normal3f {
 		float nx;
 		float ny;
@@ -78,11 +99,21 @@ namespace gfx {
 		}
 	};
 
+	/**
+	 * One vertex of every attribute, for Mesh::addVertex.  Attributes a
+	 * loader leaves unset are zero, with the color white.
+	 */
+
 	struct vertexDef {
 		vertex3f vertex;
+		vertex3s shortVertex;
 		normal3f normal;
 		color4ub color;
 		texCoord2f texCoord;
+
+		vertexDef ()
+			: vertex(0, 0, 0), shortVertex(0, 0, 0), normal(0, 0, 0), color(255, 255, 255, 255) {
+		}
 	};
 
 }
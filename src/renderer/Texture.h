@@ -28,6 +28,7 @@
 
 #include <OpenGL/gl.h>
 
+#include "GLState.h"
 #include "TextureData.h"
 
 namespace gfx {
@@ -41,41 +42,54 @@ namespace gfx {
 		GLuint _target;
 		GLuint _env_mode;
 
-		static GLuint _global_env_mode;
+		static GLuint _placeholder;
 
 	public:
 
-		Texture (GLuint target, const TextureData& texdata)
-			: _texData(texdata), _texName(0), _target(target), _env_mode(GL_MODULATE) {
-
-			glGenTextures(1, &_texName);
-			glBindTexture(target, _texName);
+		/**
+		 * Create the texture and, unless deferred, upload it.  A texture that
+		 * is not uploaded binds the placeholder until upload() is called.  The
+		 * texels are read from the image again on each upload, so it must
+		 * outlive the texture.
+		 */
 
-			glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		Texture (GLuint target, const TextureData& texdata, bool uploadNow = true)
+			: _texData(texdata), _texName(0), _target(target), _env_mode(GL_MODULATE) {
 
-			glTexImage2D(target, _texData._mipmapLevel, _texData._internalFormat,
-					_texData._width, _texData._height, _texData._border,
-					_texData._pixelFormat, _texData._pixelType, &_texData._texels->_data[0]);
+			if (uploadNow) {
+				upload();
+			}
 		}
 
 		void bind () {
-			glBindTexture(_target, _texName);
-
-			if (_env_mode != _global_env_mode) {
-				glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, _env_mode);
-				_global_env_mode = _env_mode;
-			}
+			GLState& gl = GLState::getState();
+			gl.bindTexture(_target, (_texName != 0) ? _texName : _placeholder);
+			gl.texEnvMode(_env_mode);
 		}
 
 		void disable () {
-			glDisable(_target);
+			GLState::getState().disable(_target);
 		}
 
 		void enable () {
-			glEnable(_target);
+			GLState::getState().enable(_target);
+		}
+
+		/**
+		 * Size of the texel data, as a guide to the memory the texture holds
+		 * once uploaded.
+		 */
+
+		unsigned getByteSize () const {
+			return _texData._texels->_data.size();
+		}
+
+		/**
+		 * The texels upload() reads, getByteSize() bytes of them.
+		 */
+
+		const GLvoid* getPixels () const {
+			return &_texData._texels->_data[0];
 		}
 
 		GLuint getTarget () {
@@ -86,6 +100,34 @@ namespace gfx {
 			return _texName;
 		}
 
+		const TextureData& getTextureData () const {
+			return _texData;
+		}
+
+		bool isUploaded () const {
+			return _texName != 0;
+		}
+
+		/**
+		 * Delete the GL texture, keeping what is needed to upload it again.
+		 */
+
+		void release () {
+			if (_texName != 0) {
+				GLState::getState().deleteTexture(_texName);
+				_texName = 0;
+			}
+		}
+
+		/**
+		 * Set the texture bound in place of any not yet uploaded, such as one
+		 * still queued in a TextureUploader.  0 binds no texture.
+		 */
+
+		static void setPlaceholder (GLuint name) {
+			_placeholder = name;
+		}
+
 		void setTexEnvMode (GLint value) {
 			_env_mode = value;
 		}
@@ -102,9 +144,34 @@ namespace gfx {
 			_texData = texData;
 		}
 
+		void upload () {
+			upload(getPixels());
+		}
+
+		/**
+		 * Upload from pixels rather than the image, such as an offset into
+		 * the bound pixel unpack buffer.
+		 */
+
+		void upload (const GLvoid* pixels) {
+			if (_texName == 0) {
+				glGenTextures(1, &_texName);
+			}
+			GLState::getState().bindTexture(_target, _texName);
+
+			glTexParameteri(_target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(_target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+			glTexImage2D(_target, _texData._mipmapLevel, _texData._internalFormat,
+					_texData._width, _texData._height, _texData._border,
+					_texData._pixelFormat, _texData._pixelType, pixels);
+		}
+
 	};
 
-	GLuint Texture::_global_env_mode = GL_MODULATE;
+	GLuint Texture::_placeholder = 0;
 
 }
 
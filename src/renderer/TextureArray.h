@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_TEXTUREARRAY_H_
+#define GFX_TEXTUREARRAY_H_
+
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+#include <vector>
+
+#include "Texture.h"
+
+namespace gfx {
+
+	/**
+	 * A set of same-sized textures uploaded once as the layers of a
+	 * GL_TEXTURE_2D_ARRAY, so geometry can switch between them by layer
+	 * index instead of by binding another texture.  The source textures
+	 * are kept, for paths that cannot sample arrays.
+	 */
+
+	class TextureArray {
+	protected:
+
+		std::vector<Texture*> _layers;
+
+		GLuint _texName;
+
+	public:
+
+		/**
+		 * Upload layers.  Every layer must match the first in size and
+		 * format; see isCompatible.
+		 */
+
+		TextureArray (const std::vector<Texture*>& layers)
+			: _layers(layers), _texName(0) {
+
+			const TextureData& first = _layers[0]->getTextureData();
+
+			GLState& gl = GLState::getState();
+
+			glGenTextures(1, &_texName);
+			gl.bindTexture(GL_TEXTURE_2D_ARRAY_EXT, _texName);
+
+			glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+			glTexImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, first._internalFormat, first._width, first._height,
+					_layers.size(), 0, first._pixelFormat, first._pixelType, NULL);
+
+			for (unsigned i = 0; i < _layers.size(); i++) {
+				const TextureData& data = _layers[i]->getTextureData();
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, 0, 0, i, data._width, data._height, 1,
+						data._pixelFormat, data._pixelType, &data._texels->_data[0]);
+			}
+
+			gl.bindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+		}
+
+		void bind () const {
+			GLState::getState().bindTexture(GL_TEXTURE_2D_ARRAY_EXT, _texName);
+		}
+
+		unsigned getLayerCount () const {
+			return _layers.size();
+		}
+
+		/**
+		 * The source texture of a layer.
+		 */
+
+		Texture* getLayerTexture (unsigned layer) const {
+			return _layers[layer];
+		}
+
+		GLuint getTextureObject () const {
+			return _texName;
+		}
+
+		static void unbind () {
+			GLState::getState().bindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+		}
+
+		/**
+		 * True if layers can share an array: there is at least one, and all
+		 * have the size and format of the first.
+		 */
+
+		static bool isCompatible (const std::vector<Texture*>& layers) {
+			if (layers.empty()) {
+				return false;
+			}
+
+			const TextureData& first = layers[0]->getTextureData();
+			for (unsigned i = 1; i < layers.size(); i++) {
+				const TextureData& data = layers[i]->getTextureData();
+				if (data._width != first._width || data._height != first._height
+						|| data._internalFormat != first._internalFormat
+						|| data._pixelFormat != first._pixelFormat || data._pixelType != first._pixelType) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+	};
+
+}
+
+#endif /* GFX_TEXTUREARRAY_H_ */
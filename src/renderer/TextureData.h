@@ -33,11 +33,13 @@
 namespace gfx {
 
 	class Texture;
+	class TextureArray;
 
 	class TextureData {
 	protected:
 
 		friend class Texture;
+		friend class TextureArray;
 
 		int _internalFormat;
 		int _width;
@@ -0,0 +1,426 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GFX_TEXTUREUPLOADER_H_
+#define GFX_TEXTUREUPLOADER_H_
+
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+#include <SFML/System.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+#include "Texture.h"
+#include "../system/TaskPool.h"
+
+namespace gfx {
+
+	/**
+	 * Uploads queued textures over several frames instead of all at once.
+	 *
+	 * Each texture is staged through one of a small ring of pixel buffer
+	 * objects: the buffer is mapped on the render thread, the texels are
+	 * copied into it on a TaskPool worker, and a later update() unmaps it
+	 * and points glTexImage2D at it, so the driver can copy to the GPU
+	 * without stalling the caller.  update() only finishes as many
+	 * uploads as fit the per-frame byte budget, and never waits on a
+	 * worker.  Until its upload finishes, a texture binds the placeholder.
+	 *
+	 * Without pixel buffer objects (before GL 2.1), textures are uploaded
+	 * straight from their images, still within the per-frame budget.
+	 */
+
+	class TextureUploader {
+	public:
+
+		enum {
+			SLOT_COUNT = 4,
+		};
+
+	protected:
+
+		struct Slot;
+
+		class CopyTask : public TaskPool::Task {
+		public:
+
+			TextureUploader* uploader;
+			Slot* slot;
+
+			void run () {
+				uploader->copy(*slot);
+			}
+		};
+
+		struct Slot {
+			GLuint pbo;
+			Texture* texture;
+			GLvoid* mapped;
+			const GLvoid* pixels;
+			unsigned bytes;
+
+			// Only touched by the render thread
+			bool busy;
+
+			// Set by the copy task, under the uploader's mutex
+			bool done;
+
+			CopyTask task;
+		};
+
+		std::deque<Texture*> _queue;
+		std::vector<Slot> _slots;
+
+		TaskPool* _pool;
+		sf::Mutex _mutex;
+
+		unsigned _budgetBytes;
+		unsigned _frameBytes;
+		unsigned _frameUploads;
+
+		GLuint _placeholder;
+		int _pboSupport;
+
+	public:
+
+		TextureUploader ()
+			: _slots(SLOT_COUNT), _pool(NULL), _budgetBytes(1024 * 1024), _frameBytes(0), _frameUploads(0),
+			  _placeholder(0), _pboSupport(-1) {
+			for (unsigned i = 0; i < _slots.size(); i++) {
+				Slot& slot = _slots[i];
+				slot.pbo = 0;
+				slot.texture = NULL;
+				slot.mapped = NULL;
+				slot.pixels = NULL;
+				slot.bytes = 0;
+				slot.busy = false;
+				slot.done = false;
+				slot.task.uploader = this;
+				slot.task.slot = &slot;
+			}
+		}
+
+		virtual ~TextureUploader () {
+			shutdown();
+		}
+
+		/**
+		 * Set the pool staging copies run on, and the bytes of texels to
+		 * upload per frame.  At least one texture is uploaded each frame,
+		 * however large.
+		 */
+
+		void init (TaskPool* pool, unsigned budgetBytes) {
+			_pool = pool;
+			_budgetBytes = budgetBytes;
+		}
+
+		/**
+		 * Queue a texture to be uploaded.  It must not be uploaded already.
+		 */
+
+		void queue (Texture* texture) {
+			preparePlaceholder();
+			_queue.push_back(texture);
+		}
+
+		/**
+		 * Drop a texture from the queue, or discard its upload if one is in
+		 * flight.  Call before releasing a queued texture.
+		 */
+
+		void cancel (Texture* texture) {
+			std::deque<Texture*>::iterator iter = std::find(_queue.begin(), _queue.end(), texture);
+			if (iter != _queue.end()) {
+				_queue.erase(iter);
+			}
+
+			for (unsigned i = 0; i < _slots.size(); i++) {
+				if (_slots[i].texture == texture) {
+					_slots[i].texture = NULL;
+				}
+			}
+		}
+
+		/**
+		 * Finish staged uploads within the frame budget, then start staging
+		 * the next textures into free buffers.  Must be called on the thread
+		 * owning the GL context, once a frame.
+		 */
+
+		void update () {
+			_frameBytes = 0;
+			_frameUploads = 0;
+
+			if (!prepareBuffers()) {
+				while (!_queue.empty() && fitsBudget(_queue.front()->getByteSize())) {
+					Texture* texture = _queue.front();
+					_queue.pop_front();
+					texture->upload();
+					countUpload(texture->getByteSize());
+				}
+				return;
+			}
+
+			finishUploads();
+			startUploads();
+		}
+
+		/**
+		 * Wait out any copies in flight and free the buffers.  Call before
+		 * the pool goes away.
+		 */
+
+		void shutdown () {
+			if (_pool != NULL && _pool->getWorkerCount() > 0 && isStaging()) {
+				_pool->wait();
+			}
+			_pool = NULL;
+
+			for (unsigned i = 0; i < _slots.size(); i++) {
+				Slot& slot = _slots[i];
+				if (slot.mapped != NULL) {
+					glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+					glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+					slot.mapped = NULL;
+				}
+				if (slot.pbo != 0) {
+					glDeleteBuffers(1, &slot.pbo);
+					slot.pbo = 0;
+				}
+				slot.texture = NULL;
+				slot.busy = false;
+				slot.done = false;
+			}
+			if (_pboSupport == 1) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			}
+
+			if (_placeholder != 0) {
+				Texture::setPlaceholder(0);
+				GLState::getState().deleteTexture(_placeholder);
+				_placeholder = 0;
+			}
+		}
+
+		unsigned getFrameBytes () const {
+			return _frameBytes;
+		}
+
+		unsigned getFrameUploads () const {
+			return _frameUploads;
+		}
+
+		/**
+		 * Textures queued or staging, not yet uploaded.
+		 */
+
+		unsigned getPendingCount () const {
+			unsigned count = _queue.size();
+			for (unsigned i = 0; i < _slots.size(); i++) {
+				if (_slots[i].busy && _slots[i].texture != NULL) {
+					count++;
+				}
+			}
+			return count;
+		}
+
+		bool isIdle () const {
+			return _queue.empty() && !isStaging();
+		}
+
+	protected:
+
+		void copy (Slot& slot) {
+			std::memcpy(slot.mapped, slot.pixels, slot.bytes);
+
+			sf::Lock lock(_mutex);
+			slot.done = true;
+		}
+
+		/**
+		 * Unmap buffers whose copies are done and upload from them, nearest
+		 * the front of the ring first, while the budget allows.
+		 */
+
+		void finishUploads () {
+			for (unsigned i = 0; i < _slots.size(); i++) {
+				Slot& slot = _slots[i];
+				if (!slot.busy) {
+					continue;
+				}
+
+				{
+					sf::Lock lock(_mutex);
+					if (!slot.done) {
+						continue;
+					}
+				}
+
+				if (slot.texture != NULL && !fitsBudget(slot.bytes)) {
+					continue;
+				}
+
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+				GLboolean intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				slot.mapped = NULL;
+
+				if (slot.texture != NULL) {
+					if (intact) {
+						slot.texture->upload((const GLvoid*)0);
+					}
+					else {
+						// The buffer's contents were lost; go to the image
+						glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+						slot.texture->upload();
+					}
+					countUpload(slot.bytes);
+				}
+
+				slot.texture = NULL;
+				slot.busy = false;
+				slot.done = false;
+			}
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		/**
+		 * Map a free buffer for each queued texture and hand the copy to the
+		 * pool.  With no workers the pool only runs tasks in wait(), so the
+		 * copy is made here instead.
+		 */
+
+		void startUploads () {
+			for (unsigned i = 0; i < _slots.size() && !_queue.empty(); i++) {
+				Slot& slot = _slots[i];
+				if (slot.busy) {
+					continue;
+				}
+
+				Texture* texture = _queue.front();
+				_queue.pop_front();
+
+				slot.bytes = texture->getByteSize();
+				slot.pixels = texture->getPixels();
+
+				// Orphan the old storage so mapping never waits on the
+				// driver's last read from it
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, slot.bytes, NULL, GL_STREAM_DRAW);
+				slot.mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+
+				if (slot.mapped == NULL) {
+					glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+					texture->upload();
+					countUpload(slot.bytes);
+					continue;
+				}
+
+				slot.texture = texture;
+				slot.busy = true;
+				slot.done = false;
+
+				if (_pool != NULL && _pool->getWorkerCount() > 0) {
+					_pool->submit(&slot.task);
+				}
+				else {
+					copy(slot);
+				}
+			}
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		void countUpload (unsigned bytes) {
+			_frameBytes += bytes;
+			_frameUploads++;
+		}
+
+		bool fitsBudget (unsigned bytes) const {
+			return _frameUploads == 0 || _frameBytes + bytes <= _budgetBytes;
+		}
+
+		bool isStaging () const {
+			for (unsigned i = 0; i < _slots.size(); i++) {
+				if (_slots[i].busy) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/**
+		 * Create the buffer ring on first use.  Returns false if pixel
+		 * buffer objects are unavailable.
+		 */
+
+		bool prepareBuffers () {
+			if (_pboSupport == -1) {
+				const char* version = (const char*)glGetString(GL_VERSION);
+				_pboSupport = (version != NULL && std::strtod(version, NULL) >= 2.1) ? 1 : 0;
+
+				if (_pboSupport) {
+					for (unsigned i = 0; i < _slots.size(); i++) {
+						glGenBuffers(1, &_slots[i].pbo);
+					}
+				}
+			}
+
+			return _pboSupport == 1;
+		}
+
+		/**
+		 * A one texel mid-grey texture, so geometry waiting on its texture
+		 * still shows its vertex colors and shape.
+		 */
+
+		void preparePlaceholder () {
+			if (_placeholder != 0) {
+				return;
+			}
+
+			const GLubyte grey[4] = { 128, 128, 128, 255 };
+
+			GLState& gl = GLState::getState();
+
+			glGenTextures(1, &_placeholder);
+			gl.bindTexture(GL_TEXTURE_2D, _placeholder);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+			gl.bindTexture(GL_TEXTURE_2D, 0);
+
+			Texture::setPlaceholder(_placeholder);
+		}
+
+	};
+
+}
+
+#endif /* GFX_TEXTUREUPLOADER_H_ */
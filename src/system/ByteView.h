@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef BYTEVIEW_H_
+#define BYTEVIEW_H_
+
+#include <cstddef>
+#include <algorithm>
+#include <string>
+#include "../common.h"
+
+/**
+ * A read-only window onto bytes owned elsewhere, such as a MappedFile.
+ * It indexes like a std::vector<u8>, so the get* helpers in common.h read
+ * from either.  The owner must outlive every view of its bytes.
+ */
+
+class ByteView {
+protected:
+
+	const u8* _data;
+	size_t _size;
+
+public:
+
+	ByteView ()
+		: _data(NULL), _size(0) {
+	}
+
+	ByteView (const u8* data, size_t size)
+		: _data(data), _size(size) {
+	}
+
+	const u8* data () const {
+		return _data;
+	}
+
+	bool empty () const {
+		return _size == 0;
+	}
+
+	size_t size () const {
+		return _size;
+	}
+
+	/**
+	 * Whether the length bytes at offset lie within the view.
+	 */
+
+	bool contains (size_t offset, size_t length) const {
+		return offset <= _size && length <= _size - offset;
+	}
+
+	/**
+	 * The length bytes at offset, or an empty view if they run past the
+	 * end of this one.
+	 */
+
+	ByteView sub (size_t offset, size_t length) const {
+		if (!contains(offset, length)) {
+			return ByteView();
+		}
+		return ByteView(_data + offset, length);
+	}
+
+	u8 operator[] (size_t index) const {
+		return _data[index];
+	}
+};
+
+/**
+ * getString for a view: a string running off the end is cut short there,
+ * rather than reading past it.
+ */
+
+inline std::string getString (const ByteView& v, int index, int maxLen) {
+	if (index < 0 || (size_t)index >= v.size()) {
+		return "";
+	}
+
+	const char* str = (const char*)v.data() + index;
+	size_t len = std::min((size_t)maxLen, v.size() - index);
+	return std::string(str, std::find(str, str + len, 0));
+}
+
+#endif /* BYTEVIEW_H_ */
@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * A read-only memory mapping of a whole file.  Pages are loaded by the OS
+ * on first touch and shared with other processes mapping the same file.
+ */
+
+class MappedFile {
+protected:
+
+	const unsigned char* _data;
+	size_t _size;
+
+#ifdef _WIN32
+	HANDLE _file;
+	HANDLE _mapping;
+#endif
+
+public:
+
+	MappedFile ()
+		: _data(NULL), _size(0) {
+#ifdef _WIN32
+		_file = INVALID_HANDLE_VALUE;
+		_mapping = NULL;
+#endif
+	}
+
+	virtual ~MappedFile () {
+		close();
+	}
+
+	void close () {
+#ifdef _WIN32
+		if (_data != NULL) UnmapViewOfFile(_data);
+		if (_mapping != NULL) CloseHandle(_mapping);
+		if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+		_file = INVALID_HANDLE_VALUE;
+		_mapping = NULL;
+#else
+		if (_data != NULL) munmap((void*)_data, _size);
+#endif
+		_data = NULL;
+		_size = 0;
+	}
+
+	const unsigned char* data () const {
+		return _data;
+	}
+
+	bool isOpen () const {
+		return _data != NULL;
+	}
+
+	bool open (const std::string& path) {
+		close();
+
+#ifdef _WIN32
+		_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL, NULL);
+		if (_file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+			close();
+			return false;
+		}
+
+		_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (_mapping == NULL) {
+			close();
+			return false;
+		}
+
+		_data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (_data == NULL) {
+			close();
+			return false;
+		}
+		_size = (size_t)size.QuadPart;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd == -1) {
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+
+		void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if (p == MAP_FAILED) {
+			return false;
+		}
+
+		_data = (const unsigned char*)p;
+		_size = st.st_size;
+#endif
+
+		return true;
+	}
+
+	size_t size () const {
+		return _size;
+	}
+
+protected:
+
+	MappedFile (const MappedFile&) { }
+
+	MappedFile& operator= (const MappedFile&) {
+		return *this;
+	}
+};
+
+#endif /* MAPPEDFILE_H_ */
@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TASKPOOL_H_
+#define TASKPOOL_H_
+
+#include <SFML/System.hpp>
+#include <deque>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * A fixed set of worker threads with work stealing.  Each worker has its
+ * own task deque: it takes work from the back of its own deque and, when
+ * that runs dry, steals from the front of another's.
+ *
+ * The thread calling wait() works through tasks too, so submitted work
+ * completes even before any worker has woken.  Idle workers poll with a
+ * short sleep rather than block, since SFML offers no condition variable.
+ */
+
+class TaskPool {
+public:
+
+	class Task {
+	public:
+
+		virtual ~Task () { }
+
+		virtual void run () = 0;
+	};
+
+protected:
+
+	struct Queue {
+		std::deque<Task*> tasks;
+		sf::Mutex mutex;
+	};
+
+	struct Worker {
+		TaskPool* pool;
+		unsigned index;
+		sf::Thread* thread;
+	};
+
+	std::vector<Queue*> _queues;
+	std::vector<Worker> _workers;
+
+	sf::Mutex _stateMutex;
+	unsigned _pending;
+	unsigned _nextQueue;
+	bool _quit;
+
+public:
+
+	/**
+	 * Start workerCount threads.  With zero workers, all tasks run on
+	 * the thread that calls wait().
+	 */
+
+	TaskPool (unsigned workerCount)
+		: _pending(0), _nextQueue(0), _quit(false) {
+		// Queue 0 belongs to the waiting thread
+		_queues.resize(workerCount + 1);
+		for (unsigned i = 0; i < _queues.size(); i++) {
+			_queues[i] = new Queue();
+		}
+
+		_workers.resize(workerCount);
+		for (unsigned i = 0; i < workerCount; i++) {
+			_workers[i].pool = this;
+			_workers[i].index = i + 1;
+			_workers[i].thread = new sf::Thread(&TaskPool::workerMain, &_workers[i]);
+		}
+		for (unsigned i = 0; i < workerCount; i++) {
+			_workers[i].thread->launch();
+		}
+	}
+
+	virtual ~TaskPool () {
+		{
+			sf::Lock lock(_stateMutex);
+			_quit = true;
+		}
+
+		for (unsigned i = 0; i < _workers.size(); i++) {
+			_workers[i].thread->wait();
+			delete _workers[i].thread;
+		}
+
+		for (unsigned i = 0; i < _queues.size(); i++) {
+			delete _queues[i];
+		}
+	}
+
+	/**
+	 * One worker per core, leaving one core for the calling thread.
+	 */
+
+	static unsigned defaultWorkerCount () {
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		long cores = info.dwNumberOfProcessors;
+#else
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		return (cores > 1) ? (unsigned)(cores - 1) : 0;
+	}
+
+	unsigned getWorkerCount () const {
+		return _workers.size();
+	}
+
+	/**
+	 * Queue a task.  Tasks are dealt round-robin across the deques; the
+	 * pool does not take ownership.
+	 */
+
+	void submit (Task* task) {
+		unsigned q;
+		{
+			sf::Lock lock(_stateMutex);
+			_pending++;
+			q = _nextQueue;
+			_nextQueue = (_nextQueue + 1) % _queues.size();
+		}
+
+		sf::Lock lock(_queues[q]->mutex);
+		_queues[q]->tasks.push_back(task);
+	}
+
+	/**
+	 * Run tasks on the calling thread until every submitted task is done.
+	 */
+
+	void wait () {
+		for (;;) {
+			Task* task = take(0);
+			if (task != NULL) {
+				runTask(task);
+				continue;
+			}
+
+			{
+				sf::Lock lock(_stateMutex);
+				if (_pending == 0) {
+					return;
+				}
+			}
+
+			// The rest are running on workers
+			sf::sleep(sf::microseconds(50));
+		}
+	}
+
+protected:
+
+	void runTask (Task* task) {
+		task->run();
+
+		sf::Lock lock(_stateMutex);
+		_pending--;
+	}
+
+	/**
+	 * Pop from the back of our own deque, or steal from the front of
+	 * another's.
+	 */
+
+	Task* take (unsigned self) {
+		{
+			Queue& own = *_queues[self];
+			sf::Lock lock(own.mutex);
+			if (!own.tasks.empty()) {
+				Task* task = own.tasks.back();
+				own.tasks.pop_back();
+				return task;
+			}
+		}
+
+		for (unsigned i = 1; i < _queues.size(); i++) {
+			Queue& victim = *_queues[(self + i) % _queues.size()];
+			sf::Lock lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				Task* task = victim.tasks.front();
+				victim.tasks.pop_front();
+				return task;
+			}
+		}
+
+		return NULL;
+	}
+
+	static void workerMain (Worker* worker) {
+		TaskPool& pool = *worker->pool;
+		unsigned idle = 0;
+
+		for (;;) {
+			Task* task = pool.take(worker->index);
+			if (task != NULL) {
+				pool.runTask(task);
+				idle = 0;
+				continue;
+			}
+
+			{
+				sf::Lock lock(pool._stateMutex);
+				if (pool._quit) {
+					return;
+				}
+			}
+
+			// Spin briefly after finishing work, then back off
+			sf::sleep(sf::microseconds(++idle < 64 ? 0 : 1000));
+		}
+	}
+
+private:
+
+	TaskPool (const TaskPool&) { }
+
+	TaskPool& operator= (const TaskPool&) {
+		return *this;
+	}
+};
+
+#endif /* TASKPOOL_H_ */
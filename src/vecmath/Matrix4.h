@@ -29,6 +29,7 @@
 #include <stdexcept>
 
 #include "Vecmath.h"
+#include "SIMD.h"
 
 namespace vmath {
 
@@ -245,7 +246,7 @@ namespace vmath {
 			T d02 = det3x3(_m[4], _m[5], _m[7], _m[8], _m[9], _m[11], _m[12], _m[13], _m[15]);
 			T d03 = det3x3(_m[4], _m[5], _m[6], _m[8], _m[9], _m[10], _m[12], _m[13], _m[14]);
 
-			T det = d00 - d01 + d02 - d03;
+			T det = _m[0] * d00 - _m[1] * d01 + _m[2] * d02 - _m[3] * d03;
 			if (det == 0) {
 				throw SingularException();
 			}
@@ -274,6 +275,47 @@ namespace vmath {
 			transpose();
 		}
 
+		/**
+		 * Invert a matrix whose last row is 0 0 0 1.  The upper 3x3 is
+		 * inverted through the cross products of its rows and the translation
+		 * is carried through it, which is far cheaper than invert.
+		 */
+
+		void invertAffine () {
+			T c00 = _m[5] * _m[10] - _m[6] * _m[9];
+			T c01 = _m[6] * _m[8] - _m[4] * _m[10];
+			T c02 = _m[4] * _m[9] - _m[5] * _m[8];
+
+			T det = _m[0] * c00 + _m[1] * c01 + _m[2] * c02;
+			if (det == 0) {
+				throw SingularException();
+			}
+
+			T c10 = _m[9] * _m[2] - _m[10] * _m[1];
+			T c11 = _m[10] * _m[0] - _m[8] * _m[2];
+			T c12 = _m[8] * _m[1] - _m[9] * _m[0];
+
+			T c20 = _m[1] * _m[6] - _m[2] * _m[5];
+			T c21 = _m[2] * _m[4] - _m[0] * _m[6];
+			T c22 = _m[0] * _m[5] - _m[1] * _m[4];
+
+			T tx = _m[3];
+			T ty = _m[7];
+			T tz = _m[11];
+
+			T s = T(1) / det;
+
+			_m[0] = c00 * s;	_m[1] = c10 * s;	_m[2] = c20 * s;
+			_m[4] = c01 * s;	_m[5] = c11 * s;	_m[6] = c21 * s;
+			_m[8] = c02 * s;	_m[9] = c12 * s;	_m[10] = c22 * s;
+
+			_m[3] = -(_m[0] * tx + _m[1] * ty + _m[2] * tz);
+			_m[7] = -(_m[4] * tx + _m[5] * ty + _m[6] * tz);
+			_m[11] = -(_m[8] * tx + _m[9] * ty + _m[10] * tz);
+
+			_m[12] = 0;	_m[13] = 0;	_m[14] = 0;	_m[15] = 1;
+		}
+
 		void mul (T s) {
 			for (unsigned int i = 0; i < _nElements; i++) {
 				_m[i] *= s;
@@ -460,6 +502,22 @@ namespace vmath {
 	template <typename T>
 	const Matrix4<T> Matrix4<T>::IDENTITY(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
 
+#ifdef VMATH_SSE
+
+	template <>
+	inline void Matrix4<float>::mul (const Matrix4<float>& m) {
+		simd::mul4x4(_m, m._m, _m);
+	}
+
+	template <>
+	inline void Matrix4<float>::invertAffine () {
+		if (!simd::invertAffine(_m, _m)) {
+			throw SingularException();
+		}
+	}
+
+#endif
+
 	typedef Matrix4<double> Matrix4d;
 	typedef Matrix4<float> Matrix4f;
 
@@ -191,6 +191,51 @@ namespace vmath {
 			t.set(tx, ty, tz);
 		}
 
+		/**
+		 * Transform count points, packed as xyz triples.  in and out may be
+		 * the same array.
+		 */
+
+		void transformPoints (const T* in, unsigned count, T* out) const {
+			transformRows(_m, in, count, out);
+		}
+
+		/**
+		 * Transform count normals, packed as xyz triples, by the inverse
+		 * transpose of the upper 3x3, so they stay perpendicular to surfaces
+		 * under non-uniform scale.  They are not renormalized.  in and out
+		 * may be the same array.
+		 */
+
+		void transformNormals (const T* in, unsigned count, T* out) const {
+			T rows[12];
+
+			rows[0] = _m[5] * _m[10] - _m[6] * _m[9];
+			rows[1] = _m[6] * _m[8] - _m[4] * _m[10];
+			rows[2] = _m[4] * _m[9] - _m[5] * _m[8];
+
+			T det = _m[0] * rows[0] + _m[1] * rows[1] + _m[2] * rows[2];
+			if (det == 0) {
+				throw typename Matrix4<T>::SingularException();
+			}
+
+			rows[4] = _m[9] * _m[2] - _m[10] * _m[1];
+			rows[5] = _m[10] * _m[0] - _m[8] * _m[2];
+			rows[6] = _m[8] * _m[1] - _m[9] * _m[0];
+
+			rows[8] = _m[1] * _m[6] - _m[2] * _m[5];
+			rows[9] = _m[2] * _m[4] - _m[0] * _m[6];
+			rows[10] = _m[0] * _m[5] - _m[1] * _m[4];
+
+			T s = T(1) / det;
+			for (int i = 0; i < 12; i++) {
+				rows[i] *= s;
+			}
+			rows[3] = 0;	rows[7] = 0;	rows[11] = 0;
+
+			transformRows(rows, in, count, out);
+		}
+
 		void translate (T x, T y, T z) {
 			_m[3] += _m[0] * x + _m[1] * y + _m[2] * z;
 			_m[7] += _m[4] * x + _m[5] * y + _m[6] * z;
@@ -200,12 +245,36 @@ namespace vmath {
 
 	protected:
 
+		/**
+		 * Apply the top three rows of the row-major matrix m to count xyz
+		 * triples.
+		 */
+
+		static void transformRows (const T* m, const T* in, unsigned count, T* out) {
+			for (unsigned i = 0; i < count; i++, in += 3, out += 3) {
+				T tx = m[0] * in[0] + m[1] * in[1] + m[2] * in[2] + m[3];
+				T ty = m[4] * in[0] + m[5] * in[1] + m[6] * in[2] + m[7];
+				T tz = m[8] * in[0] + m[9] * in[1] + m[10] * in[2] + m[11];
+
+				out[0] = tx;	out[1] = ty;	out[2] = tz;
+			}
+		}
+
 		static T radians (T degrees) {
 			//const double PI = 3.14159265;
 			return (degrees * PI / 180.0);
 		}
 	};
 
+#ifdef VMATH_SSE
+
+	template <>
+	inline void MatrixG4<float>::transformRows (const float* m, const float* in, unsigned count, float* out) {
+		simd::transformPoints(m, in, count, out);
+	}
+
+#endif
+
 	typedef MatrixG4<float> MatrixG4f;
 	typedef MatrixG4<double> MatrixG4d;
 
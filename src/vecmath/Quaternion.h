@@ -0,0 +1,237 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VMATH_QUATERNION_H_
+#define VMATH_QUATERNION_H_
+
+#include <cmath>
+
+#include "Vecmath.h"
+
+namespace vmath {
+
+	/**
+	 * Unit quaternion rotation.  Angles are in degrees, matching MatrixG4.
+	 * Products compose like matrices: (a * b) rotates by b, then by a.
+	 */
+
+	template <class T>
+	class Quaternion {
+	public:
+
+		static const Quaternion<T> IDENTITY;
+
+	public:
+
+		T x;
+		T y;
+		T z;
+		T w;
+
+	public:
+
+		Quaternion ()
+			: x(0), y(0), z(0), w(1) {
+		}
+
+		Quaternion (T fx, T fy, T fz, T fw)
+			: x(fx), y(fy), z(fz), w(fw) {
+		}
+
+		Quaternion<T> operator* (const Quaternion<T>& q) const {
+			Quaternion<T> op(*this);
+			op.mul(q);
+			return op;
+		}
+
+		Quaternion<T>& operator*= (const Quaternion<T>& q) {
+			mul(q);
+			return *this;
+		}
+
+		void conjugate () {
+			x = -x;
+			y = -y;
+			z = -z;
+		}
+
+		T dot (const Quaternion<T>& q) const {
+			return x * q.x + y * q.y + z * q.z + w * q.w;
+		}
+
+		T length () const {
+			return std::sqrt(lengthSquared());
+		}
+
+		T lengthSquared () const {
+			return x * x + y * y + z * z + w * w;
+		}
+
+		/**
+		 * Rotation matrix, row-major, as a 3x3 array.
+		 */
+
+		void getMatrix (T* m) const {
+			T xx = x * x, yy = y * y, zz = z * z;
+			T xy = x * y, xz = x * z, yz = y * z;
+			T wx = w * x, wy = w * y, wz = w * z;
+
+			m[0] = 1 - 2 * (yy + zz);	m[1] = 2 * (xy - wz);		m[2] = 2 * (xz + wy);
+			m[3] = 2 * (xy + wz);		m[4] = 1 - 2 * (xx + zz);	m[5] = 2 * (yz - wx);
+			m[6] = 2 * (xz - wy);		m[7] = 2 * (yz + wx);		m[8] = 1 - 2 * (xx + yy);
+		}
+
+		void getMatrix (Matrix3<T>& m) const {
+			T r[9];
+			getMatrix(r);
+			m.set(r);
+		}
+
+		void mul (const Quaternion<T>& q) {
+			T tx = w * q.x + x * q.w + y * q.z - z * q.y;
+			T ty = w * q.y - x * q.z + y * q.w + z * q.x;
+			T tz = w * q.z + x * q.y - y * q.x + z * q.w;
+			T tw = w * q.w - x * q.x - y * q.y - z * q.z;
+
+			x = tx;	y = ty;	z = tz;	w = tw;
+		}
+
+		void normalize () {
+			T mag = length();
+			if (mag != 0) {
+				x /= mag;
+				y /= mag;
+				z /= mag;
+				w /= mag;
+			}
+		}
+
+		void set (T fx, T fy, T fz, T fw) {
+			x = fx;	y = fy;	z = fz;	w = fw;
+		}
+
+		void setAxisAngle (T a, T ax, T ay, T az) {
+			Vector3<T> u(ax, ay, az);
+			u.normalize();
+
+			T half = radians(a) / 2;
+			T s = std::sin(half);
+
+			set(u.x * s, u.y * s, u.z * s, std::cos(half));
+		}
+
+		/**
+		 * Rotation by a ZYX Euler triple, equivalent to rotateZ(a.z),
+		 * rotateY(a.y), rotateX(a.x) on a MatrixG4.
+		 */
+
+		void setEulerZYX (const Tuple3<T>& a) {
+			T hx = radians(a.x) / 2;
+			T hy = radians(a.y) / 2;
+			T hz = radians(a.z) / 2;
+
+			T cx = std::cos(hx), sx = std::sin(hx);
+			T cy = std::cos(hy), sy = std::sin(hy);
+			T cz = std::cos(hz), sz = std::sin(hz);
+
+			x = sx * cy * cz - cx * sy * sz;
+			y = cx * sy * cz + sx * cy * sz;
+			z = cx * cy * sz - sx * sy * cz;
+			w = cx * cy * cz + sx * sy * sz;
+		}
+
+		void setIdentity () {
+			set(0, 0, 0, 1);
+		}
+
+		void transform (Tuple3<T>& v) const {
+			// v' = v + w * t + u x t, where t = 2 * (u x v)
+			T tx = 2 * (y * v.z - z * v.y);
+			T ty = 2 * (z * v.x - x * v.z);
+			T tz = 2 * (x * v.y - y * v.x);
+
+			v.set(v.x + w * tx + (y * tz - z * ty),
+				v.y + w * ty + (z * tx - x * tz),
+				v.z + w * tz + (x * ty - y * tx));
+		}
+
+		/**
+		 * Normalized linear interpolation along the shorter arc.  Not constant
+		 * velocity, but cheap and close to slerp for the small steps between
+		 * animation keys.
+		 */
+
+		static Quaternion<T> nlerp (const Quaternion<T>& q1, const Quaternion<T>& q2, T t) {
+			T s = (q1.dot(q2) < 0) ? -t : t;
+
+			Quaternion<T> op(q1.x + (q2.x * s - q1.x * t), q1.y + (q2.y * s - q1.y * t),
+					q1.z + (q2.z * s - q1.z * t), q1.w + (q2.w * s - q1.w * t));
+			op.normalize();
+			return op;
+		}
+
+		/**
+		 * Spherical linear interpolation along the shorter arc.
+		 */
+
+		static Quaternion<T> slerp (const Quaternion<T>& q1, const Quaternion<T>& q2, T t) {
+			T d = q1.dot(q2);
+			T sign = 1;
+
+			if (d < 0) {
+				d = -d;
+				sign = -1;
+			}
+
+			// Nearly parallel; sin(theta) is too small to divide by
+			if (d > T(0.9995)) {
+				return nlerp(q1, q2, t);
+			}
+
+			T theta = std::acos(d);
+			T sinTheta = std::sin(theta);
+			T w1 = std::sin((1 - t) * theta) / sinTheta;
+			T w2 = sign * std::sin(t * theta) / sinTheta;
+
+			return Quaternion<T>(q1.x * w1 + q2.x * w2, q1.y * w1 + q2.y * w2,
+					q1.z * w1 + q2.z * w2, q1.w * w1 + q2.w * w2);
+		}
+
+	protected:
+
+		static T radians (T degrees) {
+			return (degrees * PI / 180.0);
+		}
+	};
+
+	template <typename T>
+	const Quaternion<T> Quaternion<T>::IDENTITY(0, 0, 0, 1);
+
+	typedef Quaternion<float> Quaternionf;
+	typedef Quaternion<double> Quaterniond;
+
+}
+
+#endif /* VMATH_QUATERNION_H_ */
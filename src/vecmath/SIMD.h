@@ -0,0 +1,269 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VMATH_SIMD_H_
+#define VMATH_SIMD_H_
+
+/*
+ * SSE2 kernels for the float specializations of the matrix classes.  Define
+ * VMATH_NO_SIMD to build with the generic templates only, which is also what
+ * targets without SSE2 (such as ARM) get.
+ */
+
+#if !defined(VMATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VMATH_SSE
+#endif
+
+#ifdef VMATH_SSE
+
+#include <emmintrin.h>
+
+namespace vmath {
+
+	namespace simd {
+
+		/**
+		 * One row of a 4x4 product: the row of a times the rows of b, summed
+		 * pairwise to shorten the dependency chain.
+		 */
+
+		inline __m128 mulRow (__m128 row, __m128 b0, __m128 b1, __m128 b2, __m128 b3) {
+			__m128 s01 = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b0),
+					_mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+			__m128 s23 = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b2),
+					_mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+			return _mm_add_ps(s01, s23);
+		}
+
+		/**
+		 * out = a * b for row-major 4x4 matrices.  out may alias a or b.
+		 */
+
+		inline void mul4x4 (const float* a, const float* b, float* out) {
+			__m128 b0 = _mm_loadu_ps(b + 0);
+			__m128 b1 = _mm_loadu_ps(b + 4);
+			__m128 b2 = _mm_loadu_ps(b + 8);
+			__m128 b3 = _mm_loadu_ps(b + 12);
+
+			__m128 r0 = mulRow(_mm_loadu_ps(a + 0), b0, b1, b2, b3);
+			__m128 r1 = mulRow(_mm_loadu_ps(a + 4), b0, b1, b2, b3);
+			__m128 r2 = mulRow(_mm_loadu_ps(a + 8), b0, b1, b2, b3);
+			__m128 r3 = mulRow(_mm_loadu_ps(a + 12), b0, b1, b2, b3);
+
+			_mm_storeu_ps(out + 0, r0);
+			_mm_storeu_ps(out + 4, r1);
+			_mm_storeu_ps(out + 8, r2);
+			_mm_storeu_ps(out + 12, r3);
+		}
+
+		inline __m128 cross3 (__m128 a, __m128 b) {
+			__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+			return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+		}
+
+		/**
+		 * Invert a row-major affine matrix (last row 0 0 0 1).  The inverse of
+		 * the upper 3x3 is built from cross products of its rows, and the
+		 * translation is carried through it.  Returns false if singular.
+		 */
+
+		inline bool invertAffine (const float* m, float* out) {
+			__m128 r0 = _mm_setr_ps(m[0], m[1], m[2], 0.f);
+			__m128 r1 = _mm_setr_ps(m[4], m[5], m[6], 0.f);
+			__m128 r2 = _mm_setr_ps(m[8], m[9], m[10], 0.f);
+
+			// Columns of the adjugate
+			__m128 c0 = cross3(r1, r2);
+			__m128 c1 = cross3(r2, r0);
+			__m128 c2 = cross3(r0, r1);
+
+			float det;
+			__m128 d = _mm_mul_ps(r0, c0);
+			d = _mm_add_ps(d, _mm_movehl_ps(d, d));
+			d = _mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1)));
+			_mm_store_ss(&det, d);
+
+			if (det == 0.f) {
+				return false;
+			}
+
+			__m128 invDet = _mm_set1_ps(1.f / det);
+			c0 = _mm_mul_ps(c0, invDet);
+			c1 = _mm_mul_ps(c1, invDet);
+			c2 = _mm_mul_ps(c2, invDet);
+
+			__m128 t = _mm_mul_ps(_mm_set1_ps(m[3]), c0);
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(m[7]), c1));
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(m[11]), c2));
+			t = _mm_sub_ps(_mm_setzero_ps(), t);
+
+			// The columns c0, c1, c2 and t transpose into the top three rows
+			_MM_TRANSPOSE4_PS(c0, c1, c2, t);
+
+			_mm_storeu_ps(out + 0, c0);
+			_mm_storeu_ps(out + 4, c1);
+			_mm_storeu_ps(out + 8, c2);
+			_mm_storeu_ps(out + 12, _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
+
+			return true;
+		}
+
+		/**
+		 * Transform a center/extents box by a matrix in GL (column-major)
+		 * order and refit it to the axes.  In that order the array rows are
+		 * the matrix columns, so both results are sums of scaled rows.
+		 */
+
+		inline void transformBoundGL (const float* m, const float* center, const float* extants,
+				float* outCenter, float* outExtants) {
+			const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+			__m128 col0 = _mm_loadu_ps(m + 0);
+			__m128 col1 = _mm_loadu_ps(m + 4);
+			__m128 col2 = _mm_loadu_ps(m + 8);
+			__m128 col3 = _mm_loadu_ps(m + 12);
+
+			__m128 c = _mm_add_ps(col3, _mm_mul_ps(_mm_set1_ps(center[0]), col0));
+			c = _mm_add_ps(c, _mm_mul_ps(_mm_set1_ps(center[1]), col1));
+			c = _mm_add_ps(c, _mm_mul_ps(_mm_set1_ps(center[2]), col2));
+
+			__m128 e = _mm_mul_ps(_mm_set1_ps(extants[0]), _mm_and_ps(col0, absMask));
+			e = _mm_add_ps(e, _mm_mul_ps(_mm_set1_ps(extants[1]), _mm_and_ps(col1, absMask)));
+			e = _mm_add_ps(e, _mm_mul_ps(_mm_set1_ps(extants[2]), _mm_and_ps(col2, absMask)));
+
+			_mm_storel_pi((__m64*)outCenter, c);
+			_mm_store_ss(outCenter + 2, _mm_movehl_ps(c, c));
+			_mm_storel_pi((__m64*)outExtants, e);
+			_mm_store_ss(outExtants + 2, _mm_movehl_ps(e, e));
+		}
+
+		/**
+		 * Transform count points, packed as xyz triples, by the top three
+		 * rows of a row-major matrix.  Four points are loaded as three
+		 * vectors and shuffled into x, y and z vectors, so each row is
+		 * applied to four points at once.  in and out may be the same array.
+		 */
+
+		inline void transformPoints (const float* m, const float* in, unsigned count, float* out) {
+			__m128 m00 = _mm_set1_ps(m[0]), m01 = _mm_set1_ps(m[1]), m02 = _mm_set1_ps(m[2]), m03 = _mm_set1_ps(m[3]);
+			__m128 m10 = _mm_set1_ps(m[4]), m11 = _mm_set1_ps(m[5]), m12 = _mm_set1_ps(m[6]), m13 = _mm_set1_ps(m[7]);
+			__m128 m20 = _mm_set1_ps(m[8]), m21 = _mm_set1_ps(m[9]), m22 = _mm_set1_ps(m[10]), m23 = _mm_set1_ps(m[11]);
+
+			unsigned i = 0;
+
+			for (; i + 4 <= count; i += 4, in += 12, out += 12) {
+				// x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+				__m128 a = _mm_loadu_ps(in + 0);
+				__m128 b = _mm_loadu_ps(in + 4);
+				__m128 c = _mm_loadu_ps(in + 8);
+
+				__m128 x2y2z2x3 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2));
+				__m128 y0z0y1z1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));
+				__m128 y2z2y3z3 = _mm_shuffle_ps(x2y2z2x3, c, _MM_SHUFFLE(3, 2, 2, 1));
+
+				__m128 x = _mm_shuffle_ps(a, x2y2z2x3, _MM_SHUFFLE(3, 0, 3, 0));
+				__m128 y = _mm_shuffle_ps(y0z0y1z1, y2z2y3z3, _MM_SHUFFLE(2, 0, 2, 0));
+				__m128 z = _mm_shuffle_ps(y0z0y1z1, y2z2y3z3, _MM_SHUFFLE(3, 1, 3, 1));
+
+				__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_add_ps(_mm_mul_ps(m02, z), m03));
+				__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m12, z), m13));
+				__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_add_ps(_mm_mul_ps(m22, z), m23));
+
+				// And back to xyz triples
+				__m128 xyLo = _mm_unpacklo_ps(tx, ty);
+				__m128 xyHi = _mm_unpackhi_ps(tx, ty);
+				__m128 z0z0x1x1 = _mm_shuffle_ps(tz, tx, _MM_SHUFFLE(1, 1, 0, 0));
+				__m128 y1y1z1z1 = _mm_shuffle_ps(ty, tz, _MM_SHUFFLE(1, 1, 1, 1));
+				__m128 z2z2x3x3 = _mm_shuffle_ps(tz, xyHi, _MM_SHUFFLE(2, 2, 2, 2));
+				__m128 y3y3z3z3 = _mm_shuffle_ps(xyHi, tz, _MM_SHUFFLE(3, 3, 3, 3));
+
+				_mm_storeu_ps(out + 0, _mm_shuffle_ps(xyLo, z0z0x1x1, _MM_SHUFFLE(2, 0, 1, 0)));
+				_mm_storeu_ps(out + 4, _mm_shuffle_ps(y1y1z1z1, xyHi, _MM_SHUFFLE(1, 0, 2, 0)));
+				_mm_storeu_ps(out + 8, _mm_shuffle_ps(z2z2x3x3, y3y3z3z3, _MM_SHUFFLE(2, 0, 2, 0)));
+			}
+
+			for (; i < count; i++, in += 3, out += 3) {
+				float tx = m[0] * in[0] + m[1] * in[1] + m[2] * in[2] + m[3];
+				float ty = m[4] * in[0] + m[5] * in[1] + m[6] * in[2] + m[7];
+				float tz = m[8] * in[0] + m[9] * in[1] + m[10] * in[2] + m[11];
+
+				out[0] = tx;	out[1] = ty;	out[2] = tz;
+			}
+		}
+
+		/**
+		 * Evaluate a step function at count times, four at a time: out[i]
+		 * is the value of the last key at or before times[i], or base if
+		 * there is none.  Keys must be in time order; count must be a
+		 * multiple of four.
+		 */
+
+		inline void stepTrack (const float* times, unsigned count, const float* keyTimes,
+				const int* keyValues, unsigned keyCount, int base, int* out) {
+			for (unsigned i = 0; i < count; i += 4) {
+				__m128 t = _mm_loadu_ps(times + i);
+				__m128i v = _mm_set1_epi32(base);
+
+				for (unsigned k = 0; k < keyCount; k++) {
+					__m128i m = _mm_castps_si128(_mm_cmpge_ps(t, _mm_set1_ps(keyTimes[k])));
+					v = _mm_or_si128(_mm_and_si128(m, _mm_set1_epi32(keyValues[k])), _mm_andnot_si128(m, v));
+				}
+
+				_mm_storeu_si128((__m128i*)(out + i), v);
+			}
+		}
+
+		/**
+		 * Widen count signed 16-bit values to floats, eight at a time.
+		 */
+
+		inline void shortsToFloats (const short* in, unsigned count, float* out) {
+			unsigned i = 0;
+
+			for (; i + 8 <= count; i += 8) {
+				__m128i s = _mm_loadu_si128((const __m128i*)(in + i));
+
+				// Interleave with itself, then shift down to sign extend
+				__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+				__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+
+				_mm_storeu_ps(out + i, _mm_cvtepi32_ps(lo));
+				_mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(hi));
+			}
+
+			for (; i < count; i++) {
+				out[i] = in[i];
+			}
+		}
+
+	}
+
+}
+
+#endif /* VMATH_SSE */
+
+#endif /* VMATH_SIMD_H_ */
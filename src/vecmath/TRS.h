@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VMATH_TRS_H_
+#define VMATH_TRS_H_
+
+#include "Vecmath.h"
+#include "Quaternion.h"
+
+namespace vmath {
+
+	/**
+	 * A compact translate/rotate/scale transform, composing to
+	 * M = T * S * R.  Scale is applied after rotation, along the parent's
+	 * axes, which is the order the PM model formats use.
+	 */
+
+	template <class T>
+	struct TRS {
+		Vector3<T> translation;
+		Quaternion<T> rotation;
+		Vector3<T> scale;
+
+		TRS ()
+			: translation(T(0)), rotation(), scale(T(1)) {
+		}
+
+		TRS (const Vector3<T>& t, const Quaternion<T>& r, const Vector3<T>& s)
+			: translation(t), rotation(r), scale(s) {
+		}
+
+		/**
+		 * Compose into a row-major matrix.
+		 */
+
+		void compose (Matrix4<T>& m) const {
+			T r[9];
+			rotation.getMatrix(r);
+
+			m.set(r[0] * scale.x, r[1] * scale.x, r[2] * scale.x, translation.x,
+				r[3] * scale.y, r[4] * scale.y, r[5] * scale.y, translation.y,
+				r[6] * scale.z, r[7] * scale.z, r[8] * scale.z, translation.z,
+				0, 0, 0, 1);
+		}
+
+		/**
+		 * Compose into GL (column-major) order.
+		 */
+
+		void composeGL (Matrix4<T>& m) const {
+			T r[9];
+			rotation.getMatrix(r);
+
+			m.set(r[0] * scale.x, r[3] * scale.y, r[6] * scale.z, 0,
+				r[1] * scale.x, r[4] * scale.y, r[7] * scale.z, 0,
+				r[2] * scale.x, r[5] * scale.y, r[8] * scale.z, 0,
+				translation.x, translation.y, translation.z, 1);
+		}
+
+		static TRS<T> interpolate (const TRS<T>& a, const TRS<T>& b, T t) {
+			return TRS<T>(a.translation + (b.translation - a.translation) * t,
+					Quaternion<T>::slerp(a.rotation, b.rotation, t),
+					a.scale + (b.scale - a.scale) * t);
+		}
+	};
+
+	typedef TRS<float> TRSf;
+	typedef TRS<double> TRSd;
+
+}
+
+#endif /* VMATH_TRS_H_ */
@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Frustum culling from scripted camera positions over a grid of grouped
+ * cubes, one group hidden.  For each camera the geometry drawn must be
+ * exactly the visible geometry whose world bound is not wholly outside one
+ * clip plane, found by testing every box's corners in clip space.  With
+ * culling off, everything but the hidden group must be drawn.  Culling
+ * through a BVH must agree.  Ray casts through the BVH must find the same
+ * nearest hit as testing every triangle in the scene.
+ */
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "GLRecorder.h"
+#include "TestUtil.h"
+#include "../src/renderer/RenderGL.h"
+#include "../src/AppState.h"
+
+static const int GRID = 8;
+static const float SPACING = 20.f;
+static const int HIDDEN_GROUP = 9;
+
+struct CameraPosition {
+	const char* name;
+	float eye[3];
+	float focus[3];
+};
+
+static const CameraPosition cameras[] = {
+	{ "overhead", { 0.f, 250.f, 1.f }, { 0.f, 0.f, 0.f } },
+	{ "center, looking +x", { 0.f, 2.f, 0.f }, { 100.f, 2.f, 0.f } },
+	{ "center, looking -z", { 0.f, 2.f, 0.f }, { 0.f, 2.f, -100.f } },
+	{ "corner, looking in", { -100.f, 10.f, -100.f }, { 0.f, 0.f, 0.f } },
+	{ "corner, looking out", { -100.f, 10.f, -100.f }, { -200.f, 0.f, -200.f } },
+	{ "low, grazing", { 0.f, 30.f, 120.f }, { 0.f, 0.f, 60.f } },
+	{ "inside a group", { -70.f, 0.f, -70.f }, { -70.f, 0.f, 0.f } },
+};
+
+static gfx::Mesh* cubeMesh (gfx::RenderGL& renderer) {
+	gfx::TriMesh cube(gfx::Mesh::VTX_VERTEX);
+	for (int i = 0; i < 8; i++) {
+		gfx::vertexDef v;
+		v.vertex.x = (i & 1) ? 1.f : -1.f;
+		v.vertex.y = (i & 2) ? 1.f : -1.f;
+		v.vertex.z = (i & 4) ? 1.f : -1.f;
+		v.normal = gfx::normal3f(0.f, 0.f, 1.f);
+		v.color = gfx::color4ub(255, 255, 255, 255);
+		cube.addVertex(v);
+	}
+
+	const unsigned faces[6][4] = {
+		{ 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 },
+	};
+	for (int f = 0; f < 6; f++) {
+		std::vector<unsigned> points(faces[f], faces[f] + 4);
+		cube.addIndexPolygon(points);
+	}
+
+	return renderer.addMesh(cube);
+}
+
+/**
+ * GRID x GRID groups on the xz plane, each with four cubes around it.
+ */
+
+static void buildScene (gfx::RenderGL& renderer, gfx::Scenegraph& sg) {
+	gfx::Mesh* mesh = cubeMesh(renderer);
+	const float offsets[4][2] = { { -4.f, -4.f }, { 4.f, -4.f }, { -4.f, 4.f }, { 4.f, 4.f } };
+
+	for (int g = 0; g < GRID * GRID; g++) {
+		int group = sg.newChild(sg.root());
+		sg.getNode(group).setTranslation(vmath::Vector3f(((g % GRID) - (GRID - 1) * .5f) * SPACING, 0.f,
+				((g / GRID) - (GRID - 1) * .5f) * SPACING));
+		sg.getNode(group).setVisibility(g != HIDDEN_GROUP);
+
+		for (int c = 0; c < 4; c++) {
+			int node = sg.newChild(group);
+			sg.getNode(node).setTranslation(vmath::Vector3f(offsets[c][0], (float)c, offsets[c][1]));
+
+			gfx::Geometry geo;
+			geo.mesh(mesh);
+			geo.spacialNode = node;
+			sg.addGeometry(node, renderer.addGeometry(geo));
+		}
+	}
+
+	sg.update();
+}
+
+/**
+ * Whether every corner of the box lies outside the same clip plane, with
+ * clip = projection * modelview in GL order.
+ */
+
+static bool outsideFrustum (const float clip[16], const gfx::BoundAABB& box) {
+	const vmath::Vector3f& c = box.center();
+	const vmath::Vector3f& e = box.extants();
+
+	unsigned outside = 0x3F;
+	for (int i = 0; i < 8; i++) {
+		float p[3] = { c.x + ((i & 1) ? e.x : -e.x), c.y + ((i & 2) ? e.y : -e.y), c.z + ((i & 4) ? e.z : -e.z) };
+		float h[4];
+		for (int r = 0; r < 4; r++) {
+			h[r] = clip[r] * p[0] + clip[4 + r] * p[1] + clip[8 + r] * p[2] + clip[12 + r];
+		}
+
+		unsigned mask = 0;
+		for (int a = 0; a < 3; a++) {
+			if (h[a] < -h[3]) mask |= 1 << (a * 2);
+			if (h[a] > h[3]) mask |= 2 << (a * 2);
+		}
+		outside &= mask;
+	}
+	return outside != 0;
+}
+
+static bool nodeVisible (const gfx::Scenegraph& sg, int node) {
+	for (; node != -1; node = sg.getNode(node).getParent()) {
+		if (!sg.getNode(node).isVisible()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * The nearest hit of the ray with any triangle in the scene, found by
+ * testing every one of them in double precision.
+ */
+
+static bool bruteRaycast (const gfx::Scenegraph& sg, const double origin[3], const double dir[3],
+		double& t, unsigned& geometry) {
+	bool hit = false;
+	t = DBL_MAX;
+
+	for (unsigned g = 0; g < sg.getGeometryCount(); g++) {
+		const gfx::Geometry* geo = sg.getGeometry(g);
+		const float* m = sg.getNode(geo->spacialNode).getWorldMatrix().asArray();
+		const std::vector<unsigned int>& indexList = geo->mesh()->getIndexList();
+
+		std::vector<gfx::vertex3f> positions;
+		geo->mesh()->getPositions(positions);
+
+		for (unsigned i = 0; i + 2 < indexList.size(); i += 3) {
+			double v[3][3];
+			for (int k = 0; k < 3; k++) {
+				const gfx::vertex3f& p = positions[indexList[i + k]];
+				for (int r = 0; r < 3; r++) {
+					v[k][r] = m[r] * p.x + m[4 + r] * p.y + m[8 + r] * p.z + m[12 + r];
+				}
+			}
+
+			double e1[3], e2[3], s[3];
+			for (int r = 0; r < 3; r++) {
+				e1[r] = v[1][r] - v[0][r];
+				e2[r] = v[2][r] - v[0][r];
+				s[r] = origin[r] - v[0][r];
+			}
+
+			// Cramer's rule on origin + t * dir = v0 + u * e1 + w * e2
+			double p[3] = { dir[1] * e2[2] - dir[2] * e2[1], dir[2] * e2[0] - dir[0] * e2[2], dir[0] * e2[1] - dir[1] * e2[0] };
+			double q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+			double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+			if (std::fabs(det) < 1e-12) {
+				continue;
+			}
+
+			double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+			double w = (dir[0] * q[0] + dir[1] * q[1] + dir[2] * q[2]) / det;
+			double d = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+
+			if (u >= 0. && w >= 0. && u + w <= 1. && d >= 0. && d < t) {
+				t = d;
+				geometry = g;
+				hit = true;
+			}
+		}
+	}
+
+	return hit;
+}
+
+/**
+ * Cast rays from around and above the grid at points inside it, and check
+ * each against the brute force result.
+ */
+
+static void checkRaycasts (const gfx::Scenegraph& sg, const gfx::BVH& bvh) {
+	const unsigned RAYS = 2000;
+	const float half = GRID * SPACING * .5f;
+
+	unsigned seed = 12345;
+	unsigned hits = 0;
+
+	for (unsigned i = 0; i < RAYS; i++) {
+		float from[3], to[3];
+		for (int k = 0; k < 3; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			from[k] = ((seed >> 8) / 16777216.f * 2.f - 1.f) * half * 1.5f;
+			seed = seed * 1664525u + 1013904223u;
+			to[k] = ((seed >> 8) / 16777216.f * 2.f - 1.f) * half;
+		}
+		from[1] = std::fabs(from[1]) * .5f;
+		to[1] = to[1] / half * 4.f;
+
+		vmath::Vector3f origin(from[0], from[1], from[2]);
+		vmath::Vector3f dir(to[0] - from[0], to[1] - from[1], to[2] - from[2]);
+
+		float t;
+		unsigned geometry = 0;
+		bool hit = bvh.raycast(sg, origin, dir, t, geometry);
+
+		double o[3] = { from[0], from[1], from[2] };
+		double d[3] = { dir.x, dir.y, dir.z };
+		double bt;
+		unsigned bgeometry = 0;
+		bool bhit = bruteRaycast(sg, o, d, bt, bgeometry);
+
+		CHECK(hit == bhit);
+		if (hit && bhit) {
+			hits++;
+			CHECK(std::fabs(t - bt) <= 1e-4 * (1. + bt));
+			CHECK(geometry == bgeometry);
+		}
+	}
+
+	std::printf("%u rays, %u hit, BVH agrees with testing every triangle\n", RAYS, hits);
+	CHECK(hits > RAYS / 10);
+}
+
+int main () {
+	AppState& state = AppState::getState();
+	gfx::RenderGL renderer;
+	gfx::Scenegraph sg;
+
+	buildScene(renderer, sg);
+	renderer.scenegraph(&sg);
+	renderer.camera(&state.camera);
+
+	gfx::BVH bvh;
+	bvh.build(sg, NULL);
+
+	float proj[16];
+	perspective(60.f, 4.f / 3.f, 1.f, 500.f, proj);
+
+	state.vars.frustumCull = true;
+
+	for (unsigned i = 0; i < sizeof(cameras) / sizeof(cameras[0]); i++) {
+		const CameraPosition& cam = cameras[i];
+
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixf(proj);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+
+		state.camera.setEye(cam.eye[0], cam.eye[1], cam.eye[2]);
+		state.camera.setFocus(cam.focus[0], cam.focus[1], cam.focus[2]);
+		state.camera.setUp(0.f, 1.f, 0.f);
+		state.camera.viewTransform();
+
+		float modelview[16], clip[16];
+		glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				clip[c * 4 + r] = 0.f;
+				for (int k = 0; k < 4; k++) {
+					clip[c * 4 + r] += proj[k * 4 + r] * modelview[c * 4 + k];
+				}
+			}
+		}
+
+		unsigned expected = 0;
+		for (unsigned g = 0; g < sg.getGeometryCount(); g++) {
+			const gfx::Geometry* geo = sg.getGeometry(g);
+			if (!outsideFrustum(clip, geo->getWorldAABB())) {
+				expected += nodeVisible(sg, geo->spacialNode) ? 1 : 0;
+			}
+		}
+
+		renderer.bvh(NULL);
+		renderer.drawGeometry();
+		gfx::RenderGL::RenderStats walk = renderer.getStats();
+
+		renderer.bvh(&bvh);
+		renderer.drawGeometry();
+		gfx::RenderGL::RenderStats tree = renderer.getStats();
+
+		std::printf("%-20s expected %3u, scenegraph drew %3u (%3u nodes rejected), BVH drew %3u (%3u nodes rejected)\n",
+				cam.name, expected, walk.drawCalls, walk.culledNodes, tree.drawCalls, tree.culledNodes);
+
+		CHECK(walk.drawCalls == expected);
+		CHECK(walk.drawCalls + walk.culledGeometry == sg.getGeometryCount());
+		CHECK(tree.drawCalls == expected);
+	}
+
+	// With culling off, the hidden group is still skipped
+	state.vars.frustumCull = false;
+	renderer.bvh(NULL);
+	renderer.drawGeometry();
+
+	unsigned shown = 0;
+	for (unsigned g = 0; g < sg.getGeometryCount(); g++) {
+		shown += nodeVisible(sg, sg.getGeometry(g)->spacialNode) ? 1 : 0;
+	}
+	std::printf("%-20s expected %3u, drew %3u\n", "culling off", shown, renderer.getStats().drawCalls);
+	CHECK(renderer.getStats().drawCalls == shown);
+	CHECK(shown == sg.getGeometryCount() - 4);
+
+	checkRaycasts(sg, bvh);
+
+	return testResult("CullTest");
+}
@@ -0,0 +1,529 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TESTS_GLRECORDER_H_
+#define TESTS_GLRECORDER_H_
+
+#include <OpenGL/gl.h>
+#include <OpenGL/glext.h>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+/**
+ * A stand-in for the GL library, so renderer code runs headless in tests
+ * and benchmarks.  Nothing is drawn: each call is counted, and the state
+ * the renderer shadows in GLState (enables, bindings, blend, alpha, cull,
+ * depth mask, clear color, program) is kept as GL would keep it, so a test
+ * can compare the two.  Matrix stacks and the viewport are tracked too, for
+ * code that reads them back.  Buffers allocated without data get storage,
+ * so they can be mapped; data passed in is not kept, so vertex buffers
+ * cost no memory.  Shaders compile, programs link and framebuffers are
+ * complete.
+ *
+ * Define the entry points by including this header in exactly one file of
+ * a program, and don't link the GL library.
+ */
+
+namespace glrec {
+
+	enum Call {
+		ENABLE, DISABLE, ACTIVE_TEXTURE, BIND_TEXTURE, TEX_ENV, ALPHA_FUNC, BLEND_FUNC,
+		CULL_FACE, DEPTH_MASK, CLEAR_COLOR, USE_PROGRAM, DRAW, CALL_OTHER,
+		CALL_COUNT,
+	};
+
+	struct Matrix {
+		GLfloat m[16];
+
+		Matrix () {
+			for (int i = 0; i < 16; i++) {
+				m[i] = (i % 5 == 0) ? 1.f : 0.f;
+			}
+		}
+	};
+
+	class Recorder {
+	public:
+
+		unsigned calls[CALL_COUNT];
+
+		std::map<GLenum, bool> enabled;
+		std::map<std::pair<GLenum, GLenum>, GLuint> bindings;	// (unit, target)
+		std::map<GLenum, bool> textureEnabled;	// per unit
+		std::map<GLenum, GLint> envMode;	// per unit
+		GLenum unit;
+
+		GLenum alphaFunc;
+		GLfloat alphaRef;
+		GLenum blend[4];
+		GLenum cullFace;
+		GLboolean depthMask;
+		GLfloat clearColor[4];
+		GLuint program;
+		GLint viewport[4];
+
+		GLenum matrixMode;
+		std::vector<Matrix> stacks[3];
+
+		std::map<GLenum, GLuint> boundBuffers;	// per target
+		std::map<GLuint, std::vector<char> > bufferData;
+
+		GLuint nextName;
+
+		Recorder () {
+			reset();
+		}
+
+		/**
+		 * Back to a fresh context's state, with all counts at zero.
+		 */
+
+		void reset () {
+			std::memset(calls, 0, sizeof(calls));
+
+			enabled.clear();
+			bindings.clear();
+			textureEnabled.clear();
+			envMode.clear();
+			unit = GL_TEXTURE0;
+
+			alphaFunc = GL_ALWAYS;
+			alphaRef = 0.f;
+			blend[0] = blend[2] = GL_ONE;
+			blend[1] = blend[3] = GL_ZERO;
+			cullFace = GL_BACK;
+			depthMask = GL_TRUE;
+			clearColor[0] = clearColor[1] = clearColor[2] = clearColor[3] = 0.f;
+			program = 0;
+			viewport[0] = viewport[1] = 0;
+			viewport[2] = viewport[3] = 1;
+
+			matrixMode = GL_MODELVIEW;
+			for (int i = 0; i < 3; i++) {
+				stacks[i].assign(1, Matrix());
+			}
+
+			boundBuffers.clear();
+			bufferData.clear();
+
+			nextName = 1;
+		}
+
+		void count (Call call) {
+			calls[call]++;
+		}
+
+		unsigned total () const {
+			unsigned sum = 0;
+			for (int i = 0; i < CALL_COUNT; i++) {
+				sum += calls[i];
+			}
+			return sum;
+		}
+
+		/**
+		 * Calls that change state GLState shadows.
+		 */
+
+		unsigned stateCalls () const {
+			unsigned sum = 0;
+			for (int i = ENABLE; i <= USE_PROGRAM; i++) {
+				sum += calls[i];
+			}
+			return sum;
+		}
+
+		bool isEnabled (GLenum cap) const {
+			if (cap == GL_TEXTURE_2D) {
+				std::map<GLenum, bool>::const_iterator it = textureEnabled.find(unit);
+				return it != textureEnabled.end() && it->second;
+			}
+			std::map<GLenum, bool>::const_iterator it = enabled.find(cap);
+			return it != enabled.end() && it->second;
+		}
+
+		void setEnabled (GLenum cap, bool state) {
+			if (cap == GL_TEXTURE_2D) {
+				textureEnabled[unit] = state;
+			}
+			else {
+				enabled[cap] = state;
+			}
+		}
+
+		GLuint binding (GLenum target, GLenum onUnit) const {
+			std::map<std::pair<GLenum, GLenum>, GLuint>::const_iterator it = bindings.find(std::make_pair(onUnit, target));
+			return (it != bindings.end()) ? it->second : 0;
+		}
+
+		GLuint binding (GLenum target) const {
+			return binding(target, unit);
+		}
+
+		std::vector<Matrix>& stack () {
+			switch (matrixMode) {
+				case GL_PROJECTION: return stacks[1];
+				case GL_TEXTURE: return stacks[2];
+			}
+			return stacks[0];
+		}
+
+		const Matrix& top (GLenum mode) const {
+			switch (mode) {
+				case GL_PROJECTION_MATRIX: return stacks[1].back();
+				case GL_TEXTURE_MATRIX: return stacks[2].back();
+			}
+			return stacks[0].back();
+		}
+
+		void genNames (GLsizei n, GLuint* names) {
+			for (GLsizei i = 0; i < n; i++) {
+				names[i] = nextName++;
+			}
+		}
+
+		static Recorder& get () {
+			static Recorder rec;
+			return rec;
+		}
+
+	};
+
+}
+
+extern "C" {
+
+	// State GLState shadows
+
+	void glEnable (GLenum cap) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::ENABLE);
+		r.setEnabled(cap, true);
+	}
+
+	void glDisable (GLenum cap) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::DISABLE);
+		r.setEnabled(cap, false);
+	}
+
+	GLboolean glIsEnabled (GLenum cap) {
+		return glrec::Recorder::get().isEnabled(cap) ? GL_TRUE : GL_FALSE;
+	}
+
+	void glActiveTexture (GLenum texture) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::ACTIVE_TEXTURE);
+		r.unit = texture;
+	}
+
+	void glBindTexture (GLenum target, GLuint texture) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::BIND_TEXTURE);
+		r.bindings[std::make_pair(r.unit, target)] = texture;
+	}
+
+	void glTexEnvi (GLenum target, GLenum pname, GLint param) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::TEX_ENV);
+		if (target == GL_TEXTURE_ENV && pname == GL_TEXTURE_ENV_MODE) {
+			r.envMode[r.unit] = param;
+		}
+	}
+
+	void glAlphaFunc (GLenum func, GLclampf ref) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::ALPHA_FUNC);
+		r.alphaFunc = func;
+		r.alphaRef = ref;
+	}
+
+	void glBlendFunc (GLenum sfactor, GLenum dfactor) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::BLEND_FUNC);
+		r.blend[0] = r.blend[2] = sfactor;
+		r.blend[1] = r.blend[3] = dfactor;
+	}
+
+	void glBlendFuncSeparate (GLenum sfactorRGB, GLenum dfactorRGB, GLenum sfactorAlpha, GLenum dfactorAlpha) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::BLEND_FUNC);
+		r.blend[0] = sfactorRGB;
+		r.blend[1] = dfactorRGB;
+		r.blend[2] = sfactorAlpha;
+		r.blend[3] = dfactorAlpha;
+	}
+
+	void glCullFace (GLenum mode) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CULL_FACE);
+		r.cullFace = mode;
+	}
+
+	void glDepthMask (GLboolean flag) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::DEPTH_MASK);
+		r.depthMask = flag;
+	}
+
+	void glClearColor (GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CLEAR_COLOR);
+		r.clearColor[0] = red;
+		r.clearColor[1] = green;
+		r.clearColor[2] = blue;
+		r.clearColor[3] = alpha;
+	}
+
+	void glUseProgram (GLuint program) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::USE_PROGRAM);
+		r.program = program;
+	}
+
+	// Queries
+
+	void glGetBooleanv (GLenum pname, GLboolean* params) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		if (pname == GL_DEPTH_WRITEMASK) {
+			params[0] = r.depthMask;
+		}
+		else {
+			params[0] = r.isEnabled(pname) ? GL_TRUE : GL_FALSE;
+		}
+	}
+
+	void glGetIntegerv (GLenum pname, GLint* params) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		if (pname == GL_VIEWPORT) {
+			std::memcpy(params, r.viewport, sizeof(r.viewport));
+		}
+		else {
+			params[0] = 0;
+		}
+	}
+
+	void glGetFloatv (GLenum pname, GLfloat* params) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		switch (pname) {
+			case GL_MODELVIEW_MATRIX:
+			case GL_PROJECTION_MATRIX:
+			case GL_TEXTURE_MATRIX:
+				std::memcpy(params, r.top(pname).m, sizeof(GLfloat) * 16);
+				break;
+			case GL_COLOR_CLEAR_VALUE:
+				std::memcpy(params, r.clearColor, sizeof(r.clearColor));
+				break;
+			default:
+				params[0] = 0.f;
+		}
+	}
+
+	const GLubyte* glGetString (GLenum name) {
+		return (const GLubyte*)((name == GL_VERSION) ? "2.1 GLRecorder" : "GLRecorder");
+	}
+
+	// Matrices and viewport
+
+	void glViewport (GLint x, GLint y, GLsizei width, GLsizei height) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+		r.viewport[0] = x;
+		r.viewport[1] = y;
+		r.viewport[2] = width;
+		r.viewport[3] = height;
+	}
+
+	void glMatrixMode (GLenum mode) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+		r.matrixMode = mode;
+	}
+
+	void glLoadIdentity () {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+		r.stack().back() = glrec::Matrix();
+	}
+
+	void glLoadMatrixf (const GLfloat* m) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+		std::memcpy(r.stack().back().m, m, sizeof(GLfloat) * 16);
+	}
+
+	void glMultMatrixf (const GLfloat* m) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+
+		// Column-major, as GL stores them: top = top * m
+		glrec::Matrix& top = r.stack().back();
+		glrec::Matrix product;
+		for (int c = 0; c < 4; c++) {
+			for (int row = 0; row < 4; row++) {
+				GLfloat sum = 0.f;
+				for (int k = 0; k < 4; k++) {
+					sum += top.m[k * 4 + row] * m[c * 4 + k];
+				}
+				product.m[c * 4 + row] = sum;
+			}
+		}
+		top = product;
+	}
+
+	void glPushMatrix () {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+		r.stack().push_back(r.stack().back());
+	}
+
+	void glPopMatrix () {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+		if (r.stack().size() > 1) {
+			r.stack().pop_back();
+		}
+	}
+
+	// Drawing
+
+	void glDrawElements (GLenum, GLsizei, GLenum, const GLvoid*) {
+		glrec::Recorder::get().count(glrec::DRAW);
+	}
+
+	void glBegin (GLenum) {
+		glrec::Recorder::get().count(glrec::DRAW);
+	}
+
+	void glEnd () { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glClear (GLbitfield) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glVertex2f (GLfloat, GLfloat) { }
+	void glVertex3f (GLfloat, GLfloat, GLfloat) { }
+	void glVertex3s (GLshort, GLshort, GLshort) { }
+	void glNormal3f (GLfloat, GLfloat, GLfloat) { }
+	void glColor4ub (GLubyte, GLubyte, GLubyte, GLubyte) { }
+	void glTexCoord2f (GLfloat, GLfloat) { }
+
+	void glEnableClientState (GLenum) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glDisableClientState (GLenum) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glVertexPointer (GLint, GLenum, GLsizei, const GLvoid*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glNormalPointer (GLenum, GLsizei, const GLvoid*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glColorPointer (GLint, GLenum, GLsizei, const GLvoid*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glTexCoordPointer (GLint, GLenum, GLsizei, const GLvoid*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+
+	// Objects
+
+	void glGenTextures (GLsizei n, GLuint* textures) { glrec::Recorder::get().genNames(n, textures); }
+	void glGenBuffers (GLsizei n, GLuint* buffers) { glrec::Recorder::get().genNames(n, buffers); }
+	void glGenFramebuffersEXT (GLsizei n, GLuint* framebuffers) { glrec::Recorder::get().genNames(n, framebuffers); }
+	void glGenRenderbuffersEXT (GLsizei n, GLuint* renderbuffers) { glrec::Recorder::get().genNames(n, renderbuffers); }
+
+	void glDeleteTextures (GLsizei n, const GLuint* textures) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+
+		// Deleting a bound texture unbinds it everywhere
+		for (std::map<std::pair<GLenum, GLenum>, GLuint>::iterator it = r.bindings.begin(); it != r.bindings.end(); ++it) {
+			for (GLsizei i = 0; i < n; i++) {
+				if (it->second == textures[i]) {
+					it->second = 0;
+				}
+			}
+		}
+	}
+
+	void glDeleteBuffers (GLsizei n, const GLuint* buffers) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+		for (GLsizei i = 0; i < n; i++) {
+			r.bufferData.erase(buffers[i]);
+		}
+	}
+
+	void glBindBuffer (GLenum target, GLuint buffer) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+		r.boundBuffers[target] = buffer;
+	}
+
+	void glBufferData (GLenum target, GLsizeiptr size, const GLvoid* data, GLenum) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+
+		std::vector<char>((data == NULL) ? size : 0).swap(r.bufferData[r.boundBuffers[target]]);
+	}
+
+	void glBufferSubData (GLenum, GLintptr, GLsizeiptr, const GLvoid*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+
+	GLvoid* glMapBuffer (GLenum target, GLenum) {
+		glrec::Recorder& r = glrec::Recorder::get();
+		r.count(glrec::CALL_OTHER);
+
+		std::vector<char>& storage = r.bufferData[r.boundBuffers[target]];
+		return storage.empty() ? NULL : &storage[0];
+	}
+
+	GLboolean glUnmapBuffer (GLenum) {
+		glrec::Recorder::get().count(glrec::CALL_OTHER);
+		return GL_TRUE;
+	}
+
+	void glTexParameteri (GLenum, GLenum, GLint) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glTexImage2D (GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const GLvoid*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glTexImage3D (GLenum, GLint, GLint, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const GLvoid*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glTexSubImage3D (GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const GLvoid*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+
+	void glBindFramebufferEXT (GLenum, GLuint) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glBindRenderbufferEXT (GLenum, GLuint) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glRenderbufferStorageEXT (GLenum, GLenum, GLsizei, GLsizei) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glFramebufferRenderbufferEXT (GLenum, GLenum, GLenum, GLuint) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glFramebufferTexture2DEXT (GLenum, GLenum, GLenum, GLuint, GLint) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	GLenum glCheckFramebufferStatusEXT (GLenum) { return GL_FRAMEBUFFER_COMPLETE_EXT; }
+	void glBlitFramebufferEXT (GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glDrawBuffers (GLsizei, const GLenum*) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+
+	// Shaders
+
+	GLuint glCreateShader (GLenum) { GLuint name; glrec::Recorder::get().genNames(1, &name); return name; }
+	GLuint glCreateProgram () { GLuint name; glrec::Recorder::get().genNames(1, &name); return name; }
+	void glShaderSource (GLuint, GLsizei, const GLchar* const*, const GLint*) { }
+	void glCompileShader (GLuint) { }
+	void glAttachShader (GLuint, GLuint) { }
+	void glLinkProgram (GLuint) { }
+	void glDeleteShader (GLuint) { }
+	void glDeleteProgram (GLuint) { }
+	void glGetShaderiv (GLuint, GLenum pname, GLint* params) { params[0] = (pname == GL_COMPILE_STATUS) ? GL_TRUE : 0; }
+	void glGetProgramiv (GLuint, GLenum pname, GLint* params) { params[0] = (pname == GL_LINK_STATUS) ? GL_TRUE : 0; }
+	void glGetShaderInfoLog (GLuint, GLsizei, GLsizei* length, GLchar* infoLog) { if (length != NULL) *length = 0; infoLog[0] = 0; }
+	void glGetProgramInfoLog (GLuint, GLsizei, GLsizei* length, GLchar* infoLog) { if (length != NULL) *length = 0; infoLog[0] = 0; }
+	GLint glGetUniformLocation (GLuint, const GLchar*) { return 0; }
+	void glUniform1f (GLint, GLfloat) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+	void glUniform1i (GLint, GLint) { glrec::Recorder::get().count(glrec::CALL_OTHER); }
+
+}
+
+#endif /* TESTS_GLRECORDER_H_ */
@@ -0,0 +1,303 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * GLState against the recorder over long random call sequences.  After
+ * each call the recorded GL state must hold the requested value, no other
+ * state may have changed, and the call must have been issued exactly when
+ * it changes GL state or its value was not yet known.  The issued counter
+ * must match the state calls the recorder saw.  Now and then state is
+ * changed behind the tracker's back and then invalidated.
+ */
+
+#include <cstdio>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "GLRecorder.h"
+#include "TestUtil.h"
+#include "../src/renderer/GLState.h"
+
+static const unsigned STEPS = 100000;
+
+enum Kind {
+	ENABLED, UNIT, BINDING, ENV_MODE, ALPHA, BLEND, CULL, DEPTH_MASK, CLEAR, PROGRAM,
+	DELETE, QUERY, OUTSIDE,
+	KIND_COUNT,
+};
+
+// A piece of state: its kind, and for per-unit state the unit and cap or
+// target
+typedef std::pair<int, std::pair<GLenum, GLenum> > Key;
+typedef std::map<Key, std::vector<GLfloat> > Snapshot;
+
+static const GLenum caps[] = { GL_ALPHA_TEST, GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_TEXTURE_2D };
+static const GLenum targets[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY_EXT };
+
+static Key key (int kind, GLenum a = 0, GLenum unit = 0) {
+	return Key(kind, std::make_pair(a, unit));
+}
+
+static std::vector<GLfloat> values (GLfloat a, GLfloat b = 0.f, GLfloat c = 0.f, GLfloat d = 0.f) {
+	std::vector<GLfloat> v(4);
+	v[0] = a;	v[1] = b;	v[2] = c;	v[3] = d;
+	return v;
+}
+
+/**
+ * Everything GLState shadows, as the recorder holds it.
+ */
+
+static Snapshot snapshot (const glrec::Recorder& rec) {
+	Snapshot s;
+
+	for (int c = 0; c < 4; c++) {
+		s[key(ENABLED, caps[c])] = values(rec.isEnabled(caps[c]));
+	}
+	for (GLenum u = GL_TEXTURE0; u < GL_TEXTURE0 + gfx::GLState::TEXTURE_UNITS; u++) {
+		std::map<GLenum, bool>::const_iterator te = rec.textureEnabled.find(u);
+		s[key(ENABLED, GL_TEXTURE_2D, u)] = values(te != rec.textureEnabled.end() && te->second);
+
+		for (int t = 0; t < 2; t++) {
+			s[key(BINDING, targets[t], u)] = values((GLfloat)rec.binding(targets[t], u));
+		}
+
+		std::map<GLenum, GLint>::const_iterator env = rec.envMode.find(u);
+		s[key(ENV_MODE, 0, u)] = values((GLfloat)((env != rec.envMode.end()) ? env->second : GL_MODULATE));
+	}
+
+	s[key(UNIT)] = values((GLfloat)rec.unit);
+	s[key(ALPHA)] = values((GLfloat)rec.alphaFunc, rec.alphaRef);
+	s[key(BLEND)] = values((GLfloat)rec.blend[0], (GLfloat)rec.blend[1], (GLfloat)rec.blend[2], (GLfloat)rec.blend[3]);
+	s[key(CULL)] = values((GLfloat)rec.cullFace);
+	s[key(DEPTH_MASK)] = values(rec.depthMask);
+	s[key(CLEAR)] = values(rec.clearColor[0], rec.clearColor[1], rec.clearColor[2], rec.clearColor[3]);
+	s[key(PROGRAM)] = values((GLfloat)rec.program);
+
+	return s;
+}
+
+static GLenum pick (const GLenum* options, unsigned count, unsigned& seed) {
+	return options[(unsigned)(testRandom(seed) * count)];
+}
+
+int main () {
+	glrec::Recorder& rec = glrec::Recorder::get();
+	rec.reset();
+
+	gfx::GLState gs;
+	unsigned seed = 1;
+
+	// Values the tracker has been told since it last forgot everything.
+	// The active unit is always known
+	std::set<Key> known;
+	known.insert(key(UNIT));
+
+	unsigned wrongValue = 0;
+	unsigned sideEffects = 0;
+	unsigned wrongIssue = 0;
+	unsigned wrongCount = 0;
+	unsigned outsideCalls = 0;
+
+	for (unsigned step = 0; step < STEPS; step++) {
+		Snapshot before = snapshot(rec);
+		gfx::GLState::Counters counters = gs.getCounters();
+		unsigned stateCalls = rec.stateCalls();
+
+		GLenum unit = rec.unit;
+		int kind = (int)(testRandom(seed) * KIND_COUNT);
+		Key target;
+		std::vector<GLfloat> requested;
+
+		switch (kind) {
+			case ENABLED: {
+				GLenum cap = pick(caps, 5, seed);
+				bool state = testRandom(seed) < .5f;
+				gs.setEnabled(cap, state);
+				target = key(ENABLED, cap, (cap == GL_TEXTURE_2D) ? unit : 0);
+				requested = values(state);
+				break;
+			}
+			case UNIT: {
+				GLenum u = GL_TEXTURE0 + (GLenum)(testRandom(seed) * gfx::GLState::TEXTURE_UNITS);
+				gs.activeTexture(u);
+				target = key(UNIT);
+				requested = values((GLfloat)u);
+				break;
+			}
+			case BINDING: {
+				GLenum t = pick(targets, 2, seed);
+				GLuint name = (GLuint)(testRandom(seed) * 5);
+				gs.bindTexture(t, name);
+				target = key(BINDING, t, unit);
+				requested = values((GLfloat)name);
+				break;
+			}
+			case ENV_MODE: {
+				const GLenum modes[] = { GL_MODULATE, GL_REPLACE, GL_DECAL };
+				GLenum mode = pick(modes, 3, seed);
+				gs.texEnvMode(mode);
+				target = key(ENV_MODE, 0, unit);
+				requested = values((GLfloat)mode);
+				break;
+			}
+			case ALPHA: {
+				const GLenum funcs[] = { GL_ALWAYS, GL_GREATER, GL_GEQUAL };
+				GLenum func = pick(funcs, 3, seed);
+				GLfloat ref = (testRandom(seed) < .5f) ? 0.f : .5f;
+				gs.alphaFunc(func, ref);
+				target = key(ALPHA);
+				requested = values((GLfloat)func, ref);
+				break;
+			}
+			case BLEND: {
+				const GLenum factors[] = { GL_ONE, GL_ZERO, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA };
+				GLenum src = pick(factors, 4, seed);
+				GLenum dst = pick(factors, 4, seed);
+				if (testRandom(seed) < .5f) {
+					gs.blendFunc(src, dst);
+					requested = values((GLfloat)src, (GLfloat)dst, (GLfloat)src, (GLfloat)dst);
+				}
+				else {
+					gs.blendFuncSeparate(src, dst, GL_ONE, dst);
+					requested = values((GLfloat)src, (GLfloat)dst, (GLfloat)GL_ONE, (GLfloat)dst);
+				}
+				target = key(BLEND);
+				break;
+			}
+			case CULL: {
+				const GLenum faces[] = { GL_FRONT, GL_BACK };
+				GLenum face = pick(faces, 2, seed);
+				gs.cullFace(face);
+				target = key(CULL);
+				requested = values((GLfloat)face);
+				break;
+			}
+			case DEPTH_MASK: {
+				bool state = testRandom(seed) < .5f;
+				gs.depthMask(state);
+				target = key(DEPTH_MASK);
+				requested = values(state);
+				break;
+			}
+			case CLEAR: {
+				GLfloat r = (testRandom(seed) < .5f) ? 0.f : 1.f;
+				GLfloat b = (testRandom(seed) < .5f) ? 0.f : .5f;
+				gs.clearColor(r, 0.f, b, 1.f);
+				target = key(CLEAR);
+				requested = values(r, 0.f, b, 1.f);
+				break;
+			}
+			case PROGRAM: {
+				GLuint program = (GLuint)(testRandom(seed) * 3);
+				gs.useProgram(program);
+				target = key(PROGRAM);
+				requested = values((GLfloat)program);
+				break;
+			}
+			case DELETE: {
+				// Unbinds the name on every unit, in GL and in the tracker
+				GLuint name = 1 + (GLuint)(testRandom(seed) * 4);
+				gs.deleteTexture(name);
+				Snapshot after = snapshot(rec);
+				for (Snapshot::iterator it = before.begin(); it != before.end(); ++it) {
+					if (it->first.first == BINDING && it->second[0] == (GLfloat)name) {
+						it->second[0] = 0.f;
+					}
+				}
+				sideEffects += (after != before) ? 1 : 0;
+				wrongCount += (gs.getCounters().issued != counters.issued || rec.stateCalls() != stateCalls) ? 1 : 0;
+				continue;
+			}
+			case QUERY: {
+				// Answered from the shadow once known, from GL otherwise
+				GLenum cap = pick(caps, 5, seed);
+				wrongValue += (gs.isEnabled(cap) != rec.isEnabled(cap)) ? 1 : 0;
+				wrongValue += (gs.getDepthMask() != (rec.depthMask == GL_TRUE)) ? 1 : 0;
+				GLfloat rgba[4];
+				gs.getClearColor(rgba);
+				for (int i = 0; i < 4; i++) {
+					wrongValue += (rgba[i] != rec.clearColor[i]) ? 1 : 0;
+				}
+				if (cap != GL_TEXTURE_2D) {
+					known.insert(key(ENABLED, cap));
+				}
+				else {
+					known.insert(key(ENABLED, cap, unit));
+				}
+				known.insert(key(DEPTH_MASK));
+				known.insert(key(CLEAR));
+				sideEffects += (snapshot(rec) != before) ? 1 : 0;
+				wrongCount += (gs.getCounters().issued != counters.issued) ? 1 : 0;
+				continue;
+			}
+			case OUTSIDE: {
+				// Rare: state changed without the tracker, which is then told
+				// to forget, with the unit back at 0 as invalidate assumes
+				if (testRandom(seed) < .9f) {
+					continue;
+				}
+				glEnable(GL_BLEND);
+				glBindTexture(GL_TEXTURE_2D, 3);
+				glCullFace(GL_FRONT);
+				glActiveTexture(GL_TEXTURE0);
+				outsideCalls += rec.stateCalls() - stateCalls;
+				gs.invalidate();
+				known.clear();
+				known.insert(key(UNIT));
+				continue;
+			}
+		}
+
+		Snapshot after = snapshot(rec);
+		wrongValue += (after[target] != requested) ? 1 : 0;
+
+		for (Snapshot::iterator it = before.begin(); it != before.end(); ++it) {
+			if (it->first != target && after[it->first] != it->second) {
+				sideEffects++;
+			}
+		}
+
+		bool issued = gs.getCounters().issued != counters.issued;
+		bool redundant = known.count(target) != 0 && before[target] == requested;
+		wrongIssue += (issued == redundant) ? 1 : 0;
+		wrongCount += (gs.getCounters().issued + gs.getCounters().elided != counters.issued + counters.elided + 1) ? 1 : 0;
+		wrongCount += (gs.getCounters().issued - counters.issued != rec.stateCalls() - stateCalls) ? 1 : 0;
+		known.insert(target);
+	}
+
+	const gfx::GLState::Counters& total = gs.getCounters();
+	CHECK(wrongValue == 0);
+	CHECK(sideEffects == 0);
+	CHECK(wrongIssue == 0);
+	CHECK(wrongCount == 0);
+	CHECK(total.issued + outsideCalls == rec.stateCalls());
+	CHECK(total.elided > 0);
+
+	std::printf("%u steps: %u calls issued, %u elided\n", STEPS, total.issued, total.elided);
+
+	return testResult("GLStateTest");
+}
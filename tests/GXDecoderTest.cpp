@@ -0,0 +1,230 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Display list decoding with indices past the end of their arrays.  The
+ * triangles touching a bad index must be dropped, along with every vertex
+ * no kept triangle uses, so that building or measuring the mesh never
+ * indexes past an array.  Scanning a list for a quick measure must agree
+ * with decoding it on well-formed lists.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "GLRecorder.h"
+#include "TestUtil.h"
+#include "../src/PMWorldGL.h"
+
+static const u32 MASK = (1 << GXDecoder::POSITION) | (1 << GXDecoder::COLOR0) | (1 << GXDecoder::TEXCOORD0);
+
+/**
+ * A display list of primitives whose vertices index position, color and
+ * texture coordinate arrays, each 16 bits.
+ */
+
+struct DisplayList {
+	std::vector<u8> bytes;
+
+	void begin (u8 primitive, u16 count) {
+		bytes.push_back(primitive);
+		bytes.push_back((u8)(count >> 8));
+		bytes.push_back((u8)count);
+	}
+
+	void put16 (u16 value) {
+		bytes.push_back((u8)(value >> 8));
+		bytes.push_back((u8)value);
+	}
+
+	void vertex (u16 position, u16 color, u16 texCoord) {
+		put16(position);
+		put16(color);
+		put16(texCoord);
+	}
+
+	ByteView view () const {
+		return ByteView(&bytes[0], bytes.size());
+	}
+};
+
+/**
+ * Every decoded index must be within its limit, and every triangle must
+ * name a decoded vertex.
+ */
+
+static void checkStreams (const GXDecoder::Streams& streams, const u32* limits) {
+	for (u32 a = 0; a < GXDecoder::NUM_ATTRIBUTES; a++) {
+		if (!streams.has((GXDecoder::Attribute)a)) {
+			CHECK(streams.indices[a].empty());
+			continue;
+		}
+		CHECK(streams.indices[a].size() == streams.vertexCount);
+		for (u32 v = 0; v < streams.indices[a].size(); v++) {
+			CHECK(streams.indices[a][v] < limits[a]);
+		}
+	}
+	for (u32 i = 0; i < streams.triangles.size(); i++) {
+		CHECK(streams.triangles[i] < streams.vertexCount);
+	}
+}
+
+struct CountVisits {
+	u32 count;
+
+	CountVisits ()
+		: count(0) {
+	}
+
+	void operator() (u32) {
+		count++;
+	}
+};
+
+static void checkDecoder () {
+	DisplayList list;
+
+	// The second triangle's last position is past the array
+	list.begin(GXDecoder::TRIANGLES, 6);
+	list.vertex(0, 0, 0);
+	list.vertex(1, 1, 1);
+	list.vertex(2, 0, 2);
+	list.vertex(1, 1, 1);
+	list.vertex(2, 0, 2);
+	list.vertex(9, 1, 3);
+
+	// The strip's last color is past the array, so its third triangle goes
+	list.begin(GXDecoder::TRIANGLE_STRIP, 5);
+	list.vertex(0, 0, 0);
+	list.vertex(1, 0, 1);
+	list.vertex(2, 1, 2);
+	list.vertex(3, 1, 3);
+	list.vertex(3, 5, 3);
+
+	// Lines carry no surface, so none of their vertices stay
+	list.begin(GXDecoder::LINES, 2);
+	list.vertex(0, 0, 0);
+	list.vertex(1, 1, 1);
+
+	u32 limits[GXDecoder::NUM_ATTRIBUTES] = { 0 };
+	limits[GXDecoder::POSITION] = 4;
+	limits[GXDecoder::COLOR0] = 2;
+	limits[GXDecoder::TEXCOORD0] = 4;
+
+	GXDecoder::Streams streams;
+	CHECK(GXDecoder::decode(list.view(), MASK, limits, streams));
+	checkStreams(streams, limits);
+
+	const u32 expected[] = { 0, 1, 2, 3, 4, 5, 5, 4, 6 };
+	CHECK(streams.vertexCount == 7);
+	CHECK(streams.triangles.size() == sizeof(expected) / sizeof(expected[0]));
+	for (u32 i = 0; i < streams.triangles.size() && i < sizeof(expected) / sizeof(expected[0]); i++) {
+		CHECK(streams.triangles[i] == expected[i]);
+	}
+
+	// No texture coordinates at all: every vertex indexes past the array
+	limits[GXDecoder::TEXCOORD0] = 0;
+	GXDecoder::Streams untextured;
+	CHECK(GXDecoder::decode(list.view(), MASK, limits, untextured));
+	checkStreams(untextured, limits);
+	CHECK(untextured.vertexCount == 0 && untextured.triangles.empty());
+
+	// With every index in range, a scan counts what decoding keeps
+	for (u32 a = 0; a < GXDecoder::NUM_ATTRIBUTES; a++) {
+		limits[a] = 16;
+	}
+	GXDecoder::Streams all;
+	CHECK(GXDecoder::decode(list.view(), MASK, limits, all));
+
+	CountVisits visits;
+	u32 vertexCount = 0;
+	u32 triangleCount = 0;
+	CHECK(GXDecoder::scan(list.view(), MASK, limits, visits, vertexCount, triangleCount));
+	CHECK(vertexCount == all.vertexCount && visits.count == vertexCount);
+	CHECK(triangleCount * 3 == all.triangles.size());
+}
+
+/**
+ * The same list through the world's mesh building and measuring, with
+ * arrays just long enough for the good indices.
+ */
+
+static void checkWorld () {
+	DisplayList list;
+	list.begin(GXDecoder::TRIANGLES, 6);
+	list.vertex(0, 0, 0);
+	list.vertex(1, 1, 1);
+	list.vertex(2, 0, 2);
+	list.vertex(1, 1, 1);
+	list.vertex(2, 0, 2);
+	list.vertex(3, 1, 3);
+
+	PMWorldGL world;
+	world.vertices.resize(3);
+	for (u32 i = 0; i < world.vertices.size(); i++) {
+		world.vertices[i].x = 100 * i;
+		world.vertices[i].y = -50;
+		world.vertices[i].z = 7;
+	}
+	world.colors[0].resize(1);
+	world.texCoords[0].resize(2);
+
+	world.meshes.resize(1);
+	world.meshes[0].elementMask = MASK;
+	world.meshes[0].data.resize(1);
+	world.meshes[0].data[0].data = list.view();
+
+	// Position 3 is past the array; color 1 and texture coordinate 2
+	// drop the rest
+	gfx::TriMesh mesh;
+	world.buildMesh(0, true, mesh);
+	CHECK(mesh.getVertexCount() == 0 && mesh.getIndexCount() == 0);
+
+	// The quick measure still counts the dropped triangles, but bounds
+	// only the first vertex, the one whose indices are all in range
+	gfx::BoundAABB bound;
+	u32 bytes = 0;
+	CHECK(world.measureMesh(0, bound, bytes));
+	CHECK(bound.center().x == 0.f && bound.extants().x == 0.f);
+
+	// Long enough for the first triangle only
+	world.colors[0].resize(2);
+	world.texCoords[0].resize(3);
+	gfx::TriMesh first;
+	world.buildMesh(0, true, first);
+	CHECK(first.getVertexCount() == 3 && first.getIndexCount() == 3);
+	CHECK(first.getTexCoordList().size() == 3);
+
+	CHECK(world.measureMesh(0, bound, bytes));
+	CHECK(bound.center().x == 100.f && bound.extants().x == 100.f);
+	CHECK(bound.center().y == -50.f && bound.center().z == 7.f);
+	CHECK(bound.extants().y == 0.f && bound.extants().z == 0.f);
+}
+
+int main () {
+	checkDecoder();
+	checkWorld();
+	return testResult("GXDecoderTest");
+}
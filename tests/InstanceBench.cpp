@@ -0,0 +1,321 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Animation batch cost for 256 to 4096 instances of a 63 node model, each
+ * playing one of four looping animations with visibility and texture map
+ * tracks.  Updates run on the task pool with its default workers and with
+ * none.  Instanced frames are then drawn through the recorder, so only CPU
+ * time is measured.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "GLRecorder.h"
+#include "TestUtil.h"
+#include "../src/renderer/RenderGL.h"
+#include "../src/PMAnimationBatch.h"
+#include "../src/AppState.h"
+
+static const int DEPTH = 5;
+static const int ANIMATIONS = 4;
+static const int TEXTURES = 4;
+static const unsigned FRAMES = 100;
+
+/**
+ * A binary tree below parent, DEPTH levels deep, with a cube on each leaf.
+ * Every other leaf takes its texture from channel 0.
+ */
+
+static void buildTree (gfx::Scenegraph& sg, int parent, int depth, gfx::Mesh* mesh, std::vector<gfx::Geometry>& geos) {
+	for (int c = 0; c < 2; c++) {
+		int node = sg.newChild(parent);
+		sg.getNode(node).setTranslation(vmath::Vector3f(c ? 1.f : -1.f, 1.f, 0.f));
+
+		if (depth + 1 < DEPTH) {
+			buildTree(sg, node, depth + 1, mesh, geos);
+		}
+		else {
+			geos.push_back(gfx::Geometry());
+			geos.back().mesh(mesh);
+			geos.back().spacialNode = node;
+			geos.back().textureChannel = (geos.size() % 2 == 0) ? 0 : -1;
+		}
+	}
+}
+
+/**
+ * A looping animation that toggles the visibility of eight leaves at
+ * staggered times and steps texture map 0 through every texture.  Keys sit
+ * on half units and instances advance in whole ones, so the times compared
+ * below are exact.
+ */
+
+static PMAnimation buildAnimation (int index, const std::vector<gfx::Geometry>& geos) {
+	PMAnimation anim;
+	anim.length = 40.f + 20.f * index;
+	anim.loop = true;
+
+	for (int t = 0; t < 9; t++) {
+		PMAnimation::Track track;
+		track.type = (t < 8) ? PMAnimation::TRACK_VISIBILITY : PMAnimation::TRACK_TEXMAP;
+		track.target = (t < 8) ? geos[(t * 4 + index) % geos.size()].spacialNode : 0;
+		track.base = (t < 8) ? 1 : 0;
+		track.keyIndex = anim.keys.size();
+		track.keyCount = 0;
+
+		for (float time = 2.5f + t; time < anim.length; time += 10.5f) {
+			PMAnimation::Key key;
+			key.time = time;
+			key.value = (t < 8) ? (track.keyCount % 2 == 0) ? 0 : 1 : (track.keyCount + 1) % TEXTURES;
+			anim.keys.push_back(key);
+			track.keyCount++;
+		}
+		anim.tracks.push_back(track);
+	}
+
+	return anim;
+}
+
+static int expectedValue (const PMAnimation& anim, unsigned track, float time) {
+	const PMAnimation::Track& tr = anim.tracks[track];
+	int value = tr.base;
+	for (unsigned k = 0; k < tr.keyCount && anim.keys[tr.keyIndex + k].time <= time; k++) {
+		value = anim.keys[tr.keyIndex + k].value;
+	}
+	return value;
+}
+
+struct Model {
+	gfx::RenderGL renderer;
+	gfx::Scenegraph sg;
+	std::vector<gfx::Geometry> geos;
+	std::vector<PMAnimation> anims;
+	std::vector<int> recordNodes;
+	std::vector<u8> baseVisible;
+	std::vector<std::vector<gfx::InstanceBuffer::TextureRef> > channels;
+};
+
+static void buildModel (Model& model) {
+	gfx::TriMesh cube(gfx::Mesh::VTX_VERTEX);
+	for (int i = 0; i < 8; i++) {
+		gfx::vertexDef v;
+		v.vertex.x = (i & 1) ? .5f : -.5f;
+		v.vertex.y = (i & 2) ? .5f : -.5f;
+		v.vertex.z = (i & 4) ? .5f : -.5f;
+		v.normal = gfx::normal3f(0.f, 0.f, 1.f);
+		v.color = gfx::color4ub(255, 255, 255, 255);
+		cube.addVertex(v);
+	}
+	cube.addIndexTriangle(0, 1, 3);
+	cube.addIndexTriangle(0, 3, 2);
+
+	gfx::Mesh* mesh = model.renderer.addMesh(cube);
+
+	model.geos.reserve(1 << DEPTH);
+	buildTree(model.sg, model.sg.root(), 0, mesh, model.geos);
+
+	// Geometry must be added in node order
+	for (unsigned g = 0; g < model.geos.size(); g++) {
+		model.sg.addGeometry(model.geos[g].spacialNode, model.renderer.addGeometry(model.geos[g]));
+	}
+	model.sg.update();
+
+	// Records are the nodes themselves
+	for (unsigned n = 0; n < model.sg.size(); n++) {
+		model.recordNodes.push_back(n);
+	}
+	model.baseVisible.assign(model.sg.size(), 1);
+
+	static Image texels(4, 4, Image::RGBA8);
+	gfx::TextureData data(GL_RGBA, 4, 4, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0, texels);
+	model.channels.resize(1);
+	for (int t = 0; t < TEXTURES; t++) {
+		gfx::Texture* tex = model.renderer.addTexture(gfx::Texture(GL_TEXTURE_2D, data));
+		model.channels[0].push_back(gfx::InstanceBuffer::TextureRef(tex, -1));
+	}
+
+	for (int a = 0; a < ANIMATIONS; a++) {
+		model.anims.push_back(buildAnimation(a, model.geos));
+	}
+}
+
+/**
+ * Place count instances on a grid, cycling through the animations, with
+ * whole-unit phases.
+ */
+
+static void placeInstances (Model& model, PMAnimationBatch& batch, unsigned count) {
+	batch.setModel(&model.sg, model.recordNodes, model.baseVisible);
+	batch.setTextureChannels(model.channels);
+
+	unsigned side = 1;
+	while (side * side < count) {
+		side++;
+	}
+
+	for (unsigned i = 0; i < count; i++) {
+		f32 m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+		m[12] = (i % side) * 10.f;
+		m[14] = (i / side) * 10.f;
+
+		const PMAnimation& anim = model.anims[i % ANIMATIONS];
+		batch.addInstance(&anim, (f32)(i % (unsigned)anim.length), m);
+	}
+}
+
+/**
+ * Compare every instance's track values, visibility and textures with a
+ * plain evaluation at its time after frames whole-unit steps, and some
+ * matrices with a plain product.
+ */
+
+static void checkInstances (const Model& model, const PMAnimationBatch& batch, unsigned frames) {
+	const gfx::InstanceBuffer& ib = batch.getBuffer();
+	unsigned wrong = 0;
+
+	for (unsigned i = 0; i < batch.getInstanceCount(); i++) {
+		const PMAnimation& anim = model.anims[i % ANIMATIONS];
+		float time = (float)((i % (unsigned)anim.length + frames) % (unsigned)anim.length);
+
+		for (unsigned t = 0; t < anim.tracks.size(); t++) {
+			int value = expectedValue(anim, t, time);
+			if (batch.getValue(i, t) != value) {
+				wrong++;
+			}
+
+			const PMAnimation::Track& track = anim.tracks[t];
+			if (track.type == PMAnimation::TRACK_VISIBILITY && ib.isVisible(i, track.target) != (value != 0)) {
+				wrong++;
+			}
+			if (track.type == PMAnimation::TRACK_TEXMAP && ib.getTexture(i, 0).texture != model.channels[0][value].texture) {
+				wrong++;
+			}
+		}
+
+		if (i % 97 == 0) {
+			for (unsigned n = 0; n < model.sg.size(); n++) {
+				vmath::Matrix4f expected(model.sg.getNode(n).getWorldMatrix().asArray());
+				expected.mul(vmath::Matrix4f(ib.getPlacement(i)));
+				for (int e = 0; e < 16; e++) {
+					if (std::fabs(ib.getMatrix(i, n)[e] - expected.asArray()[e]) > 1e-4f) {
+						wrong++;
+					}
+				}
+			}
+		}
+	}
+
+	CHECK(wrong == 0);
+}
+
+static double benchUpdate (Model& model, unsigned count, TaskPool& pool) {
+	PMAnimationBatch batch;
+	placeInstances(model, batch, count);
+
+	sf::Clock clock;
+	for (unsigned f = 0; f < FRAMES; f++) {
+		batch.update(1.f, pool);
+	}
+	double ms = elapsedMs(clock) / FRAMES;
+
+	checkInstances(model, batch, FRAMES);
+	return ms;
+}
+
+/**
+ * Instanced frames with culling off, so every visible node of every
+ * instance is drawn.
+ */
+
+static void benchDraw (Model& model, unsigned count, TaskPool& pool) {
+	AppState& state = AppState::getState();
+	state.vars.frustumCull = false;
+
+	PMAnimationBatch batch;
+	placeInstances(model, batch, count);
+	batch.update(1.f, pool);
+
+	model.renderer.scenegraph(&model.sg);
+	model.renderer.camera(&state.camera);
+	model.renderer.instances(&batch.getBuffer());
+
+	float proj[16];
+	perspective(60.f, 4.f / 3.f, 1.f, 1000.f, proj);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(proj);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	model.renderer.drawGeometry();
+	glrec::Recorder::get().reset();
+
+	sf::Clock clock;
+	for (unsigned f = 0; f < FRAMES; f++) {
+		model.renderer.drawGeometry();
+	}
+	double ms = elapsedMs(clock) / FRAMES;
+
+	const glrec::Recorder& rec = glrec::Recorder::get();
+	unsigned drawCalls = model.renderer.getStats().drawCalls;
+
+	unsigned expected = 0;
+	for (unsigned i = 0; i < count; i++) {
+		for (unsigned g = 0; g < model.geos.size(); g++) {
+			expected += batch.getBuffer().isVisible(i, model.geos[g].spacialNode) ? 1 : 0;
+		}
+	}
+	CHECK(drawCalls == expected);
+	CHECK(rec.calls[glrec::DRAW] == expected * FRAMES);
+
+	std::printf("  %5u instances drawn: %7.3f ms, %u draws, %u texture binds per frame\n",
+			count, ms, drawCalls, rec.calls[glrec::BIND_TEXTURE] / FRAMES);
+
+	model.renderer.instances(NULL);
+	state.vars.resetDefault();
+}
+
+int main () {
+	Model model;
+	buildModel(model);
+
+	TaskPool pool(TaskPool::defaultWorkerCount());
+	TaskPool serial(0);
+
+	std::printf("%u nodes, %u geometry, %u frames each:\n", model.sg.size(), (unsigned)model.geos.size(), FRAMES);
+
+	const unsigned counts[] = { 256, 1024, 4096 };
+	for (int c = 0; c < 3; c++) {
+		double poolMs = benchUpdate(model, counts[c], pool);
+		double serialMs = benchUpdate(model, counts[c], serial);
+		std::printf("  %5u instances updated: %7.3f ms on %u workers, %7.3f ms on none (%5.1f ns per node)\n",
+				counts[c], poolMs, pool.getWorkerCount(), serialMs, serialMs * 1e6 / (counts[c] * model.sg.size()));
+	}
+
+	benchDraw(model, 1024, pool);
+
+	return testResult("InstanceBench");
+}
@@ -0,0 +1,252 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The float matrix kernels: 4x4 multiply, affine and general inverse, AABB
+ * refit and batch point transform.  make bench builds this twice, as is and
+ * with VMATH_NO_SIMD, to compare the SSE2 kernels with the generic
+ * templates.  Results are checked against plain loops either way.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "TestUtil.h"
+#include "../src/vecmath/Vecmath.h"
+#include "../src/vecmath/MatrixG4.h"
+#include "../src/renderer/BoundAABB.h"
+
+static const unsigned RUNS = 1000000;
+static const unsigned POINTS = 10000;
+
+static vmath::MatrixG4f affine (float angle, float x, float y, float z) {
+	vmath::MatrixG4f m;
+	m.setIdentity();
+	m.translate(x, y, z);
+	m.rotateY(angle);
+	m.rotateX(angle * .5f);
+	m.scale(1.5f, 1.5f, .5f);
+	return m;
+}
+
+static bool close (const vmath::Matrix4f& a, const vmath::Matrix4f& b, float tolerance) {
+	for (int i = 0; i < 16; i++) {
+		if (std::fabs(a.asArray()[i] - b.asArray()[i]) > tolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main () {
+#ifdef VMATH_SSE
+	std::printf("SSE2 kernels, ns per call:\n");
+#else
+	std::printf("Generic templates, ns per call:\n");
+#endif
+
+	vmath::MatrixG4f a = affine(30.f, 1.f, 2.f, 3.f);
+	vmath::MatrixG4f b = affine(-45.f, -4.f, 0.f, 2.f);
+
+	// Multiply, against the product written out
+	vmath::Matrix4f product = a;
+	product.mul(b);
+	vmath::Matrix4f expected;
+	for (int r = 0; r < 4; r++) {
+		for (int c = 0; c < 4; c++) {
+			float sum = 0.f;
+			for (int k = 0; k < 4; k++) {
+				sum += a(r, k) * b(k, c);
+			}
+			expected(r, c) = sum;
+		}
+	}
+	CHECK(close(product, expected, 1e-5f));
+
+	vmath::Matrix4f chain;
+	chain.setIdentity();
+	vmath::Matrix4f step = affine(.01f, 0.f, 0.f, 0.f);
+
+	sf::Clock clock;
+	for (unsigned i = 0; i < RUNS; i++) {
+		chain.mul(step);
+	}
+	double mulNs = elapsedMs(clock) * 1e6 / RUNS;
+
+	// Inverses, against each other and the identity
+	vmath::Matrix4f inverse = a;
+	inverse.invertAffine();
+	vmath::Matrix4f general = a;
+	general.invert();
+	CHECK(close(inverse, general, 1e-5f));
+
+	vmath::Matrix4f identity;
+	identity.setIdentity();
+	inverse.mul(a);
+	CHECK(close(inverse, identity, 1e-5f));
+
+	float sink = 0.f;
+	clock.restart();
+	for (unsigned i = 0; i < RUNS; i++) {
+		vmath::Matrix4f m = a;
+		m.setElement(3, (float)i);
+		m.invertAffine();
+		sink += m.getElement(3);
+	}
+	double affineNs = elapsedMs(clock) * 1e6 / RUNS;
+
+	clock.restart();
+	for (unsigned i = 0; i < RUNS; i++) {
+		vmath::Matrix4f m = a;
+		m.setElement(3, (float)i);
+		m.invert();
+		sink += m.getElement(3);
+	}
+	double invertNs = elapsedMs(clock) * 1e6 / RUNS;
+
+	// Bound refit, against the eight corners transformed one by one.  The
+	// matrix is in GL order, as for world matrices
+	vmath::Matrix4f gl = a;
+	gl.transpose();
+
+	gfx::BoundAABB box;
+	std::vector<vmath::Vector3f> corners;
+	for (int i = 0; i < 8; i++) {
+		corners.push_back(vmath::Vector3f((i & 1) ? 2.f : -1.f, (i & 2) ? 3.f : 1.f, (i & 4) ? .5f : -.5f));
+	}
+	box.addPoints(corners);
+
+	gfx::BoundAABB refit = box;
+	refit.transform(gl);
+
+	gfx::BoundAABB cornerBox;
+	for (int i = 0; i < 8; i++) {
+		vmath::Vector3f p = corners[i];
+		a.transform(p);
+		corners[i] = p;
+	}
+	cornerBox.addPoints(corners);
+	for (int i = 0; i < 3; i++) {
+		CHECK(std::fabs(refit.center()(i) - cornerBox.center()(i)) < 1e-4f);
+		CHECK(std::fabs(refit.extants()(i) - cornerBox.extants()(i)) < 1e-4f);
+	}
+
+	clock.restart();
+	for (unsigned i = 0; i < RUNS; i++) {
+		gfx::BoundAABB moved = box;
+		moved.transform(gl);
+		sink += moved.center().x;
+	}
+	double boundNs = elapsedMs(clock) * 1e6 / RUNS;
+
+	// Batch point transform, against transform() point by point
+	std::vector<float> points(POINTS * 3);
+	unsigned seed = 1;
+	for (unsigned i = 0; i < points.size(); i++) {
+		points[i] = testRandom(seed) * 10.f - 5.f;
+	}
+
+	std::vector<float> batch(points.size());
+	a.transformPoints(&points[0], POINTS, &batch[0]);
+	for (unsigned i = 0; i < POINTS; i++) {
+		vmath::Vector3f p(points[i * 3 + 0], points[i * 3 + 1], points[i * 3 + 2]);
+		a.transform(p);
+		CHECK(std::fabs(p.x - batch[i * 3 + 0]) + std::fabs(p.y - batch[i * 3 + 1]) + std::fabs(p.z - batch[i * 3 + 2]) < 1e-4f);
+	}
+
+	const unsigned batchRuns = RUNS / POINTS * 10;
+	clock.restart();
+	for (unsigned r = 0; r < batchRuns; r++) {
+		a.transformPoints(&points[0], POINTS, &batch[0]);
+		sink += batch[r % batch.size()];
+	}
+	double pointsNs = elapsedMs(clock) * 1e6 / (batchRuns * POINTS);
+
+	clock.restart();
+	for (unsigned r = 0; r < batchRuns; r++) {
+		for (unsigned i = 0; i < POINTS; i++) {
+			vmath::Vector3f p(points[i * 3 + 0], points[i * 3 + 1], points[i * 3 + 2]);
+			a.transform(p);
+			batch[i * 3 + 0] = p.x;
+			batch[i * 3 + 1] = p.y;
+			batch[i * 3 + 2] = p.z;
+		}
+		sink += batch[r % batch.size()];
+	}
+	double pointNs = elapsedMs(clock) * 1e6 / (batchRuns * POINTS);
+
+	// In place, with a count that leaves a partial group of four
+	std::vector<float> inPlace(points.begin(), points.begin() + 7 * 3);
+	a.transformPoints(&inPlace[0], 7, &inPlace[0]);
+	a.transformPoints(&points[0], POINTS, &batch[0]);
+	for (unsigned i = 0; i < inPlace.size(); i++) {
+		CHECK(inPlace[i] == batch[i]);
+	}
+
+	// Batch normal transform, against the inverse transpose applied to
+	// each normal.  Transformed normals must stay perpendicular to
+	// transformed tangents
+	vmath::Matrix4f normalMatrix = a;
+	normalMatrix.invert();
+	normalMatrix.transpose();
+
+	a.transformNormals(&points[0], POINTS, &batch[0]);
+	for (unsigned i = 0; i < POINTS; i++) {
+		const float* n = &points[i * 3];
+		for (int r = 0; r < 3; r++) {
+			float expect = normalMatrix(r, 0) * n[0] + normalMatrix(r, 1) * n[1] + normalMatrix(r, 2) * n[2];
+			CHECK(std::fabs(expect - batch[i * 3 + r]) < 1e-4f);
+		}
+	}
+
+	float tangent[3] = { 1.f, 2.f, -3.f };
+	float normal[3] = { 3.f, 0.f, 1.f };
+	a.transformNormals(normal, 1, normal);
+	vmath::Vector3f movedTangent(tangent[0], tangent[1], tangent[2]);
+	vmath::Vector3f origin(0.f, 0.f, 0.f);
+	a.transform(movedTangent);
+	a.transform(origin);
+	movedTangent -= origin;
+	CHECK(std::fabs(movedTangent.dot(vmath::Vector3f(normal[0], normal[1], normal[2]))) < 1e-4f);
+
+	clock.restart();
+	for (unsigned r = 0; r < batchRuns; r++) {
+		a.transformNormals(&points[0], POINTS, &batch[0]);
+		sink += batch[r % batch.size()];
+	}
+	double normalsNs = elapsedMs(clock) * 1e6 / (batchRuns * POINTS);
+
+	std::printf("  mul            %6.2f\n", mulNs);
+	std::printf("  invertAffine   %6.2f\n", affineNs);
+	std::printf("  invert         %6.2f\n", invertNs);
+	std::printf("  bound refit    %6.2f\n", boundNs);
+	std::printf("  transformPoints %5.2f per point (transform() one by one: %.2f)\n", pointsNs, pointNs);
+	std::printf("  transformNormals %4.2f per normal\n", normalsNs);
+
+	// Keeps the timed loops from being optimized away
+	CHECK(sink == sink && chain.getElement(15) == chain.getElement(15));
+
+	return testResult("MatrixBench");
+}
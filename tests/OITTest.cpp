@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Weighted blended transparency against sorted blending, rendered headless
+ * through EGL (Mesa's llvmpipe, where no GPU is present).  A single layer,
+ * or a stack of layers of one color, must come out as sorted blending does;
+ * layers of different colors only approximately so.  Opaque geometry in
+ * front of a transparent plane must hide it in both modes.
+ */
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "TestUtil.h"
+#include "../src/renderer/RenderGL.h"
+#include "../src/AppState.h"
+
+static const int WIDTH = 128;
+static const int HEIGHT = 128;
+
+/**
+ * Make a pbuffer context current.  OITBuffer copies depth from, and
+ * resolves into, framebuffer 0, so the surface needs a depth buffer.
+ */
+
+static bool createContext () {
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	EGLDisplay display = EGL_NO_DISPLAY;
+	if (getPlatformDisplay != NULL) {
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API)) {
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24, EGL_STENCIL_SIZE, 8,
+		EGL_NONE,
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+		return false;
+	}
+
+	const EGLint surfaceAttribs[] = { EGL_WIDTH, WIDTH, EGL_HEIGHT, HEIGHT, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+
+	return surface != EGL_NO_SURFACE && context != EGL_NO_CONTEXT
+			&& eglMakeCurrent(display, surface, surface, context);
+}
+
+/**
+ * A quad of one color at depth z, covering [x0, x1] x [y0, y1].
+ */
+
+static gfx::Geometry* addQuad (gfx::RenderGL& renderer, gfx::Scenegraph& sg, float x0, float y0, float x1, float y1,
+		float z, const unsigned char rgba[4], bool blend) {
+	gfx::TriMesh quad(gfx::Mesh::VTX_VERTEX | gfx::Mesh::VTX_COLOR);
+	const float corners[4][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+	for (int i = 0; i < 4; i++) {
+		gfx::vertexDef v;
+		v.vertex.x = corners[i][0];
+		v.vertex.y = corners[i][1];
+		v.vertex.z = z;
+		v.normal = gfx::normal3f(0.f, 0.f, 1.f);
+		v.color.r = rgba[0];
+		v.color.g = rgba[1];
+		v.color.b = rgba[2];
+		v.color.a = rgba[3];
+		quad.addVertex(v);
+	}
+	quad.addIndexTriangle(0, 1, 2);
+	quad.addIndexTriangle(0, 2, 3);
+
+	int node = sg.newChild(sg.root());
+
+	gfx::Geometry geo;
+	geo.mesh(renderer.addMesh(quad));
+	geo.spacialNode = node;
+	geo.blend = blend;
+	geo.blendSrc = GL_SRC_ALPHA;
+	geo.blendDst = GL_ONE_MINUS_SRC_ALPHA;
+
+	gfx::Geometry* geoPtr = renderer.addGeometry(geo);
+	sg.addGeometry(node, geoPtr);
+	return geoPtr;
+}
+
+static void render (gfx::RenderGL& renderer, AppState::Vars::TransparencyMode mode, std::vector<unsigned char>& pixels) {
+	AppState& state = AppState::getState();
+	gfx::GLState& gl = gfx::GLState::getState();
+
+	state.vars.transparencyMode = mode;
+
+	gl.clearColor(.2f, .2f, .2f, 1.f);
+	gl.enable(GL_DEPTH_TEST);
+	gl.depthMask(true);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	float proj[16];
+	perspective(60.f, (float)WIDTH / HEIGHT, 1.f, 100.f, proj);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(proj);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	state.camera.viewTransform();
+
+	renderer.drawGeometry();
+	glFinish();
+
+	pixels.resize(WIDTH * HEIGHT * 4);
+	glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+}
+
+/**
+ * Largest channel difference over the pixels in [x0, x1) x [y0, y1).
+ */
+
+static int maxDifference (const std::vector<unsigned char>& a, const std::vector<unsigned char>& b,
+		int x0, int y0, int x1, int y1, double* mean = NULL) {
+	int worst = 0;
+	double sum = 0.;
+	for (int y = y0; y < y1; y++) {
+		for (int x = x0; x < x1; x++) {
+			for (int c = 0; c < 3; c++) {
+				int d = std::abs((int)a[(y * WIDTH + x) * 4 + c] - (int)b[(y * WIDTH + x) * 4 + c]);
+				worst = std::max(worst, d);
+				sum += d;
+			}
+		}
+	}
+	if (mean != NULL) {
+		*mean = sum / ((x1 - x0) * (y1 - y0) * 3);
+	}
+	return worst;
+}
+
+static const unsigned char* pixel (const std::vector<unsigned char>& p, int x, int y) {
+	return &p[(y * WIDTH + x) * 4];
+}
+
+int main () {
+	if (!createContext()) {
+		std::printf("OITTest: skipped, no headless GL context\n");
+		return 0;
+	}
+	std::printf("GL: %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+	glViewport(0, 0, WIDTH, HEIGHT);
+
+	AppState& state = AppState::getState();
+	state.camera.setEye(0.f, 0.f, 10.f);
+	state.camera.setFocus(0.f, 0.f, 0.f);
+	state.camera.setUp(0.f, 1.f, 0.f);
+	state.vars.frustumCull = true;
+
+	gfx::RenderGL renderer;
+	gfx::Scenegraph sg;
+
+	// The view spans about +-5.8 at z = 0.  Screen quadrants, with +y up:
+	//   top left:     one red layer
+	//   top right:    three green layers
+	//   bottom left:  red, green and blue layers
+	//   bottom right: a blue layer half hidden by an opaque white quad
+	const unsigned char red[4] = { 255, 0, 0, 128 };
+	const unsigned char green[4] = { 0, 255, 0, 100 };
+	const unsigned char blue[4] = { 0, 0, 255, 160 };
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+
+	addQuad(renderer, sg, -5.f, .5f, -.5f, 5.f, 0.f, red, true);
+
+	addQuad(renderer, sg, .5f, .5f, 5.f, 5.f, -1.f, green, true);
+	addQuad(renderer, sg, .5f, .5f, 5.f, 5.f, 0.f, green, true);
+	addQuad(renderer, sg, .5f, .5f, 5.f, 5.f, 1.f, green, true);
+
+	addQuad(renderer, sg, -5.f, -5.f, -.5f, -.5f, -1.f, red, true);
+	addQuad(renderer, sg, -5.f, -5.f, -.5f, -.5f, 0.f, green, true);
+	addQuad(renderer, sg, -5.f, -5.f, -.5f, -.5f, 1.f, blue, true);
+
+	addQuad(renderer, sg, .5f, -5.f, 5.f, -.5f, -1.f, blue, true);
+	addQuad(renderer, sg, .5f, -5.f, 2.75f, -.5f, 1.f, white, false);
+
+	sg.update();
+	renderer.scenegraph(&sg);
+	renderer.camera(&state.camera);
+
+	std::vector<unsigned char> sorted, weighted;
+	render(renderer, AppState::Vars::TRANSPARENCY_SORTED, sorted);
+	render(renderer, AppState::Vars::TRANSPARENCY_WEIGHTED, weighted);
+
+	// Quadrant interiors, in pixels, clear of the edges
+	const int lo0 = 12, lo1 = 52, hi0 = 76, hi1 = 116;
+
+	// Sorted blending must have drawn something, or the comparison is moot
+	CHECK(pixel(sorted, 32, 96)[0] > 150 && pixel(sorted, 32, 96)[1] < 80);
+	CHECK(pixel(sorted, 96, 96)[1] > 150);
+
+	CHECK(maxDifference(sorted, weighted, lo0, hi0, lo1, hi1) <= 3);
+	CHECK(maxDifference(sorted, weighted, hi0, hi0, hi1, hi1) <= 3);
+
+	double mean;
+	int worst = maxDifference(sorted, weighted, lo0, lo0, lo1, lo1, &mean);
+	std::printf("Mixed colors: max difference %d, mean %.1f (of 255)\n", worst, mean);
+	CHECK(worst <= 48);
+
+	// Left of the white quad the blue layer shows; behind it, nothing does
+	CHECK(maxDifference(sorted, weighted, 84, lo0, 100, lo1) <= 3);
+	CHECK(maxDifference(sorted, weighted, 100, lo0, 116, lo1) <= 3);
+	for (int i = 0; i < 3; i++) {
+		CHECK(pixel(weighted, 90, 32)[i] == 255);
+	}
+
+	// Background between the quadrants is left alone
+	CHECK(maxDifference(sorted, weighted, 60, 0, 68, HEIGHT) <= 1);
+
+	return testResult("OITTest");
+}
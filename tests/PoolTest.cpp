@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Renderer resource pools under churn: meshes, textures and geometry are
+ * added and removed at random, many thousands of times, with frames drawn
+ * through the recorder in between.  Live objects must never move, removed
+ * ones must stop resolving, and every frame must draw exactly the live
+ * geometry.  Destroyed geometry must leave the scenegraph, and a mesh or
+ * texture still in use must refuse to be destroyed.
+ */
+
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include "GLRecorder.h"
+#include "TestUtil.h"
+#include "../src/renderer/RenderGL.h"
+#include "../src/AppState.h"
+
+static const unsigned STEPS = 20000;
+static const unsigned DRAW_EVERY = 50;
+
+/**
+ * One piece of geometry with a mesh and texture of its own, and the
+ * addresses they had when added.
+ */
+
+struct Resource {
+	gfx::RenderGL::GeometryHandle geo;
+	gfx::RenderGL::MeshHandle mesh;
+	gfx::RenderGL::TextureHandle texture;
+
+	const gfx::Geometry* geoPtr;
+	const gfx::Mesh* meshPtr;
+	const gfx::Texture* texturePtr;
+};
+
+static Resource addResource (gfx::RenderGL& renderer, gfx::Scenegraph& sg, int node, const gfx::TextureData& data,
+		unsigned& seed) {
+	gfx::TriMesh tri(gfx::Mesh::VTX_VERTEX);
+	for (int i = 0; i < 3; i++) {
+		gfx::vertexDef v;
+		v.vertex.x = testRandom(seed);
+		v.vertex.y = testRandom(seed);
+		v.vertex.z = -1.f;
+		v.normal = gfx::normal3f(0.f, 0.f, 1.f);
+		v.color = gfx::color4ub(255, 255, 255, 255);
+		tri.addVertex(v);
+	}
+	tri.addIndexTriangle(0, 1, 2);
+
+	Resource r;
+	r.mesh = renderer.createMesh(tri);
+	r.texture = renderer.createTexture(gfx::Texture(GL_TEXTURE_2D, data));
+
+	gfx::Geometry geo;
+	geo.mesh(renderer.getMesh(r.mesh));
+	geo.texture = renderer.getTexture(r.texture);
+	geo.spacialNode = node;
+	r.geo = renderer.createGeometry(geo);
+	sg.addGeometry(node, renderer.getGeometry(r.geo));
+
+	r.geoPtr = renderer.getGeometry(r.geo);
+	r.meshPtr = renderer.getMesh(r.mesh);
+	r.texturePtr = renderer.getTexture(r.texture);
+	return r;
+}
+
+static void removeResource (gfx::RenderGL& renderer, const Resource& r) {
+	// Neither may go while the geometry still uses it
+	unsigned refused = 0;
+	try {
+		renderer.destroyMesh(r.mesh);
+	}
+	catch (const std::logic_error&) {
+		refused++;
+	}
+	try {
+		renderer.destroyTexture(r.texture);
+	}
+	catch (const std::logic_error&) {
+		refused++;
+	}
+	CHECK(refused == 2);
+	CHECK(renderer.getMesh(r.mesh) == r.meshPtr && renderer.getTexture(r.texture) == r.texturePtr);
+
+	renderer.destroyGeometry(r.geo);
+	renderer.destroyMesh(r.mesh);
+	renderer.destroyTexture(r.texture);
+}
+
+/**
+ * Detaching geometry from nodes in the middle of the geometry list must
+ * close the gap in every later node's range.
+ */
+
+static void checkRemoveGeometry () {
+	gfx::Scenegraph sg;
+	int a = sg.newChild(sg.root());
+	int b = sg.newChild(sg.root());
+	int c = sg.newChild(sg.root());
+
+	gfx::Geometry geo[7];
+	sg.addGeometry(a, &geo[0]);
+	sg.addGeometry(a, &geo[1]);
+	sg.addGeometry(b, &geo[2]);
+	sg.addGeometry(b, &geo[3]);
+	sg.addGeometry(c, &geo[4]);
+	sg.addGeometry(c, &geo[5]);
+
+	CHECK(sg.removeGeometry(&geo[2]));
+	CHECK(!sg.removeGeometry(&geo[2]));
+	CHECK(sg.removeGeometry(&geo[0]) && sg.removeGeometry(&geo[1]));
+	sg.addGeometry(c, &geo[6]);
+
+	CHECK(sg.getNode(a).getGeometryCount() == 0);
+	CHECK(sg.getNode(b).getGeometryIndex() == 0 && sg.getNode(b).getGeometryCount() == 1);
+	CHECK(sg.getNode(c).getGeometryIndex() == 1 && sg.getNode(c).getGeometryCount() == 3);
+	CHECK(sg.getGeometryCount() == 4 && sg.getGeometry(0) == &geo[3] && sg.getGeometry(3) == &geo[6]);
+}
+
+int main () {
+	checkRemoveGeometry();
+
+	AppState& state = AppState::getState();
+	state.vars.frustumCull = false;
+
+	gfx::RenderGL renderer;
+	gfx::Scenegraph sg;
+	int node = sg.newChild(sg.root());
+	sg.update();
+
+	renderer.scenegraph(&sg);
+	renderer.camera(&state.camera);
+
+	Image texels(2, 2, Image::RGBA8);
+	gfx::TextureData data(GL_RGBA, GL_RGBA, 0, texels);
+
+	std::vector<Resource> live;
+	std::vector<Resource> removed;
+	unsigned seed = 1;
+	unsigned frames = 0;
+	unsigned peak = 0;
+
+	for (unsigned step = 0; step < STEPS; step++) {
+		// Adds outnumber removals, so the pools grow through many blocks
+		if (live.empty() || testRandom(seed) < .7f) {
+			live.push_back(addResource(renderer, sg, node, data, seed));
+		}
+		else {
+			unsigned k = (unsigned)(testRandom(seed) * live.size());
+			removeResource(renderer, live[k]);
+			removed.push_back(live[k]);
+			live[k] = live.back();
+			live.pop_back();
+		}
+		peak = std::max<unsigned>(peak, live.size());
+
+		if (step % DRAW_EVERY != 0) {
+			continue;
+		}
+
+		glrec::Recorder::get().reset();
+		sg.update();
+		renderer.drawGeometry();
+		frames++;
+
+		CHECK(renderer.getStats().drawCalls == live.size());
+		CHECK(glrec::Recorder::get().calls[glrec::DRAW] == live.size());
+
+		// The scenegraph holds exactly the live geometry, in one run
+		std::set<const gfx::Geometry*> liveGeometry;
+		for (unsigned i = 0; i < live.size(); i++) {
+			liveGeometry.insert(live[i].geoPtr);
+		}
+		unsigned attached = 0;
+		for (unsigned g = 0; g < sg.getGeometryCount(); g++) {
+			attached += liveGeometry.count(sg.getGeometry(g));
+		}
+		CHECK(sg.getGeometryCount() == live.size() && attached == live.size());
+		CHECK(sg.getNode(node).getGeometryCount() == live.size() && sg.getNode(node).getGeometryIndex() == 0);
+
+		unsigned moved = 0;
+		for (unsigned i = 0; i < live.size(); i++) {
+			const gfx::Geometry* geo = renderer.getGeometry(live[i].geo);
+			if (geo != live[i].geoPtr || renderer.getMesh(live[i].mesh) != live[i].meshPtr
+					|| renderer.getTexture(live[i].texture) != live[i].texturePtr
+					|| geo->mesh() != live[i].meshPtr || geo->texture != live[i].texturePtr) {
+				moved++;
+			}
+		}
+		CHECK(moved == 0);
+
+		unsigned resolved = 0;
+		for (unsigned i = 0; i < removed.size(); i++) {
+			if (renderer.getGeometry(removed[i].geo) != NULL || renderer.getMesh(removed[i].mesh) != NULL
+					|| renderer.getTexture(removed[i].texture) != NULL) {
+				resolved++;
+			}
+		}
+		CHECK(resolved == 0);
+	}
+
+	CHECK(renderer.getTextureSlotCount() >= live.size());
+	CHECK(renderer.getTextureSlotCount() <= peak);
+
+	std::printf("%u steps, %u frames: %u live, %u removed, %u texture slots\n",
+			STEPS, frames, (unsigned)live.size(), (unsigned)removed.size(), renderer.getTextureSlotCount());
+
+	return testResult("PoolTest");
+}
@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Scenegraph update cost for 64 models of 256 nodes each, 16k nodes in all,
+ * with a cube on every leaf.  Frames animate every node, only the model
+ * roots (so local matrices stay cached), one model, or nothing.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "TestUtil.h"
+#include "../src/renderer/Scenegraph.h"
+
+static const int MODELS = 64;
+static const int DEPTH = 7;
+static const unsigned FRAMES = 100;
+
+/**
+ * A binary tree below parent, DEPTH levels deep.  Children are added depth
+ * first, as the scenegraph requires.
+ */
+
+static void buildTree (gfx::Scenegraph& sg, int parent, int depth, gfx::Mesh* mesh, std::vector<gfx::Geometry>& geos) {
+	for (int c = 0; c < 2; c++) {
+		int node = sg.newChild(parent);
+		sg.getNode(node).setTranslation(vmath::Vector3f(c ? 1.f : -1.f, 1.f, 0.f));
+
+		if (depth + 1 < DEPTH) {
+			buildTree(sg, node, depth + 1, mesh, geos);
+		}
+		else {
+			geos.push_back(gfx::Geometry());
+			geos.back().mesh(mesh);
+			geos.back().spacialNode = node;
+		}
+	}
+}
+
+static vmath::Quaternionf spin (float degrees) {
+	vmath::Quaternionf q;
+	q.setEulerZYX(vmath::Vector3f(0.f, degrees, degrees * .5f));
+	return q;
+}
+
+int main () {
+	gfx::TriMesh cube(gfx::Mesh::VTX_VERTEX);
+	for (int i = 0; i < 8; i++) {
+		gfx::vertexDef v;
+		v.vertex.x = (i & 1) ? .5f : -.5f;
+		v.vertex.y = (i & 2) ? .5f : -.5f;
+		v.vertex.z = (i & 4) ? .5f : -.5f;
+		v.normal = gfx::normal3f(0.f, 0.f, 1.f);
+		v.color = gfx::color4ub(255, 255, 255, 255);
+		cube.addVertex(v);
+	}
+
+	gfx::Scenegraph sg;
+	std::vector<gfx::Geometry> geos;
+	std::vector<int> modelRoots;
+
+	geos.reserve(MODELS << DEPTH);
+	for (int m = 0; m < MODELS; m++) {
+		int root = sg.newChild(sg.root());
+		sg.getNode(root).setTranslation(vmath::Vector3f((m % 8) * 40.f, 0.f, (m / 8) * 40.f));
+		modelRoots.push_back(root);
+		buildTree(sg, root, 0, &cube, geos);
+	}
+
+	// Geometry must be added in node order
+	for (unsigned g = 0; g < geos.size(); g++) {
+		sg.addGeometry(geos[g].spacialNode, &geos[g]);
+	}
+
+	sg.update();
+
+	const unsigned nodeCount = sg.size();
+	std::printf("%u nodes, %u geometry, %u frames each:\n", nodeCount, (unsigned)geos.size(), FRAMES);
+
+	sf::Clock clock;
+	for (unsigned f = 0; f < FRAMES; f++) {
+		vmath::Quaternionf q = spin((float)f);
+		for (unsigned n = 1; n < nodeCount; n++) {
+			sg.getNode(n).setRotation(q);
+		}
+		sg.update();
+	}
+	double allMs = elapsedMs(clock) / FRAMES;
+
+	clock.restart();
+	for (unsigned f = 0; f < FRAMES; f++) {
+		vmath::Quaternionf q = spin((float)f);
+		for (int m = 0; m < MODELS; m++) {
+			sg.getNode(modelRoots[m]).setRotation(q);
+		}
+		sg.update();
+	}
+	double rootsMs = elapsedMs(clock) / FRAMES;
+
+	clock.restart();
+	for (unsigned f = 0; f < FRAMES; f++) {
+		vmath::Quaternionf q = spin((float)f);
+		int root = modelRoots[f % MODELS];
+		for (int n = root; n < sg.getNode(root).getSubtreeEnd(); n++) {
+			sg.getNode(n).setRotation(q);
+		}
+		sg.update();
+	}
+	double oneMs = elapsedMs(clock) / FRAMES;
+
+	clock.restart();
+	for (unsigned f = 0; f < FRAMES; f++) {
+		sg.update();
+	}
+	double noneMs = elapsedMs(clock) / FRAMES;
+
+	std::printf("  every node animated:  %7.3f ms (%5.1f ns per node)\n", allMs, allMs * 1e6 / nodeCount);
+	std::printf("  model roots animated: %7.3f ms\n", rootsMs);
+	std::printf("  one model animated:   %7.3f ms\n", oneMs);
+	std::printf("  nothing animated:     %7.3f ms\n", noneMs);
+
+	// A leaf's world matrix is its ancestors' transforms composed
+	int leaf = geos.back().spacialNode;
+	vmath::Matrix4f expected;
+	expected.setIdentity();
+	for (int n = leaf; n != -1; n = sg.getNode(n).getParent()) {
+		vmath::Matrix4f local;
+		sg.getNode(n).getTransform().composeGL(local);
+		expected.mul(local);
+	}
+	const float* world = sg.getNode(leaf).getWorldMatrix().asArray();
+	for (int i = 0; i < 16; i++) {
+		CHECK(std::fabs(world[i] - expected.asArray()[i]) < 1e-3f);
+	}
+
+	return testResult("ScenegraphBench");
+}
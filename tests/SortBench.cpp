@@ -0,0 +1,189 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Transparency sorting cost for scenes of thousands of blended planes:
+ * the depth key sort on its own against std::sort, then whole frames of
+ * blended drawing with geometry sorting, per-triangle sorting and the
+ * weighted blended mode, which doesn't sort.  GL calls go to the recorder,
+ * so only CPU time is measured.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "GLRecorder.h"
+#include "TestUtil.h"
+#include "../src/renderer/RenderGL.h"
+#include "../src/AppState.h"
+
+static const unsigned FRAMES = 50;
+
+/**
+ * count unit quads, scaled up, at random positions and orientations in a
+ * cube, so many of them intersect.  All share one mesh.
+ */
+
+static void buildPlanes (gfx::RenderGL& renderer, gfx::Scenegraph& sg, unsigned count) {
+	gfx::TriMesh quad(gfx::Mesh::VTX_VERTEX | gfx::Mesh::VTX_COLOR);
+	const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+	for (int i = 0; i < 4; i++) {
+		gfx::vertexDef v;
+		v.vertex.x = corners[i][0] * 4.f;
+		v.vertex.y = corners[i][1] * 4.f;
+		v.vertex.z = 0.f;
+		v.color.r = v.color.g = v.color.b = 255;
+		v.color.a = 128;
+		quad.addVertex(v);
+	}
+	quad.addIndexTriangle(0, 1, 2);
+	quad.addIndexTriangle(0, 2, 3);
+
+	gfx::Mesh* mesh = renderer.addMesh(quad);
+
+	unsigned seed = 1;
+	sg.reserve(count + 1);
+
+	for (unsigned i = 0; i < count; i++) {
+		int node = sg.newChild(sg.root());
+
+		vmath::Quaternionf rot;
+		rot.setEulerZYX(vmath::Vector3f(testRandom(seed) * 360.f, testRandom(seed) * 360.f, testRandom(seed) * 360.f));
+		sg.getNode(node).setRotation(rot);
+		sg.getNode(node).setTranslation(vmath::Vector3f(testRandom(seed) * 100.f - 50.f,
+				testRandom(seed) * 100.f - 50.f, testRandom(seed) * 100.f - 50.f));
+
+		gfx::Geometry geo;
+		geo.mesh(mesh);
+		geo.spacialNode = node;
+		geo.blend = true;
+		geo.blendSrc = GL_SRC_ALPHA;
+		geo.blendDst = GL_ONE_MINUS_SRC_ALPHA;
+
+		sg.addGeometry(node, renderer.addGeometry(geo));
+	}
+
+	sg.update();
+}
+
+static void benchKeySort (unsigned count) {
+	unsigned seed = count;
+	std::vector<gfx::DepthKey> keys(count);
+	for (unsigned i = 0; i < count; i++) {
+		keys[i] = gfx::DepthKey(-testRandom(seed) * 200.f, i);
+	}
+
+	std::vector<gfx::DepthKey> work;
+	std::vector<gfx::DepthKey> scratch;
+	const unsigned runs = 200;
+
+	sf::Clock clock;
+	for (unsigned r = 0; r < runs; r++) {
+		work = keys;
+		gfx::depthSort(work, scratch);
+	}
+	double radixMs = elapsedMs(clock) / runs;
+
+	for (unsigned i = 1; i < work.size(); i++) {
+		CHECK(work[i - 1].depth <= work[i].depth);
+	}
+
+	clock.restart();
+	for (unsigned r = 0; r < runs; r++) {
+		work = keys;
+		std::sort(work.begin(), work.end());
+	}
+	double stdMs = elapsedMs(clock) / runs;
+
+	std::printf("  %6u keys: depthSort %8.3f ms, std::sort %8.3f ms\n", count, radixMs, stdMs);
+}
+
+static double benchFrames (gfx::RenderGL& renderer, unsigned& drawCalls) {
+	renderer.drawGeometry();
+
+	sf::Clock clock;
+	for (unsigned f = 0; f < FRAMES; f++) {
+		renderer.drawGeometry();
+	}
+	double ms = elapsedMs(clock) / FRAMES;
+
+	drawCalls = renderer.getStats().drawCalls;
+	return ms;
+}
+
+static void benchScene (unsigned count) {
+	AppState& state = AppState::getState();
+	gfx::RenderGL renderer;
+	gfx::Scenegraph sg;
+
+	buildPlanes(renderer, sg, count);
+	renderer.scenegraph(&sg);
+	renderer.camera(&state.camera);
+
+	float proj[16];
+	perspective(60.f, 4.f / 3.f, 1.f, 1000.f, proj);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(proj);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	state.camera.setEye(0.f, 20.f, 150.f);
+	state.camera.setFocus(0.f, 0.f, 0.f);
+	state.camera.setUp(0.f, 1.f, 0.f);
+	state.camera.viewTransform();
+
+	state.vars.frustumCull = true;
+	unsigned draws[3];
+
+	state.vars.transparencyMode = AppState::Vars::TRANSPARENCY_SORTED;
+	state.vars.sortBlendedTriangles = false;
+	double sortedMs = benchFrames(renderer, draws[0]);
+
+	state.vars.sortBlendedTriangles = true;
+	double triangleMs = benchFrames(renderer, draws[1]);
+
+	state.vars.transparencyMode = AppState::Vars::TRANSPARENCY_WEIGHTED;
+	double weightedMs = benchFrames(renderer, draws[2]);
+
+	std::printf("  %6u planes: sorted %8.3f ms (%u draws), per-triangle %8.3f ms (%u draws), weighted %8.3f ms (%u draws)\n",
+			count, sortedMs, draws[0], triangleMs, draws[1], weightedMs, draws[2]);
+
+	state.vars.resetDefault();
+}
+
+int main () {
+	std::printf("Depth key sort:\n");
+	benchKeySort(1000);
+	benchKeySort(4000);
+	benchKeySort(16000);
+
+	std::printf("Blended frames, %u each:\n", FRAMES);
+	benchScene(1000);
+	benchScene(4000);
+	benchScene(16000);
+
+	return testResult("SortBench");
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TESTS_TESTUTIL_H_
+#define TESTS_TESTUTIL_H_
+
+#include <SFML/System.hpp>
+#include <cmath>
+#include <iostream>
+
+/**
+ * Checks and timing shared by the tests and benchmarks.  Each program is a
+ * single file that includes this once; failed checks are printed and
+ * counted, and main returns testResult().
+ */
+
+static unsigned testFailures = 0;
+
+#define CHECK(cond) testCheck((cond), #cond, __FILE__, __LINE__)
+
+inline bool testCheck (bool ok, const char* expr, const char* file, int line) {
+	if (!ok) {
+		std::cout << "(!!) " << file << ":" << line << ": check failed: " << expr << std::endl;
+		testFailures++;
+	}
+	return ok;
+}
+
+inline int testResult (const char* name) {
+	if (testFailures > 0) {
+		std::cout << name << ": " << testFailures << " check(s) failed" << std::endl;
+		return 1;
+	}
+	std::cout << name << ": ok" << std::endl;
+	return 0;
+}
+
+/**
+ * Milliseconds since the clock was last restarted.
+ */
+
+inline double elapsedMs (const sf::Clock& clock) {
+	return clock.getElapsedTime().asMicroseconds() / 1000.0;
+}
+
+/**
+ * A GL-order perspective projection, as gluPerspective builds, for tests
+ * that load it with glLoadMatrixf.
+ */
+
+inline void perspective (float fovy, float aspect, float zNear, float zFar, float m[16]) {
+	float f = 1.f / std::tan(fovy * 3.14159265f / 360.f);
+
+	for (int i = 0; i < 16; i++) {
+		m[i] = 0.f;
+	}
+	m[0] = f / aspect;
+	m[5] = f;
+	m[10] = (zFar + zNear) / (zNear - zFar);
+	m[11] = -1.f;
+	m[14] = 2.f * zFar * zNear / (zNear - zFar);
+}
+
+/**
+ * A fixed sequence of pseudo-random numbers in [0, 1), so benchmark scenes
+ * are the same on every run.
+ */
+
+inline float testRandom (unsigned& seed) {
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) / 16777216.f;
+}
+
+#endif /* TESTS_TESTUTIL_H_ */
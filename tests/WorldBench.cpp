@@ -0,0 +1,723 @@
+/**
+ * Copyright (c) 2009 Justin Aquadro
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Loading and drawing a large map: a generated 64x64 grid of terrain tiles,
+ * 4096 meshes and half a million triangles, with eight textures.  The map
+ * is loaded whole, culled with a BVH, both merged into batches per texture
+ * and as a geometry per tile, and streamed in by region.  Each run
+ * reports parse time, setup time, time to the first frame and the peak
+ * memory it added, then how much a few views cull.  Runs are forked so
+ * each has its own peak.  GL calls go to the recorder, so only CPU time
+ * and CPU memory are measured.  The loader's own peak is also measured
+ * against a baseline that copies the file as it used to, and the loader is
+ * run over truncated and corrupted copies of the map.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "GLRecorder.h"
+#include "TestUtil.h"
+#include "../src/PMWorldGL.h"
+
+static const int TILES = 64;	// per side
+static const int QUADS = 8;	// per tile side
+static const int VARIANTS = 8;	// distinct tile height fields
+static const int TEXTURES = 8;
+static const int TEXTURE_SIZE = 64;
+static const float TILE_UNITS = 10.f;	// in world units, 1000 as stored
+
+/**
+ * A big-endian file body under construction.  Addresses are offsets into
+ * it, as the map's are offsets past its descriptor.
+ */
+
+class Writer {
+public:
+
+	std::vector<u8> bytes;
+
+	u32 here () const {
+		return bytes.size();
+	}
+
+	u32 put8 (u8 v) {
+		bytes.push_back(v);
+		return bytes.size() - 1;
+	}
+
+	u32 put16 (u16 v) {
+		u32 addr = here();
+		put8(v >> 8);
+		put8(v & 0xFF);
+		return addr;
+	}
+
+	u32 put32 (u32 v) {
+		u32 addr = here();
+		put16(v >> 16);
+		put16(v & 0xFFFF);
+		return addr;
+	}
+
+	u32 putF32 (f32 v) {
+		u32 raw;
+		std::memcpy(&raw, &v, 4);
+		return put32(raw);
+	}
+
+	u32 putString (const char* s) {
+		u32 addr = here();
+		for (; *s != 0; s++) {
+			put8(*s);
+		}
+		put8(0);
+		return addr;
+	}
+
+	void set32 (u32 addr, u32 v) {
+		bytes[addr + 0] = v >> 24;
+		bytes[addr + 1] = (v >> 16) & 0xFF;
+		bytes[addr + 2] = (v >> 8) & 0xFF;
+		bytes[addr + 3] = v & 0xFF;
+	}
+
+	void align (u32 n) {
+		while (here() % n != 0) {
+			put8(0);
+		}
+	}
+
+	bool save (const std::string& path, const Writer* descriptor = NULL) const {
+		std::ofstream file(path.c_str(), std::ios::binary);
+		if (descriptor != NULL) {
+			file.write((const char*)&descriptor->bytes[0], descriptor->bytes.size());
+		}
+		file.write((const char*)&bytes[0], bytes.size());
+		return file.good();
+	}
+};
+
+static const float ROOT_OFFSET = 3.f;
+
+// Where a tile's center lands in the world
+static f32 tileX (int col) {
+	return (col - TILES / 2) * TILE_UNITS;
+}
+
+static f32 tileZ (int row) {
+	return (row - TILES / 2) * TILE_UNITS;
+}
+
+static s16 height (int variant, int i, int j) {
+	return (s16)(150.f * std::sin((i + variant) * .7f) * std::cos((j * (variant + 1)) * .4f));
+}
+
+/**
+ * A scenegraph record; the links and mesh are given as addresses.
+ */
+
+static void putRecord (Writer& w, u32 name, u32 child, u32 next, u32 prev, f32 x, f32 y, f32 z, u32 material, u32 mesh) {
+	w.put32(name);
+	w.put32(name);
+	w.put32(0);
+	w.put32(child);
+	w.put32(next);
+	w.put32(prev);
+
+	// Scale, rotation, then the translations around them
+	w.putF32(1.f);	w.putF32(1.f);	w.putF32(1.f);
+	w.putF32(0.f);	w.putF32(0.f);	w.putF32(0.f);
+	w.putF32(x);	w.putF32(y);	w.putF32(z);
+	for (int i = 0; i < 6; i++) {
+		w.putF32(0.f);
+	}
+
+	w.put32(0);
+	w.put32(0);
+	w.put32(mesh != 0);
+	w.put32(material);
+	w.put32(mesh);
+}
+
+/**
+ * Write the map to dir/d and its textures to dir/t.  Returns the map's
+ * size in bytes, or 0 on failure.
+ */
+
+static u32 writeMap (const std::string& dir) {
+	Writer w;
+	w.put32(0);	// no address is 0
+
+	u32 name = w.putString("tile");
+	u32 version = w.putString("ver1.02");
+	w.align(4);
+
+	// Info table; the root record's address is filled in below
+	u32 info = w.put32(version);
+	u32 infoRoot = w.put32(0);
+	w.put32(name);
+	w.put32(name);
+	w.put32(version);
+
+	// Materials point at a word naming their texture
+	std::vector<u32> textureWords;
+	for (int t = 0; t < TEXTURES; t++) {
+		textureWords.push_back(w.put32(0x14 + 16 * t));
+	}
+	std::vector<u32> materials;
+	for (int t = 0; t < TEXTURES; t++) {
+		materials.push_back(w.put32(name));
+		w.put32(0xFFFFFFFF);
+		w.put32(0);
+		w.put32(textureWords[t]);
+	}
+
+	u32 matTable = w.put32(TEXTURES);
+	for (int t = 0; t < TEXTURES; t++) {
+		w.put32(name);
+		w.put32(materials[t]);
+	}
+
+	u32 texTable = w.put32(TEXTURES);
+	for (int t = 0; t < TEXTURES; t++) {
+		w.put32(name);
+	}
+
+	// Attribute arrays: a height field per variant, shared texture
+	// coordinates and a few colors
+	const int side = QUADS + 1;
+
+	u32 positions = w.put32(VARIANTS * side * side);
+	for (int v = 0; v < VARIANTS; v++) {
+		for (int i = 0; i < side; i++) {
+			for (int j = 0; j < side; j++) {
+				w.put16((u16)(s16)(j * 1000 / QUADS - 500));
+				w.put16((u16)height(v, i, j));
+				w.put16((u16)(s16)(i * 1000 / QUADS - 500));
+			}
+		}
+	}
+	w.align(4);
+
+	u32 colors = w.put32(VARIANTS);
+	for (int v = 0; v < VARIANTS; v++) {
+		w.put8(128 + v * 16);	w.put8(200);	w.put8(160);	w.put8(255);
+	}
+
+	u32 texCoords = w.put32(side * side);
+	for (int i = 0; i < side; i++) {
+		for (int j = 0; j < side; j++) {
+			w.put16((u16)(j * 256 / QUADS));
+			w.put16((u16)(i * 256 / QUADS));
+		}
+	}
+
+	u32 vcdTable = w.put32(positions);
+	w.put32(0);
+	w.put32(1);
+	w.put32(colors);
+	w.put32(0);
+	w.put32(1);
+	w.put32(texCoords);
+
+	// One display list and mesh per tile: a triangle strip per row of
+	// quads, each vertex indexing position, color and texture coordinate
+	std::vector<u32> meshes;
+	for (int tile = 0; tile < TILES * TILES; tile++) {
+		int variant = (tile * 7) % VARIANTS;
+
+		w.align(32);
+		u32 list = w.here();
+		for (int i = 0; i < QUADS; i++) {
+			w.put8(GXDecoder::TRIANGLE_STRIP);
+			w.put16(2 * side);
+			for (int j = 0; j < side; j++) {
+				for (int k = 0; k < 2; k++) {
+					w.put16(variant * side * side + (i + k) * side + j);
+					w.put16(variant);
+					w.put16((i + k) * side + j);
+				}
+			}
+		}
+		w.align(32);
+		u32 length = w.here() - list;
+
+		meshes.push_back(w.put32(0));
+		w.put32(1);
+		w.put32((1 << GXDecoder::POSITION) | (1 << GXDecoder::COLOR0) | (1 << GXDecoder::TEXCOORD0));
+		w.put32(0);
+		w.put32(list);
+		w.put32(length);
+	}
+
+	// Records: a root, a record per row, and the row's tiles below it.
+	// All are the same size, so addresses are known before writing.  The
+	// root and rows carry part of each tile's placement, so tiles are only
+	// in place if every record nests under its parent
+	const u32 size = PMWorld::Scenegraph::SIZE;
+	u32 root = w.here();
+	w.set32(infoRoot, root);
+
+	putRecord(w, name, root + size, 0, 0, ROOT_OFFSET, 0.f, 0.f, 0, 0);
+	for (int row = 0; row < TILES; row++) {
+		u32 rowAddr = root + size * (1 + row * (TILES + 1));
+		u32 nextRow = (row + 1 < TILES) ? rowAddr + size * (TILES + 1) : 0;
+		u32 prevRow = (row > 0) ? rowAddr - size * (TILES + 1) : 0;
+		putRecord(w, name, rowAddr + size, nextRow, prevRow, 0.f, 0.f, tileZ(row), 0, 0);
+
+		for (int col = 0; col < TILES; col++) {
+			u32 addr = rowAddr + size * (1 + col);
+			u32 next = (col + 1 < TILES) ? addr + size : 0;
+			u32 prev = (col > 0) ? addr - size : 0;
+			putRecord(w, name, 0, next, prev, tileX(col) - ROOT_OFFSET, 0.f, 0.f,
+					materials[(row + col) % TEXTURES], meshes[row * TILES + col]);
+		}
+	}
+
+	// Table index: no master index entries, then the table entries and
+	// their names
+	u32 tableBase = w.here();
+	const u32 tables[8] = { 0, 0, 0, info, 0, matTable, texTable, vcdTable };
+	for (int t = 0; t < 8; t++) {
+		w.put32(tables[t]);
+		w.put32(0);
+	}
+	w.putString("table");
+
+	Writer descriptor;
+	descriptor.put32(0);
+	descriptor.put32(tableBase);
+	descriptor.put32(0);
+	descriptor.put32(8);
+	descriptor.align(PMWorld::Header::SIZE);
+
+	// Textures: RGBA8, which the TPL stores as 64 bytes of tile per 4x4
+	Writer tpl;
+	tpl.put32(0x0020AF30);
+	tpl.put32(TEXTURES);
+	tpl.put32(12);
+
+	u32 defs = tpl.here();
+	for (int t = 0; t < TEXTURES * 2; t++) {
+		tpl.put32(0);
+	}
+	for (int t = 0; t < TEXTURES; t++) {
+		tpl.set32(defs + t * 8, tpl.here());
+		tpl.put16(TEXTURE_SIZE);
+		tpl.put16(TEXTURE_SIZE);
+		tpl.put32(6);
+		u32 data = tpl.put32(0);
+		for (int i = 0; i < 6; i++) {
+			tpl.put32(0);
+		}
+
+		tpl.align(32);
+		tpl.set32(data, tpl.here());
+		for (int i = 0; i < TEXTURE_SIZE * TEXTURE_SIZE * 4; i++) {
+			tpl.put8((u8)(i * (t + 1)));
+		}
+	}
+
+	if (!w.save(dir + "/d", &descriptor) || !tpl.save(dir + "/t")) {
+		return 0;
+	}
+	return descriptor.bytes.size() + w.bytes.size();
+}
+
+static long peakKB () {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+static void look (float ex, float ey, float ez, float fx, float fy, float fz) {
+	AppState& state = AppState::getState();
+	state.camera.setEye(ex, ey, ez);
+	state.camera.setFocus(fx, fy, fz);
+	state.camera.setUp(0.f, 1.f, 0.f);
+}
+
+/**
+ * One frame as GLView draws it.
+ */
+
+static void frame (PMWorldGL& world) {
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	AppState::getState().camera.viewTransform();
+
+	world.Update(1.f / 60.f);
+	world.Draw();
+}
+
+struct View {
+	const char* name;
+	float eye[3];
+	float focus[3];
+};
+
+static const View views[] = {
+	{ "overhead, whole map", { 0.f, 900.f, 1.f }, { 0.f, 0.f, 0.f } },
+	{ "low, from a corner", { -330.f, 20.f, -330.f }, { 0.f, 0.f, 0.f } },
+	{ "ground, center", { 0.f, 5.f, 0.f }, { 100.f, 0.f, 0.f } },
+};
+
+static double drawView (PMWorldGL& world, const View& view, unsigned& drawn) {
+	look(view.eye[0], view.eye[1], view.eye[2], view.focus[0], view.focus[1], view.focus[2]);
+	frame(world);
+
+	const unsigned frames = 20;
+	sf::Clock clock;
+	for (unsigned f = 0; f < frames; f++) {
+		frame(world);
+	}
+	drawn = world.renderer.getStats().drawCalls;
+	return elapsedMs(clock) / frames;
+}
+
+/**
+ * Parse the map without decoding or drawing it, for the loader's own peak
+ * memory.  When copying, also hold what the loader held before it viewed
+ * the mapped file: the whole file read into memory, and a copy of every
+ * display list.  Runs in its own process; returns its test result.
+ */
+
+static int runParse (const std::string& path, bool copying) {
+	long baseKB = peakKB();
+	std::cout.setstate(std::ios::failbit);
+
+	sf::Clock clock;
+	std::vector<u8> file;
+	if (copying) {
+		std::ifstream in(path.c_str(), std::ios::binary);
+		file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	PMWorld* world = new PMWorld();
+	world->decodeMeshes = false;
+	bool loadedFile = world->LoadFile(path);
+
+	std::vector<std::vector<u8> > copies;
+	if (copying) {
+		for (u32 i = 0; i < world->meshes.size(); i++) {
+			for (u32 j = 0; j < world->meshes[i].data.size(); j++) {
+				const ByteView& data = world->meshes[i].data[j].data;
+				copies.push_back(std::vector<u8>());
+				for (u32 k = 0; k < data.size(); k++) {
+					copies.back().push_back(data[k]);
+				}
+			}
+		}
+	}
+	double parseMs = elapsedMs(clock);
+	long addedKB = peakKB() - baseKB;
+
+	std::cout.clear();
+	CHECK(loadedFile);
+	CHECK(world->meshes.size() == TILES * TILES);
+
+	std::printf("  %-20s peak memory +%6ld KB, %.1f ms\n", copying ? "copying (baseline)" : "viewing the mapping",
+			addedKB, parseMs);
+
+	delete world;
+	return testResult(copying ? "WorldBench (copying parse)" : "WorldBench (parse)");
+}
+
+static void put32 (std::vector<u8>& bytes, size_t offset, u32 value) {
+	bytes[offset + 0] = (u8)(value >> 24);
+	bytes[offset + 1] = (u8)(value >> 16);
+	bytes[offset + 2] = (u8)(value >> 8);
+	bytes[offset + 3] = (u8)value;
+}
+
+static bool loadBytes (const std::string& path, const std::vector<u8>& bytes, size_t length, PMWorld& world) {
+	{
+		std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+		out.write((const char*)&bytes[0], length);
+	}
+	return world.LoadFile(path);
+}
+
+/**
+ * Load truncated copies of the map, and copies with a mesh's display list
+ * count and a record's mesh address pointing past the end of the file.
+ * None may read outside the mapping; a bad mesh is left empty and the rest
+ * still load.  Runs in its own process, so a fault fails only this run.
+ */
+
+static int runCorrupt (const std::string& path) {
+	std::cout.setstate(std::ios::failbit);
+
+	std::vector<u8> bytes;
+	{
+		std::ifstream in(path.c_str(), std::ios::binary);
+		bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	std::string bad = path + ".bad";
+
+	PMWorld good;
+	good.decodeMeshes = false;
+	bool loadedGood = good.LoadFile(path);
+
+	unsigned cuts = 0;
+	unsigned truncated = 0;
+	for (size_t cut = 0; cut < bytes.size(); cut += bytes.size() / 61 + 1) {
+		PMWorld world;
+		if (loadBytes(bad, bytes, cut, world)) {
+			truncated++;
+		}
+		cuts++;
+	}
+
+	u32 meshAddr = good.meshes.empty() ? 0 : good.meshes[0].addr;
+	u32 recordAddr = 0;
+	for (u32 i = 0; i < good.sgRecords.size(); i++) {
+		if (good.sgRecords[i].meshID == 0) {
+			recordAddr = good.sgRecords[i].addr;
+		}
+	}
+
+	std::vector<u8> corrupt = bytes;
+	put32(corrupt, PMWorld::Header::SIZE + meshAddr + 4, 0x7FFFFFFF);
+	PMWorld counted;
+	bool loadedCounted = loadBytes(bad, corrupt, corrupt.size(), counted);
+
+	corrupt = bytes;
+	put32(corrupt, PMWorld::Header::SIZE + recordAddr + 100, 0xFFFFFFF0);
+	PMWorld addressed;
+	bool loadedAddressed = loadBytes(bad, corrupt, corrupt.size(), addressed);
+
+	std::remove(bad.c_str());
+	std::cout.clear();
+
+	CHECK(loadedGood && meshAddr != 0 && recordAddr != 0);
+	CHECK(loadedCounted && counted.meshes.size() == TILES * TILES);
+	CHECK(counted.meshes[0].data.empty() && counted.meshes[0].streams.triangles.empty());
+	CHECK(!counted.meshes[1].data.empty() && !counted.meshes[1].streams.triangles.empty());
+	CHECK(loadedAddressed && addressed.meshes.size() == TILES * TILES);
+	CHECK(addressed.meshes[0].data.empty());
+
+	std::printf("Corrupt maps: %u of %u truncated copies loaded, bad mesh count and address skipped\n", truncated, cuts);
+
+	return testResult("WorldBench (corrupt)");
+}
+
+/**
+ * Load and draw the map, loaded whole, with or without batching, or
+ * streamed.  Runs in its own process; returns its test result.
+ */
+
+static int runWorld (const std::string& path, bool streaming, bool batching) {
+	AppState& state = AppState::getState();
+	state.vars.frustumCull = true;
+
+	float proj[16];
+	perspective(40.f, 4.f / 3.f, .1f, 2000.f, proj);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(proj);
+
+	long baseKB = peakKB();
+	std::cout.setstate(std::ios::failbit);	// the world's own load log
+
+	PMWorldGL* world = new PMWorldGL();
+	world->streaming = streaming;
+	world->batching = batching;
+
+	sf::Clock total;
+	sf::Clock clock;
+	bool loadedFile = world->LoadFile(path);
+	double parseMs = elapsedMs(clock);
+
+	clock.restart();
+	world->Init();
+	double initMs = elapsedMs(clock);
+
+	look(views[1].eye[0], views[1].eye[1], views[1].eye[2], views[1].focus[0], views[1].focus[1], views[1].focus[2]);
+	frame(*world);
+	double firstMs = elapsedMs(total);
+
+	// Until every texture is uploaded and, when streaming, every chunk in
+	// range is resident
+	unsigned settleFrames = 1;
+	while (settleFrames < 10000 && (!world->textureUploader.isIdle()
+			|| (streaming && (world->streamer.getInFlightCount() > 0 || world->streamer.getResidentCount() == 0)))) {
+		frame(*world);
+		settleFrames++;
+	}
+	double settleMs = elapsedMs(total);
+	long addedKB = peakKB() - baseKB;
+
+	// LoadFile also writes the map's info file; time that on its own
+	clock.restart();
+	world->WriteInfoFile(path + ".info.txt");
+	double infoMs = elapsedMs(clock);
+
+	std::cout.clear();
+	CHECK(loadedFile);
+
+	// Batches must hold every triangle, and nothing else
+	unsigned geometry = world->scenegraph.getGeometryCount();
+	unsigned indices = 0;
+	for (unsigned g = 0; g < geometry; g++) {
+		indices += world->scenegraph.getGeometry(g)->mesh()->getIndexCount();
+	}
+	CHECK(streaming || indices == TILES * TILES * QUADS * QUADS * 2 * 3);
+	CHECK(batching == (geometry < TILES * TILES));
+
+	std::printf("%s:\n", streaming ? "Streamed" : batching ? "Loaded whole, batched" : "Loaded whole, a geometry per tile");
+	std::printf("  load %.1f ms (%.1f ms of it the info file), setup %.1f ms, first frame %.1f ms after load started\n",
+			parseMs, infoMs, initMs, firstMs);
+	std::printf("  settled after %u frames, %.1f ms; peak memory +%ld KB\n", settleFrames, settleMs, addedKB);
+
+	if (streaming) {
+		std::printf("  %u of %u chunks resident, %u KB\n", (unsigned)world->streamer.getResidentCount(),
+				(unsigned)world->streamer.getChunkCount(), (unsigned)world->streamer.getResidentBytes() / 1024);
+		CHECK(world->streamer.getResidentCount() > 0);
+	}
+	else {
+		std::printf("  BVH: %u nodes, depth %u\n", (unsigned)world->bvh.getNodes().size(), world->bvh.getDepth());
+
+		// Tiles are centered on their records, which are in row order
+		unsigned misplaced = 0;
+		unsigned tile = 0;
+		for (unsigned r = 0; r < world->sgRecords.size(); r++) {
+			if (world->sgRecords[r].meshID == -1) {
+				continue;
+			}
+			const vmath::MatrixG4f& m = world->scenegraph.getNode(world->recordNodes[r]).getWorldMatrix();
+			if (std::fabs(m.getElement(12) - tileX(tile % TILES)) > .01f || std::fabs(m.getElement(14) - tileZ(tile / TILES)) > .01f) {
+				misplaced++;
+			}
+			tile++;
+		}
+		CHECK(tile == TILES * TILES && misplaced == 0);
+
+		// Together the geometry covers the map exactly, batched or not
+		gfx::BoundAABB covered;
+		for (unsigned g = 0; g < geometry; g++) {
+			covered.addBound(world->scenegraph.getGeometry(g)->getWorldAABB());
+		}
+		vmath::Vector3f lo = covered.center() - covered.extants();
+		vmath::Vector3f hi = covered.center() + covered.extants();
+		const f32 edge = TILE_UNITS / 2.f;
+		CHECK(std::fabs(lo.x - (tileX(0) - edge)) < .01f && std::fabs(hi.x - (tileX(TILES - 1) + edge)) < .01f);
+		CHECK(std::fabs(lo.z - (tileZ(0) - edge)) < .01f && std::fabs(hi.z - (tileZ(TILES - 1) + edge)) < .01f);
+	}
+
+	for (unsigned v = 0; v < sizeof(views) / sizeof(views[0]); v++) {
+		unsigned drawn;
+		double ms = drawView(*world, views[v], drawn);
+		const gfx::RenderGL::RenderStats& stats = world->renderer.getStats();
+
+		if (streaming) {
+			// Only chunks in range around the eye are drawn at all
+			std::printf("  %-20s drew %4u/%u, %2u chunks resident, %6.3f ms\n", views[v].name, drawn, geometry,
+					(unsigned)world->streamer.getResidentCount(), ms);
+			CHECK(drawn > 0);
+			continue;
+		}
+
+		std::printf("  %-20s drew %4u/%u, culled %3u%%, %6.3f ms", views[v].name, drawn, geometry,
+				100 * stats.culledGeometry / geometry, ms);
+
+		{
+			// Against culling by walking the scenegraph
+			unsigned walked;
+			world->renderer.bvh(NULL);
+			double walkMs = drawView(*world, views[v], walked);
+			world->renderer.bvh(&world->bvh);
+
+			std::printf(" (scenegraph walk %6.3f ms)", walkMs);
+			CHECK(drawn == walked);
+			if (v == 0) {
+				CHECK(drawn == geometry);
+			}
+		}
+		std::printf("\n");
+	}
+
+	delete world;
+	return testResult(streaming ? "WorldBench (streamed)" : batching ? "WorldBench (batched)" : "WorldBench (whole)");
+}
+
+int main () {
+	char dir[] = "/tmp/worldbenchXXXXXX";
+	if (mkdtemp(dir) == NULL) {
+		std::printf("(!!) Could not create a directory for the map\n");
+		return 1;
+	}
+	std::string path = std::string(dir) + "/d";
+
+	u32 bytes = writeMap(dir);
+	CHECK(bytes > 0);
+	std::printf("%dx%d tiles, %d triangles, %u KB map, %d textures\n", TILES, TILES,
+			TILES * TILES * QUADS * QUADS * 2, (unsigned)bytes / 1024, TEXTURES);
+
+	// Whole, batched and not, streamed, then the loader alone, viewing and
+	// copying, then the corrupt copies
+	int failed = 0;
+	for (int run = 0; run < 6 && bytes > 0; run++) {
+		if (run == 3) {
+			std::printf("Parse only:\n");
+		}
+		std::fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0) {
+			int result = (run < 3) ? runWorld(path, run == 2, run == 0)
+					: (run < 5) ? runParse(path, run == 4)
+					: runCorrupt(path);
+			std::fflush(stdout);
+			_exit(result);
+		}
+
+		int status = 1;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			failed++;
+		}
+	}
+
+	std::remove((path).c_str());
+	std::remove((path + ".info.txt").c_str());
+	std::remove((std::string(dir) + "/t").c_str());
+	rmdir(dir);
+
+	CHECK(failed == 0);
+	return testResult("WorldBench");
+}
@@ -0,0 +1,14 @@
+/*
+ * Linux keeps the GL headers under GL/ rather than OpenGL/.
+ */
+
+#ifndef TESTS_OPENGL_GLU_H_
+#define TESTS_OPENGL_GLU_H_
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+
+#include <GL/glu.h>
+
+#endif